@@ -36,6 +36,7 @@
 #include "naadsm.h"
 #include "event.h"
 #include "reporting.h"
+#include "general.h"
 
 
 
@@ -64,6 +65,156 @@ const char *EVT_event_type_name[] = {
 
 
 
+/**
+ * The event pool that event constructors draw from.  Each thread running
+ * iterations installs its worker's pool, so no locking is needed.
+ */
+static NAADSM_THREAD_LOCAL EVT_event_pool_t *current_pool = NULL;
+
+
+
+/**
+ * Creates a new, empty event pool.
+ *
+ * @return a pointer to a newly-created EVT_event_pool_t structure.
+ */
+EVT_event_pool_t *
+EVT_new_event_pool (void)
+{
+  return g_new0 (EVT_event_pool_t, 1);
+}
+
+
+
+/**
+ * Makes the event constructors in the calling thread draw from the given pool,
+ * and EVT_free_event return events to it.
+ *
+ * @param pool an event pool.  Pass NULL to go back to the system allocator.
+ */
+void
+EVT_set_event_pool (EVT_event_pool_t * pool)
+{
+  current_pool = pool;
+}
+
+
+
+/**
+ * Returns a text representation of an event pool's counters.
+ *
+ * @param pool an event pool.
+ * @return a string.
+ */
+char *
+EVT_event_pool_to_string (EVT_event_pool_t * pool)
+{
+  GString *s;
+  char *chararray;
+
+  s = g_string_new (NULL);
+  g_string_sprintf (s, "<Event pool in use=%u high water=%u free=%u allocated=%lu reused=%lu>",
+                    pool->nin_use, pool->high_water, pool->nfree,
+                    pool->nallocated, pool->nreused);
+  /* don't return the wrapper object */
+  chararray = s->str;
+  g_string_free (s, FALSE);
+  return chararray;
+}
+
+
+
+/**
+ * Deletes an event pool, and the events on its free list, from memory.  Events
+ * still in use are not affected; they can be deleted later with no pool
+ * installed.
+ *
+ * @param pool an event pool.
+ */
+void
+EVT_free_event_pool (EVT_event_pool_t * pool)
+{
+  gpointer block, next;
+
+  if (pool == NULL)
+    return;
+
+  if (current_pool == pool)
+    current_pool = NULL;
+
+  for (block = pool->free_list; block != NULL; block = next)
+    {
+      next = *((gpointer *) block);
+      g_free (block);
+    }
+  g_free (pool);
+}
+
+
+
+/**
+ * Gets storage for one event, from the current pool's free list if possible.
+ *
+ * @return a pointer to an uninitialized EVT_event_t structure.
+ */
+static EVT_event_t *
+EVT_alloc_event (void)
+{
+  EVT_event_pool_t *pool;
+  gpointer block;
+
+  pool = current_pool;
+  if (pool == NULL)
+    return g_new (EVT_event_t, 1);
+
+  if (pool->free_list != NULL)
+    {
+      block = pool->free_list;
+      pool->free_list = *((gpointer *) block);
+      pool->nfree--;
+      pool->nreused++;
+    }
+  else
+    {
+      block = g_new (EVT_event_t, 1);
+      pool->nallocated++;
+    }
+  pool->nin_use++;
+  if (pool->nin_use > pool->high_water)
+    pool->high_water = pool->nin_use;
+  return (EVT_event_t *) block;
+}
+
+
+
+/**
+ * Gives back the storage for one event, to the current pool's free list if
+ * one is installed.
+ *
+ * @param event an event whose dynamically-allocated parts have been freed.
+ */
+static void
+EVT_release_event (EVT_event_t * event)
+{
+  EVT_event_pool_t *pool;
+
+  pool = current_pool;
+  if (pool == NULL)
+    {
+      g_free (event);
+      return;
+    }
+
+  *((gpointer *) event) = pool->free_list;
+  pool->free_list = event;
+  pool->nfree++;
+  /* The event may have been created before the pool was installed. */
+  if (pool->nin_use > 0)
+    pool->nin_use--;
+}
+
+
+
 /**
  * Creates a new "before any simulations" event.
  *
@@ -74,7 +225,7 @@ EVT_new_before_any_simulations_event (void)
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_BeforeAnySimulations;
   return event;
 }
@@ -104,7 +255,7 @@ EVT_new_before_each_simulation_event (void)
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_BeforeEachSimulation;
   return event;
 }
@@ -138,7 +289,7 @@ EVT_new_declaration_of_vaccination_reasons_event (GPtrArray * reasons)
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_DeclarationOfVaccinationReasons;
   event->u.declaration_of_vaccination_reasons.reasons = reasons;
   return event;
@@ -190,7 +341,7 @@ EVT_new_declaration_of_vaccine_delay_event (HRD_production_type_t production_typ
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_DeclarationOfVaccineDelay;
   event->u.declaration_of_vaccine_delay.production_type = production_type;
   event->u.declaration_of_vaccine_delay.production_type_name = production_type_name;
@@ -238,7 +389,7 @@ EVT_new_declaration_of_destruction_reasons_event (GPtrArray * reasons)
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_DeclarationOfDestructionReasons;
   event->u.declaration_of_destruction_reasons.reasons = reasons;
   return event;
@@ -287,7 +438,7 @@ EVT_new_declaration_of_outputs_event (GPtrArray * outputs)
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_DeclarationOfOutputs;
   event->u.declaration_of_outputs.outputs = outputs;
   return event;
@@ -333,9 +484,10 @@ EVT_new_new_day_event (int day)
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_NewDay;
   event->u.new_day.day = day;
+  event->u.new_day.ndays_skipped = 0;
   return event;
 }
 
@@ -354,7 +506,11 @@ EVT_new_day_event_to_string (EVT_new_day_event_t * event)
   char *chararray;
 
   s = g_string_new (NULL);
-  g_string_sprintf (s, "<New day event day=%i>", event->day);
+  if (event->ndays_skipped > 0)
+    g_string_sprintf (s, "<New day event day=%i (%u days skipped)>", event->day,
+                      event->ndays_skipped);
+  else
+    g_string_sprintf (s, "<New day event day=%i>", event->day);
   /* don't return the wrapper object */
   chararray = s->str;
   g_string_free (s, FALSE);
@@ -375,7 +531,7 @@ EVT_new_exposure_event (HRD_herd_t * exposing_herd, HRD_herd_t * exposed_herd,
 {
   EVT_event_t *event;
   
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_Exposure;
   event->u.exposure.exposing_herd = exposing_herd;
   event->u.exposure.exposed_herd = exposed_herd;
@@ -429,7 +585,7 @@ EVT_new_attempt_to_infect_event (HRD_herd_t * infecting_herd,
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_AttemptToInfect;
   event->u.attempt_to_infect.infecting_herd = infecting_herd;
   event->u.attempt_to_infect.infected_herd = infected_herd;
@@ -493,7 +649,7 @@ EVT_new_infection_event (HRD_herd_t * infecting_herd, HRD_herd_t * infected_herd
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_Infection;
   event->u.infection.infecting_herd = infecting_herd;
   event->u.infection.infected_herd = infected_herd;
@@ -550,7 +706,7 @@ EVT_new_detection_event (HRD_herd_t * herd, int day, NAADSM_detection_reason mea
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_Detection;
   event->u.detection.herd = herd;
   event->u.detection.day = day;
@@ -594,7 +750,7 @@ EVT_new_public_announcement_event (int day)
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_PublicAnnouncement;
   event->u.public_announcement.day = day;
   return event;
@@ -635,7 +791,7 @@ EVT_new_exam_event (HRD_herd_t * herd, int day, NAADSM_control_reason reason,
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_Exam;
   event->u.exam.herd = herd;
   event->u.exam.day = day;
@@ -685,7 +841,7 @@ EVT_new_attempt_to_trace_event (HRD_herd_t * herd, int day,
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_AttemptToTrace;
   event->u.attempt_to_trace.herd = herd;
   event->u.attempt_to_trace.day = day;
@@ -738,7 +894,7 @@ EVT_new_trace_result_event (HRD_herd_t * exposing_herd,
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_TraceResult;
   event->u.trace_result.exposing_herd = exposing_herd;
   event->u.trace_result.exposed_herd = exposed_herd;
@@ -793,7 +949,7 @@ EVT_new_test_event (HRD_herd_t * herd, int day, NAADSM_control_reason reason)
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_Test;
   event->u.test.herd = herd;
   event->u.test.day = day;
@@ -838,7 +994,7 @@ EVT_new_test_result_event (HRD_herd_t * herd, int day,
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_TestResult;
   event->u.test_result.herd = herd;
   event->u.test_result.day = day;
@@ -890,7 +1046,7 @@ EVT_new_request_for_vaccination_event (HRD_herd_t * herd,
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_RequestForVaccination;
   event->u.request_for_vaccination.herd = herd;
   event->u.request_for_vaccination.day = day;
@@ -937,7 +1093,7 @@ EVT_new_commitment_to_vaccinate_event (HRD_herd_t * herd, int day)
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_CommitmentToVaccinate;
   event->u.commitment_to_vaccinate.herd = herd;
   event->u.commitment_to_vaccinate.day = day;
@@ -979,7 +1135,7 @@ EVT_new_vaccination_canceled_event (HRD_herd_t * herd, int day,
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_VaccinationCanceled;
   event->u.vaccination_canceled.herd = herd;
   event->u.vaccination_canceled.day = day;
@@ -1027,7 +1183,7 @@ EVT_new_inprogress_immunity_event (HRD_herd_t * herd,
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_Vaccination;
   event->u.vaccination.herd = herd;
   event->u.vaccination.day = day;
@@ -1053,7 +1209,7 @@ EVT_new_vaccination_event (HRD_herd_t * herd, int day, char *reason,
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_Vaccination;
   event->u.vaccination.herd = herd;
   event->u.vaccination.day = day;
@@ -1117,7 +1273,7 @@ EVT_new_request_for_destruction_event (HRD_herd_t * herd,
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_RequestForDestruction;
   event->u.request_for_destruction.herd = herd;
   event->u.request_for_destruction.day = day;
@@ -1162,7 +1318,7 @@ EVT_new_commitment_to_destroy_event (HRD_herd_t * herd, int day)
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_CommitmentToDestroy;
   event->u.commitment_to_destroy.herd = herd;
   event->u.commitment_to_destroy.day = day;
@@ -1205,7 +1361,7 @@ EVT_new_destruction_event (HRD_herd_t * herd, int day, char *reason,
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_Destruction;
   event->u.destruction.herd = herd;
   event->u.destruction.day = day;
@@ -1249,7 +1405,7 @@ EVT_new_request_for_zone_focus_event (HRD_herd_t * herd, int day, char *reason)
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_RequestForZoneFocus;
   event->u.request_for_zone_focus.herd = herd;
   event->u.request_for_zone_focus.day = day;
@@ -1295,7 +1451,7 @@ EVT_new_end_of_day_event (int day, gboolean done)
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_EndOfDay;
   event->u.end_of_day.day = day;
   event->u.end_of_day.done = done;
@@ -1337,7 +1493,7 @@ EVT_new_last_day_event (int day)
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_LastDay;
   event->u.last_day.day = day;
   return event;
@@ -1378,7 +1534,7 @@ EVT_new_midnight_event (int day)
 {
   EVT_event_t *event;
 
-  event = g_new (EVT_event_t, 1);
+  event = EVT_alloc_event ();
   event->type = EVT_Midnight;
   event->u.midnight.day = day;
   return event;
@@ -1468,7 +1624,7 @@ EVT_free_event (EVT_event_t * event)
     case EVT_NEVENT_TYPES:
       g_assert_not_reached();
     }
-  g_free (event);
+  EVT_release_event (event);
 }
 
 
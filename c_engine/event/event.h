@@ -166,6 +166,9 @@ EVT_declaration_of_outputs_event_t;
 typedef struct
 {
   int day; /**< day of the simulation */
+  unsigned int ndays_skipped; /**< number of quiet days just before this one
+    that were fast-forwarded over without running the models.  Models that
+    count days off one at a time must count these too. */
 }
 EVT_new_day_event_t;
 
@@ -520,7 +523,33 @@ typedef struct
 
 
 
+/**
+ * A free list of event structures.  Events are created and deleted by the
+ * thousand every simulated day; keeping the deleted structures on a free list
+ * and handing them out again spares the allocator most of that work.
+ *
+ * Every block on the free list is an ordinary g_new'd EVT_event_t, so an event
+ * may be created with no pool installed and deleted with one, or the reverse.
+ */
+typedef struct
+{
+  gpointer free_list; /**< deleted events, linked through their first word */
+  unsigned int nfree; /**< number of events on the free list */
+  unsigned int nin_use; /**< number of events handed out and not yet deleted */
+  unsigned int high_water; /**< largest value nin_use has reached */
+  unsigned long nallocated; /**< events that had to come from the allocator */
+  unsigned long nreused; /**< events that were taken from the free list */
+}
+EVT_event_pool_t;
+
+
+
 /* Prototypes. */
+EVT_event_pool_t *EVT_new_event_pool (void);
+void EVT_set_event_pool (EVT_event_pool_t *);
+char *EVT_event_pool_to_string (EVT_event_pool_t *);
+void EVT_free_event_pool (EVT_event_pool_t *);
+
 EVT_event_t *EVT_new_before_any_simulations_event (void);
 EVT_event_t *EVT_new_before_each_simulation_event (void);
 EVT_event_t *EVT_new_declaration_of_vaccination_reasons_event (GPtrArray * reasons);
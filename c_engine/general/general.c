@@ -11,7 +11,7 @@
 
 /*  New Scenario and Iteration storage areas  */
   MAIN_scenario _scenario;
-  MAIN_iteration _iteration;
+  NAADSM_THREAD_LOCAL MAIN_iteration _iteration;
 /*  END New Scenario and Iteration storage areas  */
 
 
@@ -34,17 +34,25 @@ typedef struct
   int outbreakEndDay;
   gboolean zoneFociCreated;
   GPtrArray *_herdsInZones;
-  GHashTable *infectious_herds;  /*  Currently defined as Latent, Infectious Subclinical,
-                                 or Infectious Clinical. GHashTable is used because it is very fast
-                                 and allows for easy removal and/or testing of items presence over
-                                 GArray or GPtrArray */
+  HRD_herd_set_t *infectious_herds;  /*  Currently defined as Latent, Infectious Subclinical,
+                                 or Infectious Clinical.  A herd set gives constant-time
+                                 insertion, removal and membership tests, and can be put in
+                                 order of herd index when a model needs a fixed order. */
   guint current_day;
   gboolean first_detection;
 } MAIN_iteration;
 
+/*  When iterations run in parallel threads, each thread has its own copy of
+    the iteration storage area. */
+#if HAVE_TLS
+#  define NAADSM_THREAD_LOCAL __thread
+#else
+#  define NAADSM_THREAD_LOCAL
+#endif
+
 /*  New Scenario and Iteration storage areas (stored in main.c data space ) */
 extern  MAIN_scenario _scenario;
-extern  MAIN_iteration _iteration;
+extern  NAADSM_THREAD_LOCAL MAIN_iteration _iteration;
 /*  END New Scenario and Iteration storage areas  */
 
 void init_MAIN_structs();
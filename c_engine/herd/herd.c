@@ -93,6 +93,7 @@ even when compiled as a *nix executable (in which case,
 the functions defined will all be NULL).
 */
 #include "naadsm.h"
+#include "general.h"
 
 /**
  * A table of all valid state transitions.
@@ -159,26 +160,123 @@ free_as_GFunc (gpointer data, gpointer user_data)
 
 
 
+/**
+ * Returns TRUE if a state counts towards the average prevalence (and towards
+ * active infections).
+ */
+#define HRD_infected_status(S) ((S) >= Latent && (S) <= InfectiousClinical)
+
+
+
+/**
+ * Adds a herd to, or removes it from, the running state counts of its herd
+ * list.
+ *
+ * @param herd a herd.
+ * @param add TRUE to add the herd's current state to the counts, FALSE to
+ *   remove it.
+ */
+static void
+HRD_tally_herd (HRD_herd_t * herd, gboolean add)
+{
+  HRD_tally_t *tally;
+  HRD_status_t status;
+  gboolean by_prodtype;
+  unsigned int i;
+
+  tally = herd->tally;
+  if (tally == NULL)
+    return;
+  status = herd->state->status;
+  /* The per-production-type counts are sized when the list is recounted, so a
+   * herd appended since then may not fit in them yet. */
+  by_prodtype = (herd->production_type < tally->nprodtypes);
+  i = herd->production_type * HRD_NSTATES + status;
+  if (add)
+    {
+      tally->nunits[status]++;
+      tally->nanimals[status] += herd->size;
+      if (by_prodtype)
+        {
+          tally->nunits_by_prodtype[i]++;
+          tally->nanimals_by_prodtype[i] += herd->size;
+        }
+      if (HRD_infected_status (status))
+        {
+          tally->prevalence_num += herd->size * herd->state->prevalence;
+          tally->prevalence_denom += herd->size;
+          if (herd->state->prevalence != 0)
+            tally->nprevalent++;
+        }
+    }
+  else
+    {
+      tally->nunits[status]--;
+      tally->nanimals[status] -= herd->size;
+      if (by_prodtype)
+        {
+          tally->nunits_by_prodtype[i]--;
+          tally->nanimals_by_prodtype[i] -= herd->size;
+        }
+      if (HRD_infected_status (status))
+        {
+          tally->prevalence_num -= herd->size * herd->state->prevalence;
+          tally->prevalence_denom -= herd->size;
+          if (herd->state->prevalence != 0)
+            tally->nprevalent--;
+        }
+    }
+  if (tally->nprevalent == 0)
+    tally->prevalence_num = 0;
+}
+
+
+
+/**
+ * Sets the prevalence of infection in a herd, keeping the running prevalence
+ * total of its herd list up to date.
+ *
+ * @param herd a herd.
+ * @param prevalence the new prevalence.
+ */
+static void
+HRD_herd_set_prevalence (HRD_herd_t * herd, double prevalence)
+{
+  if (herd->tally != NULL && HRD_infected_status (herd->state->status))
+    {
+      HRD_tally_herd (herd, FALSE);
+      herd->state->prevalence = prevalence;
+      HRD_tally_herd (herd, TRUE);
+    }
+  else
+    herd->state->prevalence = prevalence;
+}
+
+
+
 /**
  * Changes the state of a herd.  This function checks if the transition is
  * valid.
  *
  * @param herd a herd.
  * @param new_state the new state.
+ * @param day the current simulation day.
  * @param infectious_herds a list of infectious herds, which may change as a
  *   result of this operation.
  */
 void
-HRD_change_state (HRD_herd_t * herd, HRD_status_t new_state,
-                  GHashTable *infectious_herds)
+HRD_change_state (HRD_herd_t * herd, HRD_status_t new_state, int day,
+                  HRD_herd_set_t *infectious_herds)
 {
   HRD_status_t state;
 
-  state = herd->status;
+  state = herd->state->status;
   if (HRD_valid_transition[state][new_state])
     {
-      herd->status = new_state;
-      herd->days_in_status = 0;
+      HRD_tally_herd (herd, FALSE);
+      herd->state->status = new_state;
+      herd->state->status_day = day;
+      HRD_tally_herd (herd, TRUE);
 
       switch( new_state )
       {
@@ -205,7 +303,7 @@ HRD_change_state (HRD_herd_t * herd, HRD_status_t new_state,
 
 #if DEBUG
       g_debug ("unit \"%s\" is now %s", herd->official_id,
-               HRD_status_name[herd->status]);
+               HRD_status_name[herd->state->status]);
 #endif
     }
   else
@@ -220,6 +318,129 @@ HRD_change_state (HRD_herd_t * herd, HRD_status_t new_state,
 
 
 
+/**
+ * The change request pool that the change request constructors draw from.
+ * Each thread running iterations installs its worker's pool.
+ */
+static NAADSM_THREAD_LOCAL HRD_change_request_pool_t *current_change_request_pool = NULL;
+
+
+
+/**
+ * Creates a new, empty change request pool.
+ *
+ * @return a pointer to a newly-created HRD_change_request_pool_t structure.
+ */
+HRD_change_request_pool_t *
+HRD_new_change_request_pool (void)
+{
+  return g_new0 (HRD_change_request_pool_t, 1);
+}
+
+
+
+/**
+ * Makes the change request constructors in the calling thread draw from the
+ * given pool, and HRD_free_change_request return requests to it.
+ *
+ * @param pool a change request pool.  Pass NULL to go back to the system
+ *   allocator.
+ */
+void
+HRD_set_change_request_pool (HRD_change_request_pool_t * pool)
+{
+  current_change_request_pool = pool;
+}
+
+
+
+/**
+ * Returns a text representation of a change request pool's counters.
+ *
+ * @param pool a change request pool.
+ * @return a string.
+ */
+char *
+HRD_change_request_pool_to_string (HRD_change_request_pool_t * pool)
+{
+  GString *s;
+  char *chararray;
+
+  s = g_string_new (NULL);
+  g_string_sprintf (s, "<Change request pool in use=%u high water=%u free=%u allocated=%lu reused=%lu>",
+                    pool->nin_use, pool->high_water, pool->nfree,
+                    pool->nallocated, pool->nreused);
+  /* don't return the wrapper object */
+  chararray = s->str;
+  g_string_free (s, FALSE);
+  return chararray;
+}
+
+
+
+/**
+ * Deletes a change request pool, and the requests on its free list, from
+ * memory.
+ *
+ * @param pool a change request pool.
+ */
+void
+HRD_free_change_request_pool (HRD_change_request_pool_t * pool)
+{
+  gpointer block, next;
+
+  if (pool == NULL)
+    return;
+
+  if (current_change_request_pool == pool)
+    current_change_request_pool = NULL;
+
+  for (block = pool->free_list; block != NULL; block = next)
+    {
+      next = *((gpointer *) block);
+      g_free (block);
+    }
+  g_free (pool);
+}
+
+
+
+/**
+ * Gets storage for one change request, from the current pool's free list if
+ * possible.
+ *
+ * @return a pointer to an uninitialized HRD_change_request_t structure.
+ */
+static HRD_change_request_t *
+HRD_alloc_change_request (void)
+{
+  HRD_change_request_pool_t *pool;
+  gpointer block;
+
+  pool = current_change_request_pool;
+  if (pool == NULL)
+    return g_new (HRD_change_request_t, 1);
+
+  if (pool->free_list != NULL)
+    {
+      block = pool->free_list;
+      pool->free_list = *((gpointer *) block);
+      pool->nfree--;
+      pool->nreused++;
+    }
+  else
+    {
+      block = g_new (HRD_change_request_t, 1);
+      pool->nallocated++;
+    }
+  pool->nin_use++;
+  if (pool->nin_use > pool->high_water)
+    pool->high_water = pool->nin_use;
+  return (HRD_change_request_t *) block;
+}
+
+
+
 /**
  * Creates a new infection change request.
  *
@@ -245,7 +466,7 @@ HRD_new_infect_change_request (int latent_period,
 {
   HRD_change_request_t *request;
 
-  request = g_new (HRD_change_request_t, 1);
+  request = HRD_alloc_change_request ();
   request->type = Infect;
   request->u.infect.latent_period = latent_period;
   request->u.infect.infectious_subclinical_period = infectious_subclinical_period;
@@ -262,14 +483,16 @@ HRD_new_infect_change_request (int latent_period,
  *
  * @param herd a herd.
  * @param request an infection change request.
+ * @param day the current simulation day.
  * @param infectious_herds a list of infectious herds, which may change as a
  *   result of this operation.
  */
 void
 HRD_apply_infect_change_request (HRD_herd_t * herd,
                                  HRD_infect_change_request_t * request,
-                                 GHashTable * infectious_herds)
+                                 int day, HRD_herd_set_t * infectious_herds)
 {
+  HRD_herd_state_t *state;
   int infectious_start_day, clinical_start_day,
     immunity_start_day, immunity_end_day;
 
@@ -277,15 +500,16 @@ HRD_apply_infect_change_request (HRD_herd_t * herd,
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER HRD_apply_infect_change_request");
 #endif
 
-  if (herd->status != Susceptible)
+  state = herd->state;
+  if (state->status != Susceptible)
     goto end;
 
   /* If the herd has been vaccinated but has not yet developed immunity, cancel
    * the progress of the vaccine. */
-  herd->in_vaccine_cycle = FALSE;
+  state->in_vaccine_cycle = FALSE;
 
-  herd->in_disease_cycle = TRUE;
-  herd->day_in_disease_cycle = request->day_in_disease_cycle;
+  state->in_disease_cycle = TRUE;
+  state->disease_start_day = day - (int) request->day_in_disease_cycle;
 
 #if DEBUG
   g_debug ("requested disease progression = day %u in (%i,%i,%i,%i)",
@@ -295,64 +519,59 @@ HRD_apply_infect_change_request (HRD_herd_t * herd,
 #endif
 
   /* Compute the day for each state transition. */
-  infectious_start_day = request->latent_period;
+  infectious_start_day = state->disease_start_day + request->latent_period;
   clinical_start_day = infectious_start_day + request->infectious_subclinical_period;
   immunity_start_day = clinical_start_day + request->infectious_clinical_period;
   immunity_end_day = immunity_start_day + request->immunity_period;
 
-  /* Advance the countdowns if the day_in_disease_cycle has been set. */
-  if (request->day_in_disease_cycle >= immunity_end_day)
+  /* Skip the transitions that are already in the past if the
+   * day_in_disease_cycle has been set. */
+  state->infectious_start_day = 0;
+  state->clinical_start_day = 0;
+  state->immunity_start_day = 0;
+  state->immunity_end_day = immunity_end_day;
+  if (day >= immunity_end_day)
     {
-      herd->in_disease_cycle = FALSE;
+      state->in_disease_cycle = FALSE;
     }
-  else if (request->day_in_disease_cycle >= immunity_start_day)
+  else if (day >= immunity_start_day)
     {
-      HRD_change_state (herd, Latent, infectious_herds);
-      HRD_change_state (herd, InfectiousClinical, infectious_herds);
-      HRD_change_state (herd, NaturallyImmune, infectious_herds);
-      herd->days_in_status = request->day_in_disease_cycle - immunity_start_day;
-      herd->infectious_start_countdown = -1;
-      herd->clinical_start_countdown = -1;
-      herd->immunity_start_countdown = -1;
-      herd->immunity_end_countdown = immunity_end_day - request->day_in_disease_cycle;
+      HRD_change_state (herd, Latent, day, infectious_herds);
+      HRD_change_state (herd, InfectiousClinical, day, infectious_herds);
+      HRD_change_state (herd, NaturallyImmune, day, infectious_herds);
+      state->status_day = immunity_start_day;
     }
-  else if (request->day_in_disease_cycle >= clinical_start_day)
+  else if (day >= clinical_start_day)
     {
-      HRD_change_state (herd, Latent, infectious_herds);
-      HRD_change_state (herd, InfectiousClinical, infectious_herds);
-      herd->days_in_status = request->day_in_disease_cycle - clinical_start_day;
-      herd->infectious_start_countdown = -1;
-      herd->clinical_start_countdown = -1;
-      herd->immunity_start_countdown = immunity_start_day - request->day_in_disease_cycle;
-      herd->immunity_end_countdown = immunity_end_day - request->day_in_disease_cycle;
+      HRD_change_state (herd, Latent, day, infectious_herds);
+      HRD_change_state (herd, InfectiousClinical, day, infectious_herds);
+      state->status_day = clinical_start_day;
+      state->immunity_start_day = immunity_start_day;
     }
-  else if (request->day_in_disease_cycle >= infectious_start_day)
+  else if (day >= infectious_start_day)
     {
-      HRD_change_state (herd, Latent, infectious_herds);
-      HRD_change_state (herd, InfectiousSubclinical, infectious_herds);
-      herd->days_in_status = request->day_in_disease_cycle - infectious_start_day;
-      herd->infectious_start_countdown = -1;
-      herd->clinical_start_countdown = clinical_start_day - request->day_in_disease_cycle;
-      herd->immunity_start_countdown = immunity_start_day - request->day_in_disease_cycle;
-      herd->immunity_end_countdown = immunity_end_day - request->day_in_disease_cycle;
+      HRD_change_state (herd, Latent, day, infectious_herds);
+      HRD_change_state (herd, InfectiousSubclinical, day, infectious_herds);
+      state->status_day = infectious_start_day;
+      state->clinical_start_day = clinical_start_day;
+      state->immunity_start_day = immunity_start_day;
     }
   else
     {
-      HRD_change_state (herd, Latent, infectious_herds);
-      herd->days_in_status = request->day_in_disease_cycle;
-      herd->infectious_start_countdown = infectious_start_day - request->day_in_disease_cycle;
-      herd->clinical_start_countdown = clinical_start_day - request->day_in_disease_cycle;
-      herd->immunity_start_countdown = immunity_start_day - request->day_in_disease_cycle;
-      herd->immunity_end_countdown = immunity_end_day - request->day_in_disease_cycle;
+      HRD_change_state (herd, Latent, day, infectious_herds);
+      state->status_day = state->disease_start_day;
+      state->infectious_start_day = infectious_start_day;
+      state->clinical_start_day = clinical_start_day;
+      state->immunity_start_day = immunity_start_day;
     }
 
 #if DEBUG
-  g_debug ("infectious start countdown=%i", herd->infectious_start_countdown);
-  g_debug ("clinical start countdown=%i", herd->clinical_start_countdown);
-  g_debug ("immunity start countdown=%i", herd->immunity_start_countdown);
-  g_debug ("immunity end countdown=%i", herd->immunity_end_countdown);
-  g_debug ("in disease cycle=%s", herd->in_disease_cycle ? "true" : "false");
-  g_debug ("day in disease cycle=%u", herd->day_in_disease_cycle);
+  g_debug ("infectious start day=%i", state->infectious_start_day);
+  g_debug ("clinical start day=%i", state->clinical_start_day);
+  g_debug ("immunity start day=%i", state->immunity_start_day);
+  g_debug ("immunity end day=%i", state->immunity_end_day);
+  g_debug ("in disease cycle=%s", state->in_disease_cycle ? "true" : "false");
+  g_debug ("disease start day=%i", state->disease_start_day);
 #endif
 
 end:
@@ -376,7 +595,7 @@ HRD_new_vaccinate_change_request (int delay, int immunity_period)
 {
   HRD_change_request_t *request;
 
-  request = g_new (HRD_change_request_t, 1);
+  request = HRD_alloc_change_request ();
   request->type = Vaccinate;
   request->u.vaccinate.delay = delay;
   request->u.vaccinate.immunity_period = immunity_period;
@@ -390,14 +609,14 @@ HRD_new_vaccinate_change_request (int delay, int immunity_period)
  *
  * @param herd a herd.
  * @param request a vaccination change request.
+ * @param day the current simulation day.
  * @param infectious_herds a list of infectious herds.
  */
 void
 HRD_apply_vaccinate_change_request (HRD_herd_t * herd,
                                     HRD_vaccinate_change_request_t * request,
-                                    GHashTable * infectious_herds)
+                                    int day, HRD_herd_set_t * infectious_herds)
 {
-  unsigned int delay;
 
 #if DEBUG
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER HRD_apply_vaccinate_change_request");
@@ -405,22 +624,17 @@ HRD_apply_vaccinate_change_request (HRD_herd_t * herd,
 
   /* If the herd is Susceptible and not already in the vaccine cycle, then we
    * start the vaccine cycle (i.e. delayed transition to Vaccine Immune). */
-  if (herd->status == Susceptible && !herd->in_vaccine_cycle)
+  if (herd->state->status == Susceptible && !herd->state->in_vaccine_cycle)
     {
-      delay = request->delay;
-      herd->immunity_start_countdown = delay;
-
-      delay += request->immunity_period;
-      herd->immunity_end_countdown = delay;
-
-      herd->in_vaccine_cycle = TRUE;
+      herd->state->immunity_start_day = day + request->delay;
+      herd->state->immunity_end_day = herd->state->immunity_start_day + request->immunity_period;
+      herd->state->in_vaccine_cycle = TRUE;
     }
   /* If the herd is already Vaccine Immune, we re-set the time left for the
    * immunity according to the new parameter. */
-  else if (herd->status == VaccineImmune)
+  else if (herd->state->status == VaccineImmune)
     {
-      delay = request->immunity_period;
-      herd->immunity_end_countdown = delay;
+      herd->state->immunity_end_day = day + request->immunity_period;
     }
 
 #if DEBUG
@@ -441,7 +655,7 @@ HRD_new_quarantine_change_request (void)
 {
   HRD_change_request_t *request;
 
-  request = g_new (HRD_change_request_t, 1);
+  request = HRD_alloc_change_request ();
   request->type = Quarantine;
   return request;
 }
@@ -461,7 +675,7 @@ HRD_apply_quarantine_change_request (HRD_herd_t * herd, HRD_quarantine_change_re
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER HRD_apply_quarantine_change_request");
 #endif
 
-  herd->quarantined = TRUE;
+  herd->state->quarantined = TRUE;
 
 #if DEBUG
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- EXIT HRD_apply_quarantine_change_request");
@@ -480,7 +694,7 @@ HRD_new_lift_quarantine_change_request (void)
 {
   HRD_change_request_t *request;
 
-  request = g_new (HRD_change_request_t, 1);
+  request = HRD_alloc_change_request ();
   request->type = LiftQuarantine;
   return request;
 }
@@ -501,7 +715,7 @@ HRD_apply_lift_quarantine_change_request (HRD_herd_t * herd,
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER HRD_apply_lift_quarantine_change_request");
 #endif
 
-  herd->quarantined = FALSE;
+  herd->state->quarantined = FALSE;
 
 #if DEBUG
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- EXIT HRD_apply_lift_quarantine_change_request");
@@ -520,7 +734,7 @@ HRD_new_destroy_change_request (void)
 {
   HRD_change_request_t *request;
 
-  request = g_new (HRD_change_request_t, 1);
+  request = HRD_alloc_change_request ();
   request->type = Destroy;
   return request;
 }
@@ -532,22 +746,23 @@ HRD_new_destroy_change_request (void)
  *
  * @param herd a herd.
  * @param request a destruction change request.
+ * @param day the current simulation day.
  * @param infectious_herds a list of infectious herds, which may change as a
  *   result of this operation.
  */
 void
 HRD_apply_destroy_change_request (HRD_herd_t * herd,
                                   HRD_destroy_change_request_t * request,
-                                  GHashTable *infectious_herds)
+                                  int day, HRD_herd_set_t *infectious_herds)
 {
 #if DEBUG
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER HRD_apply_destroy_change_request");
 #endif
 
-  herd->in_vaccine_cycle = FALSE;
-  herd->in_disease_cycle = FALSE;
+  herd->state->in_vaccine_cycle = FALSE;
+  herd->state->in_disease_cycle = FALSE;
 
-  HRD_change_state (herd, Destroyed, infectious_herds);
+  HRD_change_state (herd, Destroyed, day, infectious_herds);
 
 #if DEBUG
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- EXIT HRD_apply_destroy_change_request");
@@ -561,21 +776,22 @@ HRD_apply_destroy_change_request (HRD_herd_t * herd,
  *
  * @param herd a herd.
  * @param request a change request.
+ * @param day the current simulation day.
  * @param infectious_herds a list of infectious herds, which may change as a
  *   result of this operation.
  */
 void
 HRD_apply_change_request (HRD_herd_t * herd,
                           HRD_change_request_t * request,
-                          GHashTable *infectious_herds)
+                          int day, HRD_herd_set_t *infectious_herds)
 {
   switch (request->type)
     {
     case Infect:
-      HRD_apply_infect_change_request (herd, &(request->u.infect), infectious_herds);
+      HRD_apply_infect_change_request (herd, &(request->u.infect), day, infectious_herds);
       break;
     case Vaccinate:
-      HRD_apply_vaccinate_change_request (herd, &(request->u.vaccinate), infectious_herds);
+      HRD_apply_vaccinate_change_request (herd, &(request->u.vaccinate), day, infectious_herds);
       break;
     case Quarantine:
       HRD_apply_quarantine_change_request (herd, &(request->u.quarantine));
@@ -584,7 +800,7 @@ HRD_apply_change_request (HRD_herd_t * herd,
       HRD_apply_lift_quarantine_change_request (herd, &(request->u.lift_quarantine));
       break;
     case Destroy:
-      HRD_apply_destroy_change_request (herd, &(request->u.destroy), infectious_herds);
+      HRD_apply_destroy_change_request (herd, &(request->u.destroy), day, infectious_herds);
       break;
     default:
       g_assert_not_reached ();
@@ -594,12 +810,39 @@ HRD_apply_change_request (HRD_herd_t * herd,
 
 
 /**
- * Registers a request for a change to a herd.
+ * Marks a herd as due to be stepped on a given day.  A herd is kept in the
+ * calendar only for its earliest due day; after it is stepped, HRD_step()
+ * puts it back in for its next one.
+ *
+ * @param herd a herd.
+ * @param day the day on which the herd must be stepped.
+ */
+void
+HRD_herd_wake_on (HRD_herd_t * herd, int day)
+{
+  HRD_calendar_t *calendar;
+
+  calendar = herd->calendar;
+  if (calendar == NULL)
+    return;
+  if (herd->state->wake_day != 0 && herd->state->wake_day <= day)
+    return;
+  herd->state->wake_day = day;
+  g_array_append_val (calendar->slot[day % HRD_CALENDAR_SIZE], herd->index);
+}
+
+
+
+/**
+ * Registers a request for a change to a herd.  The request will be carried
+ * out at the next midnight.
  */
 void
 HRD_herd_add_change_request (HRD_herd_t * herd, HRD_change_request_t * request)
 {
-  herd->change_requests = g_slist_append (herd->change_requests, request);
+  herd->state->change_requests = g_slist_append (herd->state->change_requests, request);
+  if (herd->calendar != NULL)
+    HRD_herd_wake_on (herd, herd->calendar->day + 1);
 }
 
 
@@ -612,7 +855,21 @@ HRD_herd_add_change_request (HRD_herd_t * herd, HRD_change_request_t * request)
 void
 HRD_free_change_request (HRD_change_request_t * request)
 {
-  g_free (request);
+  HRD_change_request_pool_t *pool;
+
+  pool = current_change_request_pool;
+  if (pool == NULL)
+    {
+      g_free (request);
+      return;
+    }
+
+  *((gpointer *) request) = pool->free_list;
+  pool->free_list = request;
+  pool->nfree++;
+  /* The request may have been created before the pool was installed. */
+  if (pool->nin_use > 0)
+    pool->nin_use--;
 }
 
 
@@ -644,9 +901,9 @@ HRD_herd_clear_change_requests (HRD_herd_t * herd)
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER HRD_herd_clear_change_requests");
 #endif
 
-  g_slist_foreach (herd->change_requests, HRD_free_change_request_as_GFunc, NULL);
-  g_slist_free (herd->change_requests);
-  herd->change_requests = NULL;
+  g_slist_foreach (herd->state->change_requests, HRD_free_change_request_as_GFunc, NULL);
+  g_slist_free (herd->state->change_requests);
+  herd->state->change_requests = NULL;
 
 #if DEBUG
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- EXIT HRD_herd_clear_change_requests");
@@ -703,8 +960,14 @@ HRD_new_herd (HRD_production_type_t production_type,
   HRD_herd_t *herd;
 
   herd = g_new (HRD_herd_t, 1);
+  /* A herd on its own has its own state structure.  When the herd is added to
+   * a herd list, the state is copied into the list's block of states. */
+  herd->state = g_new0 (HRD_herd_state_t, 1);
+  herd->calendar = NULL;
+  herd->tally = NULL;
 
   herd->index = 0;
+  herd->original_index = 0;
   herd->official_id = NULL;
   herd->production_type = production_type;
   herd->production_type_name = production_type_name;
@@ -717,17 +980,10 @@ HRD_new_herd (HRD_production_type_t production_type,
     herd->size = size;
   herd->x = x;
   herd->y = y;
-  herd->status = herd->initial_status = Susceptible;
-  herd->days_in_status = 0;
+  herd->initial_status = Susceptible;
   herd->days_in_initial_status = 0;
   herd->days_left_in_initial_status = 0;
-  herd->quarantined = FALSE;
-  herd->prevalence = 0;
-
-  herd->in_vaccine_cycle = FALSE;
-  herd->in_disease_cycle = FALSE;
   herd->prevalence_curve = NULL;
-  herd->change_requests = NULL;
   
 #ifdef USE_SC_GUILIB
   herd->production_types = NULL;
@@ -1359,7 +1615,7 @@ endElement (void *userData, const char *name)
                      tmp, (unsigned long) XML_GetCurrentLineNumber (parser), filename);
           status = Susceptible;
         }
-      partial->herd->status = partial->herd->initial_status = status;
+      partial->herd->state->status = partial->herd->initial_status = status;
 #ifdef USE_SC_GUILIB
 	  if ( status == Destroyed )
 		partial->herd->apparent_status = asDestroyed;
@@ -1534,7 +1790,7 @@ HRD_herd_to_string (HRD_herd_t * herd)
                     herd->production_type_name, herd->official_id, herd->size, herd->x, herd->y);
 
   /* Print the status, plus days left if applicable. */
-  g_string_append_printf (s, "\n %s", HRD_status_name[herd->status]);
+  g_string_append_printf (s, "\n %s", HRD_status_name[herd->state->status]);
   if (herd->days_left_in_initial_status > 0)
     g_string_append_printf (s, " (%i days left) ", herd->days_left_in_initial_status);
 
@@ -1581,7 +1837,8 @@ HRD_fprintf_herd (FILE * stream, HRD_herd_t * herd)
 
 /**
  * Deletes a herd structure from memory.  Does not free the production type
- * name string.
+ * name string.  The herd's own state structure is always freed; do not use
+ * this function on a herd that is part of a herd list.
  *
  * @param herd a herd.
  * @param free_segment if TRUE, also frees the dynamically-allocated parts of
@@ -1597,11 +1854,68 @@ HRD_free_herd (HRD_herd_t * herd, gboolean free_segment)
       /* We do not free the prevalence chart, because it is assumed to belong
        * to the disease module. */
     }
+  g_free (herd->state);
   g_free (herd);
 }
 
 
 
+/**
+ * Creates a new, empty herd transition calendar.
+ *
+ * @return a pointer to a newly-created HRD_calendar_t structure.
+ */
+static HRD_calendar_t *
+HRD_new_calendar (void)
+{
+  HRD_calendar_t *calendar;
+  unsigned int i;
+
+  calendar = g_new (HRD_calendar_t, 1);
+  for (i = 0; i < HRD_CALENDAR_SIZE; i++)
+    calendar->slot[i] = g_array_new (FALSE, FALSE, sizeof (unsigned int));
+  calendar->due = g_array_new (FALSE, FALSE, sizeof (unsigned int));
+  calendar->day = 0;
+  return calendar;
+}
+
+
+
+/**
+ * Empties a herd transition calendar and sets it back to day 0.
+ *
+ * @param calendar a calendar.
+ */
+static void
+HRD_calendar_clear (HRD_calendar_t * calendar)
+{
+  unsigned int i;
+
+  for (i = 0; i < HRD_CALENDAR_SIZE; i++)
+    g_array_set_size (calendar->slot[i], 0);
+  calendar->day = 0;
+}
+
+
+
+/**
+ * Deletes a herd transition calendar from memory.
+ *
+ * @param calendar a calendar.
+ */
+static void
+HRD_free_calendar (HRD_calendar_t * calendar)
+{
+  unsigned int i;
+
+  for (i = 0; i < HRD_CALENDAR_SIZE; i++)
+    g_array_free (calendar->slot[i], TRUE);
+  g_array_free (calendar->due, TRUE);
+  g_free (calendar);
+}
+
+
+
 /**
  * Creates a new, empty herd list.
  *
@@ -1614,17 +1928,109 @@ HRD_new_herd_list (void)
 
   herds = g_new (HRD_herd_list_t, 1);
   herds->list = g_array_new (FALSE, FALSE, sizeof (HRD_herd_t));
+  herds->states = g_array_new (FALSE, TRUE, sizeof (HRD_herd_state_t));
+  herds->calendar = HRD_new_calendar ();
+  herds->tally = g_new0 (HRD_tally_t, 1);
 #ifdef USE_SC_GUILIB
   herds->production_types = NULL;
 #endif
   herds->production_type_names = g_ptr_array_new ();
+  herds->spatial_index = NULL;
+  herds->live_index = NULL;
+  herds->by_original_index = NULL;
   herds->projection = NULL;
+  herds->is_clone = FALSE;
 
   return herds;
 }
 
 
 
+/**
+ * Points each herd in a list at its entry in the list's block of states, and
+ * at the list's calendar.  This must be done whenever the block may have moved
+ * in memory.
+ *
+ * @param herds a herd list.
+ */
+static void
+HRD_herd_list_link_states (HRD_herd_list_t * herds)
+{
+  unsigned int nherds, i;
+  HRD_herd_t *herd;
+
+  nherds = HRD_herd_list_length (herds);
+  for (i = 0; i < nherds; i++)
+    {
+      herd = HRD_herd_list_get (herds, i);
+      herd->state = &g_array_index (herds->states, HRD_herd_state_t, i);
+      herd->calendar = herds->calendar;
+      herd->tally = herds->tally;
+    }
+}
+
+
+
+/**
+ * Creates a copy of a herd list, for use when several iterations are run in
+ * parallel.  The copy has its own block of herd states, so the herds' states
+ * can change independently of the original, but it shares the official ids,
+ * production type names, spatial index, file-order map and projection with the
+ * original.  The
+ * original must therefore not be freed before the copy.
+ *
+ * The herd structures themselves are copied too, because each one carries a
+ * pointer to its state; the copies are shallow.
+ *
+ * @param herds a herd list.
+ * @return a newly-allocated herd list.
+ */
+HRD_herd_list_t *
+HRD_clone_herd_list (HRD_herd_list_t * herds)
+{
+  HRD_herd_list_t *clone;
+  unsigned int nherds, i;
+
+#if DEBUG
+  g_debug ("----- ENTER HRD_clone_herd_list");
+#endif
+
+  nherds = HRD_herd_list_length (herds);
+  clone = g_new (HRD_herd_list_t, 1);
+  clone->list = g_array_sized_new (FALSE, FALSE, sizeof (HRD_herd_t), nherds);
+  g_array_append_vals (clone->list, herds->list->data, nherds);
+  clone->states = g_array_sized_new (FALSE, TRUE, sizeof (HRD_herd_state_t), nherds);
+  g_array_append_vals (clone->states, herds->states->data, nherds);
+  clone->calendar = HRD_new_calendar ();
+  clone->tally = g_new0 (HRD_tally_t, 1);
+  HRD_herd_list_link_states (clone);
+  /* Pending change requests and calendar entries belong to the original's
+   * iteration. */
+  for (i = 0; i < nherds; i++)
+    {
+      g_array_index (clone->states, HRD_herd_state_t, i).change_requests = NULL;
+      g_array_index (clone->states, HRD_herd_state_t, i).wake_day = 0;
+    }
+#ifdef USE_SC_GUILIB
+  clone->production_types = herds->production_types;
+#endif
+  clone->production_type_names = herds->production_type_names;
+  clone->spatial_index = herds->spatial_index;
+  clone->live_index = NULL;
+  clone->by_original_index = herds->by_original_index;
+  clone->projection = herds->projection;
+  clone->is_clone = TRUE;
+  HRD_herd_list_recount (clone);
+
+#if DEBUG
+  g_debug ("----- EXIT HRD_clone_herd_list");
+#endif
+
+  return clone;
+}
+
+
+
 /**
  * Deletes a herd list from memory.
  *
@@ -1644,23 +2050,38 @@ HRD_free_herd_list (HRD_herd_list_t * herds)
   if (herds == NULL)
     goto end;
 
-  /* Free the dynamic parts of each herd structure. */
+  /* Free the dynamic parts of each herd structure.  A copy made by
+   * HRD_clone_herd_list does not own the official ids. */
   nherds = HRD_herd_list_length (herds);
   for (i = 0; i < nherds; i++)
     {
       herd = HRD_herd_list_get (herds, i);
-      g_free (herd->official_id);
-      g_slist_foreach (herd->change_requests, HRD_free_change_request_as_GFunc, NULL);
+      if (!herds->is_clone)
+        g_free (herd->official_id);
+      g_slist_foreach (herd->state->change_requests, HRD_free_change_request_as_GFunc, NULL);
     }
 
-  /* Free the herd structures. */
+  /* Free the herd structures and their states. */
   g_array_free (herds->list, TRUE);
+  g_array_free (herds->states, TRUE);
+  HRD_free_calendar (herds->calendar);
+  g_free (herds->tally->nunits_by_prodtype);
+  g_free (herds->tally->nanimals_by_prodtype);
+  g_free (herds->tally);
+
+  if (herds->is_clone)
+    {
+      g_free (herds);
+      goto end;
+    }
 
   /* Free the production type names. */
   for (i = 0; i < herds->production_type_names->len; i++)
     g_free (g_ptr_array_index (herds->production_type_names, i));
   g_ptr_array_free (herds->production_type_names, TRUE);
 
+  g_free (herds->by_original_index);
+
   /* Free the projection. */
   if (herds->projection != NULL)
     pj_free (herds->projection);
@@ -1708,6 +2129,205 @@ HRD_herd_list_project (HRD_herd_list_t * herds, projPJ projection)
 
 
 
+/**
+ * The number of steps along each axis of the grid on which herd locations are
+ * placed before computing their positions along a space-filling curve.
+ */
+#define HRD_CURVE_SIDE 65536
+
+
+
+/**
+ * Returns the position of a grid square along a Morton (Z-order) curve.  The
+ * position is made by interleaving the bits of the x and y grid coordinates.
+ *
+ * @param x the x grid coordinate, 0 to HRD_CURVE_SIDE - 1.
+ * @param y the y grid coordinate, 0 to HRD_CURVE_SIDE - 1.
+ * @return the position along the curve.
+ */
+static guint64
+HRD_morton_key (guint32 x, guint32 y)
+{
+  guint64 key = 0;
+  unsigned int bit;
+
+  for (bit = 0; bit < 16; bit++)
+    {
+      key |= ((guint64) ((x >> bit) & 1)) << (2 * bit);
+      key |= ((guint64) ((y >> bit) & 1)) << (2 * bit + 1);
+    }
+  return key;
+}
+
+
+
+/**
+ * Returns the position of a grid square along a Hilbert curve.  Unlike the
+ * Morton curve, the Hilbert curve never jumps: squares that are consecutive
+ * along the curve are always neighbours on the map.
+ *
+ * @param x the x grid coordinate, 0 to HRD_CURVE_SIDE - 1.
+ * @param y the y grid coordinate, 0 to HRD_CURVE_SIDE - 1.
+ * @return the position along the curve.
+ */
+static guint64
+HRD_hilbert_key (guint32 x, guint32 y)
+{
+  guint64 key = 0;
+  guint32 s, rx, ry, tmp;
+
+  for (s = HRD_CURVE_SIDE / 2; s > 0; s /= 2)
+    {
+      rx = (x & s) > 0;
+      ry = (y & s) > 0;
+      key += (guint64) s * s * ((3 * rx) ^ ry);
+      /* Rotate the quadrant so that the curve inside it has the right
+       * orientation. */
+      if (ry == 0)
+        {
+          if (rx == 1)
+            {
+              x = HRD_CURVE_SIDE - 1 - x;
+              y = HRD_CURVE_SIDE - 1 - y;
+            }
+          tmp = x;
+          x = y;
+          y = tmp;
+        }
+    }
+  return key;
+}
+
+
+
+/** A herd's position along a space-filling curve, for sorting. */
+typedef struct
+{
+  guint64 key;
+  unsigned int index;
+}
+HRD_curve_position_t;
+
+
+
+/**
+ * Compares two positions along a space-filling curve.  Herds in the same grid
+ * square keep their relative order.
+ */
+static int
+HRD_compare_curve_positions (const void *a, const void *b)
+{
+  const HRD_curve_position_t *p1 = (const HRD_curve_position_t *) a;
+  const HRD_curve_position_t *p2 = (const HRD_curve_position_t *) b;
+
+  if (p1->key < p2->key)
+    return -1;
+  else if (p1->key > p2->key)
+    return 1;
+  else if (p1->index < p2->index)
+    return -1;
+  else if (p1->index > p2->index)
+    return 1;
+  else
+    return 0;
+}
+
+
+
+/**
+ * Changes the order in which herds are stored in a list, so that herds that
+ * are close together on the map are close together in memory.  Each herd's
+ * index changes to its new position; its original_index keeps its position in
+ * the herd file, and the list keeps a map from file positions to list
+ * positions (see HRD_herd_list_get_by_original_index()).
+ *
+ * This must be done after the herds are projected and before anything records
+ * herd indices: the spatial index, the sub-models, the zones, and the first
+ * iteration.  Note that the order in which herds are visited decides which
+ * random numbers they get, so the same seed gives different (but equally
+ * valid) results in different orders.
+ *
+ * @param herds a herd list.  Must not be a copy made by HRD_clone_herd_list().
+ * @param order the new order.
+ */
+void
+HRD_herd_list_reorder (HRD_herd_list_t * herds, HRD_herd_order_t order)
+{
+  unsigned int nherds, i;
+  HRD_herd_t *herd;
+  double min_x, max_x, min_y, max_y, scale_x, scale_y;
+  guint32 gx, gy;
+  HRD_curve_position_t *position;
+  GArray *list, *states;
+
+#if DEBUG
+  g_debug ("----- ENTER HRD_herd_list_reorder");
+#endif
+
+  g_assert (!herds->is_clone);
+  nherds = HRD_herd_list_length (herds);
+  if (order == HRD_FileOrder || nherds < 2)
+    goto end;
+
+  /* Place the herds on a square grid covering their bounding rectangle. */
+  herd = HRD_herd_list_get (herds, 0);
+  min_x = max_x = herd->x;
+  min_y = max_y = herd->y;
+  for (i = 1; i < nherds; i++)
+    {
+      herd = HRD_herd_list_get (herds, i);
+      min_x = MIN (min_x, herd->x);
+      max_x = MAX (max_x, herd->x);
+      min_y = MIN (min_y, herd->y);
+      max_y = MAX (max_y, herd->y);
+    }
+  scale_x = (max_x > min_x) ? (HRD_CURVE_SIDE - 1) / (max_x - min_x) : 0;
+  scale_y = (max_y > min_y) ? (HRD_CURVE_SIDE - 1) / (max_y - min_y) : 0;
+
+  position = g_new (HRD_curve_position_t, nherds);
+  for (i = 0; i < nherds; i++)
+    {
+      herd = HRD_herd_list_get (herds, i);
+      gx = (guint32) ((herd->x - min_x) * scale_x);
+      gy = (guint32) ((herd->y - min_y) * scale_y);
+      position[i].key = (order == HRD_HilbertOrder) ? HRD_hilbert_key (gx, gy) : HRD_morton_key (gx, gy);
+      position[i].index = i;
+    }
+  qsort (position, nherds, sizeof (HRD_curve_position_t), HRD_compare_curve_positions);
+
+  /* Copy the herds and their states into new blocks in the new order. */
+  list = g_array_sized_new (FALSE, FALSE, sizeof (HRD_herd_t), nherds);
+  states = g_array_sized_new (FALSE, TRUE, sizeof (HRD_herd_state_t), nherds);
+  for (i = 0; i < nherds; i++)
+    {
+      g_array_append_val (list, g_array_index (herds->list, HRD_herd_t, position[i].index));
+      g_array_append_val (states, g_array_index (herds->states, HRD_herd_state_t, position[i].index));
+    }
+  g_free (position);
+  g_array_free (herds->list, TRUE);
+  g_array_free (herds->states, TRUE);
+  herds->list = list;
+  herds->states = states;
+  HRD_herd_list_link_states (herds);
+
+  if (herds->by_original_index == NULL)
+    herds->by_original_index = g_new (unsigned int, nherds);
+  for (i = 0; i < nherds; i++)
+    {
+      herd = HRD_herd_list_get (herds, i);
+      herd->index = i;
+      herds->by_original_index[herd->original_index] = i;
+    }
+
+end:
+#if DEBUG
+  g_debug ("----- EXIT HRD_herd_list_reorder");
+#endif
+  return;
+}
+
+
+
 /**
  * Loads a herd list from a file.  Use HRD_herd_list_project() to convert the
  * lats and lons to a flat map.  Also, a bounding rectangle has not been
@@ -1858,16 +2478,31 @@ HRD_herd_list_append (HRD_herd_list_t * herds, HRD_herd_t * herd)
 {
   GArray *list;
   unsigned int new_length;
+  gchar *old_states;
 
   list = herds->list;
   g_array_append_val (list, *herd);
+  old_states = herds->states->data;
+  g_array_append_val (herds->states, *(herd->state));
   new_length = HRD_herd_list_length (herds);
 
   /* Now make the pointer point to the copy in the herd list. */
   herd = &g_array_index (list, HRD_herd_t, new_length - 1);
 
   /* Set the list index number for the herd. */
-  herd->index = new_length - 1;
+  herd->index = herd->original_index = new_length - 1;
+
+  /* Point the copy at its state in the list's block of states.  If the block
+   * was moved to make room, the other herds need updating too. */
+  if (herds->states->data != old_states)
+    HRD_herd_list_link_states (herds);
+  else
+    {
+      herd->state = &g_array_index (herds->states, HRD_herd_state_t, new_length - 1);
+      herd->calendar = herds->calendar;
+      herd->tally = herds->tally;
+    }
+  HRD_tally_herd (herd, TRUE);
 
   return new_length;
 }
@@ -1893,12 +2528,12 @@ HRD_herd_list_to_string (HRD_herd_list_t * herds)
   nherds = HRD_herd_list_length (herds);
   if (nherds > 0)
     {
-      substring = HRD_herd_to_string (HRD_herd_list_get (herds, 0));
+      substring = HRD_herd_to_string (HRD_herd_list_get_by_original_index (herds, 0));
       g_string_assign (s, substring);
       g_free (substring);
       for (i = 1; i < nherds; i++)
         {
-          substring = HRD_herd_to_string (HRD_herd_list_get (herds, i));
+          substring = HRD_herd_to_string (HRD_herd_list_get_by_original_index (herds, i));
           g_string_append_printf (s, "\n%s", substring);
           g_free (substring);
         }
@@ -1941,7 +2576,8 @@ HRD_fprintf_herd_list (FILE * stream, HRD_herd_list_t * herds)
 
 
 /**
- * Returns a text string giving the state of each herd.
+ * Returns a text string giving the state of each herd, in the order of the
+ * herd file.
  *
  * @param herds a herd list.
  * @return a string.
@@ -1956,9 +2592,9 @@ HRD_herd_list_summary_to_string (HRD_herd_list_t * herds)
 
   nherds = HRD_herd_list_length (herds);
   s = g_string_new (NULL);
-  g_string_sprintf (s, "%i", HRD_herd_list_get (herds, 0)->status);
+  g_string_sprintf (s, "%i", HRD_herd_list_get_by_original_index (herds, 0)->state->status);
   for (i = 1; i < nherds; i++)
-    g_string_sprintfa (s, " %i", HRD_herd_list_get (herds, i)->status);
+    g_string_sprintfa (s, " %i", HRD_herd_list_get_by_original_index (herds, i)->state->status);
 
   /* don't return the wrapper object */
   chararray = s->str;
@@ -1968,7 +2604,8 @@ HRD_herd_list_summary_to_string (HRD_herd_list_t * herds)
 
 
 /**
- * Returns a text string giving the prevalence of each infected herd.
+ * Returns a text string giving the prevalence of each infected herd, in the
+ * order of the herd file.
  *
  * @param herds a herd list.
  * @param day the simulation day for which the prevalence is being recorded.
@@ -1983,6 +2620,7 @@ HRD_herd_list_prevalence_to_string (HRD_herd_list_t * herds, unsigned int day)
   unsigned int i;               /* loop counter */
   gboolean first_infected_found;
   int herd_status;
+  HRD_herd_t *herd;
 
   first_infected_found = FALSE;
   nherds = HRD_herd_list_length (herds);
@@ -1991,7 +2629,8 @@ HRD_herd_list_prevalence_to_string (HRD_herd_list_t * herds, unsigned int day)
 
   for (i = 0; i < nherds; i++)
     {
-      herd_status = HRD_herd_list_get (herds, i)->status;
+      herd = HRD_herd_list_get_by_original_index (herds, i);
+      herd_status = herd->state->status;
 
       if ((Latent == herd_status)
           || (InfectiousSubclinical == herd_status) || (InfectiousClinical == herd_status))
@@ -2003,16 +2642,16 @@ HRD_herd_list_prevalence_to_string (HRD_herd_list_t * herds, unsigned int day)
               g_string_sprintf (s, "%i, %s, s%is, %f",  /* The second and third "s"'s in the string look
                                                          * funny, but they're there for a reason. */
                                 day,
-                                HRD_herd_list_get (herds, i)->official_id,
-                                herd_status, HRD_herd_list_get (herds, i)->prevalence);
+                                herd->official_id,
+                                herd_status, herd->state->prevalence);
             }
           else
             {
               g_string_sprintfa (s, "\r\n%i, %s, s%is, %f",     /* The second and third "s"'s in the string look
                                                                  * funny, but they're there for a reason. */
                                  day,
-                                 HRD_herd_list_get (herds, i)->official_id,
-                                 herd_status, HRD_herd_list_get (herds, i)->prevalence);
+                                 herd->official_id,
+                                 herd_status, herd->state->prevalence);
             }
         }
     }
@@ -2086,11 +2725,8 @@ HRD_fprintf_herd_list_summary (FILE * stream, HRD_herd_list_t * herds)
 void
 HRD_reset (HRD_herd_t * herd)
 {
-  herd->status = Susceptible;
-  herd->days_in_status = 0;
-  herd->quarantined = FALSE;
-  herd->in_vaccine_cycle = FALSE;
-  herd->in_disease_cycle = FALSE;
+  HRD_herd_clear_change_requests (herd);
+  memset (herd->state, 0, sizeof (HRD_herd_state_t));
 #ifdef USE_SC_GUILIB
   herd->ever_infected = FALSE;
   herd->day_first_infected = 0;
@@ -2098,7 +2734,154 @@ HRD_reset (HRD_herd_t * herd)
   herd->apparent_status = asUnknown;
   herd->apparent_status_day = 0;
 #endif
-  HRD_herd_clear_change_requests (herd);
+}
+
+
+
+/**
+ * Resets every herd in a list to alive, Susceptible, and not quarantined.
+ * Because the herds' states are stored in one block, this is a single memset
+ * (plus freeing any leftover change requests).
+ *
+ * @param herds a herd list.
+ */
+void
+HRD_herd_list_reset (HRD_herd_list_t * herds)
+{
+  unsigned int nherds, i;
+  HRD_herd_state_t *state;
+#ifdef USE_SC_GUILIB
+  HRD_herd_t *herd;
+#endif
+
+  nherds = HRD_herd_list_length (herds);
+  for (i = 0; i < nherds; i++)
+    {
+      state = &g_array_index (herds->states, HRD_herd_state_t, i);
+      if (state->change_requests != NULL)
+        {
+          g_slist_foreach (state->change_requests, HRD_free_change_request_as_GFunc, NULL);
+          g_slist_free (state->change_requests);
+        }
+#ifdef USE_SC_GUILIB
+      herd = HRD_herd_list_get (herds, i);
+      herd->ever_infected = FALSE;
+      herd->day_first_infected = 0;
+      herd->zone = NULL;
+      herd->apparent_status = asUnknown;
+      herd->apparent_status_day = 0;
+#endif
+    }
+  if (nherds > 0)
+    memset (herds->states->data, 0, nherds * sizeof (HRD_herd_state_t));
+  HRD_calendar_clear (herds->calendar);
+  HRD_herd_list_recount (herds);
+}
+
+
+
+/**
+ * Recomputes the running counts of herds and animals in each state from
+ * scratch.  This is done automatically by HRD_herd_list_reset(); call it
+ * directly only if the herds' states have been set some other way.
+ *
+ * @param herds a herd list.
+ */
+void
+HRD_herd_list_recount (HRD_herd_list_t * herds)
+{
+  HRD_tally_t *tally;
+  unsigned int nherds, nprodtypes, i;
+
+  tally = herds->tally;
+  nprodtypes = herds->production_type_names->len;
+  /* The herd list may hold production type numbers beyond the named ones (for
+   * example, herds made by HRD_new_herd with no name list). */
+  nherds = HRD_herd_list_length (herds);
+  for (i = 0; i < nherds; i++)
+    nprodtypes = MAX (nprodtypes, HRD_herd_list_get (herds, i)->production_type + 1);
+  if (nprodtypes != tally->nprodtypes || tally->nunits_by_prodtype == NULL)
+    {
+      g_free (tally->nunits_by_prodtype);
+      g_free (tally->nanimals_by_prodtype);
+      tally->nprodtypes = nprodtypes;
+      tally->nunits_by_prodtype = g_new (unsigned int, MAX (nprodtypes, 1) * HRD_NSTATES);
+      tally->nanimals_by_prodtype = g_new (unsigned long, MAX (nprodtypes, 1) * HRD_NSTATES);
+    }
+  memset (tally->nunits, 0, sizeof (tally->nunits));
+  memset (tally->nanimals, 0, sizeof (tally->nanimals));
+  memset (tally->nunits_by_prodtype, 0, MAX (nprodtypes, 1) * HRD_NSTATES * sizeof (unsigned int));
+  memset (tally->nanimals_by_prodtype, 0, MAX (nprodtypes, 1) * HRD_NSTATES * sizeof (unsigned long));
+  tally->prevalence_num = 0;
+  tally->prevalence_denom = 0;
+  tally->nprevalent = 0;
+
+  for (i = 0; i < nherds; i++)
+    HRD_tally_herd (HRD_herd_list_get (herds, i), TRUE);
+}
+
+
+
+/**
+ * Checks the running totals of a herd list against a fresh count of its herds.
+ * The counts must match exactly.  The prevalence sum, which is kept by adding
+ * and subtracting doubles, must match to within rounding error.
+ *
+ * @param herds a herd list.
+ * @return TRUE if the running totals are correct.
+ */
+gboolean
+HRD_herd_list_tally_ok (HRD_herd_list_t * herds)
+{
+  HRD_tally_t *tally;
+  HRD_herd_t *herd;
+  unsigned int nunits[HRD_NSTATES];
+  unsigned long nanimals[HRD_NSTATES];
+  unsigned int *nunits_by_prodtype;
+  unsigned long *nanimals_by_prodtype;
+  double prevalence_num;
+  unsigned long prevalence_denom;
+  unsigned int nherds, i, k;
+  gboolean ok;
+
+  tally = herds->tally;
+  memset (nunits, 0, sizeof (nunits));
+  memset (nanimals, 0, sizeof (nanimals));
+  nunits_by_prodtype = g_new0 (unsigned int, MAX (tally->nprodtypes, 1) * HRD_NSTATES);
+  nanimals_by_prodtype = g_new0 (unsigned long, MAX (tally->nprodtypes, 1) * HRD_NSTATES);
+  prevalence_num = 0;
+  prevalence_denom = 0;
+
+  nherds = HRD_herd_list_length (herds);
+  for (i = 0; i < nherds; i++)
+    {
+      herd = HRD_herd_list_get (herds, i);
+      nunits[herd->state->status]++;
+      nanimals[herd->state->status] += herd->size;
+      if (herd->production_type < tally->nprodtypes)
+        {
+          k = herd->production_type * HRD_NSTATES + herd->state->status;
+          nunits_by_prodtype[k]++;
+          nanimals_by_prodtype[k] += herd->size;
+        }
+      if (HRD_infected_status (herd->state->status))
+        {
+          prevalence_num += herd->size * herd->state->prevalence;
+          prevalence_denom += herd->size;
+        }
+    }
+
+  ok = (memcmp (nunits, tally->nunits, sizeof (nunits)) == 0
+        && memcmp (nanimals, tally->nanimals, sizeof (nanimals)) == 0
+        && prevalence_denom == tally->prevalence_denom
+        && fabs (prevalence_num - tally->prevalence_num) <= 1e-9 * MAX (prevalence_denom, 1));
+  for (k = 0; ok && k < tally->nprodtypes * HRD_NSTATES; k++)
+    ok = (nunits_by_prodtype[k] == tally->nunits_by_prodtype[k]
+          && nanimals_by_prodtype[k] == tally->nanimals_by_prodtype[k]);
+
+  g_free (nunits_by_prodtype);
+  g_free (nanimals_by_prodtype);
+  return ok;
 }
 
 
@@ -2134,29 +2917,39 @@ HRD_reset (HRD_herd_t * herd)
  *     vaccine) are processed last.
  * </ol>
  *
+ * Delayed transitions are stored as the day on which they happen, so a herd
+ * only needs to be stepped on days when it has pending requests, a transition
+ * due, or (if it has a prevalence chart) a changing prevalence.  Normally
+ * herds are stepped through HRD_herd_list_step(), which uses the herd list's
+ * calendar to find them.
+ *
  * @param herd a herd.
+ * @param day the current simulation day.
  * @param infectious_herds the set of infectious herds.
  */
 void
-HRD_step (HRD_herd_t * herd, GHashTable *infectious_herds)
+HRD_step (HRD_herd_t * herd, int day, HRD_herd_set_t *infectious_herds)
 {
+  HRD_herd_state_t *state;
   HRD_status_t old_state;
   GSList *iter;
   HRD_change_request_t *request;
+  int next_day;
 
 #if DEBUG
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER HRD_step");
 #endif
 
-  old_state = herd->status;
-  herd->days_in_status++;
+  state = herd->state;
+  old_state = state->status;
+  state->wake_day = 0;
 
   /* Apply requested changes in the order in which they occur. */
 
-  for (iter = herd->change_requests; iter != NULL; iter = g_slist_next (iter))
+  for (iter = state->change_requests; iter != NULL; iter = g_slist_next (iter))
     {
       request = (HRD_change_request_t *) (iter->data);
-      HRD_apply_change_request (herd, request, infectious_herds);
+      HRD_apply_change_request (herd, request, day, infectious_herds);
     }
   HRD_herd_clear_change_requests (herd);
 
@@ -2164,78 +2957,110 @@ HRD_step (HRD_herd_t * herd, GHashTable *infectious_herds)
    * trumps an order to lift quarantine. */
 
   /* Take any delayed transitions. */
-  if (herd->in_vaccine_cycle)
+  if (state->in_vaccine_cycle)
     {
-      if (herd->immunity_start_countdown-- == 0)
-        HRD_change_state (herd, VaccineImmune, infectious_herds);
-      if (herd->immunity_end_countdown-- == 0)
+      if (state->immunity_start_day == day)
+        HRD_change_state (herd, VaccineImmune, day, infectious_herds);
+      if (state->immunity_end_day == day)
         {
-          HRD_change_state (herd, Susceptible, infectious_herds);
-          herd->in_vaccine_cycle = FALSE;
+          HRD_change_state (herd, Susceptible, day, infectious_herds);
+          state->in_vaccine_cycle = FALSE;
         }
     }
 
-  if (herd->in_disease_cycle)
+  if (state->in_disease_cycle)
     {
-      if (herd->immunity_start_countdown > 0)
+      if (state->immunity_start_day > day)
         {
           if (herd->prevalence_curve == NULL)
             {
-              herd->prevalence = 1;
+              HRD_herd_set_prevalence (herd, 1);
 #if DEBUG
               g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "prevalence = 1");
 #endif
             }
           else
             {
-              herd->prevalence = REL_chart_lookup ((0.5 + herd->day_in_disease_cycle) /
-                                                   (herd->day_in_disease_cycle +
-                                                    herd->immunity_start_countdown),
-                                                   herd->prevalence_curve);
+              HRD_herd_set_prevalence (herd,
+                REL_chart_lookup ((0.5 + day - state->disease_start_day) /
+                                  (state->immunity_start_day - state->disease_start_day),
+                                  herd->prevalence_curve));
 #if DEBUG
               g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
-                     "prevalence = lookup((%i+0.5)/(%i+%i))=%g",
-                     herd->day_in_disease_cycle,
-                     herd->day_in_disease_cycle, herd->immunity_start_countdown, herd->prevalence);
+                     "prevalence = lookup((%i+0.5)/%i)=%g",
+                     day - state->disease_start_day,
+                     state->immunity_start_day - state->disease_start_day,
+                     state->prevalence);
 #endif
             }
         }
       else
         {
-          herd->prevalence = 0;
+          HRD_herd_set_prevalence (herd, 0);
 #if DEBUG
           g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "prevalence = 0");
 #endif
         }
 
-      herd->day_in_disease_cycle++;
-      if (herd->infectious_start_countdown-- == 0)
-        HRD_change_state (herd, InfectiousSubclinical, infectious_herds);
-      if (herd->clinical_start_countdown-- == 0)
-        HRD_change_state (herd, InfectiousClinical, infectious_herds);
-      if (herd->immunity_start_countdown-- == 0)
-        HRD_change_state (herd, NaturallyImmune, infectious_herds);
+      if (state->infectious_start_day == day)
+        HRD_change_state (herd, InfectiousSubclinical, day, infectious_herds);
+      if (state->clinical_start_day == day)
+        HRD_change_state (herd, InfectiousClinical, day, infectious_herds);
+      if (state->immunity_start_day == day)
+        HRD_change_state (herd, NaturallyImmune, day, infectious_herds);
       /* in Riverton, "natural immunity" (i.e., dead from disease) is permanent,
-       * so this countdown should not be used. */   
-      if (herd->immunity_end_countdown-- == 0)
+       * so this transition should not be used. */   
+      if (state->immunity_end_day == day)
         {
           #ifdef RIVERTON
             /* Do not change the herd state. 
-             * Instead, prolong the length of the countdown.
-             * (In effect, this countdown will never end.) */
-            herd->immunity_end_countdown = herd->immunity_end_countdown + 365;
+             * Instead, postpone the end of immunity.
+             * (In effect, immunity will never end.) */
+            state->immunity_end_day += 365;
           #else
-            HRD_change_state (herd, Susceptible, infectious_herds);
-            herd->in_disease_cycle = FALSE;
+            HRD_change_state (herd, Susceptible, day, infectious_herds);
+            state->in_disease_cycle = FALSE;
           #endif
         }   
     }
 
-  if (herd->status != old_state)
+  /* Put the herd back in the calendar for its next transition.  A herd with a
+   * prevalence chart also needs its prevalence updated every day until it
+   * becomes immune. */
+  next_day = 0;
+  if (state->in_vaccine_cycle || state->in_disease_cycle)
+    {
+      if (state->in_disease_cycle)
+        {
+          if (herd->prevalence_curve != NULL && state->immunity_start_day > day)
+            next_day = day + 1;
+          else
+            {
+              if (state->infectious_start_day > day)
+                next_day = state->infectious_start_day;
+              if (state->clinical_start_day > day
+                  && (next_day == 0 || state->clinical_start_day < next_day))
+                next_day = state->clinical_start_day;
+            }
+        }
+      if (next_day != day + 1)
+        {
+          if (state->immunity_start_day > day
+              && (next_day == 0 || state->immunity_start_day < next_day))
+            next_day = state->immunity_start_day;
+          if (state->immunity_end_day > day
+              && (next_day == 0 || state->immunity_end_day < next_day))
+            next_day = state->immunity_end_day;
+        }
+    }
+  if (next_day != 0)
+    HRD_herd_wake_on (herd, next_day);
+
+  if (state->status != old_state)
     {
       HRD_update_t update;
-      update.herd_index = herd->index;
-      update.status = (NAADSM_disease_state) herd->status;
+      update.herd_index = herd->original_index;
+      update.status = (NAADSM_disease_state) state->status;
 #ifdef USE_SC_GUILIB
       sc_change_herd_state ( herd, update );
 #else
@@ -2253,6 +3078,114 @@ HRD_step (HRD_herd_t * herd, GHashTable *infectious_herds)
 
 
 
+/**
+ * Compares two herd indices.  Used to sort the herds due on a day and the
+ * members of a herd set.
+ *
+ * @param a a pointer to an unsigned int, cast to a gconstpointer.
+ * @param b a pointer to an unsigned int, cast to a gconstpointer.
+ * @return a negative number if a comes before b, 0 if they are equal, or a
+ *   positive number if a comes after b.
+ */
+static gint
+HRD_compare_indices (gconstpointer a, gconstpointer b)
+{
+  unsigned int ia, ib;
+
+  ia = *((unsigned int *) a);
+  ib = *((unsigned int *) b);
+  return (ia > ib) - (ia < ib);
+}
+
+
+
+/**
+ * Steps all the herds that are due on a given day: herds with pending change
+ * requests and herds with a delayed transition (or a prevalence change) on
+ * that day.  The herds are stepped in the order in which they appear in the
+ * list, the same order as if every herd were stepped.
+ *
+ * @param herds a herd list.
+ * @param day the current simulation day.  Days must be stepped in increasing
+ *   order, and no day that has herds due may be skipped.
+ * @param infectious_herds the set of infectious herds.
+ */
+void
+HRD_herd_list_step (HRD_herd_list_t * herds, int day, HRD_herd_set_t *infectious_herds)
+{
+  HRD_calendar_t *calendar;
+  GArray *slot;
+  unsigned int n, i, nkept, herd_index;
+  int wake_day;
+
+#if DEBUG
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER HRD_herd_list_step");
+#endif
+
+  calendar = herds->calendar;
+  calendar->day = day;
+
+  /* Pull out the herds due today.  Entries for a later lap around the calendar
+   * stay in the slot; stale entries (for herds that were stepped earlier than
+   * first planned) are dropped.  Clearing wake_day as we go ensures that a
+   * herd listed twice is only stepped once. */
+  slot = calendar->slot[day % HRD_CALENDAR_SIZE];
+  g_array_set_size (calendar->due, 0);
+  n = slot->len;
+  nkept = 0;
+  for (i = 0; i < n; i++)
+    {
+      herd_index = g_array_index (slot, unsigned int, i);
+      wake_day = HRD_herd_list_get (herds, herd_index)->state->wake_day;
+      if (wake_day == day)
+        {
+          g_array_append_val (calendar->due, herd_index);
+          HRD_herd_list_get (herds, herd_index)->state->wake_day = 0;
+        }
+      else if (wake_day > day && wake_day % HRD_CALENDAR_SIZE == day % HRD_CALENDAR_SIZE)
+        g_array_index (slot, unsigned int, nkept++) = herd_index;
+    }
+  g_array_set_size (slot, nkept);
+
+  g_array_sort (calendar->due, HRD_compare_indices);
+  n = calendar->due->len;
+  for (i = 0; i < n; i++)
+    HRD_step (HRD_herd_list_get (herds, g_array_index (calendar->due, unsigned int, i)),
+              day, infectious_herds);
+
+#if DEBUG
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- EXIT HRD_herd_list_step");
+#endif
+}
+
+
+
+/**
+ * Returns the earliest day after the given one on which some herd may be due
+ * to be stepped.  The answer may be early (a calendar slot can hold herds due
+ * on a later lap around the calendar) but is never late, so stepping only on
+ * the days this function returns never misses a transition.
+ *
+ * @param herds a herd list.
+ * @param day the current simulation day.
+ * @return the next day on which HRD_herd_list_step() has work to do, or
+ *   G_MAXINT if no herd has a transition coming.
+ */
+int
+HRD_herd_list_next_wake_day (HRD_herd_list_t * herds, int day)
+{
+  HRD_calendar_t *calendar;
+  int i;
+
+  calendar = herds->calendar;
+  for (i = 1; i <= HRD_CALENDAR_SIZE; i++)
+    if (calendar->slot[(day + i) % HRD_CALENDAR_SIZE]->len > 0)
+      return day + i;
+  return G_MAXINT;
+}
+
+
+
 /**
  * Infects a herd with a disease.
  *
@@ -2340,6 +3273,153 @@ HRD_destroy (HRD_herd_t * herd)
 
 
 
+/**
+ * Creates a new, empty herd set.
+ *
+ * @param nherds the number of herds in the list the set's herds come from.
+ *   The set grows if it is given a higher herd index than this, so 0 is
+ *   allowed.
+ * @return a newly-allocated herd set.
+ */
+HRD_herd_set_t *
+HRD_new_herd_set (unsigned int nherds)
+{
+  HRD_herd_set_t *set;
+  unsigned int i;
+
+  set = g_new (HRD_herd_set_t, 1);
+  set->members = g_array_new (FALSE, FALSE, sizeof (unsigned int));
+  set->capacity = nherds;
+  set->position = g_new (unsigned int, MAX (nherds, 1));
+  for (i = 0; i < nherds; i++)
+    set->position[i] = HRD_NOT_IN_SET;
+  set->sorted = TRUE;
+  return set;
+}
+
+
+
+/**
+ * Deletes a herd set from memory.
+ *
+ * @param set a herd set.
+ */
+void
+HRD_free_herd_set (HRD_herd_set_t * set)
+{
+  if (set == NULL)
+    return;
+  g_array_free (set->members, TRUE);
+  g_free (set->position);
+  g_free (set);
+}
+
+
+
+/**
+ * Adds a herd to a herd set.  Adding a herd that is already in the set has no
+ * effect.
+ *
+ * @param set a herd set.
+ * @param herd_index the index of the herd to add.
+ */
+void
+HRD_herd_set_add (HRD_herd_set_t * set, unsigned int herd_index)
+{
+  unsigned int new_capacity, i;
+
+  if (herd_index >= set->capacity)
+    {
+      new_capacity = MAX (herd_index + 1, 2 * set->capacity);
+      set->position = g_renew (unsigned int, set->position, new_capacity);
+      for (i = set->capacity; i < new_capacity; i++)
+        set->position[i] = HRD_NOT_IN_SET;
+      set->capacity = new_capacity;
+    }
+  else if (set->position[herd_index] != HRD_NOT_IN_SET)
+    return;
+
+  if (set->sorted && set->members->len > 0
+      && herd_index < g_array_index (set->members, unsigned int, set->members->len - 1))
+    set->sorted = FALSE;
+  set->position[herd_index] = set->members->len;
+  g_array_append_val (set->members, herd_index);
+}
+
+
+
+/**
+ * Removes a herd from a herd set.  The last member of the set takes the
+ * removed herd's place.  Removing a herd that is not in the set has no effect.
+ *
+ * @param set a herd set.
+ * @param herd_index the index of the herd to remove.
+ */
+void
+HRD_herd_set_remove (HRD_herd_set_t * set, unsigned int herd_index)
+{
+  unsigned int pos, last;
+
+  if (!HRD_herd_set_contains (set, herd_index))
+    return;
+  pos = set->position[herd_index];
+  last = set->members->len - 1;
+  if (pos != last)
+    {
+      g_array_index (set->members, unsigned int, pos) =
+        g_array_index (set->members, unsigned int, last);
+      set->position[g_array_index (set->members, unsigned int, pos)] = pos;
+      set->sorted = FALSE;
+    }
+  g_array_set_size (set->members, last);
+  set->position[herd_index] = HRD_NOT_IN_SET;
+}
+
+
+
+/**
+ * Empties a herd set.  This takes time proportional to the number of members,
+ * not to the number of herds.
+ *
+ * @param set a herd set.
+ */
+void
+HRD_herd_set_clear (HRD_herd_set_t * set)
+{
+  unsigned int i;
+
+  for (i = 0; i < set->members->len; i++)
+    set->position[g_array_index (set->members, unsigned int, i)] = HRD_NOT_IN_SET;
+  g_array_set_size (set->members, 0);
+  set->sorted = TRUE;
+}
+
+
+
+/**
+ * Puts the members of a herd set in increasing order of herd index, so that
+ * sub-models that go through the set draw random numbers in a fixed order.
+ * The order is kept until a herd other than the last is removed or a herd is
+ * added out of order, so calling this again when nothing has changed costs
+ * nothing.
+ *
+ * @param set a herd set.
+ */
+void
+HRD_herd_set_sort (HRD_herd_set_t * set)
+{
+  unsigned int i;
+
+  if (set->sorted)
+    return;
+  g_array_sort (set->members, HRD_compare_indices);
+  for (i = 0; i < set->members->len; i++)
+    set->position[g_array_index (set->members, unsigned int, i)] = i;
+  set->sorted = TRUE;
+}
+
+
+
 /**
  * Removes a herd from the infectious list.
  *
@@ -2348,10 +3428,10 @@ HRD_destroy (HRD_herd_t * herd)
  */
 void
 HRD_remove_herd_from_infectious_list( HRD_herd_t *herd,
-                                      GHashTable *infectious_herds )
+                                      HRD_herd_set_t *infectious_herds )
 {
   if ( ( herd != NULL ) && ( infectious_herds != NULL ) )
-    g_hash_table_remove( infectious_herds, GUINT_TO_POINTER(herd->index) );
+    HRD_herd_set_remove( infectious_herds, herd->index );
 }
 
 
@@ -2364,13 +3444,10 @@ HRD_remove_herd_from_infectious_list( HRD_herd_t *herd,
  */
 void
 HRD_add_herd_to_infectious_list( HRD_herd_t *herd,
-                                 GHashTable *infectious_herds )
+                                 HRD_herd_set_t *infectious_herds )
 {
   if ( ( herd != NULL ) && ( infectious_herds != NULL ) )
-  {
-    if ( g_hash_table_lookup( infectious_herds, GUINT_TO_POINTER(herd->index) ) == NULL )
-      g_hash_table_insert( infectious_herds, GUINT_TO_POINTER(herd->index), (gpointer)herd );
-  };
+    HRD_herd_set_add( infectious_herds, herd->index );
 }
 
 
@@ -2394,7 +3471,7 @@ HRD_herd_list_get_by_status (HRD_herd_list_t * herds, HRD_status_t status, HRD_h
   /* Count the herds with the given status. */
   nherds = HRD_herd_list_length (herds);
   for (i = 0; i < nherds; i++)
-    if (HRD_herd_list_get (herds, i)->status == status)
+    if (HRD_herd_list_get (herds, i)->state->status == status)
       count++;
 
   if (count == 0)
@@ -2407,7 +3484,7 @@ HRD_herd_list_get_by_status (HRD_herd_list_t * herds, HRD_status_t status, HRD_h
       for (i = 0; i < nherds; i++)
         {
           herd = HRD_herd_list_get (herds, i);
-          if (herd->status == status)
+          if (herd->state->status == status)
             (*list)[count++] = herd;
         }
     }
@@ -88,6 +88,22 @@ HRD_status_t;
 extern const char *HRD_status_name[];
 
 
+/**
+ * Orders in which the herds in a list can be stored.  Storing herds that are
+ * close together on the map close together in memory makes spatial searches,
+ * and the work done on the herds they find, friendlier to the cache.
+ *
+ * @sa HRD_herd_list_reorder
+ */
+typedef enum
+{
+  HRD_FileOrder, /**< the order of the herd file */
+  HRD_MortonOrder, /**< along a Morton (Z-order) curve */
+  HRD_HilbertOrder /**< along a Hilbert curve */
+}
+HRD_herd_order_t;
+
+
 typedef enum
 {
   asUnspecified, asUnknown, asDetected, asTraceDirect, asTraceIndirect, asVaccinated, asDestroyed
@@ -179,14 +195,125 @@ HRD_change_request_t;
 
 
 
+/**
+ * A free list of change request structures, recycled the same way as events
+ * (see EVT_event_pool_t).
+ */
+typedef struct
+{
+  gpointer free_list; /**< deleted requests, linked through their first word */
+  unsigned int nfree; /**< number of requests on the free list */
+  unsigned int nin_use; /**< number of requests handed out and not yet deleted */
+  unsigned int high_water; /**< largest value nin_use has reached */
+  unsigned long nallocated; /**< requests that had to come from the allocator */
+  unsigned long nreused; /**< requests that were taken from the free list */
+}
+HRD_change_request_pool_t;
+
+
+
 /** Type of a herd's identifier. */
 typedef char *HRD_id_t;
 
 
-/** Complete state information for a herd. */
+/**
+ * Number of slots in the herd transition calendar.  Transitions further ahead
+ * than this wrap around and simply wait in their slot for a later lap.
+ */
+#define HRD_CALENDAR_SIZE 64
+
+/**
+ * A calendar (timing wheel) of the days on which herds need to be stepped.
+ * Slot d % HRD_CALENDAR_SIZE holds the indices of herds that are due on day d,
+ * so that the midnight processing only has to look at the herds that have
+ * pending change requests or delayed transitions.
+ */
+typedef struct
+{
+  GArray *slot[HRD_CALENDAR_SIZE]; /**< Each item is a herd index (unsigned
+    int).  Entries may be stale; the herd's wake_day is authoritative. */
+  GArray *due; /**< The herds stepped on the most recent day, in order.
+    Left in place after stepping, so that callers can see which herds may
+    have changed state. */
+  int day; /**< The day most recently stepped. */
+}
+HRD_calendar_t;
+
+
+
+/**
+ * Running totals of the herds and animals in each state.  These are updated
+ * as herds change state, so that the daily counts cost nothing to look up.
+ * The totals are valid after HRD_herd_list_reset() or HRD_herd_list_recount()
+ * has been called on the herd list.
+ */
+typedef struct
+{
+  unsigned int nunits[HRD_NSTATES];
+  unsigned long nanimals[HRD_NSTATES];
+  unsigned int nprodtypes;
+  unsigned int *nunits_by_prodtype; /**< nprodtypes x HRD_NSTATES counts,
+    indexed by production_type * HRD_NSTATES + status. */
+  unsigned long *nanimals_by_prodtype; /**< Same layout as nunits_by_prodtype. */
+  double prevalence_num; /**< Sum of size x prevalence over infected (Latent
+    or Infectious) herds. */
+  unsigned long prevalence_denom; /**< Sum of size over infected herds. */
+  unsigned int nprevalent; /**< Number of infected herds with non-zero
+    prevalence.  When this drops to 0, prevalence_num is set back to exactly 0
+    so that rounding errors do not accumulate. */
+}
+HRD_tally_t;
+
+
+
+/**
+ * The parts of a herd's state that change during an iteration.  These are kept
+ * apart from the rest of the herd structure so that the states of all the
+ * herds in a list sit in one contiguous block, which can be cleared with a
+ * single memset at the start of an iteration.  Every field is zero in the
+ * initial (Susceptible, not quarantined) state.
+ *
+ * Sub-models may read the status and prevalence; the remaining fields should
+ * be considered private.
+ */
+typedef struct
+{
+  HRD_status_t status;
+  double prevalence;
+
+  gboolean quarantined;
+  int status_day; /**< day on which the herd entered its current status */
+
+  /* Delayed transitions are stored as the (absolute) day on which they
+   * happen.  0 means the transition will not happen. */
+  gboolean in_vaccine_cycle;
+  gboolean in_disease_cycle;
+  int disease_start_day; /**< day 0 of the disease cycle.  May be earlier than
+    the first day of the simulation for an initially infected herd. */
+  int infectious_start_day;
+  int clinical_start_day;
+  int immunity_start_day; /**< used by both the vaccine and disease cycles */
+  int immunity_end_day; /**< used by both the vaccine and disease cycles */
+
+  int wake_day; /**< next day on which the herd is due in the calendar, or 0 */
+  GSList *change_requests;
+}
+HRD_herd_state_t;
+
+
+
+/**
+ * Complete information for a herd.  The fields in this structure are fixed
+ * once the herd list is loaded; the herd's changing state is reached through
+ * the state pointer.
+ */
 typedef struct
 {
   unsigned int index;           /**< position in a herd list */
+  unsigned int original_index;  /**< position in the herd file.  The same as
+    index unless the list was reordered with HRD_herd_list_reorder().  Anything
+    that reports a herd to the outside world (output variables, the GUI) should
+    use this. */
   HRD_production_type_t production_type;  
   char *production_type_name;
   HRD_id_t official_id;         /**< arbitrary identifier string */
@@ -194,29 +321,20 @@ typedef struct
   double latitude, longitude;
   double x;                     /**< x-coordinate on a km grid */
   double y;                     /**< y-coordinate on a km grid */
-  HRD_status_t status;
   HRD_status_t initial_status;
   int days_in_initial_status;
   int days_left_in_initial_status;
-  double prevalence;
 
-  /* Remaining fields should be considered private. */
+  HRD_herd_state_t *state;      /**< the herd's current state.  For a herd in
+    a herd list, this points into the list's block of states. */
+  HRD_calendar_t *calendar;     /**< the calendar of the herd list this herd
+    belongs to, or NULL for a herd that is not in a list. */
+  HRD_tally_t *tally;           /**< the state counts of the herd list this
+    herd belongs to, or NULL for a herd that is not in a list. */
 
-  gboolean quarantined;
-  int days_in_status;
-
-  gboolean in_vaccine_cycle;
-  int immunity_start_countdown;
-  int immunity_end_countdown;
+  /* Remaining fields should be considered private. */
 
-  gboolean in_disease_cycle;
-  int day_in_disease_cycle;
-  int infectious_start_countdown;
-  int clinical_start_countdown;   
-  
   REL_chart_t *prevalence_curve;
-
-  GSList *change_requests;
   
 #ifdef USE_SC_GUILIB  
   /*  This field is used on the NAADSM-SC version if the user wants to 
@@ -241,6 +359,10 @@ HRD_herd_t;
 typedef struct
 {
   GArray *list; /**< Each item is a HRD_herd_t structure. */
+  GArray *states; /**< Each item is a HRD_herd_state_t structure, in the same
+    order as the herds in list. */
+  HRD_calendar_t *calendar; /**< Days on which herds are due to be stepped. */
+  HRD_tally_t *tally; /**< Counts of herds in each state. */
   GPtrArray *production_type_names; /**< Each pointer is to a regular C string. */
   
 #ifdef USE_SC_GUILIB  
@@ -252,20 +374,59 @@ typedef struct
   GPtrArray *production_types;  /**< Each item is a HRD_production_type_data_t structure */
 #endif   
 
-  spatial_search_t *spatial_index;
+  spatial_search_t *spatial_index; /**< An index of every herd. */
+  spatial_search_t *live_index; /**< A view of spatial_index from which
+    destroyed herds are removed during an iteration.  Each copy made by
+    HRD_clone_herd_list() needs its own.  See naadsm_new_live_indexes() in
+    model_util.h. */
+
+  unsigned int *by_original_index; /**< For each position in the herd file,
+    the position of that herd in list.  NULL if the list is in file order. */
 
   projPJ projection; /**< The projection used to convert between the latitude,
     longitude and x,y locations of the herds.  Note that the projection object
     works in meters, while the x,y locations are stored in kilometers. */
+
+  gboolean is_clone; /**< TRUE if this list was made by HRD_clone_herd_list()
+    and shares its ids, names, spatial index and projection with another
+    list. */
 }
 HRD_herd_list_t;
 
 
 
+/**
+ * A set of herds, such as the herds that are currently Latent or Infectious.
+ * The members are packed together in an array and each herd's position in
+ * that array is recorded, so adding, removing and testing for a herd take
+ * constant time, and going through the set touches only the members.
+ * Removing a herd moves the last member into its place, so the members are in
+ * no particular order unless HRD_herd_set_sort() is called.
+ */
+typedef struct
+{
+  GArray *members; /**< The indices (unsigned ints) of the herds in the set. */
+  unsigned int *position; /**< For each herd index, that herd's position in
+    <i>members</i>, or HRD_NOT_IN_SET. */
+  unsigned int capacity; /**< The length of <i>position</i>. */
+  gboolean sorted; /**< TRUE if <i>members</i> is known to be in increasing
+    order. */
+}
+HRD_herd_set_t;
+
+#define HRD_NOT_IN_SET G_MAXUINT
+
+
+
 /* Prototypes. */
 
 HRD_herd_list_t *HRD_new_herd_list (void);
 
+HRD_change_request_pool_t *HRD_new_change_request_pool (void);
+void HRD_set_change_request_pool (HRD_change_request_pool_t *);
+char *HRD_change_request_pool_to_string (HRD_change_request_pool_t *);
+void HRD_free_change_request_pool (HRD_change_request_pool_t *);
+
 #ifdef USE_SC_GUILIB 
   HRD_herd_list_t *HRD_load_herd_list ( const char *filename, GPtrArray *production_types );
   HRD_herd_list_t *HRD_load_herd_list_from_stream (FILE *stream, const char *filename, GPtrArray *production_types);  
@@ -275,6 +436,7 @@ HRD_herd_list_t *HRD_new_herd_list (void);
 #endif
 
 
+HRD_herd_list_t *HRD_clone_herd_list (HRD_herd_list_t *);
 void HRD_free_herd_list (HRD_herd_list_t *);
 unsigned int HRD_herd_list_append (HRD_herd_list_t *, HRD_herd_t *);
 
@@ -286,6 +448,15 @@ unsigned int HRD_herd_list_append (HRD_herd_list_t *, HRD_herd_t *);
  */
 #define HRD_herd_list_length(H) (H->list->len)
 
+/**
+ * Returns the number of days a herd has spent in its current state.
+ *
+ * @param H a herd.
+ * @param D the current simulation day.
+ * @return the number of days.
+ */
+#define HRD_days_in_status(H,D) ((D) - (H)->state->status_day)
+
 /**
  * Returns the ith herd in a herd list.
  *
@@ -295,9 +466,22 @@ unsigned int HRD_herd_list_append (HRD_herd_list_t *, HRD_herd_t *);
  */
 #define HRD_herd_list_get(H,I) (&g_array_index(H->list,HRD_herd_t,I))
 
+/**
+ * Returns the herd that was ith in the herd file, which may not be the ith
+ * herd in the list if the list has been reordered.
+ *
+ * @param H a herd list.
+ * @param I the position in the herd file of the herd to retrieve.
+ * @return the herd.
+ */
+#define HRD_herd_list_get_by_original_index(H,I) \
+  ((H)->by_original_index == NULL ? HRD_herd_list_get(H,I) \
+   : HRD_herd_list_get(H,(H)->by_original_index[I]))
+
 unsigned int HRD_herd_list_get_by_status (HRD_herd_list_t *, HRD_status_t, HRD_herd_t ***);
 unsigned int HRD_herd_list_get_by_initial_status (HRD_herd_list_t *, HRD_status_t, HRD_herd_t ***);
 void HRD_herd_list_project (HRD_herd_list_t *, projPJ);
+void HRD_herd_list_reorder (HRD_herd_list_t *, HRD_herd_order_t);
 void HRD_herd_list_build_spatial_index (HRD_herd_list_t *);
 char *HRD_herd_list_to_string (HRD_herd_list_t *);
 int HRD_printf_herd_list (HRD_herd_list_t *);
@@ -316,7 +500,12 @@ int HRD_fprintf_herd (FILE *, HRD_herd_t *);
 #define HRD_printf_herd(H) HRD_fprintf_herd(stdout,H)
 
 void HRD_reset (HRD_herd_t *);
-void HRD_step (HRD_herd_t *, GHashTable *infectious_herds);
+void HRD_herd_list_reset (HRD_herd_list_t *);
+void HRD_herd_list_recount (HRD_herd_list_t *);
+gboolean HRD_herd_list_tally_ok (HRD_herd_list_t *);
+void HRD_step (HRD_herd_t *, int day, HRD_herd_set_t *infectious_herds);
+void HRD_herd_list_step (HRD_herd_list_t *, int day, HRD_herd_set_t *infectious_herds);
+int HRD_herd_list_next_wake_day (HRD_herd_list_t *, int day);
 void HRD_infect (HRD_herd_t *, int latent_period,
                  int infectious_subclinical_period,
                  int infectious_clinical_period,
@@ -327,7 +516,41 @@ void HRD_quarantine (HRD_herd_t *);
 void HRD_lift_quarantine (HRD_herd_t *);
 void HRD_destroy (HRD_herd_t *);
 
-void HRD_remove_herd_from_infectious_list( HRD_herd_t *, GHashTable * ); 
-void HRD_add_herd_to_infectious_list( HRD_herd_t *, GHashTable * );   
+HRD_herd_set_t *HRD_new_herd_set (unsigned int nherds);
+void HRD_free_herd_set (HRD_herd_set_t *);
+void HRD_herd_set_add (HRD_herd_set_t *, unsigned int herd_index);
+void HRD_herd_set_remove (HRD_herd_set_t *, unsigned int herd_index);
+void HRD_herd_set_clear (HRD_herd_set_t *);
+void HRD_herd_set_sort (HRD_herd_set_t *);
+
+/**
+ * Returns the number of herds in a herd set.
+ *
+ * @param S a herd set.
+ * @return the number of herds in the set.
+ */
+#define HRD_herd_set_length(S) ((S)->members->len)
+
+/**
+ * Returns the index of the ith herd in a herd set.
+ *
+ * @param S a herd set.
+ * @param I a position in the set, from 0 to HRD_herd_set_length(S) - 1.
+ * @return a herd index.
+ */
+#define HRD_herd_set_get(S,I) (g_array_index((S)->members,unsigned int,I))
+
+/**
+ * Returns whether a herd is in a herd set.
+ *
+ * @param S a herd set.
+ * @param I a herd index.
+ * @return TRUE if the herd is in the set.
+ */
+#define HRD_herd_set_contains(S,I) \
+  ((I) < (S)->capacity && (S)->position[I] != HRD_NOT_IN_SET)
+
+void HRD_remove_herd_from_infectious_list( HRD_herd_t *, HRD_herd_set_t * ); 
+void HRD_add_herd_to_infectious_list( HRD_herd_t *, HRD_herd_set_t * );   
 
 #endif /* !HERD_H */
@@ -49,6 +49,12 @@
  *     Step forward one day.  The output of this command is a space-separated
  *     list of the herd statuses.
  *   <li>
+ *     <code>infectious</code>
+ *
+ *     Prints the set of Latent or Infectious herds, as a space-separated list
+ *     of herd numbers in increasing order.  The list is empty if no herds are
+ *     Latent or Infectious.
+ *   <li>
  *     <code>reset</code>
  *
  *     Erase all currently entered herds.
@@ -82,11 +88,11 @@ int yyerror (char const *s);
 char errmsg[BUFFERSIZE];
 
 HRD_herd_list_t *current_herds = NULL;
+int current_day = 0;
 GPtrArray *production_type_names = NULL;
-GHashTable *dummy; /* The HRD_step function, which advances a herd's state, has
-  as an argument a hash table of infectious herds, which is updated at the same
-  time as the state change.  In this small test program, we don't need to do
-  that, but we still need a hash table to pass to HRD_step. */
+HRD_herd_set_t *infectious_herds; /* The HRD_herd_list_step function, which
+  advances a herd's state, has as an argument the set of infectious herds,
+  which is updated at the same time as the state change. */
 
 
 void g_free_as_GFunc (gpointer data, gpointer user_data);
@@ -99,7 +105,7 @@ void g_free_as_GFunc (gpointer data, gpointer user_data);
   GSList *lval;
 }
 
-%token HERD INFECT VACCINATE DESTROY STEP RESET
+%token HERD INFECT VACCINATE DESTROY STEP INFECTIOUS RESET
 %token INT FLOAT STRING
 %token LPAREN RPAREN COMMA
 %token <ival> INT
@@ -119,6 +125,7 @@ command :
   | vaccinate_command
   | destroy_command
   | step_command
+  | infectious_command
   | reset_command
   ;
 
@@ -142,7 +149,7 @@ new_command :
       HRD_herd_list_append (current_herds, herd);
       
       HRD_printf_herd (herd);
-      free (herd);
+      HRD_free_herd (herd, FALSE);
       printf ("\n%s", PROMPT);
       fflush (stdout);
     }
@@ -187,12 +194,26 @@ step_command :
       nherds = HRD_herd_list_length (current_herds);
       g_assert (nherds > 0);
       
-      for (i = 0; i < nherds; i++)
-	HRD_step (HRD_herd_list_get (current_herds, i), dummy);
+      HRD_herd_list_step (current_herds, ++current_day, infectious_herds);
+      /* The running state counts must agree with a fresh count. */
+      g_assert (HRD_herd_list_tally_ok (current_herds));
 
-      printf ("%s", HRD_status_name[HRD_herd_list_get (current_herds, 0)->status]);
+      printf ("%s", HRD_status_name[HRD_herd_list_get (current_herds, 0)->state->status]);
       for (i = 1; i < nherds; i++)
-        printf (" %s",  HRD_status_name[HRD_herd_list_get (current_herds, i)->status]);
+        printf (" %s",  HRD_status_name[HRD_herd_list_get (current_herds, i)->state->status]);
+      printf ("\n%s", PROMPT);
+      fflush (stdout);
+    }
+  ;
+
+infectious_command :
+    INFECTIOUS
+    {
+      unsigned int i;
+
+      HRD_herd_set_sort (infectious_herds);
+      for (i = 0; i < HRD_herd_set_length (infectious_herds); i++)
+        printf (i == 0 ? "%u" : " %u", HRD_herd_set_get (infectious_herds, i));
       printf ("\n%s", PROMPT);
       fflush (stdout);
     }
@@ -203,6 +224,8 @@ reset_command :
     {
       HRD_free_herd_list (current_herds);
       current_herds = HRD_new_herd_list ();
+      HRD_herd_set_clear (infectious_herds);
+      current_day = 0;
       printf ("%s", PROMPT);
       fflush (stdout);
     }
@@ -268,7 +291,7 @@ main (int argc, char *argv[])
 
   current_herds = HRD_new_herd_list ();
   production_type_names = g_ptr_array_new ();
-  dummy = g_hash_table_new (g_direct_hash, g_direct_equal);
+  infectious_herds = HRD_new_herd_set (0);
 
   printf (PROMPT);
   if (yyin == NULL)
@@ -91,12 +91,14 @@
 #define is_listening_for airborne_spread_exponential_model_is_listening_for
 #define has_pending_actions airborne_spread_exponential_model_has_pending_actions
 #define has_pending_infections airborne_spread_exponential_model_has_pending_infections
+#define next_wake_day airborne_spread_exponential_model_next_wake_day
 #define to_string airborne_spread_exponential_model_to_string
 #define local_printf airborne_spread_exponential_model_printf
 #define local_fprintf airborne_spread_exponential_model_fprintf
 #define local_free airborne_spread_exponential_model_free
 #define handle_new_day_event airborne_spread_exponential_model_handle_new_day_event
 #define check_and_infect airborne_spread_exponential_model_check_and_infect
+#define expose_sparse airborne_spread_exponential_model_expose_sparse
 
 #include "model.h"
 #include "model_util.h"
@@ -117,6 +119,7 @@
 #include "spatial_search.h"
 
 #include "naadsm.h"
+#include "general.h"
 
 #include "airborne-spread-exponential-model.h"
 
@@ -164,6 +167,8 @@ typedef struct
   GPtrArray *production_types; /**< Each item in the list is a char *. */
   param_block_t ***param_block;
   double *max_spread;
+  spatial_search_t *spatial_index; /**< The index of unit locations.  Kept so
+    that the maximum spread distances can be passed to it as search hints. */
   double *herd_size_factor;
   GPtrArray *pending_infections; /**< An array to store delayed contacts.  Each
     item in the array is a GQueue of Infection and Exposure events.  (Actually
@@ -175,6 +180,14 @@ typedef struct
   unsigned int npending_exposures;
   unsigned int npending_infections;
   unsigned int rotating_index; /**< To go with pending_infections. */
+  gboolean *target_prodtype; /**< Working space: for the current source, TRUE
+    for each production type it can expose. */
+  naadsm_neighbour_lists_t *neighbours; /**< The units near each source, with
+    the distance and heading to each.  Built as sources become infectious and
+    kept for the whole run. */
+  double *max_pair_prob; /**< For each source, the largest probability of
+    exposing any unit near it, not counting the source's prevalence.  Used
+    when only adequate exposures are recorded.  -1 where not yet computed. */
 }
 local_data_t;
 
@@ -265,6 +278,27 @@ build_size_factor_list_exp (HRD_herd_list_t * herds)
 
 
 
+/**
+ * Checks whether a heading from a source unit lies inside the area at risk of
+ * exposure.
+ *
+ * @param param_block the parameters for the source and target production
+ *   types.
+ * @param heading the heading in degrees from the source.
+ * @return TRUE if the heading is inside the area at risk of exposure.
+ */
+static gboolean
+in_exposure_area (param_block_t * param_block, double heading)
+{
+  return !(param_block->wind_range_crosses_0
+           ? (param_block->wind_dir_start - heading > EPSILON
+              && heading - param_block->wind_dir_end >=
+              EPSILON) : (param_block->wind_dir_start - heading > EPSILON
+                          || heading - param_block->wind_dir_end >= EPSILON));
+}
+
+
+
 /**
  * Special structure for use with the callback function below.
  */
@@ -280,27 +314,120 @@ typedef struct
 
 
 
+/**
+ * Records (queues) an exposure of herd 2 by herd 1, and if the exposure is
+ * adequate and herd 2 is susceptible, an attempt to infect herd 2.  Both may
+ * be delayed by the airborne transport delay.
+ *
+ * @param herd2 the exposed herd.
+ * @param param_block the parameters for herd 1's and herd 2's production
+ *   types.
+ * @param exposure_is_adequate whether the exposure is adequate.
+ * @param callback_data herd 1 and the other things needed to create events.
+ */
+static void
+queue_exposure (HRD_herd_t * herd2, param_block_t * param_block,
+                gboolean exposure_is_adequate, callback_t * callback_data)
+{
+  HRD_herd_t *herd1;
+  local_data_t *local_data;
+  int day;
+  EVT_event_t *exposure, *attempt_to_infect;
+  RAN_gen_t *rng;
+  int delay;
+  int delay_index;
+  GQueue *q = NULL;
+
+  herd1 = callback_data->herd1;
+  local_data = callback_data->local_data;
+  rng = callback_data->rng;
+
+  /* Record (queue) the exposure, whether it was adequate or not
+   * (Most event handlers will ignore exposures by airborne spread,
+   * which are not traceable). */
+  day = callback_data->day;
+  delay = (int) round (PDF_random (param_block->delay, rng));
+  exposure = EVT_new_exposure_event (herd1, herd2, day,
+                                     NAADSM_AirborneSpread,
+                                     FALSE, exposure_is_adequate, delay);
+  exposure->u.exposure.contact_type = NAADSM_AirborneSpread;
+                                      
+  if (delay <= 0)
+    {
+      EVT_event_enqueue (callback_data->queue, exposure);  
+    }
+  else
+    {
+      exposure->u.exposure.day += delay;
+      if (delay > local_data->pending_infections->len)
+        {
+          naadsm_extend_rotating_array (local_data->pending_infections,
+                                      delay, local_data->rotating_index);
+        }
+    
+      delay_index = (local_data->rotating_index + delay) % local_data->pending_infections->len;
+      q = (GQueue *) g_ptr_array_index (local_data->pending_infections, delay_index);
+      g_queue_push_tail (q, exposure);
+      local_data->npending_exposures++;
+    }
+  
+  /* If the exposure was effective (i.e., the exposure is adequate and the 
+   * recipient is susceptible), then queue an attempt to infect. */
+
+  if( (TRUE == exposure_is_adequate) && (herd2->state->status == Susceptible) ) 
+    {
+      attempt_to_infect =
+        EVT_new_attempt_to_infect_event (herd1, herd2, day, NAADSM_AirborneSpread);
+
+      if (delay <= 0)
+        {
+          EVT_event_enqueue (callback_data->queue, attempt_to_infect);
+          #if DEBUG
+            g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "  target unit infected");
+          #endif
+        }
+      else
+        {
+          attempt_to_infect->u.attempt_to_infect.day = day + delay;
+          
+          /* The queue to add the delayed infection to was already found above. */
+          g_queue_push_tail (q, attempt_to_infect);
+          local_data->npending_infections++;
+          #if DEBUG
+            g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
+                 "  target unit will be infected on day %i", day + delay);
+          #endif
+        }
+    }
+  else
+    {
+      #if DEBUG
+        g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "  target unit not infected");
+      #endif
+    }
+}
+
+
+
 /**
  * Check whether herd 1 can infect herd 2 and if so, attempt to infect herd 2.
+ *
+ * @param id the index of herd 2.
+ * @param distance the distance in km from herd 1 to herd 2.
+ * @param heading the heading in degrees from herd 1 to herd 2.
+ * @param callback_data herd 1 and the other things needed to create events.
  */
 void
-check_and_infect (int id, gpointer arg)
+check_and_infect (int id, double distance, double heading, callback_t * callback_data)
 {
-  callback_t *callback_data;
   HRD_herd_list_t *herds;
   HRD_herd_t *herd1, *herd2;
   local_data_t *local_data;
   gboolean herd2_can_be_target;
   param_block_t *param_block;
-  double distance, heading;
   double distance_factor, herd1_size_factor, herd2_size_factor;
-  int day;
-  EVT_event_t *exposure, *attempt_to_infect;
   RAN_gen_t *rng;
   double r, P;
-  int delay;
-  int delay_index;
-  GQueue *q;
   gboolean exposure_is_adequate;
 #if DEBUG
   GString *s;
@@ -310,7 +437,6 @@ check_and_infect (int id, gpointer arg)
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER check_and_infect (%s)", MODEL_NAME);
 #endif
 
-  callback_data = (callback_t *) arg;
   herds = callback_data->herds;
   herd1 = callback_data->herd1;
   herd2 = HRD_herd_list_get (herds, id);
@@ -326,14 +452,14 @@ check_and_infect (int id, gpointer arg)
   s = g_string_new (NULL);
   g_string_sprintf (s, "unit \"%s\" is %s, state is %s: ",
                     herd2->official_id, herd2->production_type_name,
-                    HRD_status_name[herd2->status]);
+                    HRD_status_name[herd2->state->status]);
 #endif
   param_block = local_data->param_block[herd1->production_type][herd2->production_type];
   herd2_can_be_target = (
     param_block != NULL 
-    && herd2->status != Destroyed
+    && herd2->state->status != Destroyed
     #ifdef RIVERTON
-    && herd2->status != NaturallyImmune
+    && herd2->state->status != NaturallyImmune
     #endif  
   );
 #if DEBUG
@@ -345,12 +471,7 @@ check_and_infect (int id, gpointer arg)
     goto end;
 
   /* Is herd 2 within the area at risk of exposure? */
-  heading = GIS_heading (herd1->x, herd1->y, herd2->x, herd2->y);
-  if (param_block->wind_range_crosses_0
-      ? (param_block->wind_dir_start - heading > EPSILON
-         && heading - param_block->wind_dir_end >=
-         EPSILON) : (param_block->wind_dir_start - heading > EPSILON
-                     || heading - param_block->wind_dir_end >= EPSILON))
+  if (!in_exposure_area (param_block, heading))
     {
 #if DEBUG
       g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
@@ -363,88 +484,151 @@ check_and_infect (int id, gpointer arg)
          "  unit \"%s\" within wind angles (%g)", herd2->official_id, heading);
 #endif
 
-  distance = GIS_distance (herd1->x, herd1->y, herd2->x, herd2->y);
   distance_factor = pow (param_block->prob_spread_1km, distance);
   herd1_size_factor = local_data->herd_size_factor[herd1->index];
   herd2_size_factor = local_data->herd_size_factor[herd2->index];
 #if DEBUG
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "  P = %g * %g * %g * %g",
-         herd1_size_factor, herd1->prevalence, distance_factor, herd2_size_factor);
+         herd1_size_factor, herd1->state->prevalence, distance_factor, herd2_size_factor);
 #endif
 
   rng = callback_data->rng;
-  P = herd1_size_factor * herd1->prevalence * distance_factor * herd2_size_factor;
+  P = herd1_size_factor * herd1->state->prevalence * distance_factor * herd2_size_factor;
   r = RAN_num (rng);
-  exposure_is_adequate = (r < P); 
+  exposure_is_adequate = (r < P);
+#if DEBUG
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "  r (%g) %s P (%g), exposure is %sadequate",
+         r, exposure_is_adequate ? "<" : ">=", P, exposure_is_adequate ? "" : "not ");
+#endif
+  queue_exposure (herd2, param_block, exposure_is_adequate, callback_data);
 
-  /* Record (queue) the exposure, whether it was adequate or not
-   * (Most event handlers will ignore exposures by airborne spread,
-   * which are not traceable). */
-  day = callback_data->day;
-  delay = (int) round (PDF_random (param_block->delay, rng));
-  exposure = EVT_new_exposure_event (herd1, herd2, day,
-                                     NAADSM_AirborneSpread,
-                                     FALSE, exposure_is_adequate, delay);
-  exposure->u.exposure.contact_type = NAADSM_AirborneSpread;
-                                      
-  if (delay <= 0)
-    {
-      EVT_event_enqueue (callback_data->queue, exposure);  
-    }
-  else
+end:
+#if DEBUG
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- EXIT check_and_infect (%s)", MODEL_NAME);
+#endif
+  return;
+}
+
+
+
+/**
+ * Returns the probability that herd 1 adequately exposes herd 2, not counting
+ * herd 1's prevalence.  This depends only on things fixed for the whole run.
+ *
+ * @param local_data this model's data.
+ * @param herd1 the source herd.
+ * @param herd2 the target herd.
+ * @param param_block the parameters for herd 1's and herd 2's production
+ *   types.
+ * @param distance the distance in km from herd 1 to herd 2.
+ * @return the probability, which may be greater than 1.
+ */
+static double
+pair_probability (local_data_t * local_data, HRD_herd_t * herd1, HRD_herd_t * herd2,
+                  param_block_t * param_block, double distance)
+{
+  return (local_data->herd_size_factor[herd1->index]
+          * pow (param_block->prob_spread_1km, distance)
+          * local_data->herd_size_factor[herd2->index]);
+}
+
+
+
+/**
+ * Exposes the units near herd 1, recording only the adequate exposures.
+ * Instead of drawing a random number for every unit near herd 1, this picks
+ * units with the largest probability that applies to any of them, skipping
+ * ahead by a geometrically distributed number of units each time, and then
+ * keeps each unit picked with the ratio of its own probability to the
+ * largest.  Each unit is still adequately exposed with the right probability,
+ * but only a few random numbers are drawn when most units near the source
+ * have a small chance of exposure.
+ *
+ * @param nneighbours the number of units near herd 1.
+ * @param target_ids the indices of the units near herd 1, in order.
+ * @param distances the distance in km to each unit.
+ * @param headings the heading in degrees to each unit.
+ * @param callback_data herd 1 and the other things needed to create events.
+ */
+void
+expose_sparse (unsigned int nneighbours, const unsigned int *target_ids,
+               const double *distances, const double *headings, callback_t * callback_data)
+{
+  local_data_t *local_data;
+  HRD_herd_list_t *herds;
+  HRD_herd_t *herd1, *herd2;
+  param_block_t *param_block;
+  RAN_gen_t *rng;
+  double max_prob, log_miss, skip, P;
+  unsigned int k;
+
+#if DEBUG
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER expose_sparse (%s)", MODEL_NAME);
+#endif
+
+  local_data = callback_data->local_data;
+  herds = callback_data->herds;
+  herd1 = callback_data->herd1;
+  rng = callback_data->rng;
+
+  /* The largest probability for any unit near herd 1 is found the first time
+   * herd 1 is a source. */
+  max_prob = local_data->max_pair_prob[herd1->index];
+  if (max_prob < 0)
     {
-      exposure->u.exposure.day += delay;
-      if (delay > local_data->pending_infections->len)
+      max_prob = 0;
+      for (k = 0; k < nneighbours; k++)
         {
-          naadsm_extend_rotating_array (local_data->pending_infections,
-                                      delay, local_data->rotating_index);
+          herd2 = HRD_herd_list_get (herds, target_ids[k]);
+          param_block = local_data->param_block[herd1->production_type][herd2->production_type];
+          if (in_exposure_area (param_block, headings[k]))
+            max_prob = MAX (max_prob,
+                            pair_probability (local_data, herd1, herd2, param_block,
+                                              distances[k]));
         }
-    
-      delay_index = (local_data->rotating_index + delay) % local_data->pending_infections->len;
-      q = (GQueue *) g_ptr_array_index (local_data->pending_infections, delay_index);
-      g_queue_push_tail (q, exposure);
-      local_data->npending_exposures++;
+      local_data->max_pair_prob[herd1->index] = max_prob;
     }
-  
-  /* If the exposure was effective (i.e., the exposure is adequate and the 
-   * recipient is susceptible), then queue an attempt to infect. */
+  max_prob = MIN (max_prob * herd1->state->prevalence, 1);
+  if (max_prob <= 0)
+    goto end;
+  log_miss = log (1 - max_prob);
 
-  if( (TRUE == exposure_is_adequate) && (herd2->status == Susceptible) ) 
+  for (k = 0; k < nneighbours; k++)
     {
-      attempt_to_infect =
-        EVT_new_attempt_to_infect_event (herd1, herd2, day, NAADSM_AirborneSpread);
-
-      if (delay <= 0)
+      /* Skip the units that were not picked. */
+      if (max_prob < 1)
         {
-          EVT_event_enqueue (callback_data->queue, attempt_to_infect);
-          #if DEBUG
-            g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "  r (%g) < P (%g), target unit infected", r, P);
-          #endif
+          skip = floor (log (RAN_num (rng)) / log_miss);
+          if (skip >= (double) (nneighbours - k))
+            break;
+          k += (unsigned int) skip;
         }
-      else
+
+      herd2 = HRD_herd_list_get (herds, target_ids[k]);
+      if (herd2->state->status == Destroyed
+#ifdef RIVERTON
+          || herd2->state->status == NaturallyImmune
+#endif
+        )
+        continue;
+      param_block = local_data->param_block[herd1->production_type][herd2->production_type];
+      if (!in_exposure_area (param_block, headings[k]))
+        continue;
+      P = herd1->state->prevalence
+        * pair_probability (local_data, herd1, herd2, param_block, distances[k]);
+      if (RAN_num (rng) * max_prob < P)
         {
-          attempt_to_infect->u.attempt_to_infect.day = day + delay;
-          
-          /* The queue to add the delayed infection to was already found above. */
-          g_queue_push_tail (q, attempt_to_infect);
-          local_data->npending_infections++;
-          #if DEBUG
-            g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
-                 "  r (%g) < P (%g), target unit will be infected on day %i",
-                 r, P, day + delay);
-          #endif
+#if DEBUG
+          g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
+                 "  unit \"%s\" adequately exposed (P = %g)", herd2->official_id, P);
+#endif
+          queue_exposure (herd2, param_block, TRUE, callback_data);
         }
     }
-  else
-    {
-      #if DEBUG
-        g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "  r (%g) >= P (%g), target unit not infected", r, P);
-      #endif
-    }
 
 end:
 #if DEBUG
-  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- EXIT check_and_infect (%s)", MODEL_NAME);
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- EXIT expose_sparse (%s)", MODEL_NAME);
 #endif
   return;
 }
@@ -467,12 +651,21 @@ handle_new_day_event (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
 {
   local_data_t *local_data;
   HRD_herd_t *herd1;
-  unsigned int nherds;          /* number of herds */
-  unsigned int herd1_index;
+  HRD_herd_set_t *infectious;
+  unsigned int nprod_types;
+  unsigned int j;
   gboolean herd1_can_be_source;
+  param_block_t **source_blocks;
+  unsigned int nneighbours;
+  const unsigned int *target_ids;
+  const double *distances, *headings;
+  param_block_t *sector_block;
+  gboolean whole_circle;
+  double sector_start, sector_end;
   GQueue *q;
   EVT_event_t *pending_event;
   callback_t callback_data;
+  unsigned int i;
 #if DEBUG
   GString *s;
 #endif
@@ -485,7 +678,7 @@ handle_new_day_event (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
 
   /* Release any pending (due to airborne transport delays) events. */
   local_data->rotating_index =
-    (local_data->rotating_index + 1) % local_data->pending_infections->len;
+    (local_data->rotating_index + 1 + event->ndays_skipped) % local_data->pending_infections->len;
   q = (GQueue *) g_ptr_array_index (local_data->pending_infections, local_data->rotating_index);
   while (!g_queue_is_empty (q))
     {
@@ -513,21 +706,29 @@ handle_new_day_event (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
   callback_data.rng = rng;
   callback_data.queue = queue;
 
-  nherds = HRD_herd_list_length (herds);
-  for (herd1_index = 0; herd1_index < nherds; herd1_index++)
+  /* Go through the infectious units in order, and through the units near
+   * each one, in order.  The units near a source, and the distance and
+   * heading to each, are looked up once and kept for the rest of the run. */
+  infectious = _iteration.infectious_herds;
+  HRD_herd_set_sort (infectious);
+  nprod_types = local_data->production_types->len;
+  for (j = 0; j < HRD_herd_set_length (infectious); j++)
     {
-      herd1 = HRD_herd_list_get (herds, herd1_index);
+      herd1 = HRD_herd_list_get (herds, HRD_herd_set_get (infectious, j));
+
+      /* The set also holds Latent units, which are not airborne sources. */
+      if (herd1->state->status != InfectiousSubclinical
+          && herd1->state->status != InfectiousClinical)
+        continue;
 
       /* Can this herd be the source of an exposure? */
 #if DEBUG
       s = g_string_new (NULL);
       g_string_sprintf (s, "unit \"%s\" is %s, state is %s: ",
                         herd1->official_id, herd1->production_type_name,
-                        HRD_status_name[herd1->status]);
+                        HRD_status_name[herd1->state->status]);
 #endif
-      herd1_can_be_source =
-        local_data->param_block[herd1->production_type] != NULL
-        && (herd1->status == InfectiousSubclinical || herd1->status == InfectiousClinical);
+      herd1_can_be_source = (local_data->param_block[herd1->production_type] != NULL);
 #if DEBUG
       g_string_sprintfa (s, "%s be source", herd1_can_be_source ? "can" : "cannot");
       g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "%s", s->str);
@@ -536,10 +737,46 @@ handle_new_day_event (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
       if (!herd1_can_be_source)
         continue;
 
+      /* If every production type this source can expose has the same area at
+       * risk of exposure, only that wedge around the source is searched.  The
+       * wedge is widened a little so that it covers the tolerance allowed in
+       * check_and_infect. */
+      source_blocks = local_data->param_block[herd1->production_type];
+      sector_block = NULL;
+      whole_circle = FALSE;
+      for (i = 0; i < nprod_types; i++)
+        {
+          local_data->target_prodtype[i] = (source_blocks[i] != NULL);
+          if (source_blocks[i] == NULL)
+            continue;
+          if (sector_block == NULL)
+            sector_block = source_blocks[i];
+          else if (source_blocks[i]->wind_dir_start != sector_block->wind_dir_start
+                   || source_blocks[i]->wind_dir_end != sector_block->wind_dir_end)
+            whole_circle = TRUE;
+        }
+      if (whole_circle || sector_block == NULL)
+        {
+          sector_start = 0;
+          sector_end = 360;
+        }
+      else
+        {
+          sector_start = sector_block->wind_dir_start - 2 * EPSILON;
+          sector_end = sector_block->wind_dir_end + 2 * EPSILON;
+        }
+      nneighbours =
+        naadsm_get_neighbours (local_data->neighbours, herds, herd1,
+                               local_data->max_spread[herd1->production_type] + EPSILON,
+                               sector_start, sector_end,
+                               local_data->target_prodtype,
+                               &target_ids, &distances, &headings);
       callback_data.herd1 = herd1;
-      spatial_search_circle_by_id (herds->spatial_index, herd1_index,
-                                   local_data->max_spread[herd1->production_type] + EPSILON,
-                                   check_and_infect, &callback_data);
+      if (naadsm_sparse_airborne_exposures)
+        expose_sparse (nneighbours, target_ids, distances, headings, &callback_data);
+      else
+        for (i = 0; i < nneighbours; i++)
+          check_and_infect (target_ids[i], distances[i], headings[i], &callback_data);
     }
 
 #if DEBUG
@@ -679,6 +916,36 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do:
+ * tomorrow while any unit is infectious, otherwise the day on which the next
+ * delayed exposure or infection comes due.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return the day, or G_MAXINT if nothing is scheduled.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  local_data_t *local_data;
+  unsigned int ahead;
+
+  local_data = (local_data_t *) (self->model_data);
+  if (herds->tally->nunits[InfectiousSubclinical] > 0
+      || herds->tally->nunits[InfectiousClinical] > 0)
+    return day + 1;
+
+  ahead = naadsm_rotating_array_next_nonempty (local_data->pending_infections,
+                                               local_data->rotating_index);
+  return (ahead > 0) ? day + ahead : G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -804,6 +1071,9 @@ local_free (struct naadsm_model_t_ *self)
 
   g_free (local_data->max_spread);
   g_free (local_data->herd_size_factor);
+  g_free (local_data->target_prodtype);
+  naadsm_free_neighbour_lists (local_data->neighbours);
+  g_free (local_data->max_pair_prob);
 
   for (i = 0; i < local_data->pending_infections->len; i++)
     {
@@ -967,6 +1237,8 @@ set_params (struct naadsm_model_t_ *self, PAR_parameter_t * params)
              * index when looking for herds to spread infection to. */
             if (param_block->max_spread > local_data->max_spread[i])
               local_data->max_spread[i] = param_block->max_spread;
+            spatial_search_add_query_radius (local_data->spatial_index,
+                                             param_block->max_spread + EPSILON);
           }
 
   g_free (from_production_type);
@@ -996,7 +1268,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  self = g_new (naadsm_model_t, 1);
+  self = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   self->name = MODEL_NAME;
@@ -1010,6 +1282,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   self->is_listening_for = is_listening_for;
   self->has_pending_actions = has_pending_actions;
   self->has_pending_infections = has_pending_infections;
+  self->next_wake_day = next_wake_day;
   self->to_string = to_string;
   self->printf = local_printf;
   self->fprintf = local_fprintf;
@@ -1022,10 +1295,18 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   local_data->production_types = herds->production_type_names;
   nprod_types = local_data->production_types->len;
   local_data->param_block = g_new0 (param_block_t **, nprod_types);
+  local_data->spatial_index = herds->spatial_index;
 
   /* Compute the herd size factors. */
   local_data->herd_size_factor = build_size_factor_list_exp (herds);
 
+  /* Initialize the working space used to search around each day's sources. */
+  local_data->target_prodtype = g_new (gboolean, nprod_types);
+  local_data->neighbours = naadsm_new_neighbour_lists (HRD_herd_list_length (herds));
+  local_data->max_pair_prob = g_new (double, HRD_herd_list_length (herds));
+  for (i = 0; i < HRD_herd_list_length (herds); i++)
+    local_data->max_pair_prob[i] = -1;
+
   /* Initialize an array to hold the maximum distance of spread from each
    * production type. */
   local_data->max_spread = g_new (double, nprod_types);
@@ -147,9 +147,9 @@ handle_detection_event (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
    * died out and no longer exist, so they don't need to be destroyed. */
   if (
       local_data->production_type[herd->production_type] == TRUE
-      && herd->status != Destroyed
+      && herd->state->status != Destroyed
       #ifdef RIVERTON
-      && herd->status != NaturallyImmune
+      && herd->state->status != NaturallyImmune
       #endif
   )
     {
@@ -401,7 +401,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_debug ("----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  m = g_new (naadsm_model_t, 1);
+  m = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   m->name = MODEL_NAME;
@@ -414,6 +414,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   m->is_listening_for = is_listening_for;
   m->has_pending_actions = has_pending_actions;
   m->has_pending_infections = has_pending_infections;
+  m->next_wake_day = NULL;
   m->to_string = to_string;
   m->printf = local_printf;
   m->fprintf = local_fprintf;
@@ -27,11 +27,14 @@
 #define new conflict_resolver_new
 #define set_params conflict_resolver_set_params
 #define run conflict_resolver_run
+#define run_batch conflict_resolver_run_batch
 #define reset conflict_resolver_reset
 #define events_listened_for conflict_resolver_events_listened_for
+#define events_batched conflict_resolver_events_batched
 #define is_listening_for conflict_resolver_is_listening_for
 #define has_pending_actions conflict_resolver_has_pending_actions
 #define has_pending_infections conflict_resolver_has_pending_infections
+#define next_wake_day conflict_resolver_next_wake_day
 #define to_string conflict_resolver_to_string
 #define local_printf conflict_resolver_printf
 #define local_fprintf conflict_resolver_fprintf
@@ -48,6 +51,7 @@
 #define resolve_conflicts conflict_resolver_resolve_conflicts
 
 #include "model.h"
+#include "model_util.h"
 
 #if STDC_HEADERS
 #  include <string.h>
@@ -87,6 +91,11 @@ EVT_event_type_t events_listened_for[] = { EVT_BeforeEachSimulation, EVT_Midnigh
 
 
 
+#define NEVENTS_BATCHED 3
+EVT_event_type_t events_batched[] = { EVT_AttemptToInfect, EVT_Vaccination, EVT_Destruction };
+
+
+
 /* Specialized information for this model. */
 typedef struct
 {
@@ -178,11 +187,12 @@ handle_before_each_simulation_event (struct naadsm_model_t_ * self,
 
   /* Set each unit's initial state.  We don't need to go through the usual
    * conflict resolution steps here. */
+  HRD_herd_list_reset (herds);
+  naadsm_restore_live_indexes (herds);
   nherds = HRD_herd_list_length (herds);
   for (i = 0; i < nherds; i++)
     {
       herd = HRD_herd_list_get (herds, i);
-      HRD_reset (herd);
       switch (herd->initial_status)
         {
         case Susceptible:
@@ -239,22 +249,18 @@ handle_midnight_event (struct naadsm_model_t_ *self,
                        RAN_gen_t * rng,
                        EVT_event_queue_t * queue)
 {
-  local_data_t *local_data;
-  unsigned int nherds, i;
-  HRD_herd_t *herd;
-
 #if DEBUG
   g_debug ("----- ENTER handle_midnight_event (%s)", MODEL_NAME);
 #endif
 
-  local_data = (local_data_t *) (self->model_data);
-  nherds = HRD_herd_list_length (herds);
-  for (i = 0; i < nherds; i++)
-    {
-      herd = HRD_herd_list_get (herds, i);
-      /* _iteration is a global variable defined in general.c */
-      HRD_step (herd, _iteration.infectious_herds);
-    }
+  /* Only the herds with pending change requests or delayed transitions due
+   * today are touched.  _iteration is a global variable defined in
+   * general.c */
+  HRD_herd_list_step (herds, event->day, _iteration.infectious_herds);
+
+  /* Destroyed herds can no longer be reached by spread or rings, so take them
+   * out of the spatial searches. */
+  naadsm_remove_destroyed_units (herds);
 
 #if DEBUG
   g_debug ("----- EXIT handle_midnight_event (%s)", MODEL_NAME);
@@ -419,7 +425,7 @@ resolve_conflicts (gpointer key, gpointer value, gpointer user_data)
 #endif
       ;
     }
-  else if (!herd->in_disease_cycle)
+  else if (!herd->state->in_disease_cycle)
     {
       /* An infection is going to go ahead.  If there is more than one
        * competing cause of infection, choose one randomly. */
@@ -548,6 +554,56 @@ run (struct naadsm_model_t_ *self, HRD_herd_list_t * herds, ZON_zone_list_t * zo
 
 
 
+/**
+ * Runs this model on all of one wave's attempts to infect, vaccinations or
+ * destructions.
+ *
+ * @param self the model.
+ * @param herds a herd list.
+ * @param zones a zone list.
+ * @param events the events, all of the same type.
+ * @param nevents the number of events.
+ * @param rng a random number generator.
+ * @param queue for any new events the model creates.
+ */
+void
+run_batch (struct naadsm_model_t_ *self, HRD_herd_list_t * herds, ZON_zone_list_t * zones,
+           EVT_event_t ** events, unsigned int nevents, RAN_gen_t * rng,
+           EVT_event_queue_t * queue)
+{
+  unsigned int i;
+
+#if DEBUG
+  g_debug ("----- ENTER run_batch (%s)", MODEL_NAME);
+#endif
+
+  switch (events[0]->type)
+    {
+    case EVT_AttemptToInfect:
+      for (i = 0; i < nevents; i++)
+        handle_attempt_to_infect_event (self, events[i]);
+      break;
+    case EVT_Vaccination:
+      for (i = 0; i < nevents; i++)
+        handle_vaccination_event (self, &(events[i]->u.vaccination));
+      break;
+    case EVT_Destruction:
+      for (i = 0; i < nevents; i++)
+        handle_destruction_event (self, &(events[i]->u.destruction));
+      break;
+    default:
+      g_error
+        ("%s has received a batch of %s events, which it does not take in batches.  This should never happen.  Please contact the developer.",
+         MODEL_NAME, EVT_event_type_name[events[0]->type]);
+    }
+
+#if DEBUG
+  g_debug ("----- EXIT run_batch (%s)", MODEL_NAME);
+#endif
+}
+
+
+
 /**
  * Resets this model after a simulation run.
  *
@@ -617,6 +673,25 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do: the
+ * next day on which some unit is due to change state.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return the day, or G_MAXINT if no unit has a state change coming.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  return HRD_herd_list_next_wake_day (herds, day);
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -754,20 +829,24 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_debug ("----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  self = g_new (naadsm_model_t, 1);
+  self = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   self->name = MODEL_NAME;
   self->events_listened_for = events_listened_for;
   self->nevents_listened_for = NEVENTS_LISTENED_FOR;
+  self->events_batched = events_batched;
+  self->nevents_batched = NEVENTS_BATCHED;
   self->outputs = g_ptr_array_new ();
   self->model_data = local_data;
   self->set_params = set_params;
   self->run = run;
+  self->run_batch = run_batch;
   self->reset = reset;
   self->is_listening_for = is_listening_for;
   self->has_pending_actions = has_pending_actions;
   self->has_pending_infections = has_pending_infections;
+  self->next_wake_day = next_wake_day;
   self->to_string = to_string;
   self->printf = local_printf;
   self->fprintf = local_fprintf;
@@ -55,11 +55,14 @@
 #define new contact_recorder_model_new
 #define set_params contact_recorder_model_set_params
 #define run contact_recorder_model_run
+#define run_batch contact_recorder_model_run_batch
 #define reset contact_recorder_model_reset
 #define events_listened_for contact_recorder_model_events_listened_for
+#define events_batched contact_recorder_model_events_batched
 #define is_listening_for contact_recorder_model_is_listening_for
 #define has_pending_actions contact_recorder_model_has_pending_actions
 #define has_pending_infections contact_recorder_model_has_pending_infections
+#define next_wake_day contact_recorder_model_next_wake_day
 #define to_string contact_recorder_model_to_string
 #define local_printf contact_recorder_model_printf
 #define local_fprintf contact_recorder_model_fprintf
@@ -104,6 +107,11 @@ EVT_event_type_t events_listened_for[] = { EVT_Exposure, EVT_AttemptToTrace,
 
 
 
+#define NEVENTS_BATCHED 1
+EVT_event_type_t events_batched[] = { EVT_Exposure };
+
+
+
 /* Specialized information for this model. */
 typedef struct
 {
@@ -381,7 +389,7 @@ handle_new_day_event (struct naadsm_model_t_ *self,
 
   /* Release any pending (due to trace delays) events. */
   local_data->rotating_index =
-    (local_data->rotating_index + 1) % local_data->pending_results->len;
+    (local_data->rotating_index + 1 + event->ndays_skipped) % local_data->pending_results->len;
   q = (GQueue *) g_ptr_array_index (local_data->pending_results, local_data->rotating_index);
   while (!g_queue_is_empty (q))
     {
@@ -447,6 +455,38 @@ run (struct naadsm_model_t_ *self, HRD_herd_list_t * herds, ZON_zone_list_t * zo
 
 
 
+/**
+ * Runs this model on all of one wave's exposures.
+ *
+ * @param self the model.
+ * @param herds a herd list.
+ * @param zones a zone list.
+ * @param events the exposure events.
+ * @param nevents the number of events.
+ * @param rng a random number generator.
+ * @param queue for any new events the model creates.
+ */
+void
+run_batch (struct naadsm_model_t_ *self, HRD_herd_list_t * herds, ZON_zone_list_t * zones,
+           EVT_event_t ** events, unsigned int nevents, RAN_gen_t * rng,
+           EVT_event_queue_t * queue)
+{
+  unsigned int i;
+
+#if DEBUG
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER run_batch (%s)", MODEL_NAME);
+#endif
+
+  for (i = 0; i < nevents; i++)
+    handle_exposure_event (self, events[i]);
+
+#if DEBUG
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- EXIT run_batch (%s)", MODEL_NAME);
+#endif
+}
+
+
+
 /**
  * Resets this model after a simulation run.
  *
@@ -551,6 +591,31 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do: the
+ * day on which the next delayed trace result comes due.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return the day, or G_MAXINT if nothing is scheduled.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  local_data_t *local_data;
+  unsigned int ahead;
+
+  local_data = (local_data_t *) (self->model_data);
+  ahead = naadsm_rotating_array_next_nonempty (local_data->pending_results,
+                                               local_data->rotating_index);
+  return (ahead > 0) ? day + ahead : G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -853,20 +918,24 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  self = g_new (naadsm_model_t, 1);
+  self = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   self->name = MODEL_NAME;
   self->events_listened_for = events_listened_for;
   self->nevents_listened_for = NEVENTS_LISTENED_FOR;
+  self->events_batched = events_batched;
+  self->nevents_batched = NEVENTS_BATCHED;
   self->outputs = g_ptr_array_new ();
   self->model_data = local_data;
   self->set_params = set_params;
   self->run = run;
+  self->run_batch = run_batch;
   self->reset = reset;
   self->is_listening_for = is_listening_for;
   self->has_pending_actions = has_pending_actions;
   self->has_pending_infections = has_pending_infections;
+  self->next_wake_day = next_wake_day;
   self->to_string = to_string;
   self->printf = local_printf;
   self->fprintf = local_fprintf;
@@ -96,13 +96,13 @@
 #define is_listening_for contact_spread_model_is_listening_for
 #define has_pending_actions contact_spread_model_has_pending_actions
 #define has_pending_infections contact_spread_model_has_pending_infections
+#define next_wake_day contact_spread_model_next_wake_day
 #define to_string contact_spread_model_to_string
 #define local_printf contact_spread_model_printf
 #define local_fprintf contact_spread_model_fprintf
 #define local_free contact_spread_model_free
 #define handle_new_day_event contact_spread_model_handle_new_day_event
 #define handle_public_announcement_event contact_spread_model_handle_public_announcement_event
-#define check_and_choose contact_spread_model_check_and_choose
 
 #include "model.h"
 #include "model_util.h"
@@ -150,6 +150,12 @@ EVT_event_type_t events_listened_for[] =
 
 
 
+/** Marks the table of movement control multipliers as needing to be filled
+ * in. */
+#define NO_MOVEMENT_FACTORS G_MININT
+
+
+
 /**
  * Specialized information for this module.  Because the module is a singleton,
  * with only one instance existing, there is a local_data_t structure that
@@ -166,6 +172,9 @@ typedef struct
     focus.  When the source unit is inside a zone focus, use the charts by
     zone and production type, in local_data_t below. */
   PDF_dist_t *distance_dist;
+  double recipient_radius; /**< How far from the source the list of potential
+    recipients reaches at first, or -1 if it holds every unit.  See
+    recipient_radius(). */
   PDF_dist_t *shipping_delay;
   gboolean latent_units_can_infect;
   gboolean subclinical_units_can_infect;
@@ -175,11 +184,63 @@ param_block_t;
 
 
 
+/**
+ * An exposure worked out by plan_contacts(), waiting to be turned into events
+ * by handle_new_day_event().
+ */
+typedef struct
+{
+  HRD_herd_t *herd1; /**< The source unit. */
+  HRD_herd_t *herd2; /**< The recipient unit. */
+  NAADSM_contact_type contact_type;
+  gboolean adequate; /**< Whether the exposure will cause infection in a
+    susceptible unit. */
+  int shipping_delay; /**< In days. */
+}
+planned_exposure_t;
+
+
+
+/**
+ * Working space for working out the contacts from sources.  When the sources
+ * are spread over several threads, each thread has one of these.  Source unit
+ * i is always handled by slot i % nslots, so that the list of units sorted by
+ * distance from a source is kept in only one slot.
+ */
+typedef struct
+{
+  GArray *contacts; /**< The contacts from the current source, as
+    sub_callback_t structures, grouped by contact type and recipient
+    production type.  Emptied rather than freed for each source, so that once
+    it has grown to hold the most contacts any one source makes, building the
+    contacts costs no memory allocation. */
+  unsigned int *first_contact; /**< Where the contacts of each contact type to
+    each recipient production type start in contacts.  Use an expression of
+    the form first_contact[contact_type * nprod_types + production_type]. */
+  unsigned int *ncontacts; /**< How many contacts there are of each contact
+    type to each recipient production type, laid out as first_contact. */
+  naadsm_distance_index_t *recipients; /**< For each source unit handled by
+    this slot and each production type, the potential recipients within
+    at least the production type pair's recipient_radius, sorted by
+    distance.  Kept from day to day and from iteration to iteration, since
+    units do not move. */
+  PDF_dist_t *poisson; /**< Used to pick the number of contacts from a
+    source. */
+  RAN_gen_t rng; /**< The current source's random number stream. */
+  GArray *exposures; /**< The exposures planned today for this slot's
+    sources, as planned_exposure_t structures, source by source. */
+}
+source_slot_t;
+
+
+
 /* Specialized information for this model. */
 typedef struct
 {
   GPtrArray *production_types; /**< Each item in the list is a char *. */
   ZON_zone_list_t *zones;
+  spatial_search_t *spatial_index; /**< The index of unit locations, kept so
+    that set_params can tell it the search radii this model will use. */
   param_block_t ***param_block[NAADSM_NCONTACT_TYPES]; /**< Blocks of parameters.
     Use an expression of the form
     param_block[contact_type][source_production_type][recipient_production_type]
@@ -199,35 +260,58 @@ typedef struct
   unsigned int rotating_index; /**< To go with pending_infections. */
   gboolean outbreak_known;
   int public_announcement_day;
+  double *movement_factors; /**< Today's movement control multipliers.  Use an
+    expression of the form
+    movement_factors[((contact_type * nzones + zone->level-1) * nprod_types
+    + source_production_type) * nprod_types + recipient_production_type]
+    to get a particular multiplier. */
+  int movement_factors_day; /**< The number of days since the public
+    announcement that movement_factors was filled in for, -1 if it was filled
+    in for before the announcement, or NO_MOVEMENT_FACTORS if it needs to be
+    filled in. */
+  unsigned int nslots;
+  source_slot_t *slots; /**< Working space for each thread. */
+  GArray *sources; /**< Today's source units, as unit indices (unsigned ints)
+    in increasing order. */
+  GArray *first_exposure; /**< For each of today's sources, where its planned
+    exposures start in its slot's exposures array. */
+  GArray *nexposures; /**< For each of today's sources, how many exposures it
+    has planned. */
+  HRD_herd_list_t *day_herds; /**< Today's herd list, zone list and iteration
+    random number stream, for the threads to read. */
+  ZON_zone_list_t *day_zones;
+  RAN_gen_t *day_rng;
+  int day;
+#if HAVE_GTHREAD
+  GThreadPool *pool; /**< Threads that handle slots 1 to nslots-1, or NULL if
+    there is only 1 slot.  Slot 0 is handled by the calling thread. */
+  GAsyncQueue *slots_done; /**< Each thread posts here when it has finished
+    a slot. */
+#endif
 }
 local_data_t;
 
 
 
 /**
- * Special sub-structure for use with the callback function below.
- * 
+ * One contact from a source unit, for use with choose_recipient() below.
  */
 typedef struct
 {
   NAADSM_contact_type contact_type;
   unsigned int recipient_production_type;
   double movement_distance;
-  HRD_herd_t *best_herd; /**< The current pick for best recipient. */
+  HRD_herd_t *best_herd; /**< The chosen recipient. */
   double best_herd_distance; /**< The distance from the source unit to
     best_herd. */
   double best_herd_difference; /**< The difference between the desired contact
     distance and best_herd_distance. */
-  double min_difference; /**< The smallest value of best_herd_difference so
-    far.  See the file drift.xml in the direct contact tests for an explanation
-    of why this is needed. */
-  double cumul_size;    
-  gboolean try_again;  /*  Used if and when the RTree search method found no match */    
 }sub_callback_t;
 
 
 /**
- * Special structure for use with the callback function below.
+ * Information about a source unit and its contacts, for use with
+ * choose_recipient() below.
  */
 typedef struct
 {
@@ -256,902 +340,1093 @@ typedef struct
    **/
   unsigned long contact_count;
   unsigned long production_type_count;
-  /*  This is a 3-Dimensional matrix of contact-types, production-types, and 
-   *  sub_callback_t structures, where the depth of the matrix, sub-callback_t element,
-   *  is variable per [contact-type, production-type] pair.
-   */
-  GPtrArray ***_contacts; /* gpointer points to a sub_callback_t */    
-  unsigned int num_unmatched_exposures;
 } callback_t;
 
 
 
 /**
- * Check whether herd 1 can infect herd 2 and if so, whether it beats the
- * best (so far) matching potential target herd.
+ * How many times choose_recipient() will draw a unit in proportion to size
+ * and throw it back because it cannot receive the contact, before it gives up
+ * and adds up the sizes of just the units that can.
  */
-void
-check_and_choose (int id, gpointer arg)
+#define MAX_REDRAWS 4
+
+
+
+/**
+ * For a distance distribution with no upper limit, the share of contact
+ * distances that the lists of potential recipients are built to handle (see
+ * recipient_radius()).
+ */
+#define RECIPIENT_RADIUS_QUANTILE 0.999
+
+
+
+/**
+ * Works out how far from a source its list of potential recipients has to
+ * reach.  choose_recipient() needs every unit within d + m + EPSILON of the
+ * source, where d is the contact's distance and m is how far the best match is
+ * from d.  When the best match is no farther away than d, that is at most
+ * 2d + EPSILON.  So the list reaches to twice the longest contact distance, or
+ * twice a high quantile for a distribution with no upper limit, and the rare
+ * contact that needs more widens the list for its source (see
+ * plan_contacts()).  Only a Poisson distribution, or one whose quantile is
+ * infinite, gives no radius to start from.
+ *
+ * @param dist the distribution of contact distances.
+ * @return the radius, in km, or -1 if the list must hold every unit.
+ */
+static double
+recipient_radius (PDF_dist_t * dist)
 {
-  callback_t *callback_data;
-  HRD_herd_list_t *herds;
-  HRD_herd_t *herd2;
-  HRD_herd_t *herd1;
-  local_data_t *local_data;
-  double distance;
-  double difference;
-  ZON_zone_fragment_t *herd1_fragment, *herd2_fragment;
-  gboolean contact_forbidden;
-  NAADSM_contact_type contact_type;
-  unsigned long production_type;
-  unsigned long index;
+  double d;
+
+  if (dist == NULL)
+    return 0;
+  if (PDF_has_max (dist))
+    d = PDF_max (dist);
+  else if (dist->type == PDF_Poisson)
+    /* There is no inverse CDF for the Poisson distribution. */
+    return -1;
+  else
+    d = PDF_inverse_cdf (RECIPIENT_RADIUS_QUANTILE, dist);
+  /* This also catches an infinite or undefined quantile. */
+  if (!(d < G_MAXDOUBLE / 4))
+    return -1;
+  return 2 * MAX (d, 0) + EPSILON;
+}
 
-#if DEBUG
-  g_debug ("----- ENTER check_and_choose (%s)", MODEL_NAME);
-#endif
 
-  callback_data = (callback_t *) arg;
-  g_assert (callback_data != NULL);
 
-  herds = callback_data->herds;
-  herd2 = HRD_herd_list_get (herds, id);
+/**
+ * Returns the number of values in a sorted array that are less than a given
+ * value.
+ *
+ * @param values an array of values, in increasing order.
+ * @param count the length of the array.
+ * @param value the value to look for.
+ * @return the position of the first value >= value.
+ */
+static unsigned int
+count_below (const double *values, unsigned int count, double value)
+{
+  unsigned int lo, hi, mid;
 
-  if ( callback_data->_contacts != NULL )
-  {
-    if ( 
-      ( herd2 != callback_data->herd1 ) 
-      && ( herd2->status != Destroyed )
-      #ifdef RIVERTON
-      && ( herd2->status != NaturallyImmune ) 
-      #endif
-    )
+  lo = 0;
+  hi = count;
+  while (lo < hi)
     {
-      herd1 = callback_data->herd1;
+      mid = lo + (hi - lo) / 2;
+      if (values[mid] < value)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
 
-      local_data = ( local_data_t * ) ( callback_data->self->model_data );
-      distance = GIS_distance ( herd1->x, herd1->y, herd2->x, herd2->y );
-  
-      for ( contact_type = 0; contact_type < callback_data->contact_count; contact_type++ )
-      {         
-        for ( production_type = 0; production_type < callback_data->production_type_count; production_type++ )
-        {
-          GPtrArray *_contacts = (GPtrArray *)callback_data->_contacts[contact_type][production_type];
-   
-          if ( _contacts != NULL )
-          {
-            sub_callback_t *contact;
-            for ( index = 0; index < _contacts->len; index ++ )
-            {              
-              if ( ( contact = g_ptr_array_index ( _contacts, index ) ) != NULL )
-              {  
-                if ( index == 0 )
-                  if ( herd2->production_type != contact->recipient_production_type )
-                  {
-                    /*  Wrong production type...try next combination */ 
-                    break;
-                  };
-  
-                /* This will be set to TRUE if the search within the circle is
-                 * running for the first time, or if the search within the
-                 * circle found nothing and we are now using exhaustive search.
-                 */
-                if ( contact->try_again )
-                { 
-                  /* Is herd 2 closer to herd 1 than the best match so far? */
-                  difference = fabs ( contact->movement_distance - distance );
-                  if ( contact->best_herd == NULL )
-                  {                     
-                    /* If herd 2 is quarantined, it cannot be the recipient of a direct
-                     * contact. */
-                    if ( ( herd2->quarantined ) && ( contact->contact_type == NAADSM_DirectContact ) )
-                    {
-                      #if DEBUG
-                        g_log ( G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- check_and_choose - Optimized Version:  Fit found, but not allowed; quarantined direct-contact" );
-                      #endif                         
-                    }
-                    else
-                    {                        
-                      contact->best_herd = herd2;
-                      contact->best_herd_distance = distance;
-                      contact->best_herd_difference = difference;
-                      contact->min_difference = difference;
-                      contact->cumul_size = herd2->size;
-                      /* A best_herd has been filled in where there previously
-                       * was NULL.  This means that we can decrement the count
-                       * of unmatched exposures. */
-                      callback_data->num_unmatched_exposures--;
-                    };
-                  }
-                  else if ( fabs ( difference - contact->min_difference ) <= EPSILON )
-                  {                        
-                    /* When we find a second potential recipient unit the same distance from
-                     * the source as the current closest potential recipient, we first check
-                     * if contact with the new find is forbidden by quarantine or zone rules.
-                     * If so, we can ignore it.  Otherwise, the new find has a 1 in 2 chance
-                     * of replacing the older find, if they are the same size.  (If the new
-                     * find is half the size of the old one, it has a 1 in 3 chance; if it is
-                     * twice the size of the old one, it has a 2 in 3 chance.)  If we find a
-                     * third potential recipient unit the same distance from the source, its
-                     * chance of replacing the older choice is its size divided by the sum of
-                     * its size and the sizes of all of the older choices.  This gives the
-                     * same result as recording all the potential recipient herds and
-                     * choosing among them afterwards. */
-                    herd1_fragment = callback_data->herd1_fragment;
-                    herd2_fragment = callback_data->zones->membership[herd2->index];
-    
-    
-                    contact_forbidden = ( ( herd2->quarantined && contact->contact_type == NAADSM_DirectContact )
-                                          || ( ZON_level ( herd2_fragment ) > ZON_level ( herd1_fragment ) )
-                                          || ( ZON_level ( herd1_fragment ) - ZON_level ( herd2_fragment ) > 1 )
-                                          || ( ( ZON_level ( herd1_fragment ) - ZON_level ( herd2_fragment ) == 1 )
-                                               && !ZON_nests_in ( herd2_fragment, herd1_fragment ) )
-                                          || ( ( ZON_level ( herd2_fragment ) == ZON_level ( herd1_fragment ) )
-                                               && !ZON_same_fragment ( herd2_fragment, herd1_fragment ) ) );
-    
-                    if ( !contact_forbidden )
-                    {
-                      contact->cumul_size += herd2->size;
-    
-                      if ( RAN_num ( callback_data->rng ) < herd2->size / contact->cumul_size )
-                      {                        
-                        contact->best_herd = herd2;
-                        contact->best_herd_distance = distance;
-                        contact->best_herd_difference = difference;
-                        if ( difference < contact->min_difference )
-                          contact->min_difference = difference;
-                      }
-                      else
-                      {
-                        #if DEBUG
-                        g_log ( G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- check_and_choose - Optimized Version:  Herd size rules do allow replacing best_herd with this contacted herd" );
-                        #endif                           
-                      };
-                    }
-                    else
-                    {
-                      #if DEBUG
-                      g_log ( G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- check_and_choose - Optimized Version:  Contact forbidden by zone rules or quarantine rules" );
-                      #endif                        
-                    }
-                  }
-                  else if ( difference < contact->min_difference )
-                  {
-                       
-                    contact_forbidden = ( herd2->quarantined && contact->contact_type == NAADSM_DirectContact );
-    
-                    if ( !contact_forbidden )
-                    {                       
-                      contact->best_herd = herd2;
-                      contact->best_herd_distance = distance;
-                      contact->best_herd_difference = difference;
-                      contact->min_difference = difference;
-                      contact->cumul_size = herd2->size;
-                    }
-                    else
-                    {
-                      #if DEBUG
-                      g_log ( G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- check_and_choose - Optimized Version:  Better fit found, but contact forbidden:  quarantined herd for direct-contact" );
-                      #endif           
-                    };
-                  }
-                  else
-                  {
-                    #if DEBUG
-                    g_log ( G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- check_and_choose - Optimized Version:  No fit found" );
-                    #endif       
-                  };
-                };
-              };  /*  End if contact is not NULL */
-            };  /* End For contacts loop */
-          };  /*  End if contacts list is not NULL */
-        };  /*  End for production types loop */
-      };  /*  End for contact types loop */
-    }  /*  End if herd2 is not the same herd as the source herd */
-    else
+
+
+/**
+ * Returns the number of values in a sorted array that are less than or equal
+ * to a given value.
+ *
+ * @param values an array of values, in increasing order.
+ * @param count the length of the array.
+ * @param value the value to look for.
+ * @return the position of the first value > value.
+ */
+static unsigned int
+count_at_most (const double *values, unsigned int count, double value)
+{
+  unsigned int lo, hi, mid;
+
+  lo = 0;
+  hi = count;
+  while (lo < hi)
     {
-#if DEBUG
-     if ( herd2->status == Destroyed )
-       g_log ( G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- check_and_choose - Optimized Version:  Herd found was destroyed" );
-     else     
-       g_log ( G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- check_and_choose - Optimized Version:  Herd found was same as source herd" );
-#endif   
-         ;      
-    };
-  }; /*  END if callback_data->_contacts != NULL */
-#if DEBUG
-  g_log ( G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- EXIT check_and_choose (%s) - Optimized Version", MODEL_NAME );
+      mid = lo + (hi - lo) / 2;
+      if (values[mid] <= value)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+
+
+/**
+ * Checks whether herd 2 can be the recipient of a contact from herd 1 at all,
+ * that is, whether it is still alive and, for direct contact, not quarantined.
+ */
+static gboolean
+can_receive (HRD_herd_t * herd2, NAADSM_contact_type contact_type)
+{
+  if (herd2->state->status == Destroyed)
+    return FALSE;
+#ifdef RIVERTON
+  if (herd2->state->status == NaturallyImmune)
+    return FALSE;
 #endif
-  return;
+  if (herd2->state->quarantined && contact_type == NAADSM_DirectContact)
+    return FALSE;
+  return TRUE;
 }
 
 
 
-typedef struct
+/**
+ * Checks whether the zone rules forbid contact from a unit in one zone
+ * fragment to a unit in another.
+ */
+static gboolean
+zone_forbids (ZON_zone_fragment_t * herd1_fragment, ZON_zone_fragment_t * herd2_fragment)
 {
-  struct naadsm_model_t_ *self;
-  HRD_herd_list_t *herds;
-  ZON_zone_list_t *zones;
-  EVT_new_day_event_t *event;
-  RAN_gen_t *rng;
-  EVT_event_queue_t *queue;   
-  PDF_dist_t *_poisson;
-  unsigned long new_infections;
-  unsigned long exposure_attempts;
-} new_day_event_hash_table_data;
+  return ((ZON_level (herd2_fragment) > ZON_level (herd1_fragment))
+          || (ZON_level (herd1_fragment) - ZON_level (herd2_fragment) > 1)
+          || ((ZON_level (herd1_fragment) - ZON_level (herd2_fragment) == 1)
+              && !ZON_nests_in (herd2_fragment, herd1_fragment))
+          || ((ZON_level (herd2_fragment) == ZON_level (herd1_fragment))
+              && !ZON_same_fragment (herd2_fragment, herd1_fragment)));
+}
 
 
-void new_day_event_handler( gpointer key, gpointer value, gpointer user_data );
 
 /**
- * Optimized Version:
- * Responds to a new day event by releasing any pending contacts and
- * stochastically generating exposures and infections.  This optimized version
- * calls a glib hash_table foreach function for each infectious herd in the 
- * list, which in turn does the work found in the non-optimized version of this
- * function.  This foreach call should be altered to an OMP pragma around a
- * for loop to utilize a parallel implementation of this loop, in future revisions.
+ * Chooses the recipient of one contact from herd 1: the unit of the wanted
+ * production type whose distance from herd 1 is closest to the contact's
+ * distance.  The units are taken from a list sorted by distance, so the
+ * closest one is found with a binary search, stepping past any units that
+ * cannot receive the contact.
  *
- * @param self the model.
- * @param herds a list of herds.
- * @param zones the zone list.
- * @param event a new day event.
- * @param rng a random number generator.
- * @param queue for any new events the model creates.
+ * Units whose distance is within EPSILON of the best match are considered to
+ * be "the same" distance.  Among those, contact with units forbidden by the
+ * zone rules is ignored, and the recipient is chosen in proportion to unit
+ * size.  (If two units are the same size, each has a 1 in 2 chance; if one is
+ * half the size of the other, it has a 1 in 3 chance.)  The best match itself
+ * is always in the running, even if the zone rules forbid contact with it; in
+ * that case the contact is dropped after the choice is made.  See the file
+ * drift.xml in the direct contact tests for why "the same" distance is
+ * measured from the best match rather than from the previous pick.
+ *
+ * The choice in proportion to size uses the running totals of unit sizes
+ * kept with the list, drawing again if the unit drawn cannot receive the
+ * contact.
+ *
+ * If the list holds only the units within some radius, and the best match or
+ * the units "the same" distance from herd 1 may lie beyond it, nothing is
+ * chosen and no random numbers are drawn, so that the caller can try again
+ * with a list that reaches farther.  A list limited to a radius is the start
+ * of the list of all units, so when it does reach far enough, the choice is
+ * the same.
+ *
+ * @param callback_data information about herd 1.
+ * @param contact the contact.  Its best_herd, best_herd_distance and
+ *   best_herd_difference are filled in, or best_herd is set to NULL if no unit
+ *   can receive the contact.
+ * @param count the number of units in the list.
+ * @param target_ids the unit indices in the list.
+ * @param distances the distance from herd 1 to each unit, in increasing order.
+ * @param cumul_sizes the running totals of the unit sizes.
+ * @param radius the distance within which the list holds every unit, or a
+ *   negative number if the list holds all units.
+ * @param wider_radius if the list does not reach far enough, a location in
+ *   which to store the radius to try next.  When the list holds a unit that
+ *   can receive the contact, a list reaching to that radius is sure to be
+ *   enough; otherwise the radius is doubled.
+ * @return FALSE if the list does not reach far enough, TRUE otherwise.
  */
-void
-handle_new_day_event (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
-                      ZON_zone_list_t * zones, EVT_new_day_event_t * event,
-                      RAN_gen_t * rng, EVT_event_queue_t * queue)
+static gboolean
+choose_recipient (callback_t * callback_data, sub_callback_t * contact,
+                  unsigned int count, const unsigned int *target_ids,
+                  const double *distances, const double *cumul_sizes,
+                  double radius, double *wider_radius)
 {
-  local_data_t *local_data;
-  EVT_event_t *pending_event;
-  PDF_dist_t *poisson;
-  new_day_event_hash_table_data *foreach_callback_data;
-  GQueue *q;
-#ifdef USE_MPI
-  double start_time, end_time;
-#endif
+  HRD_herd_list_t *herds;
+  HRD_herd_t *herd2;
+  ZON_zone_fragment_t *herd1_fragment;
+  double wanted, min_difference;
+  unsigned int lo, hi, best, first, last, k, tries;
+  double base, total, r;
 
 #if DEBUG
-  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER handle_new_day_event (%s) - Optimized Version", MODEL_NAME);
+  g_debug ("----- ENTER choose_recipient (%s)", MODEL_NAME);
 #endif
 
-  /******                                                      ******/
-  /* This is all the same as the previous version of this function */
-  /******                                                    ******/
-  local_data = (local_data_t *) (self->model_data);
-
-  /* Release any pending (due to shipping delays) events. */
-  local_data->rotating_index =
-    (local_data->rotating_index + 1) % local_data->pending_infections->len;
-  q = (GQueue *) g_ptr_array_index (local_data->pending_infections, local_data->rotating_index);
-  while (!g_queue_is_empty (q))
+  herds = callback_data->herds;
+  herd1_fragment = callback_data->herd1_fragment;
+  wanted = contact->movement_distance;
+  contact->best_herd = NULL;
+
+  /* Step outwards from the wanted distance until we reach a unit that can
+   * receive the contact.  The units below the wanted distance are at lo-1,
+   * lo-2, ..., the ones above at hi, hi+1, .... */
+  lo = hi = count_below (distances, count, wanted);
+  best = count;
+  while (lo > 0 || hi < count)
     {
-      /* Remove the event from this model's internal queue and place it in the
-       * simulation's event queue. */
-      pending_event = (EVT_event_t *) g_queue_pop_head (q);
-#ifndef WIN_DLL
-      /* Double-check that the event is coming out on the correct day. */
-      if (pending_event->type == EVT_Exposure)
-        g_assert (pending_event->u.exposure.day == event->day);
+      if (hi < count && (lo == 0 || distances[hi] - wanted < wanted - distances[lo - 1]))
+        k = hi++;
       else
-        g_assert (pending_event->u.attempt_to_infect.day == event->day);
+        k = --lo;
+      if (can_receive (HRD_herd_list_get (herds, target_ids[k]), contact->contact_type))
+        {
+          best = k;
+          break;
+        }
+    }
+  if (best == count)
+    {
+#if DEBUG
+      g_debug ("----- EXIT choose_recipient (%s):  no unit can receive the contact", MODEL_NAME);
 #endif
-      EVT_event_enqueue (queue, pending_event);
-      local_data->npending_infections--;
+      if (radius < 0)
+        return TRUE;
+      *wider_radius = MAX (2 * radius, 2 * wanted + EPSILON);
+      return FALSE;
     }
-  
-  /* Allocate a distribution that will be used to pick the number of exposures
-   * from a source. */
-  poisson = PDF_new_poisson_dist ( 1.0 );
-
-    /******                                                    ******/
-   /*           Begin optimization additions/changes               */
-  /******                                                    ******/
-
-  foreach_callback_data = g_new( new_day_event_hash_table_data, 1 );
-
-  /*  Fill in the user_data to be sent to the foreach hash table call */
-  foreach_callback_data->self = self;
-  foreach_callback_data->herds = herds;
-  foreach_callback_data->zones = zones;
-  foreach_callback_data->event = event;
-  foreach_callback_data->rng = rng;
-  foreach_callback_data->queue = queue; 
-  foreach_callback_data->_poisson = poisson; 
-  foreach_callback_data->new_infections = 0;
-  foreach_callback_data->exposure_attempts = 0;
 
-#ifdef USE_MPI
-    start_time = MPI_Wtime();
-#endif
-  
-#if defined( USE_MPI ) && defined( USE_OMP )
-#error TODO:  Add OMP code here to process the infectious herd list!
-#else  
-  /*  Iterate over the infectious herds.  This is a shortened list compared to the entire herd list */
-  g_hash_table_foreach( _iteration.infectious_herds, new_day_event_handler, foreach_callback_data );  
+  /* Find the units "the same" distance from herd 1 as the best match. */
+  min_difference = fabs (distances[best] - wanted);
+  if (radius >= 0 && wanted + min_difference + EPSILON > radius)
+    {
+      /* No unit beyond the radius can be a better match than this one, so
+       * the units that matter are all within wanted + min_difference. */
+#if DEBUG
+      g_debug ("----- EXIT choose_recipient (%s):  the list does not reach far enough", MODEL_NAME);
 #endif
-    
-#ifdef USE_MPI  
-    end_time = MPI_Wtime();
-    g_log( G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "handle_new_day_event: Day: %i  Processed %i infectious herds, %i exposure attempts, and %i new infections in %g seconds.\n", event->day, g_hash_table_size( _iteration.infectious_herds ), foreach_callback_data->exposure_attempts, foreach_callback_data->new_infections, (double)( end_time - start_time) );
+      *wider_radius = wanted + min_difference + EPSILON;
+      return FALSE;
+    }
+  first = count_below (distances, count, wanted - min_difference - EPSILON);
+  last = count_at_most (distances, count, wanted + min_difference + EPSILON);
+
+  if (last - first > 1)
+    {
+      /* Draw in proportion to size among all the units in that range, and
+       * throw back any unit that is not in the running. */
+      base = (first > 0) ? cumul_sizes[first - 1] : 0;
+      total = cumul_sizes[last - 1] - base;
+      for (tries = 0; tries < MAX_REDRAWS && total > 0; tries++)
+        {
+          r = base + RAN_num (callback_data->rng) * total;
+          k = first + count_at_most (cumul_sizes + first, last - first, r);
+          if (k >= last)
+            k = last - 1;
+          herd2 = HRD_herd_list_get (herds, target_ids[k]);
+          if (k == best
+              || (can_receive (herd2, contact->contact_type)
+                  && !zone_forbids (herd1_fragment, callback_data->zones->membership[herd2->index])))
+            {
+              best = k;
+              goto chosen;
+            }
+        }
+
+      /* Too many throw-backs: add up the sizes of the units in the running. */
+      total = 0;
+      for (k = first; k < last; k++)
+        {
+          herd2 = HRD_herd_list_get (herds, target_ids[k]);
+          if (k == best
+              || (can_receive (herd2, contact->contact_type)
+                  && !zone_forbids (herd1_fragment, callback_data->zones->membership[herd2->index])))
+            total += herd2->size;
+        }
+      if (total > 0)
+        {
+          r = RAN_num (callback_data->rng) * total;
+          for (k = first; k < last; k++)
+            {
+              herd2 = HRD_herd_list_get (herds, target_ids[k]);
+              if (k == best
+                  || (can_receive (herd2, contact->contact_type)
+                      && !zone_forbids (herd1_fragment, callback_data->zones->membership[herd2->index])))
+                {
+                  if (r < herd2->size)
+                    {
+                      best = k;
+                      break;
+                    }
+                  r -= herd2->size;
+                }
+            }
+        }
+    }
+
+chosen:
+  contact->best_herd = HRD_herd_list_get (herds, target_ids[best]);
+  contact->best_herd_distance = distances[best];
+  contact->best_herd_difference = fabs (distances[best] - wanted);
+
+#if DEBUG
+  g_debug ("----- EXIT choose_recipient (%s)", MODEL_NAME);
 #endif
-  
-  /*  Free memory used by the user_data structure */
-  g_free( foreach_callback_data );
+  return TRUE;
+}
+
 
-  /* Free memory used by the Poisson distribution */
-  PDF_free_dist (poisson);
+
+/**
+ * Fills in the table of movement control multipliers for a day.  The
+ * multipliers depend only on the contact type, the zone the source is in, the
+ * source and recipient production types and the number of days since the
+ * public announcement, so they are looked up here once per day, instead of
+ * once per source in plan_contacts().  Nothing is looked up if the table is
+ * already filled in for the same number of days since the announcement.
+ *
+ * Looking up a chart moves the chart's interpolation accelerator, so this also
+ * keeps the threads in plan_contacts() from writing to the charts.
+ *
+ * @param local_data the model's local data.
+ * @param zones the zone list.
+ * @param day the current simulation day.
+ */
+static void
+fill_movement_factors (local_data_t * local_data, ZON_zone_list_t * zones, int day)
+{
+  int days_since_announcement;
+  double x;
+  unsigned int nprod_types, nzones, background_index;
+  NAADSM_contact_type contact_type;
+  unsigned int zone_index, i, j;
+  param_block_t **contact_type_block;
+  param_block_t *param_block;
+  REL_chart_t *control_chart;
+  double zone_factor;
+  double *factors;
+
+  if (local_data->outbreak_known)
+    days_since_announcement = day - local_data->public_announcement_day;
+  else
+    days_since_announcement = -1;
+  if (days_since_announcement == local_data->movement_factors_day)
+    return;
 
 #if DEBUG
-  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- EXIT handle_new_day_event (%s) - Optimized Version", MODEL_NAME);
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
+         "fill_movement_factors: filling in multipliers for day %i", day);
 #endif
+
+  /* Before the public announcement, every unit uses its movement control
+   * chart at day 0. */
+  x = MAX (days_since_announcement, 0);
+  nprod_types = local_data->production_types->len;
+  nzones = ZON_zone_list_length (zones);
+  background_index = ZON_level (ZON_zone_list_get_background (zones)) - 1;
+  for (contact_type = NAADSM_DirectContact; contact_type <= NAADSM_IndirectContact; contact_type++)
+    for (zone_index = 0; zone_index < nzones; zone_index++)
+      for (i = 0; i < nprod_types; i++)
+        {
+          contact_type_block = local_data->param_block[contact_type][i];
+          if (contact_type_block == NULL)
+            continue;
+          factors = local_data->movement_factors
+            + ((contact_type * nzones + zone_index) * nprod_types + i) * nprod_types;
+
+          /* Units inside a zone use the zone's chart for their production
+           * type, if there is one. */
+          control_chart = NULL;
+          if (local_data->outbreak_known && zone_index != background_index)
+            control_chart = local_data->movement_control[contact_type][zone_index][i];
+          if (control_chart != NULL)
+            zone_factor = REL_chart_lookup (x, control_chart);
+          for (j = 0; j < nprod_types; j++)
+            {
+              param_block = contact_type_block[j];
+              if (param_block == NULL)
+                continue;
+              if (control_chart != NULL)
+                factors[j] = zone_factor;
+              else
+                factors[j] = REL_chart_lookup (x, param_block->movement_control);
+            }
+        }
+  local_data->movement_factors_day = days_since_announcement;
 }
 
+
+
 /**
- * Responds to a new day event by releasing any pending contacts and
- * stochastically generating exposures and infections.
- * This is the optimized version, which builds matrices of exposure attempt/production_type/contact_type
- * combinations, and sends them to the optimized version of check_and_choose.
+ * Works out the contacts from one source unit on one day: how many shipments
+ * of each contact type go to each production type, how far each one travels,
+ * which unit receives it, whether the exposure is adequate, and how long the
+ * shipment takes.  The herds, the zones and the event queue are only read
+ * here, so several sources can be worked on at once in different threads.  The
+ * exposures are recorded in the slot, and handle_new_day_event() turns them
+ * into events afterwards, in order of source.
  *
- * @param key       Unused, but required by g_hash_table_foreach()
- * @param value     A Pointer to the infectious herd, (source herd).
- * @param user_data A Pointer to the foreach_callback_data structure, as passed by the optimized handle_new_day_event() function.
+ * All random numbers come from the source's own stream for the day, so the
+ * outcome for a source does not depend on which thread works on it or on the
+ * order in which the sources are worked on.
+ *
+ * @param self the model.
+ * @param slot the working space to use.  The planned exposures are appended
+ *   to its exposures array.
+ * @param herd1 the source unit.
  */
-void new_day_event_handler( gpointer key, gpointer value, gpointer user_data )
+static void
+plan_contacts (struct naadsm_model_t_ *self, source_slot_t * slot, HRD_herd_t * herd1)
 {
   local_data_t *local_data;
   double disease_control_factors;
   double rate;
   PDF_dist_t *poisson;
-  unsigned int nherds;          /* number of herds */
   NAADSM_contact_type contact_type;
   param_block_t **contact_type_block;
-  HRD_herd_t *herd1, *herd2;
+  HRD_herd_t *herd2;
   unsigned int nprod_types, i, j, k;
   param_block_t *param_block;
-  unsigned int herd2_index;
-  unsigned int zone_index;
-  REL_chart_t *control_chart;
+  unsigned int nzones;
+  const double *movement_factors;
   int nexposures;
-  EVT_event_t *exposure, *attempt_to_infect;
   callback_t callback_data;
-  double distance;              /* between two herds being considered */
   gboolean contact_forbidden;
   double r, P;
-  gboolean contact_is_adequate;
-  ZON_zone_fragment_t *background_zone, *herd1_fragment, *herd2_fragment;
-  int shipping_delay;
-  int delay_index;
-  GQueue *q;
-  GPtrArray ***_contacts;
+  ZON_zone_fragment_t *herd1_fragment, *herd2_fragment;
+  unsigned int pair, first, ncontacts;
+  sub_callback_t *contact;
+  gboolean have_recipients;
+  double radius;
+  unsigned int nrecipients;
+  const unsigned int *target_ids;
+  const double *distances, *cumul_sizes;
 
-  struct naadsm_model_t_ *self;
   HRD_herd_list_t *herds;
   ZON_zone_list_t *zones;
-  EVT_new_day_event_t *event;
   RAN_gen_t *rng;
-  EVT_event_queue_t *queue;  
+  int day;
+  planned_exposure_t planned;
   unsigned long sum_exposures;
-  double max_distance;
-  unsigned long new_infections;
-  
-  
+
 #if DEBUG
-  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER new_day_event_handler - Optimized Version" );
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER plan_contacts (%s)", MODEL_NAME);
 #endif
   
-  max_distance = 0.0;  
-  new_infections = 0;
   sum_exposures = 0;
 
-  /*  Does our user_data actually point to something? */
-  if ( user_data != NULL )
-  {
-    new_day_event_hash_table_data *foreach_callback_data = (new_day_event_hash_table_data *) user_data;
+  local_data = (local_data_t *) (self->model_data);
+  herds = local_data->day_herds;
+  zones = local_data->day_zones;
+  day = local_data->day;
+
+  /*  Switch to this source's random number stream for today. */
+  rng = &slot->rng;
+  RAN_set_substream (rng, local_data->day_rng, RAN_ContactSpreadStream,
+                     herd1->index, (unsigned int) day);
+
+  /*  Set the usual items for this function from the choose_recipient callback structure*/
+  callback_data.self = self;
+  callback_data.herds = herds;
+  callback_data.zones = zones;
+  callback_data.rng = rng;
+
+  poisson = slot->poisson;
+  nprod_types = local_data->production_types->len;
     
-    self = foreach_callback_data->self;
-    herds = foreach_callback_data->herds;
-    zones = foreach_callback_data->zones;
-    event = foreach_callback_data->event;
-    rng = foreach_callback_data->rng;
-    queue = foreach_callback_data->queue;  
-
-    /*  Do we actually have a valid model_data pointer? */
-    if ( self->model_data != NULL )
-    {
-      local_data = (local_data_t *) (self->model_data);
-
-      /*  Set the usual items for this function from the check_and_choose callback structure*/
-      callback_data.self = self;
-      callback_data.herds = herds;
-      callback_data.zones = zones;
-      callback_data.rng = rng;
-
-      poisson = foreach_callback_data->_poisson;
-      background_zone = ZON_zone_list_get_background ( zones );
-      nprod_types = local_data->production_types->len;
-      nherds = HRD_herd_list_length ( herds );
-        
-      herd1 = (HRD_herd_t *) value;
-      herd1_fragment = zones->membership[herd1->index];
-      callback_data.herd1_fragment = herd1_fragment;      
-      callback_data.herd1 = herd1;
+  herd1_fragment = zones->membership[herd1->index];
+  callback_data.herd1_fragment = herd1_fragment;      
+  callback_data.herd1 = herd1;
+
+  /*  This source's row of today's movement control multipliers, for the
+      first contact type. */
+  nzones = ZON_zone_list_length ( zones );
+  movement_factors = local_data->movement_factors
+    + ((ZON_level ( herd1_fragment ) - 1) * nprod_types + herd1->production_type) * nprod_types;
 
 #if DEBUG
-      g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
-             "new_day_event_handler:  unit \"%s\" is %s (%i), state is %s",
-             herd1->official_id, herd1->production_type_name, herd1->production_type, HRD_status_name[herd1->status]);
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
+         "plan_contacts:  unit \"%s\" is %s (%i), state is %s",
+         herd1->official_id, herd1->production_type_name, herd1->production_type, HRD_status_name[herd1->state->status]);
 #endif
 
-      /*  How many contact types do we have?  */
-      j = 0;
-      for ( contact_type = NAADSM_DirectContact; contact_type <= NAADSM_IndirectContact; contact_type++ )
-        j++;
-
-      /*  Begin building 1-dimension of the attempted exposure matrix */
-      _contacts = g_new( GPtrArray **, j );
-      
-      /*  Set some more callback data for check_and_choose to use */
-      callback_data.contact_count = j;
-      callback_data.production_type_count = nprod_types;
-      callback_data._contacts = _contacts; 
-
-      /*  Iterate over all contact/production-type pairs and build the remaining dimensions of the matrix of desired matches for exposure attempts */
-      if ( callback_data.contact_count > 0 )
-      {        
-        j = 0;
-        for ( contact_type = NAADSM_DirectContact; contact_type <= NAADSM_IndirectContact; contact_type++ )
-        {
-          _contacts[j] = g_new( GPtrArray *, nprod_types );
-  
-          contact_type_block = local_data->param_block[contact_type][herd1->production_type];
+  /*  How many contact types do we have?  */
+  j = 0;
+  for ( contact_type = NAADSM_DirectContact; contact_type <= NAADSM_IndirectContact; contact_type++ )
+    j++;
+
+  /*  Set some more callback data for choose_recipient to use */
+  callback_data.contact_count = j;
+  callback_data.production_type_count = nprod_types;
+
+  /*  Start a fresh matrix of attempted exposures in the working space
+      left over from the previous source. */
+  g_array_set_size( slot->contacts, 0 );
+
+  /*  Iterate over all contact/production-type pairs and build the remaining dimensions of the matrix of desired matches for exposure attempts */
+  if ( callback_data.contact_count > 0 )
+  {        
+    j = 0;
+    for ( contact_type = NAADSM_DirectContact; contact_type <= NAADSM_IndirectContact; contact_type++ )
+    {
+      contact_type_block = local_data->param_block[contact_type][herd1->production_type];
 
 #if DEBUG
-      g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
-             "new_day_event_handler:  Trying %i production types for this contact type %s",
-            nprod_types, (( contact_type == NAADSM_DirectContact)? "Direct":"Indirect"));
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
+         "plan_contacts:  Trying %i production types for this contact type %s",
+        nprod_types, (( contact_type == NAADSM_DirectContact)? "Direct":"Indirect"));
 #endif  
-          for (i = 0; i < nprod_types; i++)
-          {
-            /*  Reset maximum distance desired to zero for each contact/production-type pair.  
-                This is used only by the RTree search function.  */
-            distance = 0.0;
-            
-            /*  Create this element of the 2nd Dimension of the exposure attempt matrix */
-            _contacts[j][i] = g_ptr_array_new();
+      for (i = 0; i < nprod_types; i++)
+      {
+        /*  The contacts for this contact/production-type pair start at the
+            current end of the working space. */
+        pair = contact_type * nprod_types + i;
+        slot->first_contact[pair] = slot->contacts->len;
+        slot->ncontacts[pair] = 0;
   
-            if (contact_type_block != NULL)
-            {
-              /*  Get this combination, contact_type/production_type, param_block from memory */              
-              param_block = contact_type_block[i];
+        if (contact_type_block != NULL)
+        {
+          /*  Get this combination, contact_type/production_type, param_block from memory */              
+          param_block = contact_type_block[i];
   
-              if ( param_block != NULL )
-              {
+          if ( param_block != NULL )
+          {
   
-                /*  Can this exposure attempt happen? */
-                if ( !((herd1->quarantined) && (contact_type == NAADSM_DirectContact)) )
-                {
-                  /*  Check spread parameters to see if this unit's status can spread for this contact type */ 
-                  if ( (herd1->status == Latent && param_block->latent_units_can_infect == TRUE) || 
-                       (herd1->status == InfectiousSubclinical && param_block->subclinical_units_can_infect == TRUE)
-                       || ( (herd1->status != Latent) && (herd1->status != InfectiousSubclinical) )
-                     )
-                  { 
-                    /*  Okay, this unit CAN spread disease for this contact/production_type pair 
-                        Establish the parameters of this exposure attempt.  */
-                    
-                    
-                    /* Compute a multiplier to reduce the rate of movement once the
-                     * community is aware of an outbreak. */
-                    if ( !local_data->outbreak_known )
-                      disease_control_factors = REL_chart_lookup (0, param_block->movement_control);
-                    else if (ZON_same_zone (background_zone, herd1_fragment))
-                      disease_control_factors =
-                        REL_chart_lookup (event->day - local_data->public_announcement_day,
-                                          param_block->movement_control);
-                    else
-                    {
-                      zone_index = ZON_level (herd1_fragment) - 1;
-#if DEBUG
-                      g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "zone index = %u", zone_index);
-#endif                        
-                      control_chart =
-                        local_data->movement_control[contact_type][zone_index][herd1->production_type];
-                      if (control_chart == NULL)
-                      {
-#if DEBUG
-                        g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
-                               "new_day_event_handler:  unit is in \"%s\" zone, no special control chart for %s units in this zone",
-                               herd1_fragment->parent->name, herd1->production_type_name);
-#endif
-                        control_chart = param_block->movement_control;
-                      }
-                      else
-                      {
+            /*  Can this exposure attempt happen? */
+            if ( !((herd1->state->quarantined) && (contact_type == NAADSM_DirectContact)) )
+            {
+              /*  Check spread parameters to see if this unit's status can spread for this contact type */ 
+              if ( (herd1->state->status == Latent && param_block->latent_units_can_infect == TRUE) || 
+                   (herd1->state->status == InfectiousSubclinical && param_block->subclinical_units_can_infect == TRUE)
+                   || ( (herd1->state->status != Latent) && (herd1->state->status != InfectiousSubclinical) )
+                 )
+              { 
+                /*  Okay, this unit CAN spread disease for this contact/production_type pair 
+                    Establish the parameters of this exposure attempt.  */
+                
+                
+                /* Look up the multiplier that reduces the rate of movement
+                 * once the community is aware of an outbreak. */
+                disease_control_factors = movement_factors[contact_type * nzones * nprod_types * nprod_types + i];
 #if DEBUG
-                        g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
-                               "new_day_event_handler:  unit is in \"%s\" zone, using special control chart for %s units in this zone",
-                               herd1_fragment->parent->name, herd1->production_type_name);
+                g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
+                       "plan_contacts:  unit is in \"%s\" zone, movement multiplier = %g",
+                       herd1_fragment->parent->name, disease_control_factors);
 #endif
-                        ;
-                      }
-                      disease_control_factors =
-                        REL_chart_lookup (event->day - local_data->public_announcement_day,
-                                          control_chart);
-                    }; /*  END Compute a multiplier */
   
   
-                    /* Pick the number of exposures from this source.
-                     * If a fixed number of movements is specified, use it.
-                     * Otherwise, pick a number from the Poisson distribution. */
-                    if (param_block->fixed_movement_rate > 0)
-                    {
-                      rate = param_block->fixed_movement_rate * disease_control_factors;
+                /* Pick the number of exposures from this source.
+                 * If a fixed number of movements is specified, use it.
+                 * Otherwise, pick a number from the Poisson distribution. */
+                if (param_block->fixed_movement_rate > 0)
+                {
+                  rate = param_block->fixed_movement_rate * disease_control_factors;
 #if DEBUG
-                      g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
-                             "new_day_event_handler:  contact rate = %g (fixed) * %g = %g",
-                             param_block->fixed_movement_rate, disease_control_factors, rate);
+                  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
+                         "plan_contacts:  contact rate = %g (fixed) * %g = %g",
+                         param_block->fixed_movement_rate, disease_control_factors, rate);
 #endif
-                      nexposures = (int) ((event->day + 1) * rate) - (int) (event->day * rate);
-                      sum_exposures = sum_exposures + nexposures;
-                    }
-                    else
-                    {
-                      rate = param_block->movement_rate * disease_control_factors;
+                  nexposures = (int) ((day + 1) * rate) - (int) (day * rate);
+                  sum_exposures = sum_exposures + nexposures;
+                }
+                else
+                {
+                  rate = param_block->movement_rate * disease_control_factors;
 #if DEBUG
-                      g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
-                             "new_day_event_handler:  contact rate = %g * %g = %g",
-                             param_block->movement_rate, disease_control_factors, rate);
+                  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,
+                         "plan_contacts:  contact rate = %g * %g = %g",
+                         param_block->movement_rate, disease_control_factors, rate);
 #endif
-                      poisson->u.poisson.mu = rate;
-                      nexposures = (int) (PDF_random (poisson, rng));
-                      sum_exposures = sum_exposures + nexposures;                          
-                    }
+                  poisson->u.poisson.mu = rate;
+                  nexposures = (int) (PDF_random (poisson, rng));
+                  sum_exposures = sum_exposures + nexposures;                          
+                }
 #if DEBUG
-                    g_debug ("new_day_event_handler:  Day %i, Needing %i exposures from herd \"%s\", for production_type %i and contact_type %i",
-                             event->day, nexposures, herd1->official_id, i + 1, j + 1 );
+                g_debug ("plan_contacts:  Day %i, Needing %i exposures from herd \"%s\", for production_type %i and contact_type %i",
+                         day, nexposures, herd1->official_id, i + 1, j + 1 );
 #endif
   
-                    /*  Now create and fillin the 3rd and final dimension of the 
-                        exposure attempt matrix, to be used by check_and_choose  */
-                    for ( k = 0; k < nexposures; k++ )
-                    {
-                      /*  Allocate some memory for this data */  
-                      sub_callback_t *sub_callback = g_new(sub_callback_t, 1);
-  
-                      if ( sub_callback != NULL )
-                      {
-                        /*  Add the pointer to this data to the matrix */ 
-                        g_ptr_array_add( _contacts[j][i], sub_callback );
-  
-                        sub_callback->try_again = TRUE;
-                        sub_callback->contact_type = contact_type;
-                        sub_callback->recipient_production_type = i;
-                        sub_callback->best_herd = NULL;
-                        sub_callback->movement_distance = PDF_random (param_block->distance_dist, rng);
-                        if (sub_callback->movement_distance < 0)
-                          sub_callback->movement_distance = 0;
-  
-                        /*  Use maximum distance desired for the bounding box in RTree */
-                        if ( sub_callback->movement_distance > distance )
-                          distance = sub_callback->movement_distance;
-#if DEBUG
-                        g_debug ( "new_day_event_handler:  contact of %g km",sub_callback->movement_distance );
-#endif  
-                      };  
-                    };  /*  END nexposures for loop */                
-                  }
-                  else
-                  {
-                    if ( ( herd1->status != Latent ) && ( herd1->status != InfectiousSubclinical ) )
-                      g_log ( G_LOG_DOMAIN, G_LOG_LEVEL_ERROR, "new_day_event_handler:  !! ERROR !!  Herd1 is okay to infect, but was not allowed to...something is wrong with the if statement logic...." );
-                     
-                  }
+                /*  Now fill in this pair's row of the exposure attempt
+                    matrix, to be used by choose_recipient  */
+                if ( nexposures > 0 )
+                {
+                  first = slot->contacts->len;
+                  g_array_set_size( slot->contacts, first + nexposures );
+                  slot->ncontacts[pair] = nexposures;
                 }
-                else
+                for ( k = 0; k < nexposures; k++ )
                 {
+                  contact = &g_array_index( slot->contacts, sub_callback_t, first + k );
+                  contact->contact_type = contact_type;
+                  contact->recipient_production_type = i;
+                  contact->best_herd = NULL;
+                  contact->movement_distance = PDF_random (param_block->distance_dist, rng);
+                  if (contact->movement_distance < 0)
+                    contact->movement_distance = 0;
 #if DEBUG
-                  g_debug ( "new_day_event_handler:  Herd1 is quarantined and this is direct contact" );
-#endif                    
-                };
+                  g_debug ( "plan_contacts:  contact of %g km",contact->movement_distance );
+#endif  
+                };  /*  END nexposures for loop */                
               }
               else
               {
-#if DEBUG
-                g_debug ( "new_day_event_handler:  parameter_block empty for this production_type/contact_type pair, %i/%s", i + 1, ((contact_type == NAADSM_DirectContact)? "Direct":"Indirect") );
-#endif                    
-              };
+                if ( ( herd1->state->status != Latent ) && ( herd1->state->status != InfectiousSubclinical ) )
+                  g_log ( G_LOG_DOMAIN, G_LOG_LEVEL_ERROR, "plan_contacts:  !! ERROR !!  Herd1 is okay to infect, but was not allowed to...something is wrong with the if statement logic...." );
+                 
+              }
             }
             else
             {
 #if DEBUG
-              g_debug ( "new_day_event_handler:  contact_type_block empty for this production_type/contact_type pair" );
-#endif                
-            };    
-            
-            /*  Calculate the overall maximum distance for the RTree search */
-            if ( max_distance < distance )
-              max_distance = distance;     
+              g_debug ( "plan_contacts:  Herd1 is quarantined and this is direct contact" );
+#endif                    
+            };
+          }
+          else
+          {
 #if DEBUG
-            g_log ( G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "new_day_event_handler:  using a max distance of %g km for this contact/production-type pair", distance );
-#endif            
+            g_debug ( "plan_contacts:  parameter_block empty for this production_type/contact_type pair, %i/%s", i + 1, ((contact_type == NAADSM_DirectContact)? "Direct":"Indirect") );
+#endif                    
           };
-          j = j +1;
-        };  /*  END build matrix of desired matches */
-      }; /*  END if contact_type count > 0 */
+        }
+        else
+        {
+#if DEBUG
+          g_debug ( "plan_contacts:  contact_type_block empty for this production_type/contact_type pair" );
+#endif                
+        };    
+      };
+      j = j +1;
+    };  /*  END build matrix of desired matches */
+  }; /*  END if contact_type count > 0 */
 
-      if ( sum_exposures > 0 )
-      {
+  if ( sum_exposures > 0 )
+  {
 #if DEBUG
-        g_log ( G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "new_day_event_handler:  Total exposures sought for this herd: %lu", sum_exposures );
+    g_log ( G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "plan_contacts:  Total exposures sought for this herd: %lu", sum_exposures );
 #endif          
 
-        callback_data.num_unmatched_exposures = sum_exposures;
-        spatial_search_circle_by_id (herds->spatial_index, herd1->index, max_distance*2.0 + EPSILON,
-                                     check_and_choose, &callback_data);
-
-        /* A re-search using the exhaustive method is necessary if some
-         * exposures remain unmatched. */
-        if (callback_data.num_unmatched_exposures > 0)
+    /*  Find a recipient for each contact in the list of units of the
+        recipient production type, sorted by their distance from this
+        unit.  The list reaches as far as either contact type's distances
+        need.  If it turns out to be too short for some contact, it is
+        replaced by a longer one found with the spatial index, which is kept
+        for this source and production type from then on.  */
+    for( i = 0; i < nprod_types; i++ )
+    {
+      have_recipients = FALSE;
+      radius = 0;
+      for( contact_type = NAADSM_DirectContact; contact_type <= NAADSM_IndirectContact; contact_type++ )
+      {
+        contact_type_block = local_data->param_block[contact_type][herd1->production_type];
+        if ( contact_type_block == NULL || contact_type_block[i] == NULL )
+          continue;
+        if ( radius >= 0 )
         {
-          /*  Iterate over the results and reset "try_again" status based on each 
-              match's status.  A re-search using the exhaustive method may be necessary... */
-          j = 0;
-          for( contact_type = NAADSM_DirectContact; contact_type <= NAADSM_IndirectContact; contact_type++ )
-          {
-            for( i = 0; i < nprod_types; i++ )
-            {
-              GPtrArray *t_array = NULL;
-              t_array = _contacts[j][i];
-                    
-              for( k = 0; k < t_array->len; k++ )
-              {                       
-                sub_callback_t *tsub = g_ptr_array_index( t_array, k );
-                if ( tsub != NULL )
-                {
-                  /*  Did we not find a match?? */ 
-                  tsub->try_again = ( tsub->best_herd == NULL );
-                };
-              }
-            };
-            j = j + 1;
-          }
-#if DEBUG
-          g_debug ( "new_day_event_handler:  Using exhaustive search" );
-#endif
-          /*  Iterate over the entire list of herds and find matches for each 
-              needed exposure, using the check_and_choose function */
-          for (herd2_index = 0; herd2_index < nherds; herd2_index++)
-          {
-            check_and_choose (herd2_index, &callback_data);
-          };
-        };
-  
+          if ( contact_type_block[i]->recipient_radius < 0 )
+            radius = -1;
+          else
+            radius = MAX (radius, contact_type_block[i]->recipient_radius);
+        }
+      }
+      for( contact_type = NAADSM_DirectContact; contact_type <= NAADSM_IndirectContact; contact_type++ )
+      {
+        pair = contact_type * nprod_types + i;
+        ncontacts = slot->ncontacts[pair];
+        if ( ncontacts == 0 )
+          continue;
+        if ( !have_recipients )
+        {
+          nrecipients = naadsm_get_units_by_distance (slot->recipients, herds, herd1, i, &radius,
+                                                      &target_ids, &distances, &cumul_sizes);
+          have_recipients = TRUE;
+        }
+        first = slot->first_contact[pair];
+        for( k = 0; k < ncontacts; k++ )
+        {
+          contact = &g_array_index( slot->contacts, sub_callback_t, first + k );
+          while ( !choose_recipient (&callback_data, contact,
+                                     nrecipients, target_ids, distances, cumul_sizes,
+                                     radius, &radius) )
+            nrecipients = naadsm_get_units_by_distance (slot->recipients, herds, herd1, i, &radius,
+                                                        &target_ids, &distances, &cumul_sizes);
+        }
+      }
+    }
+
+
+    /*  Okay, now we "should" have all the "best" fit's for each desired 
+        contact/production-type pair, items.  */
+    /*  Iterate over the results and post exposure and infection events 
+        when applicable */
+    for( contact_type = NAADSM_DirectContact; contact_type <= NAADSM_IndirectContact; contact_type++ )
+    {
+      contact_type_block = local_data->param_block[contact_type][herd1->production_type];
   
-        /*  Okay, now we "should" have all the "best" fit's for each desired 
-            contact/production-type pair, items.  */
-        /*  Iterate over the results and post exposure and infection events 
-            when applicable, and simultaneously delete dynamic memory used */
-        j = 0;
-        for( contact_type = NAADSM_DirectContact; contact_type <= NAADSM_IndirectContact; contact_type++ )
+      if ( contact_type_block != NULL )
+      {
+        for( i = 0; i < nprod_types; i++ )
         {
-          contact_type_block = local_data->param_block[contact_type][herd1->production_type];
+          pair = contact_type * nprod_types + i;
+          first = slot->first_contact[pair];
+          ncontacts = slot->ncontacts[pair];
   
-          if ( contact_type_block != NULL )
+          param_block = contact_type_block[i];
+  
+          if ( param_block != NULL )
           {
-            for( i = 0; i < nprod_types; i++ )
+            /*  Iterate over each exposure attempt for this contact/production_type pair */ 
+            for( k = 0; k < ncontacts; k++ )
             {
-              GPtrArray *t_array = NULL;
-              t_array = _contacts[j][i];
-  
-              param_block = contact_type_block[i];
-  
-              if ( param_block != NULL )
+              sub_callback_t *tsub = &g_array_index( slot->contacts, sub_callback_t, first + k );
+              if (tsub->best_herd != NULL)
               {
-                /*  Iterate over each exposure attempt for this contact/production_type pair */ 
-                for( k = 0; k < t_array->len; k++ )
+                /*  Create exposure and infection events here  */
+
+                /* An eligible recipient unit (correct production type, not
+                 * Destroyed, in range, etc... ) was found. */
+                herd2 = tsub->best_herd;
+#if DEBUG
+                g_debug ("plan_contacts:  unit \"%s\" within %g km of %g",
+                         herd2->official_id,
+                         tsub->best_herd_difference, tsub->movement_distance);
+#endif
+                /* Check whether contact with this unit is forbidden by the
+                 * zone rules. */
+                herd2_fragment = zones->membership[herd2->index];
+                contact_forbidden = FALSE;
+                if ( ZON_level ( herd2_fragment ) > ZON_level ( herd1_fragment ) )
                 {
-                  sub_callback_t *tsub = g_ptr_array_index( t_array, k );
-                  if ( tsub != NULL )
-                  {
-                    if (tsub->best_herd != NULL)
-                    {
-                      /*  Create exposure and infection events here  */
-  
-                      /* An eligible recipient unit (correct production type, not
-                       * Destroyed, in range, etc... ) was found. */
-                      herd2 = tsub->best_herd;
+                  contact_forbidden = TRUE;
 #if DEBUG
-                      g_debug ("new_day_event_handler:  unit \"%s\" within %g km of %g",
-                               herd2->official_id,
-                               tsub->best_herd_difference, tsub->movement_distance);
+                  g_debug ("plan_contacts: contact forbidden: contact from unit \"%s\" in \"%s\" zone, level %i to unit \"%s\" in \"%s\" zone, level %i would violate higher-to-lower rule",
+                           herd1->official_id,
+                           herd1_fragment->parent->name,
+                           herd1_fragment->parent->level,
+                           herd2->official_id,
+                           herd2_fragment->parent->name,
+                           herd2_fragment->parent->level);
 #endif
-                      /* Check whether contact with this unit is forbidden by the
-                       * zone rules. */
-                      herd2_fragment = zones->membership[herd2->index];
-                      contact_forbidden = FALSE;
-                      if ( ZON_level ( herd2_fragment ) > ZON_level ( herd1_fragment ) )
-                      {
-                        contact_forbidden = TRUE;
+                }
+                else if ( ZON_level ( herd2_fragment ) == ZON_level ( herd1_fragment ) )
+                {
+                  if ( !ZON_same_fragment ( herd2_fragment, herd1_fragment ) )
+                  {
+                    contact_forbidden = TRUE;
 #if DEBUG
-                        g_debug ("new_day_event_handler: contact forbidden: contact from unit \"%s\" in \"%s\" zone, level %i to unit \"%s\" in \"%s\" zone, level %i would violate higher-to-lower rule",
-                                 herd1->official_id,
-                                 herd1_fragment->parent->name,
-                                 herd1_fragment->parent->level,
-                                 herd2->official_id,
-                                 herd2_fragment->parent->name,
-                                 herd2_fragment->parent->level);
+                    g_debug ("plan_contacts: contact forbidden: contact from unit \"%s\" to unit \"%s\" in separate foci of \"%s\" zone would violate separate foci rule",
+                             herd1->official_id, herd2->official_id, herd1_fragment->parent->name);
 #endif
-                      }
-                      else if ( ZON_level ( herd2_fragment ) == ZON_level ( herd1_fragment ) )
-                      {
-                        if ( !ZON_same_fragment ( herd2_fragment, herd1_fragment ) )
-                        {
-                          contact_forbidden = TRUE;
+                  }
+                }
+                else /* ZON_level ( herd2_fragment ) < ZON_level ( herd1_fragment ) */
+                {
+                  if ( ZON_level ( herd1_fragment ) - ZON_level ( herd2_fragment ) > 1 )
+                  {
+                    contact_forbidden = TRUE;
 #if DEBUG
-                          g_debug ("new_day_event_handler: contact forbidden: contact from unit \"%s\" to unit \"%s\" in separate foci of \"%s\" zone would violate separate foci rule",
-                                   herd1->official_id, herd2->official_id, herd1_fragment->parent->name);
+                    g_debug ("plan_contacts: contact forbidden: contact from unit \"%s\" in \"%s\" zone, level %i to unit \"%s\" in non-adjacent \"%s\" zone, level %i",
+                             herd1->official_id,
+                             herd1_fragment->parent->name,
+                             herd1_fragment->parent->level,
+                             herd2->official_id,
+                             herd2_fragment->parent->name,
+                             herd2_fragment->parent->level);
 #endif
-                        }
-                      }
-                      else /* ZON_level ( herd2_fragment ) < ZON_level ( herd1_fragment ) */
-                      {
-                        if ( ZON_level ( herd1_fragment ) - ZON_level ( herd2_fragment ) > 1 )
-                        {
-                          contact_forbidden = TRUE;
+                  }
+                  else if ( !ZON_nests_in ( herd2_fragment, herd1_fragment ) )
+                  {
+                    contact_forbidden = TRUE;
 #if DEBUG
-                          g_debug ("new_day_event_handler: contact forbidden: contact from unit \"%s\" in \"%s\" zone, level %i to unit \"%s\" in non-adjacent \"%s\" zone, level %i",
-                                   herd1->official_id,
-                                   herd1_fragment->parent->name,
-                                   herd1_fragment->parent->level,
-                                   herd2->official_id,
-                                   herd2_fragment->parent->name,
-                                   herd2_fragment->parent->level);
+                    g_debug ("plan_contacts: contact forbidden: contact from unit \"%s\" in \"%s\" zone, level %i to unit \"%s\" in non-nested focus of \"%s\" zone, level %i",
+                             herd1->official_id,
+                             herd1_fragment->parent->name,
+                             herd1_fragment->parent->level,
+                             herd2->official_id,
+                             herd2_fragment->parent->name,
+                             herd2_fragment->parent->level);
 #endif
-                        }
-                        else if ( !ZON_nests_in ( herd2_fragment, herd1_fragment ) )
-                        {
-                          contact_forbidden = TRUE;
+                  }
+                }
+
+                /* If none of the zone rules forbade contact, create the exposure. */
+                if ( !contact_forbidden )
+                {
+                  /* Announce the exposure. */
 #if DEBUG
-                          g_debug ("new_day_event_handler: contact forbidden: contact from unit \"%s\" in \"%s\" zone, level %i to unit \"%s\" in non-nested focus of \"%s\" zone, level %i",
-                                   herd1->official_id,
-                                   herd1_fragment->parent->name,
-                                   herd1_fragment->parent->level,
-                                   herd2->official_id,
-                                   herd2_fragment->parent->name,
-                                   herd2_fragment->parent->level);
+                  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,"plan_contacts:  unit \"%s\" unit exposed", herd2->official_id);
 #endif
-                        }
-                      }
 
-                      /* If none of the zone rules forbade contact, create the exposure. */
-                      if ( !contact_forbidden )
-                      {
-                        /* Announce the exposure. */
+                  /* Is the exposure adequate (i.e., will it cause infection in a susceptible herd)? */
+                  if (contact_type == NAADSM_DirectContact && herd1->prevalence_curve != NULL)
+                    P = herd1->state->prevalence;
+                  else
+                    P = param_block->prob_infect;
+                  r = RAN_num (rng);
 #if DEBUG
-                        g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG,"new_day_event_handler:  unit \"%s\" unit exposed", herd2->official_id);
+                  if (r < P)
+                    g_debug ("plan_contacts:  r (%g) < P (%g), unit \"%s\" infected", r, P,
+                             herd2->official_id);
+                  else
+                    g_debug ("plan_contacts:  r (%g) >= P (%g), unit \"%s\" not infected", r,
+                             P, herd2->official_id);
 #endif
-  
-                        /* Is the exposure adequate (i.e., will it cause infection in a susceptible herd)? */
-                        if (contact_type == NAADSM_DirectContact && herd1->prevalence_curve != NULL)
-                          P = herd1->prevalence;
-                        else
-                          P = param_block->prob_infect;
-                        r = RAN_num (rng);
-                        contact_is_adequate = (r < P);
-  
-                        shipping_delay = (int) round (PDF_random (param_block->shipping_delay, rng));  
-                        exposure = EVT_new_exposure_event (herd1, herd2, event->day,
-                                                           contact_type, TRUE, 
-                                                           contact_is_adequate, shipping_delay);
-                        exposure->u.exposure.contact_type = contact_type; /* This seems redundant (exposure.cause does the same thing), but there's probably a reason.... */
-                              
-                        if (shipping_delay <= 0)
-                        {
-                          EVT_event_enqueue (queue, exposure);
-                        }
-                        else
-                        {
-                          exposure->u.exposure.day += shipping_delay;
-                          if (shipping_delay > local_data->pending_infections->len)
-                          {
-                            naadsm_extend_rotating_array (local_data->pending_infections,
-                                                          shipping_delay, local_data->rotating_index);
-                          }
-  
-                          delay_index = (local_data->rotating_index + shipping_delay) % local_data->pending_infections->len;
-                          q = (GQueue *) g_ptr_array_index (local_data->pending_infections, delay_index);
-                          g_queue_push_tail (q, exposure);
-                          local_data->npending_infections++;
-                        };
-
-                        /* If contact was adequate, queue an attempt to infect. */
-                        if( contact_is_adequate )
-                        {
+                  planned.herd1 = herd1;
+                  planned.herd2 = herd2;
+                  planned.contact_type = contact_type;
+                  planned.adequate = (r < P);
+                  planned.shipping_delay = (int) round (PDF_random (param_block->shipping_delay, rng));
+                  g_array_append_val (slot->exposures, planned);
+                } /* contact was not forbidden */
+              } 
+              else  /*  hmmm no match was found... */
+              {
 #if DEBUG
-                          g_debug ("new_day_event_handler:  r (%g) < P (%g), unit \"%s\" infected", r, P,
-                                   herd2->official_id);
+                g_debug ("plan_contacts:  no recipient can be found at ~%g km from unit \"%s\" for this instance of this contact_type / production_type pair" ,
+                         tsub->movement_distance, herd1->official_id);
 #endif
-                          new_infections = new_infections + 1;
-                          attempt_to_infect = EVT_new_attempt_to_infect_event (herd1, herd2,
-                                                                               event->day,
-                                                                               contact_type);
-                          if (shipping_delay <= 0)
-                            EVT_event_enqueue (queue, attempt_to_infect);
-                          else
-                          {
-                            attempt_to_infect->u.attempt_to_infect.day += shipping_delay;
-                            /* The queue to add the delayed infection to was already
-                             * found above. */
-                            g_queue_push_tail (q, attempt_to_infect);
-                            local_data->npending_infections++;
-                          };
-                        }
-                        else
-                        {
+                ;
+              };  /*  END if a herd match was found */
+            };  /*  END for loop iteration over this pair's contacts  */
+          };
+        }; /*  END iteration over production_types  */
+      };
+    }; /*  END iteration over contact_types  */
+  } /*  END if contact count > 0 */
 #if DEBUG
-                          g_debug ("new_day_event_handler:  r (%g) >= P (%g), unit \"%s\" not infected", r,
-                                   P, herd2->official_id);
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- EXIT plan_contacts (%s)", MODEL_NAME);
+#endif  
+}
+
+
+
+/**
+ * Works out the contacts from the day's sources that belong to one slot.
+ *
+ * @param self the model.
+ * @param slot_index which slot.
+ */
+static void
+plan_slot_contacts (struct naadsm_model_t_ *self, unsigned int slot_index)
+{
+  local_data_t *local_data;
+  source_slot_t *slot;
+  unsigned int i, herd1_index, first;
+
+  local_data = (local_data_t *) (self->model_data);
+  slot = &local_data->slots[slot_index];
+  for (i = 0; i < local_data->sources->len; i++)
+    {
+      herd1_index = g_array_index (local_data->sources, unsigned int, i);
+      if (herd1_index % local_data->nslots != slot_index)
+        continue;
+      first = slot->exposures->len;
+      g_array_index (local_data->first_exposure, unsigned int, i) = first;
+      plan_contacts (self, slot, HRD_herd_list_get (local_data->day_herds, herd1_index));
+      g_array_index (local_data->nexposures, unsigned int, i) = slot->exposures->len - first;
+    }
+}
+
+
+
+#if HAVE_GTHREAD
+/**
+ * Works out the contacts for one slot, then reports that the slot is done.
+ * This function is typed as a GFunc so that it can be used with a GLib thread
+ * pool.
+ *
+ * @param data the slot index, cast to a gpointer.  (Slot 0 is never handled by
+ *   the pool, and a thread pool cannot be given a NULL task.)
+ * @param user_data the model, cast to a gpointer.
+ */
+static void
+plan_slot_contacts_in_thread (gpointer data, gpointer user_data)
+{
+  struct naadsm_model_t_ *self;
+
+  self = (struct naadsm_model_t_ *) user_data;
+  plan_slot_contacts (self, GPOINTER_TO_UINT (data));
+  g_async_queue_push (((local_data_t *) (self->model_data))->slots_done, data);
+}
 #endif
-                        };
-                      } /* contact was not forbidden */
-                    } 
-                    else  /*  hmmm no match was found... */
-                    {
+
+
+
+/**
+ * Turns a planned exposure into an exposure event and, if the exposure is
+ * adequate, an attempt to infect.  The events go into the simulation's event
+ * queue, or are held back for as long as the shipment takes.
+ *
+ * @param local_data the model's local data.
+ * @param planned the planned exposure.
+ * @param day the current simulation day.
+ * @param queue for any new events the model creates.
+ */
+static void
+queue_exposure (local_data_t * local_data, planned_exposure_t * planned,
+                int day, EVT_event_queue_t * queue)
+{
+  EVT_event_t *exposure, *attempt_to_infect;
+  int shipping_delay;
+  int delay_index;
+  GQueue *q = NULL;
+
+  shipping_delay = planned->shipping_delay;
+  exposure = EVT_new_exposure_event (planned->herd1, planned->herd2, day,
+                                     planned->contact_type, TRUE,
+                                     planned->adequate, shipping_delay);
+  exposure->u.exposure.contact_type = planned->contact_type; /* This seems redundant (exposure.cause does the same thing), but there's probably a reason.... */
+
+  if (shipping_delay <= 0)
+    EVT_event_enqueue (queue, exposure);
+  else
+    {
+      exposure->u.exposure.day += shipping_delay;
+      if (shipping_delay > local_data->pending_infections->len)
+        naadsm_extend_rotating_array (local_data->pending_infections,
+                                      shipping_delay, local_data->rotating_index);
+      delay_index = (local_data->rotating_index + shipping_delay) % local_data->pending_infections->len;
+      q = (GQueue *) g_ptr_array_index (local_data->pending_infections, delay_index);
+      g_queue_push_tail (q, exposure);
+      local_data->npending_infections++;
+    }
+
+  /* If contact was adequate, queue an attempt to infect. */
+  if (planned->adequate)
+    {
+      attempt_to_infect = EVT_new_attempt_to_infect_event (planned->herd1, planned->herd2,
+                                                           day, planned->contact_type);
+      if (shipping_delay <= 0)
+        EVT_event_enqueue (queue, attempt_to_infect);
+      else
+        {
+          attempt_to_infect->u.attempt_to_infect.day += shipping_delay;
+          /* The queue to add the delayed infection to was already found
+           * above. */
+          g_queue_push_tail (q, attempt_to_infect);
+          local_data->npending_infections++;
+        }
+    }
+}
+
+
+
+/**
+ * Responds to a new day event by releasing any pending contacts and
+ * stochastically generating exposures and infections.
+ *
+ * The contacts from the day's sources are worked out first, spread over the
+ * model's threads if there is more than one (see plan_contacts()).  Then the
+ * planned exposures are turned into events source by source, in order of
+ * unit index, so that the events come out the same no matter how many
+ * threads there are.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones the zone list.
+ * @param event a new day event.
+ * @param rng a random number generator.
+ * @param queue for any new events the model creates.
+ */
+void
+handle_new_day_event (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+                      ZON_zone_list_t * zones, EVT_new_day_event_t * event,
+                      RAN_gen_t * rng, EVT_event_queue_t * queue)
+{
+  local_data_t *local_data;
+  EVT_event_t *pending_event;
+  GQueue *q;
+  unsigned int nsources, i, j, slot_index, first, nexposures;
+  source_slot_t *slot;
+  planned_exposure_t *planned;
+#ifdef USE_MPI
+  double start_time, end_time;
+  unsigned long exposure_attempts = 0, new_infections = 0;
+#endif
+
 #if DEBUG
-                      g_debug ("new_day_event_handler:  no recipient can be found at ~%g km from unit \"%s\" for this instance of this contact_type / production_type pair" ,
-                               tsub->movement_distance, herd1->official_id);
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER handle_new_day_event (%s)", MODEL_NAME);
 #endif
-                      ;
-                    };  /*  END if a herd match was found */
-                        
-                    /*  Free the structure memory stored at this location in this GPtrArray  */
-                    g_free( tsub );
-                        
-                  };  /* END if tsub != NULL  */
-                };  /*  END for loop iteration over this GPtrArray  */
-              };
-
-              /* Free memory for GPtrArray */
-              g_ptr_array_free( t_array, TRUE );
-              _contacts[j][i] = NULL; /* just in case */
-
-            }; /*  END iteration over production_types  */
-          };
 
-          /* Free memory for this row */
-          g_free( _contacts[j] );
-          j = j + 1;
-        }; /*  END iteration over contact_types  */
-      } /*  END if contact count > 0 */
+  local_data = (local_data_t *) (self->model_data);
+
+  /* Release any pending (due to shipping delays) events. */
+  local_data->rotating_index =
+    (local_data->rotating_index + 1 + event->ndays_skipped) % local_data->pending_infections->len;
+  q = (GQueue *) g_ptr_array_index (local_data->pending_infections, local_data->rotating_index);
+  while (!g_queue_is_empty (q))
+    {
+      /* Remove the event from this model's internal queue and place it in the
+       * simulation's event queue. */
+      pending_event = (EVT_event_t *) g_queue_pop_head (q);
+#ifndef WIN_DLL
+      /* Double-check that the event is coming out on the correct day. */
+      if (pending_event->type == EVT_Exposure)
+        g_assert (pending_event->u.exposure.day == event->day);
       else
-      {
-        /* Free memory */
-        for( j = 0, contact_type = NAADSM_DirectContact; contact_type <= NAADSM_IndirectContact; contact_type++, j++ )
+        g_assert (pending_event->u.attempt_to_infect.day == event->day);
+#endif
+      EVT_event_enqueue (queue, pending_event);
+      local_data->npending_infections--;
+    }
+
+#ifdef USE_MPI
+  start_time = MPI_Wtime ();
+#endif
+
+  /* Gather today's sources (Latent or Infectious units) in order of unit
+   * index. */
+  HRD_herd_set_sort (_iteration.infectious_herds);
+  nsources = HRD_herd_set_length (_iteration.infectious_herds);
+  g_array_set_size (local_data->sources, 0);
+  if (nsources > 0)
+    g_array_append_vals (local_data->sources,
+                         &HRD_herd_set_get (_iteration.infectious_herds, 0), nsources);
+  g_array_set_size (local_data->first_exposure, nsources);
+  g_array_set_size (local_data->nexposures, nsources);
+
+  fill_movement_factors (local_data, zones, event->day);
+
+  local_data->day_herds = herds;
+  local_data->day_zones = zones;
+  local_data->day_rng = rng;
+  local_data->day = event->day;
+  for (slot_index = 0; slot_index < local_data->nslots; slot_index++)
+    g_array_set_size (local_data->slots[slot_index].exposures, 0);
+
+  /* Work out the contacts from each source. */
+#if HAVE_GTHREAD
+  if (local_data->pool != NULL && nsources > 1)
+    {
+      for (slot_index = 1; slot_index < local_data->nslots; slot_index++)
+        g_thread_pool_push (local_data->pool, GUINT_TO_POINTER (slot_index), NULL);
+      plan_slot_contacts (self, 0);
+      for (slot_index = 1; slot_index < local_data->nslots; slot_index++)
+        g_async_queue_pop (local_data->slots_done);
+    }
+  else
+#endif
+    for (slot_index = 0; slot_index < local_data->nslots; slot_index++)
+      plan_slot_contacts (self, slot_index);
+
+  /* Create the events, source by source. */
+  for (i = 0; i < nsources; i++)
+    {
+      slot = &local_data->slots[g_array_index (local_data->sources, unsigned int, i) % local_data->nslots];
+      first = g_array_index (local_data->first_exposure, unsigned int, i);
+      nexposures = g_array_index (local_data->nexposures, unsigned int, i);
+      for (j = 0; j < nexposures; j++)
         {
-          for (i = 0; i < nprod_types; i++)
-            g_ptr_array_free (_contacts[j][i], TRUE);
-          g_free( _contacts[j] );
+          planned = &g_array_index (slot->exposures, planned_exposure_t, first + j);
+          queue_exposure (local_data, planned, event->day, queue);
+#ifdef USE_MPI
+          exposure_attempts++;
+          if (planned->adequate)
+            new_infections++;
+#endif
         }
-      }
-      g_free( _contacts );
-      _contacts = NULL;  /*  just in case */
+    }
+
+#ifdef USE_MPI
+  end_time = MPI_Wtime ();
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "handle_new_day_event: Day: %i  Processed %u infectious herds, %lu exposures, and %lu new infections in %g seconds.\n", event->day, nsources, exposure_attempts, new_infections, (double) (end_time - start_time));
+#endif
 
-    }; /*  END test model_data Not NULL */
-    
-    /*  Set some debugging or informative counts for use by who, 
-       (i.e. some function or procedure), ever might want/need them after this */
-    foreach_callback_data->new_infections = foreach_callback_data->new_infections + new_infections;
-    foreach_callback_data->exposure_attempts = foreach_callback_data->exposure_attempts + sum_exposures;  
-      
-  }; /*  END test user_data not NULL */
-  
 #if DEBUG
-  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- EXIT new_day_event_handler - Optimized Version" );
-#endif  
- }
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- EXIT handle_new_day_event (%s)", MODEL_NAME);
+#endif
+}
 
 
 
@@ -1250,6 +1525,7 @@ reset (struct naadsm_model_t_ *self)
   local_data = (local_data_t *) (self->model_data);
   local_data->outbreak_known = FALSE;
   local_data->public_announcement_day = 0;
+  local_data->movement_factors_day = NO_MOVEMENT_FACTORS;
   for (i = 0; i < local_data->pending_infections->len; i++)
     {
       q = (GQueue *) g_ptr_array_index (local_data->pending_infections, i);
@@ -1320,6 +1596,37 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do:
+ * tomorrow while any unit is latent or infectious, otherwise the day on
+ * which the next delayed exposure or infection comes due.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return the day, or G_MAXINT if nothing is scheduled.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  local_data_t *local_data;
+  unsigned int ahead;
+
+  local_data = (local_data_t *) (self->model_data);
+  if (herds->tally->nunits[Latent] > 0
+      || herds->tally->nunits[InfectiousSubclinical] > 0
+      || herds->tally->nunits[InfectiousClinical] > 0)
+    return day + 1;
+
+  ahead = naadsm_rotating_array_next_nonempty (local_data->pending_infections,
+                                               local_data->rotating_index);
+  return (ahead > 0) ? day + ahead : G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -1486,6 +1793,7 @@ local_free (struct naadsm_model_t_ *self)
   param_block_t *param_block;
   REL_chart_t ***contact_type_chart;
   GQueue *q;
+  source_slot_t *slot;
 
 #if DEBUG
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER free (%s)", MODEL_NAME);
@@ -1547,6 +1855,30 @@ local_free (struct naadsm_model_t_ *self)
     }
   g_ptr_array_free (local_data->pending_infections, TRUE);
 
+  g_free (local_data->movement_factors);
+
+#if HAVE_GTHREAD
+  if (local_data->pool != NULL)
+    {
+      g_thread_pool_free (local_data->pool, FALSE, TRUE);
+      g_async_queue_unref (local_data->slots_done);
+    }
+#endif
+  for (i = 0; i < local_data->nslots; i++)
+    {
+      slot = &local_data->slots[i];
+      g_array_free (slot->contacts, TRUE);
+      g_free (slot->first_contact);
+      g_free (slot->ncontacts);
+      naadsm_free_distance_index (slot->recipients);
+      PDF_free_dist (slot->poisson);
+      g_array_free (slot->exposures, TRUE);
+    }
+  g_free (local_data->slots);
+  g_array_free (local_data->sources, TRUE);
+  g_array_free (local_data->first_exposure, TRUE);
+  g_array_free (local_data->nexposures, TRUE);
+
   g_free (local_data);
   g_ptr_array_free (self->outputs, TRUE);
   g_free (self);
@@ -1660,6 +1992,9 @@ set_params (struct naadsm_model_t_ *self, PAR_parameter_t * params)
     {
       t.distance_dist = NULL;
     }
+  t.recipient_radius = recipient_radius (t.distance_dist);
+  if (t.recipient_radius >= 0)
+    spatial_search_add_query_radius (local_data->spatial_index, t.recipient_radius);
 
   e = scew_element_by_name (params, "delay");
   if (e != NULL)
@@ -1788,6 +2123,7 @@ set_params (struct naadsm_model_t_ *self, PAR_parameter_t * params)
               param_block->fixed_movement_rate = t.fixed_movement_rate;
               param_block->movement_control = REL_clone_chart (t.movement_control);
               param_block->distance_dist = PDF_clone_dist (t.distance_dist);
+              param_block->recipient_radius = t.recipient_radius;
               param_block->shipping_delay = PDF_clone_dist (t.shipping_delay);
               param_block->latent_units_can_infect = t.latent_units_can_infect;
               param_block->subclinical_units_can_infect = t.subclinical_units_can_infect;
@@ -1869,12 +2205,16 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   naadsm_model_t *m;
   local_data_t *local_data;
   unsigned int nprod_types, nzones, i;
+  source_slot_t *slot;
+#if HAVE_GTHREAD
+  GError *error = NULL;
+#endif
 
 #if DEBUG
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  m = g_new (naadsm_model_t, 1);
+  m = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   m->name = MODEL_NAME;
@@ -1888,6 +2228,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   m->is_listening_for = is_listening_for;
   m->has_pending_actions = has_pending_actions;
   m->has_pending_infections = has_pending_infections;
+  m->next_wake_day = next_wake_day;
   m->to_string = to_string;
   m->printf = local_printf;
   m->fprintf = local_fprintf;
@@ -1911,6 +2252,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
    * zone (rows), then by source production type (columns).  Initially, the
    * rows contain all NULL pointers. */
   local_data->zones = zones;
+  local_data->spatial_index = herds->spatial_index;
   nzones = ZON_zone_list_length (zones);
   for (i = 0; i < NAADSM_NCONTACT_TYPES; i++)
     local_data->movement_control[i] = NULL;
@@ -1925,6 +2267,12 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   local_data->outbreak_known = FALSE;
   local_data->public_announcement_day = 0;
 
+  /* The table of movement control multipliers is filled in at the start of
+   * each day. */
+  local_data->movement_factors =
+    g_new0 (double, NAADSM_NCONTACT_TYPES * nzones * nprod_types * nprod_types);
+  local_data->movement_factors_day = NO_MOVEMENT_FACTORS;
+
   /* Initialize an array for delayed contacts.  We don't know yet how long the
    * the array needs to be, since that will depend on values we sample from the
    * delay distribution, so we initialize it to length 1. */
@@ -1933,6 +2281,50 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   local_data->npending_infections = 0;
   local_data->rotating_index = 0;
 
+  /* Initialize the working space for each thread.  The lists of potential
+   * recipients are built as sources need them, while there is memory left
+   * (see naadsm_neighbour_list_limit). */
+#if HAVE_GTHREAD
+  local_data->nslots = MAX (naadsm_contact_spread_nthreads, 1);
+  local_data->pool = NULL;
+  if (local_data->nslots > 1)
+    {
+#if !GLIB_CHECK_VERSION(2,32,0)
+      if (!g_thread_supported ())
+        g_thread_init (NULL);
+#endif
+      /* The calling thread works on slot 0 itself, so the pool needs one
+       * thread fewer than there are slots. */
+      local_data->pool = g_thread_pool_new (plan_slot_contacts_in_thread, m,
+                                            local_data->nslots - 1, TRUE, &error);
+      if (local_data->pool == NULL)
+        {
+          g_warning ("%s: could not create threads, working single-threaded: %s",
+                     MODEL_NAME, error->message);
+          g_clear_error (&error);
+          local_data->nslots = 1;
+        }
+      else
+        local_data->slots_done = g_async_queue_new ();
+    }
+#else
+  local_data->nslots = 1;
+#endif
+  local_data->slots = g_new0 (source_slot_t, local_data->nslots);
+  for (i = 0; i < local_data->nslots; i++)
+    {
+      slot = &local_data->slots[i];
+      slot->contacts = g_array_new (FALSE, FALSE, sizeof (sub_callback_t));
+      slot->first_contact = g_new0 (unsigned int, NAADSM_NCONTACT_TYPES * nprod_types);
+      slot->ncontacts = g_new0 (unsigned int, NAADSM_NCONTACT_TYPES * nprod_types);
+      slot->recipients = naadsm_new_distance_index (herds, nprod_types);
+      slot->poisson = PDF_new_poisson_dist (1.0);
+      slot->exposures = g_array_new (FALSE, FALSE, sizeof (planned_exposure_t));
+    }
+  local_data->sources = g_array_new (FALSE, FALSE, sizeof (unsigned int));
+  local_data->first_exposure = g_array_new (FALSE, FALSE, sizeof (unsigned int));
+  local_data->nexposures = g_array_new (FALSE, FALSE, sizeof (unsigned int));
+
   /* Send the XML subtree to the init function to read the production type
    * combination specific parameters. */
   m->set_params (m, params);
@@ -75,6 +75,7 @@
 #define is_listening_for detection_model_is_listening_for
 #define has_pending_actions detection_model_has_pending_actions
 #define has_pending_infections detection_model_has_pending_infections
+#define next_wake_day detection_model_next_wake_day
 #define to_string detection_model_to_string
 #define local_printf detection_model_printf
 #define local_fprintf detection_model_fprintf
@@ -206,7 +207,7 @@ handle_new_day_event (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
        * herd. */
       prod_type = herd->production_type;
       param_block = local_data->param_block[prod_type];
-      if (herd->status != InfectiousClinical || param_block == NULL)
+      if (herd->state->status != InfectiousClinical || param_block == NULL)
         continue;
 
       /* Find which zone the herd is in. */
@@ -219,7 +220,7 @@ handle_new_day_event (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
              herd->official_id,
              herd->production_type_name,
              zone->name,
-             HRD_status_name[herd->status], local_data->detected[i] ? "already" : "not");
+             HRD_status_name[herd->state->status], local_data->detected[i] ? "already" : "not");
 #endif
       /* Check whether the herd has already been detected.  If so, go on to the
        * next herd. */
@@ -231,10 +232,11 @@ handle_new_day_event (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
        * computed above. */
 #if DEBUG
       g_debug ("using chart value for day %i in clinical state",
-               herd->days_in_status);
+               HRD_days_in_status (herd, event->day));
 #endif
       prob_report_from_signs =
-        REL_chart_lookup (herd->days_in_status, param_block->prob_report_vs_days_clinical);
+        REL_chart_lookup (HRD_days_in_status (herd, event->day),
+                          param_block->prob_report_vs_days_clinical);
 
       if (ZON_same_zone (background_zone, fragment))
         {
@@ -321,7 +323,7 @@ handle_exam_event (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
   g_debug ("unit \"%s\" is %s, state is %s, %s detected",
            herd->official_id,
            herd->production_type_name,
-           HRD_status_name[herd->status],
+           HRD_status_name[herd->state->status],
            local_data->detected[herd->index] ? "already" : "not");
 #endif
 
@@ -330,12 +332,13 @@ handle_exam_event (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
     goto end;
 
   /* Check whether the herd is showing clinical signs of disease. */
-  if (herd->status == InfectiousClinical)
+  if (herd->state->status == InfectiousClinical)
     {
       /* Compute the probability that the disease would be noticed, based on
        * clinical signs and the request multiplier. */
       prob_report_from_signs =
-        REL_chart_lookup (herd->days_in_status, param_block->prob_report_vs_days_clinical);
+        REL_chart_lookup (HRD_days_in_status (herd, event->day),
+                          param_block->prob_report_vs_days_clinical);
 
       P = prob_report_from_signs * event->detection_multiplier;
 #if DEBUG
@@ -548,6 +551,28 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do:
+ * tomorrow while any unit is showing clinical signs.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return the day, or G_MAXINT if no unit is showing clinical signs.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  if (herds->tally->nunits[InfectiousClinical] > 0)
+    return day + 1;
+  else
+    return G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -881,7 +906,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  self = g_new (naadsm_model_t, 1);
+  self = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   self->name = MODEL_NAME;
@@ -895,6 +920,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   self->is_listening_for = is_listening_for;
   self->has_pending_actions = has_pending_actions;
   self->has_pending_infections = has_pending_infections;
+  self->next_wake_day = next_wake_day;
   self->to_string = to_string;
   self->printf = local_printf;
   self->fprintf = local_fprintf;
@@ -28,6 +28,7 @@
 #define is_listening_for detection_monitor_is_listening_for
 #define has_pending_actions detection_monitor_has_pending_actions
 #define has_pending_infections detection_monitor_has_pending_infections
+#define next_wake_day detection_monitor_next_wake_day
 #define to_string detection_monitor_to_string
 #define local_printf detection_monitor_printf
 #define local_fprintf detection_monitor_fprintf
@@ -242,10 +243,10 @@ handle_detection_event (struct naadsm_model_t_ *self, EVT_detection_event_t * ev
   peek = RPT_reporting_get_text1 (local_data->detections, means);
   first_of_means = (peek == NULL) || (strlen (peek) == 0);
 
-  g_string_printf (local_data->target, first_of_means ? "%u" : ",%u", herd->index);
+  g_string_printf (local_data->target, first_of_means ? "%u" : ",%u", herd->original_index);
   RPT_reporting_append_text1 (local_data->detections, local_data->target->str, means);
 
-  detection.herd_index = herd->index;
+  detection.herd_index = herd->original_index;
   detection.reason = event->means;
   detection.test_result = event->test_result;
   
@@ -565,6 +566,27 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do.
+ * A new day only zeroes the daily counts and copies the first and last
+ * detection days, none of which change after a day on which nothing was
+ * detected, so the model never needs waking.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return G_MAXINT.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  return G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -709,7 +731,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_debug ("----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  self = g_new (naadsm_model_t, 1);
+  self = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   self->name = MODEL_NAME;
@@ -722,6 +744,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   self->is_listening_for = is_listening_for;
   self->has_pending_actions = has_pending_actions;
   self->has_pending_infections = has_pending_infections;
+  self->next_wake_day = next_wake_day;
   self->to_string = to_string;
   self->printf = local_printf;
   self->fprintf = local_fprintf;
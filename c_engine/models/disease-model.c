@@ -625,7 +625,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  m = g_new (naadsm_model_t, 1);
+  m = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   m->name = MODEL_NAME;
@@ -638,6 +638,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   m->is_listening_for = is_listening_for;
   m->has_pending_actions = has_pending_actions;
   m->has_pending_infections = has_pending_infections;
+  m->next_wake_day = NULL;
   m->to_string = to_string;
   m->printf = local_printf;
   m->fprintf = local_fprintf;
@@ -34,6 +34,7 @@
 #define is_listening_for economic_model_is_listening_for
 #define has_pending_actions economic_model_has_pending_actions
 #define has_pending_infections economic_model_has_pending_infections
+#define next_wake_day economic_model_next_wake_day
 #define to_string economic_model_to_string
 #define local_printf economic_model_printf
 #define local_fprintf economic_model_fprintf
@@ -192,7 +193,7 @@ handle_new_day_event (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
           if (surveillance_cost_param[zone_index] &&
               /* TODO.  This should probably be the authority's view
                * of whether the herd has been destroyed or not. */
-              (herd->status != Destroyed))
+              (herd->state->status != Destroyed))
             {
               cost =
                 surveillance_cost_param[zone_index][herd->production_type] *
@@ -490,6 +491,34 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do:
+ * tomorrow if surveillance costs are being accumulated, since they are charged
+ * for every day.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return the day, or G_MAXINT if no surveillance costs are being tracked.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  local_data_t *local_data;
+
+  local_data = (local_data_t *) (self->model_data);
+  if ((local_data->surveillance_cost_param) &&
+      ((local_data->cumul_surveillance_cost->frequency != RPT_never) ||
+       (local_data->cumul_total_cost->frequency != RPT_never)))
+    return day + 1;
+  else
+    return G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -1097,7 +1126,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  m = g_new (naadsm_model_t, 1);
+  m = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   m->name = MODEL_NAME;
@@ -1111,6 +1140,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   m->is_listening_for = is_listening_for;
   m->has_pending_actions = has_pending_actions;
   m->has_pending_infections = has_pending_infections;
+  m->next_wake_day = next_wake_day;
   m->to_string = to_string;
   m->printf = local_printf;
   m->fprintf = local_fprintf;
@@ -28,6 +28,7 @@
 #define is_listening_for exam_monitor_is_listening_for
 #define has_pending_actions exam_monitor_has_pending_actions
 #define has_pending_infections exam_monitor_has_pending_infections
+#define next_wake_day exam_monitor_next_wake_day
 #define to_string exam_monitor_to_string
 #define local_printf exam_monitor_printf
 #define local_fprintf exam_monitor_fprintf
@@ -172,7 +173,7 @@ handle_exam_event (struct naadsm_model_t_ *self, EVT_exam_event_t *event)
 
   /* Record the exam in the GUI */
   /* -------------------------- */
-  exam.herd_index = event->herd->index;
+  exam.herd_index = event->herd->original_index;
   
   if ( event->reason == NAADSM_ControlTraceForwardDirect )
     {
@@ -365,6 +366,26 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do.
+ * A new day only zeroes the daily counts, which are already zero after a
+ * day on which nothing was examined, so the model never needs waking.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return G_MAXINT.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  return G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -489,7 +510,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_debug ("----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  self = g_new (naadsm_model_t, 1);
+  self = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   self->name = MODEL_NAME;
@@ -502,6 +523,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   self->is_listening_for = is_listening_for;
   self->has_pending_actions = has_pending_actions;
   self->has_pending_infections = has_pending_infections;
+  self->next_wake_day = next_wake_day;
   self->to_string = to_string;
   self->printf = local_printf;
   self->fprintf = local_fprintf;
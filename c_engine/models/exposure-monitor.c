@@ -23,11 +23,14 @@
 /* To avoid name clashes when multiple modules have the same interface. */
 #define new exposure_monitor_new
 #define run exposure_monitor_run
+#define run_batch exposure_monitor_run_batch
 #define reset exposure_monitor_reset
 #define events_listened_for exposure_monitor_events_listened_for
+#define events_batched exposure_monitor_events_batched
 #define is_listening_for exposure_monitor_is_listening_for
 #define has_pending_actions exposure_monitor_has_pending_actions
 #define has_pending_infections exposure_monitor_has_pending_infections
+#define next_wake_day exposure_monitor_next_wake_day
 #define to_string exposure_monitor_to_string
 #define local_printf exposure_monitor_printf
 #define local_fprintf exposure_monitor_fprintf
@@ -56,6 +59,11 @@ EVT_event_type_t events_listened_for[] = { EVT_BeforeAnySimulations, EVT_NewDay,
 
 
 
+#define NEVENTS_BATCHED 1
+EVT_event_type_t events_batched[] = { EVT_Exposure };
+
+
+
 /** Specialized information for this model. */
 typedef struct
 {
@@ -189,14 +197,14 @@ handle_exposure_event (struct naadsm_model_t_ *self, EVT_exposure_event_t * even
 
   g_string_printf (local_data->source_and_target,
                    first_of_cause ? "%u->%u" : ",%u->%u",
-                   event->exposing_herd->index, event->exposed_herd->index);
+                   event->exposing_herd->original_index, event->exposed_herd->original_index);
   RPT_reporting_append_text1 (local_data->exposures, local_data->source_and_target->str,
                               cause);
                                 
-  update.src_index = exposing_herd->index;
-  update.src_status = (NAADSM_disease_state) exposing_herd->status;
-  update.dest_index = exposed_herd->index;
-  update.dest_status = (NAADSM_disease_state) exposed_herd->status;
+  update.src_index = exposing_herd->original_index;
+  update.src_status = (NAADSM_disease_state) exposing_herd->state->status;
+  update.dest_index = exposed_herd->original_index;
+  update.dest_status = (NAADSM_disease_state) exposed_herd->state->status;
   
   update.initiated_day = (int) event->initiated_day;
   update.finalized_day = (int) event->initiated_day + event->delay;
@@ -230,7 +238,7 @@ handle_exposure_event (struct naadsm_model_t_ *self, EVT_exposure_event_t * even
 #endif  
 
 #if UNDEFINED
-  printf ("Herd at index %d exposed by method %s\n", event->exposed_herd->index, cause);
+  printf ("Herd at index %d exposed by method %s\n", event->exposed_herd->original_index, cause);
 #endif
 
   /* Update the counts of exposures. */
@@ -315,6 +323,38 @@ run (struct naadsm_model_t_ *self, HRD_herd_list_t * herds, ZON_zone_list_t * zo
 
 
 
+/**
+ * Runs this model on all of one wave's exposures.
+ *
+ * @param self the model.
+ * @param herds a herd list.
+ * @param zones a zone list.
+ * @param events the exposure events.
+ * @param nevents the number of events.
+ * @param rng a random number generator.
+ * @param queue for any new events the model creates.
+ */
+void
+run_batch (struct naadsm_model_t_ *self, HRD_herd_list_t * herds, ZON_zone_list_t * zones,
+           EVT_event_t ** events, unsigned int nevents, RAN_gen_t * rng,
+           EVT_event_queue_t * queue)
+{
+  unsigned int i;
+
+#if DEBUG
+  g_debug ("----- ENTER run_batch (%s)", MODEL_NAME);
+#endif
+
+  for (i = 0; i < nevents; i++)
+    handle_exposure_event (self, &(events[i]->u.exposure));
+
+#if DEBUG
+  g_debug ("----- EXIT run_batch (%s)", MODEL_NAME);
+#endif
+}
+
+
+
 /**
  * Resets this model after a simulation run.
  *
@@ -395,6 +435,26 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do.
+ * A new day only zeroes the daily counts, which are already zero after a
+ * day on which there were no exposures, so the model never needs waking.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return G_MAXINT.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  return G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -524,19 +584,23 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_debug ("----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  m = g_new (naadsm_model_t, 1);
+  m = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   m->name = MODEL_NAME;
   m->events_listened_for = events_listened_for;
   m->nevents_listened_for = NEVENTS_LISTENED_FOR;
+  m->events_batched = events_batched;
+  m->nevents_batched = NEVENTS_BATCHED;
   m->outputs = g_ptr_array_new ();
   m->model_data = local_data;
   m->run = run;
+  m->run_batch = run_batch;
   m->reset = reset;
   m->is_listening_for = is_listening_for;
   m->has_pending_actions = has_pending_actions;
   m->has_pending_infections = has_pending_infections;
+  m->next_wake_day = next_wake_day;
   m->to_string = to_string;
   m->printf = local_printf;
   m->fprintf = local_fprintf;
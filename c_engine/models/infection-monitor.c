@@ -29,6 +29,7 @@
 #define is_listening_for infection_monitor_is_listening_for
 #define has_pending_actions infection_monitor_has_pending_actions
 #define has_pending_infections infection_monitor_has_pending_infections
+#define next_wake_day infection_monitor_next_wake_day
 #define to_string infection_monitor_to_string
 #define local_printf infection_monitor_printf
 #define local_fprintf infection_monitor_fprintf
@@ -346,16 +347,16 @@ handle_infection_event (struct naadsm_model_t_ *self, EVT_infection_event_t * ev
 
   if (infecting_herd == NULL)
     g_string_printf (local_data->source_and_target,
-                     first_of_cause ? "%u" : ",%u", infected_herd->index);
+                     first_of_cause ? "%u" : ",%u", infected_herd->original_index);
   else
     g_string_printf (local_data->source_and_target,
                      first_of_cause ? "%u->%u" : ",%u->%u",
-                     infecting_herd->index, infected_herd->index);
+                     infecting_herd->original_index, infected_herd->original_index);
 
   RPT_reporting_append_text1 (local_data->infections, local_data->source_and_target->str,
                               cause);
 
-  update.herd_index = infected_herd->index;
+  update.herd_index = infected_herd->original_index;
   update.infection_source_type = event->contact_type;
   
 #ifdef USE_SC_GUILIB
@@ -367,7 +368,7 @@ handle_infection_event (struct naadsm_model_t_ *self, EVT_infection_event_t * ev
     }
 #endif
 #if UNDEFINED
-  printf ("Herd at index %d INFECTED by method %s\n", infected_herd->index, cause);
+  printf ("Herd at index %d INFECTED by method %s\n", infected_herd->original_index, cause);
 #endif
 
   /* Update the counts of infections.  Note that initially infected units are
@@ -605,6 +606,35 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do:
+ * tomorrow while any infections are left in the window used for the ratio of
+ * recent infections.  Once the window is all zeroes, a new day changes
+ * nothing.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return the day, or G_MAXINT if the window is empty.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  local_data_t *local_data;
+  unsigned int i, n;
+
+  local_data = (local_data_t *) (self->model_data);
+  n = local_data->nrecent_days * 2;
+  for (i = 0; i < n; i++)
+    if (local_data->nrecent_infections[i] > 0)
+      return day + 1;
+  return G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -738,7 +768,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_debug ("----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  m = g_new (naadsm_model_t, 1);
+  m = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   m->name = MODEL_NAME;
@@ -751,6 +781,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   m->is_listening_for = is_listening_for;
   m->has_pending_actions = has_pending_actions;
   m->has_pending_infections = has_pending_infections;
+  m->next_wake_day = next_wake_day;
   m->to_string = to_string;
   m->printf = local_printf;
   m->fprintf = local_fprintf;
@@ -32,10 +32,42 @@
 #  include <strings.h>
 #endif
 
+#if HAVE_MATH_H
+#  include <math.h>
+#endif
+
 #define EPSILON 0.001
 
 
 
+/** By default, all the neighbour lists and distance indexes together may
+ * take 256 MB. */
+gsize naadsm_neighbour_list_limit = 256 * 1024 * 1024;
+
+/** The memory taken so far by all the neighbour lists and distance indexes,
+ * in every model instance and every thread. */
+static gsize neighbour_list_nbytes = 0;
+G_LOCK_DEFINE_STATIC (neighbour_list_nbytes);
+
+/** Whether the airborne spread models record only adequate exposures. */
+gboolean naadsm_sparse_airborne_exposures = FALSE;
+
+/** The contact spread model works out its contacts in 1 thread by default. */
+int naadsm_contact_spread_nthreads = 1;
+
+
+
+/** A unit and its distance from a source, used while building a distance
+ * index. */
+typedef struct
+{
+  double distance;
+  unsigned int id;
+}
+distance_index_entry_t;
+
+
+
 /**
  *
  */
@@ -322,6 +354,32 @@ end:
 
 
 
+/**
+ * Finds the next non-empty slot in a rotating array of pending events.
+ *
+ * @param array the pending events array.  Each item is a GQueue.
+ * @param index the current location of the rotating index.
+ * @return how many days ahead of the rotating index the next non-empty slot
+ *   is, from 1 to the length of the array, or 0 if every slot is empty.
+ */
+unsigned int
+naadsm_rotating_array_next_nonempty (GPtrArray * array, unsigned int index)
+{
+  unsigned int length, i;
+  GQueue *q;
+
+  length = array->len;
+  for (i = 1; i <= length; i++)
+    {
+      q = (GQueue *) g_ptr_array_index (array, (index + i) % length);
+      if (q != NULL && !g_queue_is_empty (q))
+        return i;
+    }
+  return 0;
+}
+
+
+
 /**
  * The g_queue_free function from GLib, cast to the format of a GDestroyNotify
  * function.
@@ -372,4 +430,626 @@ naadsm_insert_node_number_into_filename (const char *filename)
 #endif
 }
 
+
+
+/**
+ * Gives a herd list its own view of the spatial index, from which the herds
+ * destroyed during an iteration are removed (see
+ * naadsm_remove_destroyed_units()).  The index of every herd,
+ * herds->spatial_index, is left alone, for the searches that must still find
+ * destroyed herds, such as assigning herds to zones.  Each copy made by
+ * HRD_clone_herd_list() gets a view of its own, so that threads running
+ * separate iterations do not disturb one another.
+ *
+ * @param herds a herd list whose spatial index is prepared.
+ */
+void
+naadsm_new_live_indexes (HRD_herd_list_t * herds)
+{
+  herds->live_index = spatial_search_new_view (herds->spatial_index);
+
+  return;
+}
+
+
+
+/**
+ * Removes the herds destroyed on the most recent day from the herd list's
+ * live spatial indexes, so that spread and ring searches no longer find them.
+ * A destroyed herd never changes state again, so those searches would only
+ * skip it.  Call this after HRD_herd_list_step().
+ *
+ * @param herds a herd list.
+ */
+void
+naadsm_remove_destroyed_units (HRD_herd_list_t * herds)
+{
+  GArray *due;
+  unsigned int i, herd_index;
+  HRD_herd_t *herd;
+
+  if (herds->live_index == NULL)
+    return;
+
+  due = herds->calendar->due;
+  for (i = 0; i < due->len; i++)
+    {
+      herd_index = g_array_index (due, unsigned int, i);
+      herd = HRD_herd_list_get (herds, herd_index);
+      if (herd->state->status != Destroyed)
+        continue;
+      spatial_search_remove_point (herds->live_index, herd_index);
+    }
+
+  return;
+}
+
+
+
+/**
+ * Puts all the herds back into the herd list's live spatial indexes, at the
+ * start of an iteration.
+ *
+ * @param herds a herd list.
+ */
+void
+naadsm_restore_live_indexes (HRD_herd_list_t * herds)
+{
+  if (herds->live_index == NULL)
+    return;
+
+  spatial_search_restore_points (herds->live_index);
+
+  return;
+}
+
+
+
+/**
+ * Deletes the spatial indexes attached to a herd list from memory.  A copy
+ * made by HRD_clone_herd_list() frees only its own views, and must be done
+ * before the original.
+ *
+ * @param herds a herd list.
+ */
+void
+naadsm_free_spatial_indexes (HRD_herd_list_t * herds)
+{
+  free_spatial_search (herds->live_index);
+  herds->live_index = NULL;
+
+  if (!herds->is_clone)
+    free_spatial_search (herds->spatial_index);
+  herds->spatial_index = NULL;
+
+  return;
+}
+
+
+
+/**
+ * Takes memory for a list from the budget shared by all neighbour lists and
+ * distance indexes (see naadsm_neighbour_list_limit).
+ *
+ * @param nbytes the size of the list.
+ * @return TRUE if there was room, FALSE otherwise.
+ */
+static gboolean
+reserve_list_memory (gsize nbytes)
+{
+  gboolean room;
+
+  G_LOCK (neighbour_list_nbytes);
+  room = (neighbour_list_nbytes <= naadsm_neighbour_list_limit
+          && nbytes <= naadsm_neighbour_list_limit - neighbour_list_nbytes);
+  if (room)
+    neighbour_list_nbytes += nbytes;
+  G_UNLOCK (neighbour_list_nbytes);
+
+  return room;
+}
+
+
+
+/**
+ * Gives memory taken with reserve_list_memory() back to the shared budget.
+ *
+ * @param nbytes the memory to give back.
+ */
+static void
+release_list_memory (gsize nbytes)
+{
+  G_LOCK (neighbour_list_nbytes);
+  neighbour_list_nbytes -= nbytes;
+  G_UNLOCK (neighbour_list_nbytes);
+
+  return;
+}
+
+
+
+/**
+ * Creates a new, empty set of neighbour lists.
+ *
+ * @param nsources the number of units that may be sources.
+ * @return a set of neighbour lists.
+ */
+naadsm_neighbour_lists_t *
+naadsm_new_neighbour_lists (unsigned int nsources)
+{
+  naadsm_neighbour_lists_t *lists;
+  unsigned int i;
+
+  lists = g_new (naadsm_neighbour_lists_t, 1);
+  lists->nsources = nsources;
+  lists->offsets = g_new (unsigned int, nsources);
+  for (i = 0; i < nsources; i++)
+    lists->offsets[i] = NAADSM_NEIGHBOURS_NOT_BUILT;
+  lists->counts = g_new0 (unsigned int, nsources);
+  lists->target_ids = g_array_new (FALSE, FALSE, sizeof (unsigned int));
+  lists->distances = g_array_new (FALSE, FALSE, sizeof (double));
+  lists->headings = g_array_new (FALSE, FALSE, sizeof (double));
+  lists->nbytes = 0;
+  lists->hits = spatial_search_new_hits (TRUE);
+  lists->scratch_ids = g_array_new (FALSE, FALSE, sizeof (unsigned int));
+  lists->scratch_distances = g_array_new (FALSE, FALSE, sizeof (double));
+  lists->scratch_headings = g_array_new (FALSE, FALSE, sizeof (double));
+
+  return lists;
+}
+
+
+
+/**
+ * Returns the units of certain production types within a given distance of a
+ * source unit, and within a range of headings from it, in increasing order,
+ * with the distance and heading to each.  The first call for a source does a
+ * spatial search and, if there is room, keeps the result; later calls for the
+ * same source just return the kept list.  A source's radius, headings and
+ * production types must therefore be the same on every call.
+ *
+ * The search is done on the list's full spatial index, so destroyed units are
+ * included; callers must check the status of each unit returned.
+ *
+ * @param lists a set of neighbour lists.
+ * @param herds the herd list.
+ * @param source the source unit.
+ * @param radius the search radius, in km.
+ * @param start_heading the heading, in degrees, at which the range of
+ *   headings starts.  The range runs clockwise.
+ * @param end_heading the heading at which the range ends.  Use 0 and 360 for
+ *   all headings.
+ * @param want_prodtype an array with one entry per production type, TRUE for
+ *   the types to return.
+ * @param target_ids location in which to return a pointer to the unit
+ *   indices.
+ * @param distances location in which to return a pointer to the distances.
+ * @param headings location in which to return a pointer to the headings.
+ * @return the number of units returned.  The arrays returned are only valid
+ *   until the next call.
+ */
+unsigned int
+naadsm_get_neighbours (naadsm_neighbour_lists_t * lists, HRD_herd_list_t * herds,
+                       HRD_herd_t * source, double radius,
+                       double start_heading, double end_heading,
+                       const gboolean * want_prodtype,
+                       const unsigned int **target_ids,
+                       const double **distances, const double **headings)
+{
+  unsigned int offset, count, i, herd_index;
+  HRD_herd_t *herd;
+  gsize entry_size;
+  GArray *ids, *dists, *heads;
+  double distance, heading;
+
+  offset = lists->offsets[source->index];
+  if (offset != NAADSM_NEIGHBOURS_NOT_BUILT)
+    {
+      count = lists->counts[source->index];
+      goto found;
+    }
+
+  spatial_search_sector_by_xy_to_array (herds->spatial_index, source->x, source->y,
+                                        radius, start_heading, end_heading, lists->hits);
+  count = 0;
+  for (i = 0; i < lists->hits->id->len; i++)
+    {
+      herd_index = g_array_index (lists->hits->id, int, i);
+      if (herd_index != source->index
+          && want_prodtype[HRD_herd_list_get (herds, herd_index)->production_type])
+        count++;
+    }
+
+  /* Keep the list if there is room, otherwise put it in the scratch arrays. */
+  entry_size = sizeof (unsigned int) + 2 * sizeof (double);
+  if (reserve_list_memory (count * entry_size))
+    {
+      ids = lists->target_ids;
+      dists = lists->distances;
+      heads = lists->headings;
+      offset = ids->len;
+      lists->offsets[source->index] = offset;
+      lists->counts[source->index] = count;
+      lists->nbytes += count * entry_size;
+    }
+  else
+    {
+      ids = lists->scratch_ids;
+      dists = lists->scratch_distances;
+      heads = lists->scratch_headings;
+      g_array_set_size (ids, 0);
+      g_array_set_size (dists, 0);
+      g_array_set_size (heads, 0);
+      offset = 0;
+    }
+
+  for (i = 0; i < lists->hits->id->len; i++)
+    {
+      herd_index = g_array_index (lists->hits->id, int, i);
+      herd = HRD_herd_list_get (herds, herd_index);
+      if (herd_index == source->index || !want_prodtype[herd->production_type])
+        continue;
+      distance = sqrt (g_array_index (lists->hits->distance_sq, double, i));
+      heading = GIS_heading (source->x, source->y, herd->x, herd->y);
+      g_array_append_val (ids, herd_index);
+      g_array_append_val (dists, distance);
+      g_array_append_val (heads, heading);
+    }
+
+  if (ids == lists->scratch_ids)
+    {
+      *target_ids = &g_array_index (ids, unsigned int, 0);
+      *distances = &g_array_index (dists, double, 0);
+      *headings = &g_array_index (heads, double, 0);
+      return count;
+    }
+
+found:
+  *target_ids = &g_array_index (lists->target_ids, unsigned int, offset);
+  *distances = &g_array_index (lists->distances, double, offset);
+  *headings = &g_array_index (lists->headings, double, offset);
+  return count;
+}
+
+
+
+/**
+ * Deletes a set of neighbour lists from memory.
+ *
+ * @param lists a set of neighbour lists.
+ */
+void
+naadsm_free_neighbour_lists (naadsm_neighbour_lists_t * lists)
+{
+  if (lists == NULL)
+    return;
+
+  release_list_memory (lists->nbytes);
+  g_free (lists->offsets);
+  g_free (lists->counts);
+  g_array_free (lists->target_ids, TRUE);
+  g_array_free (lists->distances, TRUE);
+  g_array_free (lists->headings, TRUE);
+  spatial_search_free_hits (lists->hits);
+  g_array_free (lists->scratch_ids, TRUE);
+  g_array_free (lists->scratch_distances, TRUE);
+  g_array_free (lists->scratch_headings, TRUE);
+  g_free (lists);
+
+  return;
+}
+
+/**
+ * Creates a new, empty distance index.
+ *
+ * @param herds the herd list.  Every unit may be a source.
+ * @param nprodtypes the number of production types.
+ * @return a distance index.
+ */
+naadsm_distance_index_t *
+naadsm_new_distance_index (HRD_herd_list_t * herds, unsigned int nprodtypes)
+{
+  naadsm_distance_index_t *index;
+  HRD_herd_t *herd;
+  unsigned int nsources, i;
+
+  nsources = HRD_herd_list_length (herds);
+  index = g_new (naadsm_distance_index_t, 1);
+  index->nsources = nsources;
+  index->nprodtypes = nprodtypes;
+  index->nunits = g_new0 (unsigned int, nprodtypes);
+  for (i = 0; i < nsources; i++)
+    {
+      herd = HRD_herd_list_get (herds, i);
+      if (herd->production_type < nprodtypes)
+        index->nunits[herd->production_type]++;
+    }
+  index->offsets = g_new (unsigned int, nsources * nprodtypes);
+  for (i = 0; i < nsources * nprodtypes; i++)
+    index->offsets[i] = NAADSM_NEIGHBOURS_NOT_BUILT;
+  index->counts = g_new0 (unsigned int, nsources * nprodtypes);
+  index->radii = g_new0 (double, nsources * nprodtypes);
+  index->target_ids = g_array_new (FALSE, FALSE, sizeof (unsigned int));
+  index->distances = g_array_new (FALSE, FALSE, sizeof (double));
+  index->cumul_sizes = g_array_new (FALSE, FALSE, sizeof (double));
+  index->nbytes = 0;
+  index->sort_space = g_array_new (FALSE, FALSE, sizeof (distance_index_entry_t));
+  index->hits = spatial_search_new_hits (TRUE);
+  index->scratch_ids = g_array_new (FALSE, FALSE, sizeof (unsigned int));
+  index->scratch_distances = g_array_new (FALSE, FALSE, sizeof (double));
+  index->scratch_cumul_sizes = g_array_new (FALSE, FALSE, sizeof (double));
+
+  return index;
+}
+
+
+
+/**
+ * Orders distance index entries by distance, and entries at the same distance
+ * by unit index, so that the order does not depend on the sort algorithm.
+ */
+static gint
+compare_distance_index_entries (gconstpointer a, gconstpointer b)
+{
+  const distance_index_entry_t *entry1, *entry2;
+
+  entry1 = (const distance_index_entry_t *) a;
+  entry2 = (const distance_index_entry_t *) b;
+  if (entry1->distance < entry2->distance)
+    return -1;
+  if (entry1->distance > entry2->distance)
+    return 1;
+  if (entry1->id < entry2->id)
+    return -1;
+  if (entry1->id > entry2->id)
+    return 1;
+  return 0;
+}
+
+
+
+/**
+ * Puts the units of a production type within a given distance of a source
+ * unit, other than the source itself, into a distance index's sort space,
+ * sorted by distance.  With a radius, the units are found with a search of the
+ * herd list's spatial index, so the cost depends on how many units are nearby
+ * rather than on the size of the population.  Asking for every unit, which
+ * is only for callers that cannot put any bound on the distance they need,
+ * takes a scan of the whole herd list.
+ *
+ * @param index a distance index.
+ * @param herds the herd list.
+ * @param source the source unit.
+ * @param prodtype the production type of the units to find.
+ * @param radius the distance, in km, within which to find units, or a negative
+ *   number to find all units of the production type.
+ * @return the radius the sorted units cover, or -1 if they are all the units
+ *   of the production type.
+ */
+static double
+sort_units_by_distance (naadsm_distance_index_t * index, HRD_herd_list_t * herds,
+                        HRD_herd_t * source, HRD_production_type_t prodtype,
+                        double radius)
+{
+  unsigned int nherds, nunits, i;
+  HRD_herd_t *herd;
+  distance_index_entry_t entry;
+
+  g_array_set_size (index->sort_space, 0);
+  if (radius < 0)
+    {
+      nherds = HRD_herd_list_length (herds);
+      for (i = 0; i < nherds; i++)
+        {
+          herd = HRD_herd_list_get (herds, i);
+          if (herd->production_type != prodtype || herd == source)
+            continue;
+          entry.id = i;
+          entry.distance = GIS_distance (source->x, source->y, herd->x, herd->y);
+          g_array_append_val (index->sort_space, entry);
+        }
+    }
+  else
+    {
+      /* The search goes a little past the radius, so that no unit within it
+       * is lost to rounding error. */
+      spatial_search_circle_by_xy_to_array (herds->spatial_index, source->x, source->y,
+                                            radius + EPSILON, index->hits);
+      for (i = 0; i < index->hits->id->len; i++)
+        {
+          entry.id = g_array_index (index->hits->id, int, i);
+          herd = HRD_herd_list_get (herds, entry.id);
+          if (herd->production_type != prodtype || herd == source)
+            continue;
+          entry.distance = sqrt (g_array_index (index->hits->distance_sq, double, i));
+          g_array_append_val (index->sort_space, entry);
+        }
+    }
+  g_array_sort (index->sort_space, compare_distance_index_entries);
+
+  /* Once the circle takes in every unit of the production type, the list
+   * cannot grow any more. */
+  nunits = index->nunits[prodtype];
+  if (source->production_type == prodtype)
+    nunits--;
+  if (index->sort_space->len == nunits)
+    radius = -1;
+
+  return radius;
+}
+
+
+
+/**
+ * Copies the sorted units in a distance index's sort space onto the ends of
+ * the given arrays, with the running totals of their sizes.
+ *
+ * @param index a distance index.
+ * @param herds the herd list.
+ * @param ids the array of unit indices to add to.
+ * @param dists the array of distances to add to.
+ * @param cumul the array of running totals to add to.
+ */
+static void
+store_units_by_distance (naadsm_distance_index_t * index, HRD_herd_list_t * herds,
+                         GArray * ids, GArray * dists, GArray * cumul)
+{
+  distance_index_entry_t entry;
+  double size_so_far;
+  unsigned int i;
+
+  size_so_far = 0;
+  for (i = 0; i < index->sort_space->len; i++)
+    {
+      entry = g_array_index (index->sort_space, distance_index_entry_t, i);
+      size_so_far += HRD_herd_list_get (herds, entry.id)->size;
+      g_array_append_val (ids, entry.id);
+      g_array_append_val (dists, entry.distance);
+      g_array_append_val (cumul, size_so_far);
+    }
+
+  return;
+}
+
+
+
+/**
+ * Returns the units of a production type within a given distance of a source
+ * unit, sorted by their distance from the source, with the running totals of
+ * their sizes.  The source itself is left out.  The first call for a source
+ * and production type finds and sorts the units and, if there is room, keeps
+ * the result; later calls return the kept list as long as it reaches far
+ * enough.  A call with a larger radius than the kept list covers builds a
+ * longer list with the spatial index and keeps that instead, so each source
+ * pays for a given reach only once.  The memory of the shorter list is only
+ * reused if it was the last list built; otherwise it stays counted against the
+ * shared budget (see naadsm_neighbour_list_limit).
+ *
+ * Every unit within the radius is in the list, and possibly some a little
+ * farther away.  Since the list is sorted by distance, then by unit index, it
+ * is the start of the list of all units of the production type.
+ *
+ * The lists include destroyed units; callers must check the status of each
+ * unit returned.
+ *
+ * @param index a distance index.
+ * @param herds the herd list.
+ * @param source the source unit.
+ * @param prodtype the production type of the units to return.
+ * @param radius on entry, the distance, in km, within which units are wanted,
+ *   or a negative number if all units of the production type are wanted.  On
+ *   return, the distance within which the returned list holds every unit,
+ *   which may be more than was asked for, or -1 if it holds all units of the
+ *   production type.
+ * @param target_ids location in which to return a pointer to the unit
+ *   indices.
+ * @param distances location in which to return a pointer to the distances,
+ *   in increasing order.
+ * @param cumul_sizes location in which to return a pointer to the running
+ *   totals of the unit sizes.
+ * @return the number of units returned.  The arrays returned are only valid
+ *   until the next call.
+ */
+unsigned int
+naadsm_get_units_by_distance (naadsm_distance_index_t * index, HRD_herd_list_t * herds,
+                              HRD_herd_t * source, HRD_production_type_t prodtype,
+                              double *radius,
+                              const unsigned int **target_ids,
+                              const double **distances, const double **cumul_sizes)
+{
+  unsigned int slot, offset, count;
+  gsize entry_size;
+  double kept_radius, new_radius;
+
+  entry_size = sizeof (unsigned int) + 2 * sizeof (double);
+  slot = source->index * index->nprodtypes + prodtype;
+  offset = index->offsets[slot];
+  if (offset != NAADSM_NEIGHBOURS_NOT_BUILT)
+    {
+      kept_radius = index->radii[slot];
+      if (kept_radius < 0 || (*radius >= 0 && kept_radius >= *radius))
+        {
+          count = index->counts[slot];
+          *radius = kept_radius;
+          goto found;
+        }
+    }
+
+  new_radius = sort_units_by_distance (index, herds, source, prodtype, *radius);
+  *radius = new_radius;
+  count = index->sort_space->len;
+
+  /* A shorter list that was the last one built can be cut off the ends of the
+   * arrays and its memory reused. */
+  if (offset != NAADSM_NEIGHBOURS_NOT_BUILT
+      && offset + index->counts[slot] == index->target_ids->len)
+    {
+      g_array_set_size (index->target_ids, offset);
+      g_array_set_size (index->distances, offset);
+      g_array_set_size (index->cumul_sizes, offset);
+      release_list_memory (index->counts[slot] * entry_size);
+      index->nbytes -= index->counts[slot] * entry_size;
+      index->offsets[slot] = NAADSM_NEIGHBOURS_NOT_BUILT;
+    }
+
+  /* Keep the list if there is room, otherwise put it in the scratch arrays. */
+  if (!reserve_list_memory (count * entry_size))
+    {
+      g_array_set_size (index->scratch_ids, 0);
+      g_array_set_size (index->scratch_distances, 0);
+      g_array_set_size (index->scratch_cumul_sizes, 0);
+      store_units_by_distance (index, herds, index->scratch_ids,
+                               index->scratch_distances, index->scratch_cumul_sizes);
+      *target_ids = &g_array_index (index->scratch_ids, unsigned int, 0);
+      *distances = &g_array_index (index->scratch_distances, double, 0);
+      *cumul_sizes = &g_array_index (index->scratch_cumul_sizes, double, 0);
+      return count;
+    }
+
+  offset = index->target_ids->len;
+  index->offsets[slot] = offset;
+  index->counts[slot] = count;
+  index->radii[slot] = new_radius;
+  index->nbytes += count * entry_size;
+  store_units_by_distance (index, herds, index->target_ids,
+                           index->distances, index->cumul_sizes);
+
+found:
+  *target_ids = &g_array_index (index->target_ids, unsigned int, offset);
+  *distances = &g_array_index (index->distances, double, offset);
+  *cumul_sizes = &g_array_index (index->cumul_sizes, double, offset);
+  return count;
+}
+
+
+
+/**
+ * Deletes a distance index from memory.
+ *
+ * @param index a distance index.
+ */
+void
+naadsm_free_distance_index (naadsm_distance_index_t * index)
+{
+  if (index == NULL)
+    return;
+
+  release_list_memory (index->nbytes);
+  g_free (index->nunits);
+  g_free (index->offsets);
+  g_free (index->counts);
+  g_free (index->radii);
+  g_array_free (index->target_ids, TRUE);
+  g_array_free (index->distances, TRUE);
+  g_array_free (index->cumul_sizes, TRUE);
+  g_array_free (index->sort_space, TRUE);
+  spatial_search_free_hits (index->hits);
+  g_array_free (index->scratch_ids, TRUE);
+  g_array_free (index->scratch_distances, TRUE);
+  g_array_free (index->scratch_cumul_sizes, TRUE);
+  g_free (index);
+
+  return;
+}
+
 /* end of file model_util.c */
@@ -27,11 +27,122 @@
 
 
 
+/**
+ * Lists of the units near each source unit, kept for the whole run because
+ * the units never move.  The lists are in compressed-sparse-row form: the
+ * units near source <i>i</i> are target_ids[offsets[i]] to
+ * target_ids[offsets[i]+counts[i]-1], in increasing order, and the distance
+ * and heading to each are at the same positions in distances and headings.
+ * A source's list is only built the first time it is asked for, and once all
+ * the lists in the process reach their memory limit (see
+ * naadsm_neighbour_list_limit), the units near any further sources are found
+ * by a spatial search each time.
+ */
+typedef struct
+{
+  unsigned int nsources;
+  unsigned int *offsets; /**< Where each source's list starts.
+    NAADSM_NEIGHBOURS_NOT_BUILT for sources whose list has not been built. */
+  unsigned int *counts; /**< The length of each source's list. */
+  GArray *target_ids; /**< Unit indices, as unsigned ints. */
+  GArray *distances; /**< Distances in km, as doubles. */
+  GArray *headings; /**< Headings in degrees from the source, as doubles. */
+  gsize nbytes; /**< The memory taken by the lists built so far. */
+  spatial_search_hits_t *hits; /**< Working space for searches. */
+  GArray *scratch_ids; /**< Where the units near a source are put when there
+    is no room to keep them. */
+  GArray *scratch_distances;
+  GArray *scratch_headings;
+}
+naadsm_neighbour_lists_t;
+
+#define NAADSM_NEIGHBOURS_NOT_BUILT G_MAXUINT
+
+/**
+ * For each source unit and production type, the units of that production type
+ * sorted by their distance from the source, so that the unit whose distance is
+ * closest to a wanted distance can be found with a binary search.  A list may
+ * be limited to the units within some distance of the source, and is
+ * replaced by a longer one if a wider distance is asked for later.  Alongside
+ * the distances are running totals of the units' sizes, for choosing among
+ * units at about the same distance in proportion to their sizes.  As with
+ * naadsm_neighbour_lists_t, the lists are in compressed-sparse-row form, a list
+ * is only built the first time it is asked for, and once the memory shared by
+ * all such lists runs out, any further list is rebuilt in scratch space each
+ * time.
+ */
+typedef struct
+{
+  unsigned int nsources;
+  unsigned int nprodtypes;
+  unsigned int *nunits; /**< The number of units of each production type. */
+  unsigned int *offsets; /**< Where the list for source s and production type
+    p starts, at s * nprodtypes + p.  NAADSM_NEIGHBOURS_NOT_BUILT for lists
+    that have not been built. */
+  unsigned int *counts; /**< The length of each list, laid out as offsets. */
+  double *radii; /**< The distance within which each list holds every unit,
+    or -1 if it holds all the units of its production type, laid out as
+    offsets. */
+  GArray *target_ids; /**< Unit indices, as unsigned ints. */
+  GArray *distances; /**< Distances in km, as doubles, in increasing order
+    within each list. */
+  GArray *cumul_sizes; /**< Within each list, the total size of the units up to
+    and including this one, as doubles. */
+  gsize nbytes; /**< The memory taken by the lists built so far. */
+  GArray *sort_space; /**< Working space for sorting. */
+  spatial_search_hits_t *hits; /**< Working space for searches. */
+  GArray *scratch_ids; /**< Where a list is put when there is no room to keep
+    it. */
+  GArray *scratch_distances;
+  GArray *scratch_cumul_sizes;
+}
+naadsm_distance_index_t;
+
+/** The most memory, in bytes, that all the sets of neighbour lists and
+ * distance indexes together may take, across every model instance and every
+ * thread.  Set with naadsm_set_neighbour_list_memory(). */
+extern gsize naadsm_neighbour_list_limit;
+
+/** Whether the airborne spread models record only adequate exposures, which
+ * lets them skip most of the random numbers they would otherwise draw.  Set
+ * with naadsm_set_sparse_airborne_exposures(). */
+extern gboolean naadsm_sparse_airborne_exposures;
+
+/** The number of threads the contact spread model may use to work out the
+ * contacts from the day's sources.  Set with
+ * naadsm_set_contact_spread_threads(). */
+extern int naadsm_contact_spread_nthreads;
+
+
+
 /* Prototypes. */
 gboolean *naadsm_read_prodtype_attribute (const scew_element *, char *, GPtrArray *);
 gboolean *naadsm_read_zone_attribute (const scew_element *, ZON_zone_list_t *);
 void naadsm_extend_rotating_array (GPtrArray * array, unsigned int length, unsigned int index);
+unsigned int naadsm_rotating_array_next_nonempty (GPtrArray * array, unsigned int index);
 void g_queue_free_as_GDestroyNotify (gpointer data);
 char *naadsm_insert_node_number_into_filename (const char *filename);
+void naadsm_new_live_indexes (HRD_herd_list_t *);
+void naadsm_remove_destroyed_units (HRD_herd_list_t *);
+void naadsm_restore_live_indexes (HRD_herd_list_t *);
+void naadsm_free_spatial_indexes (HRD_herd_list_t *);
+naadsm_neighbour_lists_t *naadsm_new_neighbour_lists (unsigned int nsources);
+unsigned int naadsm_get_neighbours (naadsm_neighbour_lists_t *, HRD_herd_list_t *,
+                                    HRD_herd_t * source, double radius,
+                                    double start_heading, double end_heading,
+                                    const gboolean * want_prodtype,
+                                    const unsigned int **target_ids,
+                                    const double **distances, const double **headings);
+void naadsm_free_neighbour_lists (naadsm_neighbour_lists_t *);
+naadsm_distance_index_t *naadsm_new_distance_index (HRD_herd_list_t *,
+                                                    unsigned int nprodtypes);
+unsigned int naadsm_get_units_by_distance (naadsm_distance_index_t *, HRD_herd_list_t *,
+                                           HRD_herd_t * source,
+                                           HRD_production_type_t prodtype,
+                                           double *radius,
+                                           const unsigned int **target_ids,
+                                           const double **distances,
+                                           const double **cumul_sizes);
+void naadsm_free_distance_index (naadsm_distance_index_t *);
 
 #endif /* !MODEL_UTIL_H */
@@ -232,6 +232,7 @@
 #define is_listening_for resources_and_implementation_of_controls_model_is_listening_for
 #define has_pending_actions resources_and_implementation_of_controls_model_has_pending_actions
 #define has_pending_infections resources_and_implementation_of_controls_model_has_pending_infections
+#define next_wake_day resources_and_implementation_of_controls_model_next_wake_day
 #define to_string resources_and_implementation_of_controls_model_to_string
 #define local_printf resources_and_implementation_of_controls_model_printf
 #define local_fprintf resources_and_implementation_of_controls_model_fprintf
@@ -462,11 +463,11 @@ destroy (struct naadsm_model_t_ *self, HRD_herd_t * herd,
   #ifdef RIVERTON
   /* In Riverton, if the unit is already Destroyed or NaturallyImmune, 
    * it should not be destroyed again. */
-  g_assert ( (herd->status != Destroyed) && (herd->status != NaturallyImmune) );
+  g_assert ( (herd->state->status != Destroyed) && (herd->state->status != NaturallyImmune) );
   #else
   /* In the standard version, if the unit is already Destroyed, it should not
    * be destroyed again. */
-  g_assert (herd->status != Destroyed);
+  g_assert (herd->state->status != Destroyed);
   #endif
 
 #if DEBUG
@@ -678,11 +679,11 @@ vaccinate (struct naadsm_model_t_ *self, HRD_herd_t * herd,
   #ifdef RIVERTON
   /* In Riverton, if the unit is Destroyed or NaturallyImmune, 
    * it should not be vaccinated. */
-  g_assert ( (herd->status != Destroyed) && (herd->status != NaturallyImmune) );
+  g_assert ( (herd->state->status != Destroyed) && (herd->state->status != NaturallyImmune) );
   #else
   /* In the standard version, if the unit is already Destroyed, 
    * it should not be vaccinated. */
-  g_assert (herd->status != Destroyed);
+  g_assert (herd->state->status != Destroyed);
   #endif
 
   /* If the unit has already been vaccinated recently, we can ignore the
@@ -1503,7 +1504,7 @@ handle_request_for_zone_focus_event (struct naadsm_model_t_ *self,
   sc_make_zone_focus( event->day, herd );
 #else
   if( NULL != naadsm_make_zone_focus )
-    naadsm_make_zone_focus (herd->index);
+    naadsm_make_zone_focus (herd->original_index);
 #endif
 
 #if DEBUG
@@ -1715,6 +1716,55 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do:
+ * tomorrow while there are units waiting for vaccination, or while there are
+ * units waiting for destruction and capacity to destroy them.  Before the
+ * destruction program begins, the answer is the day it begins.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return the day, or G_MAXINT if nothing is scheduled.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  local_data_t *local_data;
+  unsigned int npriorities;
+  GQueue *q;
+  int i;
+
+  local_data = (local_data_t *) (self->model_data);
+
+  /* Waiting vaccinations are either carried out or, below the program
+   * threshold, cleared, so either way there is work tomorrow. */
+  npriorities = local_data->pending_vaccinations->len;
+  for (i = 0; i < npriorities; i++)
+    {
+      q = (GQueue *) g_ptr_array_index (local_data->pending_vaccinations, i);
+      if (!g_queue_is_empty (q))
+        return day + 1;
+    }
+
+  if (local_data->outbreak_known && !local_data->no_more_destructions)
+    {
+      npriorities = local_data->pending_destructions->len;
+      for (i = 0; i < npriorities; i++)
+        {
+          q = (GQueue *) g_ptr_array_index (local_data->pending_destructions, i);
+          if (!g_queue_is_empty (q))
+            return MAX (day + 1, local_data->destruction_program_begin_day);
+        }
+    }
+
+  return G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -1868,7 +1918,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_debug ("----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  m = g_new (naadsm_model_t, 1);
+  m = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   m->name = MODEL_NAME;
@@ -1881,6 +1931,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   m->is_listening_for = is_listening_for;
   m->has_pending_actions = has_pending_actions;
   m->has_pending_infections = has_pending_infections;
+  m->next_wake_day = next_wake_day;
   m->to_string = to_string;
   m->printf = local_printf;
   m->fprintf = local_fprintf;
@@ -171,9 +171,9 @@ check_and_choose (int id, gpointer arg)
    * died out and no longer exist, so they don't need to be destroyed. */
   if (
       local_data->to_production_type[herd2->production_type] == FALSE
-      || herd2->status == Destroyed
+      || herd2->state->status == Destroyed
       #ifdef RIVERTON
-      || herd2->status == NaturallyImmune
+      || herd2->state->status == NaturallyImmune
       #endif
   )
     goto end;
@@ -216,7 +216,7 @@ ring_destroy (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
   callback_data.queue = queue;
 
   /* Find the distances to other units. */
-  spatial_search_circle_by_id (herds->spatial_index, herd->index,
+  spatial_search_circle_by_id (herds->live_index, herd->index,
                                local_data->radius + EPSILON,
                                check_and_choose, &callback_data);
 
@@ -493,7 +493,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  m = g_new (naadsm_model_t, 1);
+  m = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   m->name = MODEL_NAME;
@@ -506,6 +506,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   m->is_listening_for = is_listening_for;
   m->has_pending_actions = has_pending_actions;
   m->has_pending_infections = has_pending_infections;
+  m->next_wake_day = NULL;
   m->to_string = to_string;
   m->printf = local_printf;
   m->fprintf = local_fprintf;
@@ -576,6 +577,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
       g_warning ("%s: radius missing, setting to 0", MODEL_NAME);
       local_data->radius = 0;
     }
+  spatial_search_add_query_radius (herds->spatial_index, local_data->radius + EPSILON);
 
 #if DEBUG
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- EXIT new (%s)", MODEL_NAME);
@@ -33,6 +33,7 @@
 #define is_listening_for ring_vaccination_model_is_listening_for
 #define has_pending_actions ring_vaccination_model_has_pending_actions
 #define has_pending_infections ring_vaccination_model_has_pending_infections
+#define next_wake_day ring_vaccination_model_next_wake_day
 #define to_string ring_vaccination_model_to_string
 #define local_printf ring_vaccination_model_printf
 #define local_fprintf ring_vaccination_model_fprintf
@@ -109,6 +110,8 @@ typedef struct
   double *max_radius; /**< One value for each production type, giving the
     largest vaccination ring that can be triggered by a unit of that production
     type. */
+  spatial_search_t *spatial_index; /**< The index of unit locations.  Kept so
+    that the vaccination radii can be passed to it as search hints. */
   GHashTable *detected_units; /**< A list of detected units.  The pointer to
     the HRD_herd_t structure is the key. */
   GHashTable *requested_today; /**< A list of units for which this module made
@@ -218,9 +221,9 @@ check_and_choose (int id, gpointer arg)
    * In the experimental version 'Riverton', "naturally immune" units have
    * died out and no longer exist, so they don't need to be vaccinated. */
   if (
-      herd2->status == Destroyed
+      herd2->state->status == Destroyed
       #ifdef RIVERTON
-      || herd2->status == NaturallyImmune
+      || herd2->state->status == NaturallyImmune
       #endif
    )
     goto end;
@@ -292,7 +295,7 @@ ring_vaccinate (struct naadsm_model_t_ *self, HRD_herd_list_t * herds, HRD_herd_
   callback_data.queue = queue;
 
   /* Find the distances to other herds. */
-  spatial_search_circle_by_id (herds->spatial_index, herd->index,
+  spatial_search_circle_by_id (herds->live_index, herd->index,
                                local_data->max_radius[herd->production_type] + EPSILON,
                                check_and_choose, &callback_data);
 
@@ -450,6 +453,26 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do.
+ * A new day only forgets the requests made the day before, so the model
+ * never needs waking.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return G_MAXINT.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  return G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -735,6 +758,8 @@ set_params (struct naadsm_model_t_ *self, PAR_parameter_t * params)
              * index when looking for herds to spread infection to. */
             if (param_block->radius > local_data->max_radius[i])
               local_data->max_radius[i] = param_block->radius;
+            spatial_search_add_query_radius (local_data->spatial_index,
+                                             param_block->radius + EPSILON);
           }
 
   g_free (from_production_type);
@@ -764,7 +789,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_debug ("----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  self = g_new (naadsm_model_t, 1);
+  self = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   self->name = MODEL_NAME;
@@ -778,6 +803,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   self->is_listening_for = is_listening_for;
   self->has_pending_actions = has_pending_actions;
   self->has_pending_infections = has_pending_infections;
+  self->next_wake_day = next_wake_day;
   self->to_string = to_string;
   self->printf = local_printf;
   self->fprintf = local_fprintf;
@@ -790,6 +816,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   local_data->production_types = herds->production_type_names;
   nprod_types = local_data->production_types->len;
   local_data->param_block = g_new0 (param_block_t **, nprod_types);
+  local_data->spatial_index = herds->spatial_index;
 
   /* Initialize a list of detected units. */
   local_data->detected_units = g_hash_table_new (g_direct_hash, g_direct_equal);
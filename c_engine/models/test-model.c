@@ -34,6 +34,7 @@
 #define is_listening_for test_model_is_listening_for
 #define has_pending_actions test_model_has_pending_actions
 #define has_pending_infections test_model_has_pending_infections
+#define next_wake_day test_model_next_wake_day
 #define to_string test_model_to_string
 #define local_printf test_model_printf
 #define local_fprintf test_model_fprintf
@@ -161,7 +162,7 @@ handle_new_day_event (struct naadsm_model_t_ *self,
                                not_needed_in_detection_status, NULL);
 
   /* Release any test results that were delayed until today. */
-  local_data->rotating_index = (local_data->rotating_index + 1) % local_data->pending_results->len;
+  local_data->rotating_index = (local_data->rotating_index + 1 + event->ndays_skipped) % local_data->pending_results->len;
   q = (GQueue *) g_ptr_array_index (local_data->pending_results,
 				    local_data->rotating_index);
   last_herd = NULL;
@@ -314,9 +315,9 @@ handle_test_event (struct naadsm_model_t_ *self,
 #if DEBUG
   s = g_string_new (NULL);
   g_string_printf (s, "unit \"%s\" is %s", herd->official_id,
-        	   HRD_status_name [herd->status]);
+        	   HRD_status_name [herd->state->status]);
 #endif
-  switch (herd->status)
+  switch (herd->state->status)
     {
     case Latent:
     case InfectiousSubclinical:
@@ -555,6 +556,31 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do: the
+ * day on which the next delayed test result comes due.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return the day, or G_MAXINT if nothing is scheduled.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  local_data_t *local_data;
+  unsigned int ahead;
+
+  local_data = (local_data_t *) (self->model_data);
+  ahead = naadsm_rotating_array_next_nonempty (local_data->pending_results,
+                                               local_data->rotating_index);
+  return (ahead > 0) ? day + ahead : G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -708,7 +734,7 @@ new (scew_element * params, HRD_herd_list_t *herds, projPJ projection,
   g_debug ("----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  self = g_new (naadsm_model_t, 1);
+  self = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   self->name = MODEL_NAME;
@@ -721,6 +747,7 @@ new (scew_element * params, HRD_herd_list_t *herds, projPJ projection,
   self->is_listening_for = is_listening_for;
   self->has_pending_actions = has_pending_actions;
   self->has_pending_infections = has_pending_infections;
+  self->next_wake_day = next_wake_day;
   self->to_string = to_string;
   self->printf = local_printf;
   self->fprintf = local_fprintf;
@@ -181,7 +181,7 @@ handle_test_result_event (struct naadsm_model_t_ * self,
 
   /* Record the test in the GUI */
   /* -------------------------- */
-  test.herd_index = event->herd->index;
+  test.herd_index = event->herd->original_index;
 
   if( event->reason == NAADSM_ControlTraceForwardDirect )
     {
@@ -517,7 +517,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_debug ("----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  self = g_new (naadsm_model_t, 1);
+  self = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   self->name = MODEL_NAME;
@@ -530,6 +530,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   self->is_listening_for = is_listening_for;
   self->has_pending_actions = has_pending_actions;
   self->has_pending_infections = has_pending_infections;
+  self->next_wake_day = NULL;
   self->to_string = to_string;
   self->printf = local_printf;
   self->fprintf = local_fprintf;
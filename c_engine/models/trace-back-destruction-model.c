@@ -50,6 +50,7 @@
 #define is_listening_for trace_back_destruction_model_is_listening_for
 #define has_pending_actions trace_back_destruction_model_has_pending_actions
 #define has_pending_infections trace_back_destruction_model_has_pending_infections
+#define next_wake_day trace_back_destruction_model_next_wake_day
 #define to_string trace_back_destruction_model_to_string
 #define local_printf trace_back_destruction_model_printf
 #define local_fprintf trace_back_destruction_model_fprintf
@@ -233,9 +234,9 @@ handle_record (EVT_event_t *exposure_record,
       /* In the experimental version 'Riverton', "naturally immune" units have
        * died out and no longer exist, so they don't need to be destroyed. */
       if (
-          trace->exposed_herd->status != Destroyed
+          trace->exposed_herd->state->status != Destroyed
           #ifdef RIVERTON
-          && trace->exposed_herd->status != NaturallyImmune
+          && trace->exposed_herd->state->status != NaturallyImmune
           #endif
       )
         {
@@ -560,6 +561,26 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do.
+ * A new day only forgets the detections made the day before, so the model
+ * never needs waking.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return G_MAXINT.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  return G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -696,7 +717,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_debug ("----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  m = g_new (naadsm_model_t, 1);
+  m = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   m->name = MODEL_NAME;
@@ -709,6 +730,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   m->is_listening_for = is_listening_for;
   m->has_pending_actions = has_pending_actions;
   m->has_pending_infections = has_pending_infections;
+  m->next_wake_day = next_wake_day;
   m->to_string = to_string;
   m->printf = local_printf;
   m->fprintf = local_fprintf;
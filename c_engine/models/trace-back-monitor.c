@@ -37,6 +37,7 @@
 #define is_listening_for trace_back_monitor_is_listening_for
 #define has_pending_actions trace_back_monitor_has_pending_actions
 #define has_pending_infections trace_back_monitor_has_pending_infections
+#define next_wake_day trace_back_monitor_next_wake_day
 #define to_string trace_back_monitor_to_string
 #define local_printf trace_back_monitor_printf
 #define local_fprintf trace_back_monitor_fprintf
@@ -191,11 +192,11 @@ handle_trace_result_event (struct naadsm_model_t_ *self, EVT_trace_result_event_
   trace.day = (int) event->day;
   trace.initiated_day = (int) event->initiated_day;
   
-  trace.identified_index = identified_herd->index;
-  trace.identified_status = (NAADSM_disease_state) identified_herd->status;
+  trace.identified_index = identified_herd->original_index;
+  trace.identified_status = (NAADSM_disease_state) identified_herd->state->status;
   
-  trace.origin_index = origin_herd->index; 
-  trace.origin_status = (NAADSM_disease_state) origin_herd->status;
+  trace.origin_index = origin_herd->original_index; 
+  trace.origin_status = (NAADSM_disease_state) origin_herd->state->status;
   
   trace.trace_type = event->direction;
   trace.contact_type = event->contact_type;
@@ -384,6 +385,26 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do.
+ * A new day only zeroes the daily counts, which are already zero after a
+ * day on which nothing was traced, so the model never needs waking.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return G_MAXINT.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  return G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -518,7 +539,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projections,
   g_debug ("----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  m = g_new (naadsm_model_t, 1);
+  m = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   m->name = MODEL_NAME;
@@ -531,6 +552,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projections,
   m->is_listening_for = is_listening_for;
   m->has_pending_actions = has_pending_actions;
   m->has_pending_infections = has_pending_infections;
+  m->next_wake_day = next_wake_day;
   m->to_string = to_string;
   m->printf = local_printf;
   m->fprintf = local_fprintf;
@@ -172,7 +172,7 @@ handle_trace_result_event (struct naadsm_model_t_ *self,
   else
     herd = event->exposing_herd;
 
-  if (herd->status == Destroyed
+  if (herd->state->status == Destroyed
       || local_data->production_type[herd->production_type] == FALSE)
     goto end;
 
@@ -468,7 +468,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  self = g_new (naadsm_model_t, 1);
+  self = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   self->name = MODEL_NAME;
@@ -481,6 +481,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   self->is_listening_for = is_listening_for;
   self->has_pending_actions = has_pending_actions;
   self->has_pending_infections = has_pending_infections;
+  self->next_wake_day = NULL;
   self->to_string = to_string;
   self->printf = local_printf;
   self->fprintf = local_fprintf;
@@ -28,6 +28,7 @@
 #define is_listening_for vaccination_list_monitor_is_listening_for
 #define has_pending_actions vaccination_list_monitor_has_pending_actions
 #define has_pending_infections vaccination_list_monitor_has_pending_infections
+#define next_wake_day vaccination_list_monitor_next_wake_day
 #define to_string vaccination_list_monitor_to_string
 #define local_printf vaccination_list_monitor_printf
 #define local_fprintf vaccination_list_monitor_fprintf
@@ -204,7 +205,7 @@ handle_commitment_to_vaccinate_event (struct naadsm_model_t_ *self,
 
   if (NULL != naadsm_queue_herd_for_vaccination)
     {
-      naadsm_queue_herd_for_vaccination (herd->index);
+      naadsm_queue_herd_for_vaccination (herd->original_index);
     }
 
   /* Increment the counts of vaccinations still to do. */
@@ -338,7 +339,7 @@ handle_vaccination_canceled_event (struct naadsm_model_t_ *self,
   herd = event->herd;
 
   /* Inform the GUI of the cancellation. */
-  update.herd_index = herd->index;
+  update.herd_index = herd->original_index;
   update.day_commitment_made = event->day_commitment_made;
   update.reason = 0; /* This is unused for "vaccination canceled" events */
   
@@ -522,6 +523,32 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do:
+ * tomorrow while any units are waiting to be vaccinated, because every day in
+ * the queue is counted.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return the day, or G_MAXINT if the queue is empty.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  local_data_t *local_data;
+
+  local_data = (local_data_t *) (self->model_data);
+  if (local_data->unique_herds_awaiting_vaccination > 0)
+    return day + 1;
+  else
+    return G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -643,7 +670,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_debug ("----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  self = g_new (naadsm_model_t, 1);
+  self = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   self->name = MODEL_NAME;
@@ -656,6 +683,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   self->is_listening_for = is_listening_for;
   self->has_pending_actions = has_pending_actions;
   self->has_pending_infections = has_pending_infections;
+  self->next_wake_day = next_wake_day;
   self->to_string = to_string;
   self->printf = local_printf;
   self->fprintf = local_fprintf;
@@ -28,6 +28,7 @@
 #define is_listening_for vaccination_monitor_is_listening_for
 #define has_pending_actions vaccination_monitor_has_pending_actions
 #define has_pending_infections vaccination_monitor_has_pending_infections
+#define next_wake_day vaccination_monitor_next_wake_day
 #define to_string vaccination_monitor_to_string
 #define local_printf vaccination_monitor_printf
 #define local_fprintf vaccination_monitor_fprintf
@@ -274,9 +275,9 @@ handle_vaccination_event (struct naadsm_model_t_ *self, EVT_vaccination_event_t
   peek = RPT_reporting_get_text1 (local_data->vaccinations, event->reason);
   first_of_cause = (peek == NULL) || (strlen (peek) == 0);
 
-  g_string_printf (local_data->target, first_of_cause ? "%u" : ",%u", herd->index);
+  g_string_printf (local_data->target, first_of_cause ? "%u" : ",%u", herd->original_index);
 
-  update.herd_index = herd->index;
+  update.herd_index = herd->original_index;
   update.day_commitment_made = event->day_commitment_made;
   
   if( 0 == strcmp( "Ring", event->reason ) ) 
@@ -494,6 +495,26 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do.
+ * A new day only zeroes the daily counts, which are already zero after a
+ * day on which nothing was vaccinated, so the model never needs waking.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return G_MAXINT.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  return G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -627,7 +648,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_debug ("----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  m = g_new (naadsm_model_t, 1);
+  m = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   m->name = MODEL_NAME;
@@ -640,6 +661,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   m->is_listening_for = is_listening_for;
   m->has_pending_actions = has_pending_actions;
   m->has_pending_infections = has_pending_infections;
+  m->next_wake_day = next_wake_day;
   m->to_string = to_string;
   m->printf = local_printf;
   m->fprintf = local_fprintf;
@@ -39,6 +39,7 @@
 #define is_listening_for zone_model_is_listening_for
 #define has_pending_actions zone_model_has_pending_actions
 #define has_pending_infections zone_model_has_pending_infections
+#define next_wake_day zone_model_next_wake_day
 #define to_string zone_model_to_string
 #define local_printf zone_model_printf
 #define local_fprintf zone_model_fprintf
@@ -234,7 +235,7 @@ check_circle_and_rezone (int id, gpointer arg)
 #endif
                   zones->membership[herd->index] = callback_data->fragment_containing_focus[i];
 
-                  zone_update.herd_index = herd->index;
+                  zone_update.herd_index = herd->original_index;
                   zone_update.zone_level = zone->level;
 				  
 #ifdef USE_SC_GUILIB
@@ -341,7 +342,7 @@ check_poly_and_rezone (int id, gpointer arg)
 #endif
               zones->membership[herd->index] = callback_data->hole_fragment;
 
-              zone_update.herd_index = herd->index;
+              zone_update.herd_index = herd->original_index;
               zone_update.zone_level = zone->level;
 			  
 #ifdef USE_SC_GUILIB
@@ -724,6 +725,42 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do:
+ * tomorrow if there are foci waiting to be added, or if a cumulative count of
+ * filled holes is being kept (it grows every day once any hole has been
+ * filled).
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return the day, or G_MAXINT if nothing is scheduled.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  local_data_t *local_data;
+  param_block_t *param_block;
+  unsigned int i;
+
+  if (!g_queue_is_empty (zones->pending_foci))
+    return day + 1;
+
+  local_data = (local_data_t *) (self->model_data);
+  for (i = 0; i < local_data->param_blocks->len; i++)
+    {
+      param_block = (param_block_t *) g_ptr_array_index (local_data->param_blocks, i);
+      if (param_block->cumul_num_holes_filled->frequency != RPT_never
+          && param_block->zone->nholes_filled > 0)
+        return day + 1;
+    }
+  return G_MAXINT;
+}
+
+
+
 /**
  */
 static void param_block_to_string (gpointer data, gpointer user_data)
@@ -930,6 +967,11 @@ set_params (struct naadsm_model_t_ *self, PAR_parameter_t * params)
 
   param_block->zone = ZON_new_zone (name, level, radius);
 
+  /* Searches around a focus use the radius of the largest zone.  Which zone
+   * that is is not known until all zones are read, so pass every radius to the
+   * spatial index as a hint. */
+  spatial_search_add_query_radius (local_data->herds->spatial_index, radius + EPSILON);
+
   {
     GString * s = g_string_new (NULL);
 
@@ -1019,7 +1061,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  self = g_new (naadsm_model_t, 1);
+  self = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   self->name = MODEL_NAME;
@@ -1033,6 +1075,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   self->is_listening_for = is_listening_for;
   self->has_pending_actions = has_pending_actions;
   self->has_pending_infections = has_pending_infections;
+  self->next_wake_day = next_wake_day;
   self->to_string = to_string;
   self->printf = local_printf;
   self->fprintf = local_fprintf;
@@ -30,6 +30,7 @@
 #define is_listening_for zone_monitor_is_listening_for
 #define has_pending_actions zone_monitor_has_pending_actions
 #define has_pending_infections zone_monitor_has_pending_infections
+#define next_wake_day zone_monitor_next_wake_day
 #define to_string zone_monitor_to_string
 #define local_printf zone_monitor_printf
 #define local_fprintf zone_monitor_fprintf
@@ -313,7 +314,7 @@ handle_new_day_event (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
           drill_down_list[0] = zone->name;
           drill_down_list[1] = herd->production_type_name;
           RPT_reporting_add_integer (local_data->num_units_by_prodtype, 1, drill_down_list);
-          if (herd->status != Destroyed)
+          if (herd->state->status != Destroyed)
             {
               RPT_reporting_add_integer1 (local_data->num_unit_days, 1, zone->name);
               RPT_reporting_add_integer1 (local_data->num_animal_days, herd->size, zone->name);
@@ -606,6 +607,41 @@ has_pending_infections (struct naadsm_model_t_ * self)
 
 
 
+/**
+ * Reports the earliest day on which this model has work of its own to do:
+ * tomorrow if zone areas or perimeters are passed to the GUI or tracked for
+ * their maximums, or if unit-days and animal-days in zones are being counted.
+ * The remaining outputs are snapshots that do not change on a day when
+ * nothing happens.
+ *
+ * @param self the model.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param day the current simulation day.
+ * @return the day, or G_MAXINT if nothing is scheduled.
+ */
+int
+next_wake_day (struct naadsm_model_t_ *self, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, int day)
+{
+  local_data_t *local_data;
+  gboolean area_due, perimeter_due;
+
+  local_data = (local_data_t *) (self->model_data);
+  area_due = local_data->area->frequency == RPT_daily
+             || local_data->max_area_day->frequency != RPT_never;
+  perimeter_due = local_data->perimeter->frequency == RPT_daily
+                  || local_data->max_perimeter_day->frequency != RPT_never;
+  if ((local_data->nzones > 1 && (area_due || perimeter_due))
+      || local_data->num_unit_days->frequency != RPT_never
+      || local_data->num_animal_days->frequency != RPT_never)
+    return day + 1;
+  else
+    return G_MAXINT;
+}
+
+
+
 /**
  * Returns a text representation of this model.
  *
@@ -732,7 +768,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   g_debug ("----- ENTER new (%s)", MODEL_NAME);
 #endif
 
-  self = g_new (naadsm_model_t, 1);
+  self = g_new0 (naadsm_model_t, 1);
   local_data = g_new (local_data_t, 1);
 
   self->name = MODEL_NAME;
@@ -745,6 +781,7 @@ new (scew_element * params, HRD_herd_list_t * herds, projPJ projection,
   self->is_listening_for = is_listening_for;
   self->has_pending_actions = has_pending_actions;
   self->has_pending_infections = has_pending_infections;
+  self->next_wake_day = next_wake_day;
   self->to_string = to_string;
   self->printf = local_printf;
   self->fprintf = local_fprintf;
@@ -22,17 +22,93 @@
 #endif
 
 #include "rng.h"
-#include <sprng.h>
 
 #include "naadsm.h"
 
+#if HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+#include <time.h>
+
+
+
+/* Constants for the Philox4x32 round function and key schedule. */
+#define PHILOX_M0 0xD2511F53U
+#define PHILOX_M1 0xCD9E8D57U
+#define PHILOX_W0 0x9E3779B9U
+#define PHILOX_W1 0xBB67AE85U
+#define PHILOX_ROUNDS 10
+
 
 
 /**
- * Wraps sprng() in a function that can be stored in a gsl_rng_type object.
+ * Computes one block of random bits from the generator's key and counter
+ * (Philox4x32-10), then advances the counter.
+ *
+ * @param gen a random number generator.
  */
-double
-sprng_as_get_double (void *state)
+static void
+philox_next_block (RAN_gen_t * gen)
+{
+  guint32 c0, c1, c2, c3, k0, k1;
+  guint64 p0, p1;
+  int round;
+
+  c0 = gen->counter[0];
+  c1 = gen->counter[1];
+  c2 = gen->counter[2];
+  c3 = gen->counter[3];
+  k0 = gen->key[0];
+  k1 = gen->key[1];
+  for (round = 0; round < PHILOX_ROUNDS; round++)
+    {
+      if (round > 0)
+        {
+          k0 += PHILOX_W0;
+          k1 += PHILOX_W1;
+        }
+      p0 = (guint64) PHILOX_M0 * c0;
+      p1 = (guint64) PHILOX_M1 * c2;
+      c0 = (guint32) (p1 >> 32) ^ c1 ^ k0;
+      c1 = (guint32) p1;
+      c2 = (guint32) (p0 >> 32) ^ c3 ^ k1;
+      c3 = (guint32) p0;
+    }
+  gen->block[0] = c0;
+  gen->block[1] = c1;
+  gen->block[2] = c2;
+  gen->block[3] = c3;
+  gen->nused = 0;
+
+  /* The block number is a 64-bit value in the low two words of the
+   * counter. */
+  if (++gen->counter[0] == 0)
+    gen->counter[1]++;
+}
+
+
+
+/**
+ * Returns the next 32 random bits from a generator.
+ *
+ * @param gen a random number generator.
+ * @return 32 random bits.
+ */
+static guint32
+philox_next_word (RAN_gen_t * gen)
+{
+  if (gen->nused == 4)
+    philox_next_block (gen);
+  return gen->block[gen->nused++];
+}
+
+
+
+/**
+ * Wraps RAN_num() in a function that can be stored in a gsl_rng_type object.
+ */
+static double
+ran_as_get_double (void *state)
 {
   RAN_gen_t *rng;
 
@@ -43,12 +119,50 @@ sprng_as_get_double (void *state)
 
 
 /**
- * Wraps isprng() in a function that can be stored in a gsl_rng_type object.
+ * Returns a 31-bit random integer, in a function that can be stored in a
+ * gsl_rng_type object.
+ */
+static unsigned long int
+ran_as_get (void *state)
+{
+  return (unsigned long int) (philox_next_word ((RAN_gen_t *) state) >> 1);
+}
+
+
+
+/**
+ * Initializes a generator to the start of the stream named by (seed,
+ * iteration, purpose).
+ *
+ * @param self a random number generator.
+ * @param seed a seed value.
+ * @param iteration an iteration number.
+ * @param purpose what the stream will be used for.
  */
-unsigned long int
-sprng_as_get (void *dummy)
+static void
+ran_init (RAN_gen_t * self, int seed, unsigned int iteration, RAN_purpose_t purpose)
 {
-  return isprng ();
+  self->fixed = FALSE;
+  self->seed = seed;
+  self->key[0] = (guint32) seed;
+  self->key[1] = (guint32) iteration;
+  self->counter[0] = 0;
+  self->counter[1] = 0;
+  self->counter[2] = 0;
+  self->counter[3] = (guint32) purpose;
+  self->nused = 4;              /* no block computed yet */
+
+  /* Fill in the GSL-compatibility fields. */
+  self->as_gsl_rng_type.name = "Philox4x32-10";
+  self->as_gsl_rng_type.max = 2147483647;
+  self->as_gsl_rng_type.min = 0;
+  self->as_gsl_rng_type.size = 0;
+  self->as_gsl_rng_type.set = NULL;
+  self->as_gsl_rng_type.get = ran_as_get;
+  self->as_gsl_rng_type.get_double = ran_as_get_double;
+
+  self->as_gsl_rng.type = &(self->as_gsl_rng_type);
+  self->as_gsl_rng.state = self;
 }
 
 
@@ -67,27 +181,13 @@ RAN_new_generator (int seed)
   char s[1024];
 
   if (seed == -1)
-    seed = make_sprng_seed ();
+    seed = (int) ((time (NULL) ^ (getpid () << 16)) & 0x7FFFFFFF);
     
   if (NULL != rng_read_seed)
     rng_read_seed (seed);  
   
-  g_assert (init_sprng (SPRNG_LFG, seed, SPRNG_DEFAULT) != NULL);
-
   self = g_new (RAN_gen_t, 1);
-  self->fixed = FALSE;
-
-  /* Fill in the GSL-compatibility fields. */
-  self->as_gsl_rng_type.name = "SPRNG2.0";
-  self->as_gsl_rng_type.max = 2147483647;
-  self->as_gsl_rng_type.min = 0;
-  self->as_gsl_rng_type.size = 0;
-  self->as_gsl_rng_type.set = NULL;
-  self->as_gsl_rng_type.get = sprng_as_get;
-  self->as_gsl_rng_type.get_double = sprng_as_get_double;
-
-  self->as_gsl_rng.type = &(self->as_gsl_rng_type);
-  self->as_gsl_rng.state = self;
+  ran_init (self, seed, 0, RAN_IterationStream);
 
   if( NULL != naadsm_debug ) {
     sprintf( s, "RNG seed set to %d", seed );
@@ -99,6 +199,66 @@ RAN_new_generator (int seed)
 
 
 
+/**
+ * Creates a new random number generator that uses the same seed as an
+ * existing one, but draws from the independent stream for a particular
+ * iteration and purpose.  The numbers drawn from the new generator do not
+ * depend on how many numbers have been drawn from any other stream, so
+ * iteration k gets the same numbers no matter which thread or MPI node runs
+ * it.  If the existing generator is fixed, the new one is fixed to the same
+ * value.
+ *
+ * @param gen a random number generator.
+ * @param iteration an iteration number.
+ * @param purpose what the stream will be used for.
+ * @return a random number generator.
+ */
+RAN_gen_t *
+RAN_new_substream (RAN_gen_t * gen, unsigned int iteration, RAN_purpose_t purpose)
+{
+  RAN_gen_t *self;
+
+  self = g_new (RAN_gen_t, 1);
+  ran_init (self, gen->seed, iteration, purpose);
+  self->fixed = gen->fixed;
+  self->fixed_value = gen->fixed_value;
+
+  return self;
+}
+
+
+
+/**
+ * Sets a generator to the start of one of the independent streams that belong
+ * to an existing generator's seed and iteration.  Within a purpose there is a
+ * stream for each (index, step) pair, for example one for each unit on each
+ * day, so that the numbers a unit draws do not depend on which thread works
+ * on it or on the order in which the units are worked on.  Unlike
+ * RAN_new_substream(), this allocates nothing, so it is cheap enough to call
+ * for every unit on every day.  Each stream is 2^32 blocks of 4 words long.
+ * If the existing generator is fixed, this one is fixed to the same value.
+ *
+ * @param self the generator to set.
+ * @param gen a random number generator, usually an iteration's stream.
+ * @param purpose what the stream will be used for.
+ * @param index which stream within the purpose, e.g., a unit index.
+ * @param step which stream for that index, e.g., a day.
+ */
+void
+RAN_set_substream (RAN_gen_t * self, RAN_gen_t * gen, RAN_purpose_t purpose,
+                   unsigned int index, unsigned int step)
+{
+  ran_init (self, gen->seed, gen->key[1], purpose);
+  /* The high word of the block number selects the step, and the sub-index
+   * word of the counter selects the index. */
+  self->counter[1] = (guint32) step;
+  self->counter[2] = (guint32) index;
+  self->fixed = gen->fixed;
+  self->fixed_value = gen->fixed_value;
+}
+
+
+
 /**
  * Returns a random number in [0,1).
  *
@@ -108,10 +268,15 @@ RAN_new_generator (int seed)
 double
 RAN_num (RAN_gen_t * gen)
 {
+  guint32 a, b;
+
   if (gen->fixed)
     return gen->fixed_value;
-  else
-    return sprng ();
+
+  /* Build a double with 53 random bits from two 32-bit words. */
+  a = philox_next_word (gen) >> 5;
+  b = philox_next_word (gen) >> 6;
+  return (a * 67108864.0 + b) * (1.0 / 9007199254740992.0);
 }
 
 
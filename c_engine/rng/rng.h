@@ -35,12 +35,42 @@
 
 
 
-/** A random number generator object. */
+/**
+ * Purposes for which separate random number substreams can be made.  See
+ * RAN_new_substream().
+ */
+typedef enum
+{
+  RAN_IterationStream, /**< the stream used by all models in one
+    iteration */
+  RAN_ContactSpreadStream, /**< one stream per source unit per day, for the
+    contact spread model */
+  RAN_NPURPOSES
+}
+RAN_purpose_t;
+
+
+
+/**
+ * A random number generator object.
+ *
+ * The generator is counter-based (Philox4x32-10, from Salmon et al., "Parallel
+ * random numbers: as easy as 1, 2, 3", SC '11): the n-th block of random bits
+ * is a keyed hash of the number n.  The key holds the seed and the iteration
+ * number, and the high words of the counter hold the purpose, so every
+ * (seed, iteration, purpose) triple names an independent stream, and moving
+ * to a different stream costs nothing.
+ */
 typedef struct
 {
   gboolean fixed;
   double fixed_value;
-
+  int seed;
+  guint32 key[2]; /**< [0] = seed, [1] = iteration number */
+  guint32 counter[4]; /**< [0],[1] = block number (low, high word),
+    [2] = sub-index within a purpose, [3] = purpose */
+  guint32 block[4]; /**< the current block of random bits */
+  int nused; /**< how many words of <i>block</i> have been used */
   /* These fields included so that the random number generator can be used by
    * GNU Scientific Library functions. */
   gsl_rng_type as_gsl_rng_type;
@@ -51,6 +81,9 @@ RAN_gen_t;
 
 
 RAN_gen_t *RAN_new_generator (int seed);
+RAN_gen_t *RAN_new_substream (RAN_gen_t *, unsigned int iteration, RAN_purpose_t);
+void RAN_set_substream (RAN_gen_t * self, RAN_gen_t *, RAN_purpose_t,
+                        unsigned int index, unsigned int step);
 double RAN_num (RAN_gen_t *);
 gsl_rng *RAN_generator_as_gsl (RAN_gen_t *);
 void RAN_fix (RAN_gen_t *, double);
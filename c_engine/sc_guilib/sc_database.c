@@ -81,7 +81,7 @@ void write_herds_ever_infected_SQL( HRD_herd_list_t *_herds )
         if ( _herd->ever_infected )
         {
           char _status[50];
-          switch ( _herd->status )
+          switch ( _herd->state->status )
           {
             case Susceptible:
               sprintf( _status, "Susceptible" );
@@ -113,7 +113,7 @@ void write_herds_ever_infected_SQL( HRD_herd_list_t *_herds )
           };
 
           g_print( "Herd: %s was first infected on day %i, and is currently %s and has been in that status for %i days\n",
-                     _herd->official_id, _herd->day_first_infected, _status, _herd->days_in_status );
+                     _herd->official_id, _herd->day_first_infected, _status, HRD_days_in_status (_herd, _iteration.current_day) );
         }
       };
     };
@@ -551,8 +551,8 @@ void write_outIterationByHerd_SQL( guint _run, HRD_herd_list_t *_herds )
       if ( _herd != NULL )
       { 
 		g_print( "INSERT INTO outIterationByHerd ( jobID, iteration, herdID, lastStatusCode, lastStatusDay, lastApparentStateCode, lastApparentStateDay, firstInfectionDay ) VALUES( %s, %i, %s, '%c', %i, '%c', %i, %i );\n", 
-				 _scenario.scenarioId,  iteration, _herd->official_id, HRD_STATE_CHAR[_herd->status], 
-				 ((_iteration.outbreakEndDay > 0 )? (_iteration.outbreakEndDay - _herd->days_in_status):(_iteration.current_day - _herd->days_in_status)), 
+				 _scenario.scenarioId,  iteration, _herd->official_id, HRD_STATE_CHAR[_herd->state->status], 
+				 ((_iteration.outbreakEndDay > 0 )? (_iteration.outbreakEndDay - HRD_days_in_status (_herd, _iteration.current_day)):(_iteration.current_day - HRD_days_in_status (_herd, _iteration.current_day))), 
 				 HRD_APPARENT_STATE_CHAR[_herd->apparent_status], _herd->apparent_status_day, _herd->day_first_infected
 				);
 	  };
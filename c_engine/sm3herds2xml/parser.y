@@ -194,7 +194,7 @@ herd:
 
       $$ = HRD_new_herd (i, g_ptr_array_index (production_type_names, i), $5, $7, $9);
       assert ($$ != NULL);
-      $$->status = Susceptible;
+      $$->state->status = Susceptible;
     }
   | INT COMMA INT COMMA INT COMMA FLOAT COMMA FLOAT COMMA INT
     {
@@ -224,7 +224,7 @@ herd:
 
       $$ = HRD_new_herd (i, g_ptr_array_index (production_type_names, i), $5, $7, $9);
       assert ($$ != NULL);
-      $$->status = $11;
+      $$->state->status = $11;
     }
   | INT COMMA INT COMMA INT COMMA FLOAT COMMA FLOAT COMMA INT COMMA INT COMMA INT COMMA int_list
     {
@@ -256,7 +256,7 @@ herd:
 
       $$ = HRD_new_herd (i, g_ptr_array_index (production_type_names, i), $5, $7, $9);
       assert ($$ != NULL);
-      $$->status = $7;
+      $$->state->status = $7;
 
       /* Copy the values from the variable-length part of the line into the
        * herd structure. */
@@ -105,7 +105,7 @@ main (int argc, char *argv[])
       printf ("      <latitude>%g</latitude>\n", herd->y);
       printf ("      <longitude>%g</longitude>\n", herd->x);
       printf ("    </location>\n");
-      printf ("    <status>%s</status>\n", HRD_status_name[herd->status]);
+      printf ("    <status>%s</status>\n", HRD_status_name[herd->state->status]);
       printf ("  </herd>\n");
     }
   printf ("</herds>\n");
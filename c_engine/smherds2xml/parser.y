@@ -159,7 +159,7 @@ herd:
        * initialize the herd structure. */
       $$ = HRD_new_herd (0, "Unknown livestock type", $1, $3, $5);
       assert ($$ != NULL);
-      $$->status = $7;
+      $$->state->status = $7;
 
       /* Copy the values from the variable-length part of the line into the
        * herd structure. */
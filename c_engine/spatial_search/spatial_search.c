@@ -2,9 +2,10 @@
  * Functions for finding objects in a spatial arrangement.
  *
  * The current implementation uses the R-tree data structure developed by A.
- * Guttman.  The purpose of wrapping the R-tree in another data structure (the
- * spatial search object) is to make it easier to replace the R-tree with
- * newer, better data structures and algorithms.
+ * Guttman for narrow searches, and a uniform grid (cell list) for wide ones.
+ * The purpose of wrapping them in another data structure (the spatial search
+ * object) is to make it easier to replace them with newer, better data
+ * structures and algorithms.
  *
  * @author Neil Harvey <neilharvey@gmail.com><br>
  *   Department of Computing & Information Science, University of Guelph<br>
@@ -33,10 +34,44 @@
 #include "wml.h"
 #include <gsl/gsl_math.h>
 
+#if STDC_HEADERS
+#  include <stdlib.h>
+#  include <string.h>
+#endif
+
 
 
 #define EPSILON 0.001
 
+/** The number of search radii tried when calibrating the R-tree cutover. */
+#define NCALIBRATION_RADII 11
+
+/** The calibration search radii, as fractions of the short side of the
+ * minimum-area rectangle around the points.  The fixed cutover used before
+ * calibration was added is a search diameter of 0.25 of the short side, that
+ * is, a radius of 0.125. */
+static const double calibration_radius_fraction[NCALIBRATION_RADII] =
+  { 0.005, 0.01, 0.02, 0.04, 0.06, 0.08, 0.1, 0.125, 0.15, 0.2, 0.3 };
+
+/** Calibration is skipped for point sets smaller than this, where timings are
+ * too small to measure and it makes no real difference which path is used. */
+#define CALIBRATION_MIN_POINTS 500
+
+/** The number of searches timed at each calibration radius. */
+#define CALIBRATION_NQUERIES 64
+
+/** Each calibration timing is repeated until at least this many seconds have
+ * passed, to get above the resolution of the timer. */
+#define CALIBRATION_MIN_SECONDS 0.002
+
+/** Fixed seed for choosing the calibration search centers, so that the same
+ * searches are timed on every run. */
+#define CALIBRATION_SEED 20101
+
+/** Removed points are dropped from the grid once they make up this fraction
+ * of the points still in it.  Until then, searches step over them. */
+#define COMPACTION_FRACTION 0.25
+
 
 
 /**
@@ -54,11 +89,111 @@ typedef struct
     minimum-area oriented rectangle. */
   double short_axis_length; /**< xaxis_length or yaxis_length, whichever is
     less. */
+  gboolean calibrated; /**< Whether rtree_threshold was measured.  If FALSE,
+    it is the fixed fraction of short_axis_length. */
+  double calibration_radius[NCALIBRATION_RADII];
+  double calibration_rtree_time[NCALIBRATION_RADII]; /**< Seconds per search
+    using the R-tree, at each of the calibration radii. */
+  double calibration_wide_time[NCALIBRATION_RADII]; /**< Seconds per search
+    using the grid (or the exhaustive scan, if there is no grid), at each of
+    the calibration radii. */
+  spatial_search_backend_t backend;
+  gboolean prepared;
+  GArray *query_radii; /**< The search radii the callers expect to use.  Used
+    to size the grid cells. */
+  double cell_size; /**< The side length of a grid cell. */
+  double grid_min_x, grid_min_y; /**< The lower left corner of the grid. */
+  unsigned int grid_ncols, grid_nrows;
+  unsigned int *cell_start; /**< For each grid cell, in row-major order, where
+    its points start in cell_id and cell_xy.  There is one extra entry at the
+    end, so that the points of cell c run from cell_start[c] to
+    cell_start[c+1].  NULL if there is no grid. */
+  int *cell_id; /**< The ids of the points, grouped by cell, in increasing
+    order within each cell. */
+  double *cell_xy; /**< The locations of the points in the same order as
+    cell_id, as x,y pairs, so that scanning a cell reads memory in order. */
+  unsigned int *full_cell_start; /**< The grid as built, with every point in
+    it.  cell_start, cell_id and cell_xy point to the same arrays until removed
+    points are compacted out of the grid. */
+  int *full_cell_id;
+  double *full_cell_xy;
+  spatial_search_t *view_of; /**< The spatial search object whose points,
+    R-tree and grid this one shares, or NULL if it owns them.  See
+    spatial_search_new_view(). */
+  guint8 *removed; /**< One flag per point, TRUE if the point has been
+    removed.  NULL if no point has been removed yet. */
+  unsigned int nremoved; /**< The number of points removed. */
+  unsigned int nremoved_in_grid; /**< The number of removed points that have
+    not yet been compacted out of the grid. */
 }
 private_data_t;
 
 
 
+/**
+ * Returns TRUE if a point has been removed from a spatial search object.
+ *
+ * @param P the spatial search object's internal data.
+ * @param ID the id of a point.
+ */
+#define IS_REMOVED(P,ID) ((P)->removed != NULL && (P)->removed[ID])
+
+
+
+/**
+ * Scratch storage for the searches that call back once for each point found.
+ * Those collect their hits first, so that the points come out in order of id.
+ * The array is kept between searches instead of being allocated each time.
+ * There is one per thread, because the same spatial search object may be
+ * searched from several threads at once.
+ */
+#if HAVE_TLS
+static __thread GArray *scratch_hits = NULL;
+#else
+static GArray *scratch_hits = NULL;
+#endif
+
+
+
+/**
+ * Takes this thread's scratch array of hits, emptied.  A search started from
+ * inside another search's callback finds the scratch array in use and gets a
+ * new one.
+ *
+ * @return an empty array of ints.
+ */
+static GArray *
+take_scratch_hits (void)
+{
+  GArray *hits;
+
+  hits = scratch_hits;
+  scratch_hits = NULL;
+  if (hits == NULL)
+    hits = g_array_new (FALSE, FALSE, sizeof(int));
+  else
+    g_array_set_size (hits, 0);
+  return hits;
+}
+
+
+
+/**
+ * Gives back an array taken with take_scratch_hits().
+ *
+ * @param hits the array.
+ */
+static void
+give_back_scratch_hits (GArray *hits)
+{
+  if (scratch_hits == NULL)
+    scratch_hits = hits;
+  else
+    g_array_free (hits, TRUE);
+}
+
+
+
 /**
  * Returns the distance between two points.
  *
@@ -125,6 +260,20 @@ new_spatial_search (void)
   private_data = g_new (private_data_t, 1);
   private_data->rtree = RTreeNewIndex ();
   private_data->xy = g_array_new (FALSE, FALSE, sizeof(double));
+  private_data->backend = SPATIAL_SEARCH_AUTO;
+  private_data->prepared = FALSE;
+  private_data->calibrated = FALSE;
+  private_data->query_radii = g_array_new (FALSE, FALSE, sizeof(double));
+  private_data->cell_start = NULL;
+  private_data->cell_id = NULL;
+  private_data->cell_xy = NULL;
+  private_data->full_cell_start = NULL;
+  private_data->full_cell_id = NULL;
+  private_data->full_cell_xy = NULL;
+  private_data->view_of = NULL;
+  private_data->removed = NULL;
+  private_data->nremoved = 0;
+  private_data->nremoved_in_grid = 0;
   searcher->private_data = (gpointer) private_data;
 
 #if DEBUG
@@ -153,6 +302,7 @@ spatial_search_add_point (spatial_search_t *searcher, double x, double y)
   struct Rect rect;
 
   private_data = (private_data_t *)(searcher->private_data);
+  g_assert (private_data->view_of == NULL);
   rect.boundary[0] = x;
   rect.boundary[1] = y;
   rect.boundary[2] = x;
@@ -184,6 +334,29 @@ spatial_search_add_point (spatial_search_t *searcher, double x, double y)
 
 
 
+/**
+ * Tells the spatial search object about a search radius that will be used.
+ * The radii given before spatial_search_prepare() is called decide the size
+ * of the grid cells; radii given afterwards are ignored.  Giving no radii is
+ * allowed, and just leaves the cell size to a default.
+ *
+ * @param searcher the spatial search object.
+ * @param radius a search radius.
+ */
+void
+spatial_search_add_query_radius (spatial_search_t *searcher, double radius)
+{
+  private_data_t *private_data;
+
+  private_data = (private_data_t *)(searcher->private_data);
+  if (!private_data->prepared && radius > 0)
+    g_array_append_val (private_data->query_radii, radius);
+
+  return;
+}
+
+
+
 /**
  * Calculates a minimum-area oriented rectangle bounding the points.  After
  * this function is called, the bounding_box field of the spatial_search_t
@@ -395,14 +568,180 @@ end:
 
 
 
+/**
+ * Compares two doubles.  This function is typed as a GCompareFunc so that it
+ * can be used to sort a GArray.
+ */
+static gint
+compare_doubles (gconstpointer a, gconstpointer b)
+{
+  double x = *((const double *) a), y = *((const double *) b);
+
+  return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+
+
+/**
+ * Compares two point ids.  This function is typed as a GCompareFunc so that
+ * it can be used to sort a GArray.
+ */
+static gint
+compare_ids (gconstpointer a, gconstpointer b)
+{
+  return *((const int *) a) - *((const int *) b);
+}
+
+
+
+/**
+ * Chooses the side length of the grid cells.  A search of radius r looks at
+ * every point in the cells overlapping a square of side 2r, so cells of about
+ * r/2 keep the area scanned to about twice the area of the circle, while
+ * cells much smaller than that add many empty cells to step over.  The radius
+ * used is the median of the radii the callers said they would search with,
+ * counting only those wide enough to be sent to the grid.  The cells are also
+ * kept large enough that there are no more than about 2 cells per point.
+ *
+ * @param searcher the spatial search object.
+ * @return the cell size.
+ */
+static double
+choose_cell_size (spatial_search_t *searcher)
+{
+  private_data_t *private_data;
+  double min_radius, radius, cell_size, width, height, max_cells;
+  GArray *radii;
+  unsigned int i;
+
+  private_data = (private_data_t *)(searcher->private_data);
+
+  /* The narrowest search the grid will be asked for. */
+  if (private_data->backend == SPATIAL_SEARCH_GRID)
+    min_radius = 0;
+  else
+    min_radius = private_data->rtree_threshold / 2;
+
+  radii = g_array_new (FALSE, FALSE, sizeof(double));
+  for (i = 0; i < private_data->query_radii->len; i++)
+    {
+      radius = g_array_index (private_data->query_radii, double, i);
+      if (radius > min_radius)
+        g_array_append_val (radii, radius);
+    }
+  if (radii->len > 0)
+    {
+      g_array_sort (radii, compare_doubles);
+      radius = g_array_index (radii, double, radii->len / 2);
+    }
+  else if (min_radius > 0)
+    radius = min_radius;
+  else
+    radius = private_data->short_axis_length / 8;
+  g_array_free (radii, TRUE);
+#if DEBUG
+  g_debug ("typical grid search radius = %g", radius);
+#endif
+
+  width = searcher->max_x - searcher->min_x;
+  height = searcher->max_y - searcher->min_y;
+  cell_size = radius / 2;
+  if (cell_size <= 0)
+    cell_size = MAX (MAX (width, height), 1);
+  max_cells = 2.0 * searcher->npoints;
+  while ((floor (width / cell_size) + 1) * (floor (height / cell_size) + 1) > max_cells)
+    cell_size *= 2;
+
+  return cell_size;
+}
+
+
+
+/**
+ * Builds the uniform grid.  The points are sorted into cells with a counting
+ * sort, which keeps them in increasing order of id within each cell.
+ *
+ * @param searcher the spatial search object.
+ */
+static void
+build_grid (spatial_search_t *searcher)
+{
+  private_data_t *private_data;
+  unsigned int npoints, ncells, ncols, nrows, col, row, cell, pos;
+  unsigned int *cell_of, *next;
+  double x, y;
+  unsigned int i;
+
+  private_data = (private_data_t *)(searcher->private_data);
+  npoints = searcher->npoints;
+
+  private_data->cell_size = choose_cell_size (searcher);
+  private_data->grid_min_x = searcher->min_x;
+  private_data->grid_min_y = searcher->min_y;
+  ncols = (unsigned int) floor ((searcher->max_x - searcher->min_x) / private_data->cell_size) + 1;
+  nrows = (unsigned int) floor ((searcher->max_y - searcher->min_y) / private_data->cell_size) + 1;
+  private_data->grid_ncols = ncols;
+  private_data->grid_nrows = nrows;
+  ncells = ncols * nrows;
+#if DEBUG
+  g_debug ("grid of %u x %u cells, each %g km across", ncols, nrows, private_data->cell_size);
+#endif
+
+  /* Count the points in each cell... */
+  private_data->cell_start = g_new0 (unsigned int, ncells + 1);
+  cell_of = g_new (unsigned int, npoints);
+  for (i = 0; i < npoints; i++)
+    {
+      x = g_array_index (private_data->xy, double, 2 * i);
+      y = g_array_index (private_data->xy, double, 2 * i + 1);
+      col = MIN ((unsigned int) ((x - private_data->grid_min_x) / private_data->cell_size), ncols - 1);
+      row = MIN ((unsigned int) ((y - private_data->grid_min_y) / private_data->cell_size), nrows - 1);
+      cell = row * ncols + col;
+      cell_of[i] = cell;
+      private_data->cell_start[cell + 1]++;
+    }
+  /* ...turn the counts into starting positions... */
+  for (cell = 0; cell < ncells; cell++)
+    private_data->cell_start[cell + 1] += private_data->cell_start[cell];
+  /* ...and drop each point into place. */
+  next = g_new (unsigned int, ncells);
+  for (cell = 0; cell < ncells; cell++)
+    next[cell] = private_data->cell_start[cell];
+  private_data->cell_id = g_new (int, npoints);
+  private_data->cell_xy = g_new (double, 2 * npoints);
+  for (i = 0; i < npoints; i++)
+    {
+      pos = next[cell_of[i]]++;
+      private_data->cell_id[pos] = i;
+      private_data->cell_xy[2 * pos] = g_array_index (private_data->xy, double, 2 * i);
+      private_data->cell_xy[2 * pos + 1] = g_array_index (private_data->xy, double, 2 * i + 1);
+    }
+  g_free (next);
+  g_free (cell_of);
+  private_data->full_cell_start = private_data->cell_start;
+  private_data->full_cell_id = private_data->cell_id;
+  private_data->full_cell_xy = private_data->cell_xy;
+
+  return;
+}
+
+
+
+static void calibrate (spatial_search_t *);
+
+
+
 /**
  * Prepares the spatial search object for use, after all the points have been
- * added.
+ * added.  Unless the grid alone is used, this times a set of searches through
+ * the R-tree and through the wide-area path, and sets the cutover between the
+ * two to the radius where the R-tree stops being faster.
  *
  * @param searcher the spatial search object.
+ * @param backend which data structures to use.
  */
 void
-spatial_search_prepare (spatial_search_t *searcher)
+spatial_search_prepare (spatial_search_t *searcher, spatial_search_backend_t backend)
 {
   private_data_t *private_data;
 
@@ -411,6 +750,7 @@ spatial_search_prepare (spatial_search_t *searcher)
 #endif
 
   private_data = (private_data_t *)(searcher->private_data);
+  g_assert (private_data->view_of == NULL);
 
 #if DEBUG
   g_debug ("x range %g-%g y range %g-%g",
@@ -420,10 +760,22 @@ spatial_search_prepare (spatial_search_t *searcher)
 
   /* This is specific to the R-tree algorithm: it is useful to know how large
    * the area covered by the points is.  So we find the minimum-area oriented
-   * bounding box around the point. */
+   * bounding box around the point.  The fixed fraction of the short side is
+   * only a starting guess; it is used to size the grid cells, and is kept if
+   * calibration is not possible. */
   find_oriented_bounding_box (searcher);
   private_data->rtree_threshold = 0.25 * private_data->short_axis_length;
 
+  private_data->backend = backend;
+  if (backend != SPATIAL_SEARCH_RTREE && searcher->npoints > 0)
+    build_grid (searcher);
+  if (backend != SPATIAL_SEARCH_GRID)
+    calibrate (searcher);
+  private_data->prepared = TRUE;
+#if DEBUG
+  g_debug ("R-tree used for search radii up to %g km", private_data->rtree_threshold / 2);
+#endif
+
 #if DEBUG
   g_debug ("----- EXIT spatial_search_prepare");
 #endif
@@ -433,152 +785,165 @@ spatial_search_prepare (spatial_search_t *searcher)
 
 
 
-typedef struct
+/**
+ * Creates a view of a prepared spatial search object.  The view shares the
+ * points, R-tree and grid of the original, so it is cheap to make, but points
+ * removed from the view (see spatial_search_remove_point()) are removed from
+ * the view alone.  This lets threads that run separate iterations each remove
+ * points from one shared index.
+ *
+ * The view must be freed before the original.
+ *
+ * @param searcher a prepared spatial search object, or a view of one.
+ * @return a new view.
+ */
+spatial_search_t *
+spatial_search_new_view (spatial_search_t *searcher)
 {
-  spatial_search_hit_callback user_function;
-  gpointer user_data;
-  GArray *xy;
-  double center_x, center_y, radius_sq; /* used just in circular searches */
+  spatial_search_t *view;
+  private_data_t *private_data, *view_private_data;
+
+  private_data = (private_data_t *)(searcher->private_data);
+  g_assert (private_data->prepared);
+  if (private_data->view_of != NULL)
+    {
+      searcher = private_data->view_of;
+      private_data = (private_data_t *)(searcher->private_data);
+    }
+
+  view = g_new (spatial_search_t, 1);
+  *view = *searcher;
+  view_private_data = g_new (private_data_t, 1);
+  *view_private_data = *private_data;
+  view_private_data->cell_start = private_data->full_cell_start;
+  view_private_data->cell_id = private_data->full_cell_id;
+  view_private_data->cell_xy = private_data->full_cell_xy;
+  view_private_data->view_of = searcher;
+  view_private_data->removed = NULL;
+  view_private_data->nremoved = 0;
+  view_private_data->nremoved_in_grid = 0;
+  view->private_data = (gpointer) view_private_data;
+
+  return view;
 }
-spatial_search_callback_args_t;
 
 
 
 /**
- * The function that the R-tree code library calls when it finds a point inside
- * the requested search rectangle.  Because we want a search circle, we do an
- * additional distance check before passing this point along to the
- * user-provided callback function.
+ * Drops the removed points from the grid.  The first time this is done, the
+ * grid is copied, so that the arrays built by spatial_search_prepare() (which
+ * views may share) are never changed.
  *
- * @param id the id of the point found by the R-tree search.
- * @param arg the user-provided function to notify about the found point.
+ * @param private_data the spatial search object's internal data.
  */
-int
-spatial_search_circle_callback (int id, void *arg)
+static void
+compact_grid (private_data_t *private_data)
 {
-  spatial_search_callback_args_t *args;
-  unsigned int index;
-  double point_x, point_y;
-
-  args = (spatial_search_callback_args_t *) arg;
-  /* Retrieve the x and y-coordinate of the point with id "id".  Recall that
-   * R-tree id's start at 1. */
-  index = (id - 1) * 2;
-  point_x = g_array_index (args->xy, double, index);
-  point_y = g_array_index (args->xy, double, index + 1);
+  unsigned int ncells, npoints, cell, pos, end, out;
+  unsigned int *cell_start;
+  int *cell_id;
+  double *cell_xy;
+
+  ncells = private_data->grid_ncols * private_data->grid_nrows;
+  npoints = private_data->cell_start[ncells] - private_data->nremoved_in_grid;
+  cell_start = g_new (unsigned int, ncells + 1);
+  cell_id = g_new (int, npoints);
+  cell_xy = g_new (double, 2 * npoints);
+  out = 0;
+  for (cell = 0; cell < ncells; cell++)
+    {
+      cell_start[cell] = out;
+      end = private_data->cell_start[cell + 1];
+      for (pos = private_data->cell_start[cell]; pos < end; pos++)
+        {
+          if (private_data->removed[private_data->cell_id[pos]])
+            continue;
+          cell_id[out] = private_data->cell_id[pos];
+          cell_xy[2 * out] = private_data->cell_xy[2 * pos];
+          cell_xy[2 * out + 1] = private_data->cell_xy[2 * pos + 1];
+          out++;
+        }
+    }
+  cell_start[ncells] = out;
 
-  if (distance_sq (args->center_x, args->center_y, point_x, point_y) <= args->radius_sq)
-    args->user_function (id - 1, args->user_data);
+  if (private_data->cell_id != private_data->full_cell_id)
+    {
+      g_free (private_data->cell_start);
+      g_free (private_data->cell_id);
+      g_free (private_data->cell_xy);
+    }
+  private_data->cell_start = cell_start;
+  private_data->cell_id = cell_id;
+  private_data->cell_xy = cell_xy;
+  private_data->nremoved_in_grid = 0;
 
-  /* A return value of 0 would mean that the R-tree search should stop early
-   * (before all points in the search circle were visited).  We don't want
-   * that, so return 1. */
-  return 1;
+  return;
 }
 
 
 
 /**
- * Searches for points within the given circle.  The callback function provided
- * as an argument will be called with the id's of points in the circle.
+ * Removes a point, so that searches no longer report it.  The point keeps its
+ * id, and can be put back with spatial_search_restore_points().
  *
- * @param searcher the spatial search object.
- * @param x the x-coordinate of the center of the circle.
- * @param y the y-coordinate of the center of the circle.
- * @param radius the radius of the circle.
- * @param user_function the function to be called with the id's of points in
- *   the circle.
- * @param user_data any data to be passed to user_function.  Can be NULL.
+ * @param searcher a prepared spatial search object, or a view of one.
+ * @param id the id of the point to remove.  Removing a point that is already
+ *   removed does nothing.
  */
 void
-spatial_search_circle_by_xy (spatial_search_t * searcher,
-                             double x, double y, double radius,
-                             spatial_search_hit_callback user_function,
-                             gpointer user_data)
+spatial_search_remove_point (spatial_search_t *searcher, int id)
 {
   private_data_t *private_data;
-  spatial_search_callback_args_t args;
-
-#if DEBUG
-  g_debug ("----- ENTER spatial_search_circle_by_xy (x=%g, y=%g, radius=%g)", x, y, radius);
-#endif
+  unsigned int ncells;
 
   private_data = (private_data_t *)(searcher->private_data);
-
-  args.user_function = user_function;
-  args.user_data = user_data;
-  args.xy = private_data->xy;
-  args.center_x = x;
-  args.center_y = y;
-  args.radius_sq = gsl_pow_2 (radius);
-
-  if (radius * 2 <= private_data->rtree_threshold)
-    {
-      struct Rect search_rect;
-#if DEBUG
-      g_debug ("use R-tree");
-#endif
-      search_rect.boundary[0] = x - radius;
-      search_rect.boundary[1] = y - radius;
-      search_rect.boundary[2] = x + radius;
-      search_rect.boundary[3] = y + radius;
-      RTreeSearch (private_data->rtree, &search_rect, spatial_search_circle_callback, &args);
-    }
-  else
+  if (private_data->removed == NULL)
+    private_data->removed = g_new0 (guint8, searcher->npoints);
+  else if (private_data->removed[id])
+    return;
+
+  private_data->removed[id] = TRUE;
+  private_data->nremoved++;
+  if (private_data->cell_start != NULL)
     {
-      unsigned int npoints, id;
-#if DEBUG
-      g_debug ("use exhaustive search");
-#endif
-      npoints = searcher->npoints;
-      for (id = 1; id <= npoints; id++)
-        spatial_search_circle_callback (id, &args);
+      private_data->nremoved_in_grid++;
+      ncells = private_data->grid_ncols * private_data->grid_nrows;
+      if (private_data->nremoved_in_grid
+          > COMPACTION_FRACTION * private_data->cell_start[ncells])
+        compact_grid (private_data);
     }
 
-#if DEBUG
-  g_debug ("----- EXIT spatial_search_circle_by_xy");
-#endif
-
   return;
 }
 
 
 
 /**
- * Searches for points within a circle around a particular point.  The callback
- * function provided as an argument will be called with the id's of points in
- * the circle.
+ * Puts back all the points removed with spatial_search_remove_point().
  *
- * @param searcher the spatial search object.
- * @param id the id of the point at the center of the circle.
- * @param radius the radius of the circle.
- * @param user_function the function to be called with the id's of points in
- *   the circle.
- * @param user_data any data to be passed to user_function.  Can be NULL.
+ * @param searcher a prepared spatial search object, or a view of one.
  */
 void
-spatial_search_circle_by_id (spatial_search_t * searcher,
-                             int id, double radius,
-                             spatial_search_hit_callback user_function,
-                             gpointer user_data)
+spatial_search_restore_points (spatial_search_t *searcher)
 {
   private_data_t *private_data;
-  unsigned int index;
-  double x, y;
-
-#if DEBUG
-  g_debug ("----- ENTER spatial_search_circle_by_id (id=%i, radius=%g)", id, radius);
-#endif
 
   private_data = (private_data_t *)(searcher->private_data);
-  index = id * 2;
-  x = g_array_index (private_data->xy, double, index);
-  y = g_array_index (private_data->xy, double, index + 1);
-  spatial_search_circle_by_xy (searcher, x, y, radius, user_function, user_data);
+  if (private_data->nremoved == 0)
+    return;
 
-#if DEBUG
-  g_debug ("----- EXIT spatial_search_circle_by_id");
-#endif
+  memset (private_data->removed, 0, searcher->npoints * sizeof (guint8));
+  private_data->nremoved = 0;
+  private_data->nremoved_in_grid = 0;
+  if (private_data->cell_id != private_data->full_cell_id)
+    {
+      g_free (private_data->cell_start);
+      g_free (private_data->cell_id);
+      g_free (private_data->cell_xy);
+      private_data->cell_start = private_data->full_cell_start;
+      private_data->cell_id = private_data->full_cell_id;
+      private_data->cell_xy = private_data->full_cell_xy;
+    }
 
   return;
 }
@@ -586,39 +951,882 @@ spatial_search_circle_by_id (spatial_search_t * searcher,
 
 
 /**
- * The function that the R-tree code library calls when it finds a point inside
- * the requested search rectangle.
- *
- * @param id the id of the point found by the R-tree search.
- * @param arg the user-provided function to notify about the found point.
+ * A wedge of a search circle, running clockwise from a start heading to an
+ * end heading.  Headings follow the navigation convention (0 = north, 90 =
+ * east).  They are kept as unit vectors so that points can be tested against
+ * the wedge with cross products instead of trigonometry.
  */
-int
-spatial_search_rectangle_callback (int id, void *arg)
+typedef struct
 {
-  spatial_search_callback_args_t *args;
+  double start_x, start_y; /**< Unit vector along the start heading. */
+  double end_x, end_y; /**< Unit vector along the end heading. */
+  gboolean reflex; /**< TRUE if the wedge is wider than 180 degrees. */
+}
+sector_t;
 
-  args = (spatial_search_callback_args_t *) arg;
-  args->user_function (id - 1, args->user_data);
 
-  /* A return value of 0 would mean that the R-tree search should stop early
-   * (before all points in the search circle were visited).  We don't want
-   * that, so return 1. */
-  return 1;
+
+/**
+ * Returns the z-component of the cross product of two vectors.  It is
+ * negative when b lies clockwise of a (within half a turn).
+ */
+static double
+cross (double ax, double ay, double bx, double by)
+{
+  return ax * by - ay * bx;
 }
 
 
 
 /**
- * Searches for points within the given rectangle.  The callback function provided
- * as an argument will be called with the id's of points in the rectangle.
+ * Sets up a wedge.
  *
- * @param searcher the spatial search object.
- * @param x1 the x-coordinate of one corner of the rectangle.
- * @param y1 the y-coordinate of one corner of the rectangle.
- * @param x2 the x-coordinate of the opposite corner of the rectangle.
- * @param y2 the y-coordinate of the opposite corner of the rectangle.
- * @param user_function the function to be called with the id's of points in
- *   the rectangle.
+ * @param start the heading, in degrees, at which the wedge starts.
+ * @param end the heading, in degrees, at which the wedge ends.  It may be
+ *   less than start, in which case the wedge crosses north.
+ * @param sector a location in which to store the wedge.
+ * @return FALSE if the wedge covers the whole circle.
+ */
+static gboolean
+make_sector (double start, double end, sector_t *sector)
+{
+  double span;
+
+  span = end - start;
+  if (span < 0)
+    span += 360;
+  if (span >= 360)
+    return FALSE;
+
+  sector->start_x = sin (start * M_PI / 180);
+  sector->start_y = cos (start * M_PI / 180);
+  sector->end_x = sin (end * M_PI / 180);
+  sector->end_y = cos (end * M_PI / 180);
+  sector->reflex = (span > 180);
+  return TRUE;
+}
+
+
+
+/**
+ * Checks whether a direction lies inside a wedge.  The edges of the wedge
+ * count as inside.
+ *
+ * @param sector the wedge.
+ * @param dx the x-component of the direction.
+ * @param dy the y-component of the direction.
+ * @return TRUE if the direction is inside the wedge.
+ */
+static gboolean
+in_sector (const sector_t *sector, double dx, double dy)
+{
+  /* A wedge wider than 180 degrees is everything outside a narrower one. */
+  if (sector->reflex)
+    return !(cross (sector->end_x, sector->end_y, dx, dy) < 0
+             && cross (dx, dy, sector->start_x, sector->start_y) < 0);
+  else
+    return (cross (sector->start_x, sector->start_y, dx, dy) <= 0
+            && cross (dx, dy, sector->end_x, sector->end_y) <= 0);
+}
+
+
+
+/**
+ * Checks whether a rectangle lies entirely outside a wedge.  The test is
+ * conservative: it may answer FALSE for some rectangles that miss the wedge,
+ * but never answers TRUE for one that touches it.
+ *
+ * @param sector the wedge.
+ * @param x1 the smaller x-coordinate of the rectangle, relative to the apex
+ *   of the wedge.
+ * @param y1 the smaller y-coordinate of the rectangle, relative to the apex.
+ * @param x2 the larger x-coordinate of the rectangle, relative to the apex.
+ * @param y2 the larger y-coordinate of the rectangle, relative to the apex.
+ * @return TRUE if the rectangle lies outside the wedge.
+ */
+static gboolean
+sector_misses_box (const sector_t *sector, double x1, double y1, double x2, double y2)
+{
+  double corner[8];
+  unsigned int i;
+  gboolean before_start, after_end, in_gap;
+
+  corner[0] = x1; corner[1] = y1;
+  corner[2] = x2; corner[3] = y1;
+  corner[4] = x1; corner[5] = y2;
+  corner[6] = x2; corner[7] = y2;
+  before_start = after_end = in_gap = TRUE;
+  for (i = 0; i < 8; i += 2)
+    {
+      if (sector->reflex)
+        in_gap = in_gap
+          && cross (sector->end_x, sector->end_y, corner[i], corner[i + 1]) < 0
+          && cross (corner[i], corner[i + 1], sector->start_x, sector->start_y) < 0;
+      else
+        {
+          before_start = before_start
+            && cross (sector->start_x, sector->start_y, corner[i], corner[i + 1]) > 0;
+          after_end = after_end
+            && cross (corner[i], corner[i + 1], sector->end_x, sector->end_y) > 0;
+        }
+    }
+  /* The wedge is convex (or the gap is), so the rectangle, which is also
+   * convex, is outside if all its corners are on the wrong side of one edge
+   * (or all inside the gap). */
+  return sector->reflex ? in_gap : (before_start || after_end);
+}
+
+
+
+/**
+ * Finds the bounding rectangle of a wedge of a circle.
+ *
+ * @param sector the wedge, or NULL for the whole circle.
+ * @param x the x-coordinate of the center of the circle.
+ * @param y the y-coordinate of the center of the circle.
+ * @param radius the radius of the circle.
+ * @param x1 a location in which to store the smaller x-coordinate.
+ * @param y1 a location in which to store the smaller y-coordinate.
+ * @param x2 a location in which to store the larger x-coordinate.
+ * @param y2 a location in which to store the larger y-coordinate.
+ */
+static void
+sector_bounds (const sector_t *sector, double x, double y, double radius,
+               double *x1, double *y1, double *x2, double *y2)
+{
+  double min_x, min_y, max_x, max_y;
+
+  if (sector == NULL)
+    {
+      *x1 = x - radius;
+      *y1 = y - radius;
+      *x2 = x + radius;
+      *y2 = y + radius;
+      return;
+    }
+
+  /* The wedge is bounded by its apex, the ends of its arc, and any point of
+   * the compass the arc passes through. */
+  min_x = MIN (0, MIN (sector->start_x, sector->end_x));
+  max_x = MAX (0, MAX (sector->start_x, sector->end_x));
+  min_y = MIN (0, MIN (sector->start_y, sector->end_y));
+  max_y = MAX (0, MAX (sector->start_y, sector->end_y));
+  if (in_sector (sector, 0, 1))
+    max_y = 1;
+  if (in_sector (sector, 1, 0))
+    max_x = 1;
+  if (in_sector (sector, 0, -1))
+    min_y = -1;
+  if (in_sector (sector, -1, 0))
+    min_x = -1;
+  *x1 = x + min_x * radius;
+  *y1 = y + min_y * radius;
+  *x2 = x + max_x * radius;
+  *y2 = y + max_y * radius;
+  return;
+}
+
+
+
+typedef struct
+{
+  GArray *xy;
+  double center_x, center_y, radius_sq; /* used just in circular searches */
+  const sector_t *sector; /* used just in circular searches, NULL for the
+    whole circle */
+  double x1, y1, x2, y2; /* used just in rectangular searches */
+  guint8 *removed; /**< The removed-point flags, or NULL. */
+  GArray *hits; /**< The ids of the points found by an R-tree search. */
+}
+spatial_search_callback_args_t;
+
+
+
+/**
+ * The function that the R-tree code library calls when it finds a point inside
+ * the requested search rectangle.  Because we want a search circle, we do an
+ * additional distance check before adding the point to the list of hits.
+ *
+ * @param id the id of the point found by the R-tree search.
+ * @param arg the search circle and the list of hits.
+ */
+int
+spatial_search_circle_callback (int id, void *arg)
+{
+  spatial_search_callback_args_t *args;
+  unsigned int index;
+  double point_x, point_y;
+
+  args = (spatial_search_callback_args_t *) arg;
+  if (args->removed != NULL && args->removed[id - 1])
+    return 1;
+  /* Retrieve the x and y-coordinate of the point with id "id".  Recall that
+   * R-tree id's start at 1. */
+  index = (id - 1) * 2;
+  point_x = g_array_index (args->xy, double, index);
+  point_y = g_array_index (args->xy, double, index + 1);
+
+  if (distance_sq (args->center_x, args->center_y, point_x, point_y) <= args->radius_sq
+      && (args->sector == NULL
+          || in_sector (args->sector, point_x - args->center_x, point_y - args->center_y)))
+    {
+      id--;
+      g_array_append_val (args->hits, id);
+    }
+
+  /* A return value of 0 would mean that the R-tree search should stop early
+   * (before all points in the search circle were visited).  We don't want
+   * that, so return 1. */
+  return 1;
+}
+
+
+
+/**
+ * Finds the block of grid cells that overlaps a rectangle.
+ *
+ * @param private_data the spatial search object's internal data.
+ * @param x1 the smaller x-coordinate of the rectangle.
+ * @param y1 the smaller y-coordinate of the rectangle.
+ * @param x2 the larger x-coordinate of the rectangle.
+ * @param y2 the larger y-coordinate of the rectangle.
+ * @param col1 a location in which to store the first column.
+ * @param row1 a location in which to store the first row.
+ * @param col2 a location in which to store the last column.
+ * @param row2 a location in which to store the last row.
+ * @return FALSE if the rectangle lies entirely outside the grid.
+ */
+static gboolean
+grid_cell_range (private_data_t *private_data,
+                 double x1, double y1, double x2, double y2,
+                 unsigned int *col1, unsigned int *row1,
+                 unsigned int *col2, unsigned int *row2)
+{
+  double c1, c2, r1, r2;
+
+  c1 = floor ((x1 - private_data->grid_min_x) / private_data->cell_size);
+  c2 = floor ((x2 - private_data->grid_min_x) / private_data->cell_size);
+  r1 = floor ((y1 - private_data->grid_min_y) / private_data->cell_size);
+  r2 = floor ((y2 - private_data->grid_min_y) / private_data->cell_size);
+  if (c2 < 0 || r2 < 0 || c1 >= private_data->grid_ncols || r1 >= private_data->grid_nrows)
+    return FALSE;
+
+  *col1 = (c1 < 0) ? 0 : (unsigned int) c1;
+  *row1 = (r1 < 0) ? 0 : (unsigned int) r1;
+  *col2 = (c2 >= private_data->grid_ncols) ? private_data->grid_ncols - 1 : (unsigned int) c2;
+  *row2 = (r2 >= private_data->grid_nrows) ? private_data->grid_nrows - 1 : (unsigned int) r2;
+  return TRUE;
+}
+
+
+
+/**
+ * Sorts the ids added to the end of a list of hits by an R-tree or grid
+ * search.  The exhaustive scan visits points in order of id, and callers draw
+ * random numbers as they go through the points found, so keeping that order
+ * means the results do not depend on which path a search took.
+ *
+ * @param hits a list of point ids.
+ * @param first the position of the first id to sort.
+ */
+static void
+sort_new_hits (GArray *hits, unsigned int first)
+{
+  if (hits->len - first > 1)
+    qsort (&g_array_index (hits, int, first), hits->len - first, sizeof(int),
+           (int (*)(const void *, const void *)) compare_ids);
+  return;
+}
+
+
+
+/**
+ * Searches for points within a circle, or a wedge of one, using the R-tree.
+ *
+ * @param private_data the spatial search object's internal data.
+ * @param x the x-coordinate of the center of the circle.
+ * @param y the y-coordinate of the center of the circle.
+ * @param radius the radius of the circle.
+ * @param sector the wedge to search, or NULL for the whole circle.
+ * @param hits the ids of the points found are appended to this list, in order
+ *   of id.
+ */
+static void
+rtree_search_circle (private_data_t *private_data,
+                     double x, double y, double radius, const sector_t *sector,
+                     GArray *hits)
+{
+  struct Rect search_rect;
+  spatial_search_callback_args_t args;
+  unsigned int first;
+
+  args.xy = private_data->xy;
+  args.removed = private_data->removed;
+  args.center_x = x;
+  args.center_y = y;
+  args.radius_sq = gsl_pow_2 (radius);
+  args.sector = sector;
+  args.hits = hits;
+  sector_bounds (sector, x, y, radius, &search_rect.boundary[0], &search_rect.boundary[1],
+                 &search_rect.boundary[2], &search_rect.boundary[3]);
+  first = hits->len;
+  RTreeSearch (private_data->rtree, &search_rect, spatial_search_circle_callback, &args);
+  sort_new_hits (hits, first);
+
+  return;
+}
+
+
+
+/**
+ * Searches for points within a circle, or a wedge of one, using the uniform
+ * grid.  For a whole circle, the cells in one row of the block that covers
+ * the circle are contiguous in memory, so each row is scanned as a single
+ * run.  For a wedge, the cells are scanned one at a time so that those
+ * outside the wedge can be skipped.
+ *
+ * @param private_data the spatial search object's internal data.
+ * @param x the x-coordinate of the center of the circle.
+ * @param y the y-coordinate of the center of the circle.
+ * @param radius the radius of the circle.
+ * @param sector the wedge to search, or NULL for the whole circle.
+ * @param hits the ids of the points found are appended to this list, in order
+ *   of id.
+ */
+static void
+grid_search_circle (private_data_t *private_data,
+                    double x, double y, double radius, const sector_t *sector,
+                    GArray *hits)
+{
+  unsigned int col1, row1, col2, row2, row, col, last_col, pos, end;
+  double x1, y1, x2, y2, cell_x, cell_y;
+  double radius_sq;
+  double *xy;
+  unsigned int first;
+
+  sector_bounds (sector, x, y, radius, &x1, &y1, &x2, &y2);
+  if (!grid_cell_range (private_data, x1, y1, x2, y2, &col1, &row1, &col2, &row2))
+    return;
+
+  radius_sq = gsl_pow_2 (radius);
+  first = hits->len;
+  for (row = row1; row <= row2; row++)
+    for (col = col1; col <= col2; col = last_col + 1)
+      {
+        if (sector == NULL)
+          last_col = col2;
+        else
+          {
+            last_col = col;
+            cell_x = private_data->grid_min_x + col * private_data->cell_size - x;
+            cell_y = private_data->grid_min_y + row * private_data->cell_size - y;
+            if (sector_misses_box (sector, cell_x, cell_y, cell_x + private_data->cell_size,
+                                   cell_y + private_data->cell_size))
+              continue;
+          }
+        pos = private_data->cell_start[row * private_data->grid_ncols + col];
+        end = private_data->cell_start[row * private_data->grid_ncols + last_col + 1];
+        for (xy = private_data->cell_xy + 2 * pos; pos < end; pos++, xy += 2)
+          {
+            if (distance_sq (x, y, xy[0], xy[1]) <= radius_sq
+                && (sector == NULL || in_sector (sector, xy[0] - x, xy[1] - y))
+                && !IS_REMOVED (private_data, private_data->cell_id[pos]))
+              g_array_append_val (hits, private_data->cell_id[pos]);
+          }
+      }
+  sort_new_hits (hits, first);
+
+  return;
+}
+
+
+
+/**
+ * Searches for points within a circle, or a wedge of one, by checking every
+ * point.
+ *
+ * @param private_data the spatial search object's internal data.
+ * @param npoints the number of points.
+ * @param x the x-coordinate of the center of the circle.
+ * @param y the y-coordinate of the center of the circle.
+ * @param radius the radius of the circle.
+ * @param sector the wedge to search, or NULL for the whole circle.
+ * @param hits the ids of the points found are appended to this list, in order
+ *   of id.
+ */
+static void
+exhaustive_search_circle (private_data_t *private_data, unsigned int npoints,
+                          double x, double y, double radius, const sector_t *sector,
+                          GArray *hits)
+{
+  int id;
+  double radius_sq;
+  double *xy;
+
+  radius_sq = gsl_pow_2 (radius);
+  xy = (double *)(private_data->xy->data);
+  for (id = 0; id < npoints; id++, xy += 2)
+    {
+      if (distance_sq (x, y, xy[0], xy[1]) <= radius_sq
+          && (sector == NULL || in_sector (sector, xy[0] - x, xy[1] - y))
+          && !IS_REMOVED (private_data, id))
+        g_array_append_val (hits, id);
+    }
+
+  return;
+}
+
+
+
+/**
+ * Searches for points within a circle, or a wedge of one, choosing the R-tree,
+ * the grid, or the exhaustive scan according to the radius and the backend.
+ *
+ * @param searcher the spatial search object.
+ * @param x the x-coordinate of the center of the circle.
+ * @param y the y-coordinate of the center of the circle.
+ * @param radius the radius of the circle.
+ * @param sector the wedge to search, or NULL for the whole circle.
+ * @param hits the ids of the points found are appended to this list, in order
+ *   of id.
+ */
+static void
+search_circle (spatial_search_t *searcher,
+               double x, double y, double radius, const sector_t *sector,
+               GArray *hits)
+{
+  private_data_t *private_data;
+
+  private_data = (private_data_t *)(searcher->private_data);
+  if (private_data->backend != SPATIAL_SEARCH_GRID
+      && radius * 2 <= private_data->rtree_threshold)
+    {
+#if DEBUG
+      g_debug ("use R-tree");
+#endif
+      rtree_search_circle (private_data, x, y, radius, sector, hits);
+    }
+  else if (private_data->cell_start != NULL)
+    {
+#if DEBUG
+      g_debug ("use grid");
+#endif
+      grid_search_circle (private_data, x, y, radius, sector, hits);
+    }
+  else
+    {
+#if DEBUG
+      g_debug ("use exhaustive search");
+#endif
+      exhaustive_search_circle (private_data, searcher->npoints, x, y, radius, sector, hits);
+    }
+
+  return;
+}
+
+
+
+/**
+ * Searches for points within the given circle.  The callback function provided
+ * as an argument will be called with the id's of points in the circle, in
+ * increasing order.
+ *
+ * @param searcher the spatial search object.
+ * @param x the x-coordinate of the center of the circle.
+ * @param y the y-coordinate of the center of the circle.
+ * @param radius the radius of the circle.
+ * @param user_function the function to be called with the id's of points in
+ *   the circle.
+ * @param user_data any data to be passed to user_function.  Can be NULL.
+ */
+void
+spatial_search_circle_by_xy (spatial_search_t * searcher,
+                             double x, double y, double radius,
+                             spatial_search_hit_callback user_function,
+                             gpointer user_data)
+{
+  GArray *hits;
+  unsigned int i;
+
+#if DEBUG
+  g_debug ("----- ENTER spatial_search_circle_by_xy (x=%g, y=%g, radius=%g)", x, y, radius);
+#endif
+
+  hits = take_scratch_hits ();
+  search_circle (searcher, x, y, radius, NULL, hits);
+  for (i = 0; i < hits->len; i++)
+    user_function (g_array_index (hits, int, i), user_data);
+  give_back_scratch_hits (hits);
+
+#if DEBUG
+  g_debug ("----- EXIT spatial_search_circle_by_xy");
+#endif
+
+  return;
+}
+
+
+
+/**
+ * Searches for points within a circle around a particular point.  The callback
+ * function provided as an argument will be called with the id's of points in
+ * the circle, in increasing order.
+ *
+ * @param searcher the spatial search object.
+ * @param id the id of the point at the center of the circle.
+ * @param radius the radius of the circle.
+ * @param user_function the function to be called with the id's of points in
+ *   the circle.
+ * @param user_data any data to be passed to user_function.  Can be NULL.
+ */
+void
+spatial_search_circle_by_id (spatial_search_t * searcher,
+                             int id, double radius,
+                             spatial_search_hit_callback user_function,
+                             gpointer user_data)
+{
+  private_data_t *private_data;
+  unsigned int index;
+  double x, y;
+
+#if DEBUG
+  g_debug ("----- ENTER spatial_search_circle_by_id (id=%i, radius=%g)", id, radius);
+#endif
+
+  private_data = (private_data_t *)(searcher->private_data);
+  index = id * 2;
+  x = g_array_index (private_data->xy, double, index);
+  y = g_array_index (private_data->xy, double, index + 1);
+  spatial_search_circle_by_xy (searcher, x, y, radius, user_function, user_data);
+
+#if DEBUG
+  g_debug ("----- EXIT spatial_search_circle_by_id");
+#endif
+
+  return;
+}
+
+
+
+/**
+ * Creates a new list of search results.  It can be filled and refilled by
+ * any number of searches.
+ *
+ * @param with_distances if TRUE, searches will also store the squared
+ *   distance from the center of the search to each point found.
+ * @return a pointer to a newly-created spatial_search_hits_t structure.
+ */
+spatial_search_hits_t *
+spatial_search_new_hits (gboolean with_distances)
+{
+  spatial_search_hits_t *hits;
+  unsigned int zero = 0;
+
+  hits = g_new (spatial_search_hits_t, 1);
+  hits->id = g_array_new (FALSE, FALSE, sizeof(int));
+  if (with_distances)
+    hits->distance_sq = g_array_new (FALSE, FALSE, sizeof(double));
+  else
+    hits->distance_sq = NULL;
+  hits->start = g_array_new (FALSE, FALSE, sizeof(unsigned int));
+  g_array_append_val (hits->start, zero);
+  hits->ncenters = 0;
+
+  return hits;
+}
+
+
+
+/**
+ * Empties a list of search results, keeping the memory for re-use.
+ *
+ * @param hits a list of search results.
+ */
+static void
+clear_hits (spatial_search_hits_t *hits)
+{
+  g_array_set_size (hits->id, 0);
+  if (hits->distance_sq != NULL)
+    g_array_set_size (hits->distance_sq, 0);
+  g_array_set_size (hits->start, 1);
+  hits->ncenters = 0;
+  return;
+}
+
+
+
+/**
+ * Adds the results of a search around one more center to a list of search
+ * results.
+ *
+ * @param searcher the spatial search object.
+ * @param x the x-coordinate of the center of the circle.
+ * @param y the y-coordinate of the center of the circle.
+ * @param radius the radius of the circle.
+ * @param sector the wedge to search, or NULL for the whole circle.
+ * @param hits a list of search results.
+ */
+static void
+append_circle_hits (spatial_search_t *searcher,
+                    double x, double y, double radius, const sector_t *sector,
+                    spatial_search_hits_t *hits)
+{
+  private_data_t *private_data;
+  unsigned int first, i;
+  int *id;
+  double *xy;
+  double d;
+
+  private_data = (private_data_t *)(searcher->private_data);
+  first = hits->id->len;
+  search_circle (searcher, x, y, radius, sector, hits->id);
+  if (hits->distance_sq != NULL)
+    {
+      /* The hits are in order of id, so compute the distances after the
+       * search rather than carry them through the sort. */
+      g_array_set_size (hits->distance_sq, hits->id->len);
+      id = (int *)(hits->id->data);
+      xy = (double *)(private_data->xy->data);
+      for (i = first; i < hits->id->len; i++)
+        {
+          d = distance_sq (x, y, xy[2 * id[i]], xy[2 * id[i] + 1]);
+          g_array_index (hits->distance_sq, double, i) = d;
+        }
+    }
+  g_array_append_val (hits->start, hits->id->len);
+  hits->ncenters++;
+
+  return;
+}
+
+
+
+/**
+ * Searches for points within the given circle, storing the id's of the points
+ * found in a list of search results instead of calling a function for each.
+ * Any earlier contents of the list are discarded.  The id's are in increasing
+ * order, the same order in which spatial_search_circle_by_xy() would report
+ * them.
+ *
+ * @param searcher the spatial search object.
+ * @param x the x-coordinate of the center of the circle.
+ * @param y the y-coordinate of the center of the circle.
+ * @param radius the radius of the circle.
+ * @param hits a list of search results.
+ * @return the number of points found.
+ */
+unsigned int
+spatial_search_circle_by_xy_to_array (spatial_search_t * searcher,
+                                      double x, double y, double radius,
+                                      spatial_search_hits_t * hits)
+{
+#if DEBUG
+  g_debug ("----- ENTER spatial_search_circle_by_xy_to_array (x=%g, y=%g, radius=%g)", x, y, radius);
+#endif
+
+  clear_hits (hits);
+  append_circle_hits (searcher, x, y, radius, NULL, hits);
+
+#if DEBUG
+  g_debug ("----- EXIT spatial_search_circle_by_xy_to_array");
+#endif
+
+  return hits->id->len;
+}
+
+
+
+/**
+ * Searches for points within a circle around a particular point, storing the
+ * id's of the points found in a list of search results.  Any earlier contents
+ * of the list are discarded.
+ *
+ * @param searcher the spatial search object.
+ * @param id the id of the point at the center of the circle.
+ * @param radius the radius of the circle.
+ * @param hits a list of search results.
+ * @return the number of points found.
+ */
+unsigned int
+spatial_search_circle_by_id_to_array (spatial_search_t * searcher,
+                                      int id, double radius,
+                                      spatial_search_hits_t * hits)
+{
+  private_data_t *private_data;
+  double x, y;
+
+  private_data = (private_data_t *)(searcher->private_data);
+  x = g_array_index (private_data->xy, double, 2 * id);
+  y = g_array_index (private_data->xy, double, 2 * id + 1);
+  return spatial_search_circle_by_xy_to_array (searcher, x, y, radius, hits);
+}
+
+
+
+/**
+ * Searches for points within a wedge of a circle, storing the id's of the
+ * points found in a list of search results.  Any earlier contents of the list
+ * are discarded.  The wedge runs clockwise from start_heading to end_heading;
+ * headings are in degrees, with 0 = north (+y) and 90 = east (+x).  Parts of
+ * the index that lie outside the wedge are skipped, and points are tested
+ * against the wedge with cross products, so a narrow wedge costs a fraction of
+ * the whole circle.
+ *
+ * @param searcher the spatial search object.
+ * @param x the x-coordinate of the center of the circle.
+ * @param y the y-coordinate of the center of the circle.
+ * @param radius the radius of the circle.
+ * @param start_heading the heading at which the wedge starts.
+ * @param end_heading the heading at which the wedge ends.  If it is less than
+ *   start_heading, the wedge crosses north.  If it is 360 or more degrees
+ *   past start_heading, the whole circle is searched.
+ * @param hits a list of search results.
+ * @return the number of points found.
+ */
+unsigned int
+spatial_search_sector_by_xy_to_array (spatial_search_t * searcher,
+                                      double x, double y, double radius,
+                                      double start_heading, double end_heading,
+                                      spatial_search_hits_t * hits)
+{
+  sector_t sector;
+  gboolean is_sector;
+
+#if DEBUG
+  g_debug ("----- ENTER spatial_search_sector_by_xy_to_array (x=%g, y=%g, radius=%g, %g-%g)",
+           x, y, radius, start_heading, end_heading);
+#endif
+
+  is_sector = make_sector (start_heading, end_heading, &sector);
+  clear_hits (hits);
+  append_circle_hits (searcher, x, y, radius, is_sector ? &sector : NULL, hits);
+
+#if DEBUG
+  g_debug ("----- EXIT spatial_search_sector_by_xy_to_array");
+#endif
+
+  return hits->id->len;
+}
+
+
+
+/**
+ * Searches for points within circles around several points at once, storing
+ * the id's of the points found in a list of search results.  Any earlier
+ * contents of the list are discarded.  The points found around center k are
+ * at positions start[k] to start[k+1]-1 of the list, in increasing order of
+ * id.
+ *
+ * @param searcher the spatial search object.
+ * @param ncenters the number of circles.
+ * @param center_id the id's of the points at the centers of the circles.
+ * @param radius the radius of each circle.
+ * @param hits a list of search results.
+ * @return the total number of points found.  A point inside several circles
+ *   is counted once for each.
+ */
+unsigned int
+spatial_search_circles_by_id (spatial_search_t * searcher,
+                              unsigned int ncenters, const int *center_id,
+                              const double *radius,
+                              spatial_search_hits_t * hits)
+{
+  private_data_t *private_data;
+  double *xy;
+  unsigned int i;
+
+#if DEBUG
+  g_debug ("----- ENTER spatial_search_circles_by_id (%u centers)", ncenters);
+#endif
+
+  private_data = (private_data_t *)(searcher->private_data);
+  xy = (double *)(private_data->xy->data);
+  clear_hits (hits);
+  for (i = 0; i < ncenters; i++)
+    append_circle_hits (searcher, xy[2 * center_id[i]], xy[2 * center_id[i] + 1],
+                        radius[i], NULL, hits);
+
+#if DEBUG
+  g_debug ("----- EXIT spatial_search_circles_by_id");
+#endif
+
+  return hits->id->len;
+}
+
+
+
+/**
+ * Deletes a list of search results from memory.
+ *
+ * @param hits a list of search results.
+ */
+void
+spatial_search_free_hits (spatial_search_hits_t *hits)
+{
+  if (hits != NULL)
+    {
+      g_array_free (hits->id, TRUE);
+      if (hits->distance_sq != NULL)
+        g_array_free (hits->distance_sq, TRUE);
+      g_array_free (hits->start, TRUE);
+      g_free (hits);
+    }
+  return;
+}
+
+
+
+/**
+ * The function that the R-tree code library calls when it finds a point inside
+ * the requested search rectangle.  The R-tree includes points on all four
+ * edges of the rectangle, while the other search paths leave out the top and
+ * right edges, so we repeat that test before adding the point to the list of
+ * hits.
+ *
+ * @param id the id of the point found by the R-tree search.
+ * @param arg the search rectangle and the list of hits.
+ */
+int
+spatial_search_rectangle_callback (int id, void *arg)
+{
+  spatial_search_callback_args_t *args;
+  unsigned int index;
+  double point_x, point_y;
+
+  args = (spatial_search_callback_args_t *) arg;
+  if (args->removed != NULL && args->removed[id - 1])
+    return 1;
+  index = (id - 1) * 2;
+  point_x = g_array_index (args->xy, double, index);
+  point_y = g_array_index (args->xy, double, index + 1);
+
+  if (point_x >= args->x1 && point_x < args->x2
+      && point_y >= args->y1 && point_y < args->y2)
+    {
+      id--;
+      g_array_append_val (args->hits, id);
+    }
+
+  /* A return value of 0 would mean that the R-tree search should stop early
+   * (before all points in the search circle were visited).  We don't want
+   * that, so return 1. */
+  return 1;
+}
+
+
+
+/**
+ * Searches for points within the given rectangle.  The callback function provided
+ * as an argument will be called with the id's of points in the rectangle, in
+ * increasing order.
+ *
+ * @param searcher the spatial search object.
+ * @param x1 the x-coordinate of one corner of the rectangle.
+ * @param y1 the y-coordinate of one corner of the rectangle.
+ * @param x2 the x-coordinate of the opposite corner of the rectangle.
+ * @param y2 the y-coordinate of the opposite corner of the rectangle.
+ * @param user_function the function to be called with the id's of points in
+ *   the rectangle.
  * @param user_data any data to be passed to user_function.  Can be NULL.
  */
 void
@@ -628,42 +1836,78 @@ spatial_search_rectangle (spatial_search_t * searcher,
                           gpointer user_data)
 {
   private_data_t *private_data;
-  spatial_search_callback_args_t args;
   double long_axis;
+  GArray *hits;
+  unsigned int i;
 
 #if DEBUG
   g_debug ("----- ENTER spatial_search_rectangle");
 #endif
 
   private_data = (private_data_t *)(searcher->private_data);
-
-  args.user_function = user_function;
-  args.user_data = user_data;
+  hits = take_scratch_hits ();
 
   long_axis = MAX (fabs(x2 - x1), fabs(y2 - y1));
-  if (long_axis <= private_data->rtree_threshold)
+  if (private_data->backend != SPATIAL_SEARCH_GRID
+      && long_axis <= private_data->rtree_threshold)
     {
       struct Rect search_rect;
+      spatial_search_callback_args_t args;
+
+      args.xy = private_data->xy;
+      args.removed = private_data->removed;
+      args.x1 = x1;
+      args.y1 = y1;
+      args.x2 = x2;
+      args.y2 = y2;
+      args.hits = hits;
       search_rect.boundary[0] = x1;
       search_rect.boundary[1] = y1;
       search_rect.boundary[2] = x2;
       search_rect.boundary[3] = y2;
       RTreeSearch (private_data->rtree, &search_rect, spatial_search_rectangle_callback, &args);
+      sort_new_hits (hits, 0);
+    }
+  else if (private_data->cell_start != NULL)
+    {
+      unsigned int col1, row1, col2, row2, row, pos, end;
+      double *xy;
+
+      if (grid_cell_range (private_data, x1, y1, x2, y2, &col1, &row1, &col2, &row2))
+        {
+          for (row = row1; row <= row2; row++)
+            {
+              pos = private_data->cell_start[row * private_data->grid_ncols + col1];
+              end = private_data->cell_start[row * private_data->grid_ncols + col2 + 1];
+              for (xy = private_data->cell_xy + 2 * pos; pos < end; pos++, xy += 2)
+                {
+                  if (xy[0] >= x1 && xy[0] < x2 && xy[1] >= y1 && xy[1] < y2
+                      && !IS_REMOVED (private_data, private_data->cell_id[pos]))
+                    g_array_append_val (hits, private_data->cell_id[pos]);
+                }
+            }
+          sort_new_hits (hits, 0);
+        }
     }
   else
     {
-      unsigned int npoints, id;
+      int npoints, id;
       double *x, *y;
       npoints = searcher->npoints;
       x = y = (double *)(private_data->xy->data);
       y++;
-      for (id = 1; id <= npoints; id++, x+=2, y+=2)
+      for (id = 0; id < npoints; id++, x+=2, y+=2)
       {
-        if (*x >= x1 && *x < x2 && *y >= y1 && *y < y2)
-          spatial_search_rectangle_callback (id, &args);
+        if (*x >= x1 && *x < x2 && *y >= y1 && *y < y2
+            && !IS_REMOVED (private_data, id))
+          g_array_append_val (hits, id);
       }
     }
 
+  for (i = 0; i < hits->len; i++)
+    user_function (g_array_index (hits, int, i), user_data);
+  give_back_scratch_hits (hits);
+
 #if DEBUG
   g_debug ("----- EXIT spatial_search_rectangle");
 #endif
@@ -673,6 +1917,187 @@ spatial_search_rectangle (spatial_search_t * searcher,
 
 
 
+/**
+ * Measures where the R-tree stops being faster than the wide-area search path
+ * (the grid, or the exhaustive scan if there is no grid) on this particular
+ * set of points, and sets rtree_threshold accordingly.  How well the R-tree
+ * does depends on how the points are clustered, so a fixed fraction of the
+ * study area fits some populations much better than others.
+ *
+ * The searches are centered on points chosen at random with a fixed seed, at
+ * radii that are fractions of the short side of the minimum-area rectangle
+ * around the points.  The cutover is put halfway between the largest radius at
+ * which the R-tree wins and the next radius tried; to keep timing noise at
+ * small radii from cutting the R-tree off early, that radius is the one below
+ * the point from which the wide-area path wins at every larger radius.
+ *
+ * Since both paths report points in order of id, the cutover affects only
+ * speed, never results.
+ *
+ * @param searcher the spatial search object.
+ */
+static void
+calibrate (spatial_search_t *searcher)
+{
+  private_data_t *private_data;
+  unsigned int npoints;
+  GRand *rng;
+  int *center;
+  GTimer *timer;
+  GArray *hits;
+  double x, y, radius, elapsed;
+  unsigned int npasses;
+  int path;
+  unsigned int i, q;
+  double *time_per_search;
+  double *xy;
+
+#if DEBUG
+  g_debug ("----- ENTER calibrate");
+#endif
+
+  private_data = (private_data_t *)(searcher->private_data);
+  npoints = searcher->npoints;
+  private_data->calibrated = FALSE;
+  if (npoints < CALIBRATION_MIN_POINTS || private_data->short_axis_length <= 0)
+    goto end;
+
+  rng = g_rand_new_with_seed (CALIBRATION_SEED);
+  center = g_new (int, CALIBRATION_NQUERIES);
+  for (q = 0; q < CALIBRATION_NQUERIES; q++)
+    center[q] = g_rand_int_range (rng, 0, npoints);
+  g_rand_free (rng);
+
+  hits = g_array_new (FALSE, FALSE, sizeof(int));
+  xy = (double *)(private_data->xy->data);
+  timer = g_timer_new ();
+  for (i = 0; i < NCALIBRATION_RADII; i++)
+    {
+      radius = calibration_radius_fraction[i] * private_data->short_axis_length;
+      private_data->calibration_radius[i] = radius;
+      /* Path 0 is the R-tree, path 1 the wide-area search. */
+      for (path = 0; path < 2; path++)
+        {
+          npasses = 0;
+          g_timer_start (timer);
+          do
+            {
+              for (q = 0; q < CALIBRATION_NQUERIES; q++)
+                {
+                  x = xy[2 * center[q]];
+                  y = xy[2 * center[q] + 1];
+                  g_array_set_size (hits, 0);
+                  if (path == 0)
+                    rtree_search_circle (private_data, x, y, radius, NULL, hits);
+                  else if (private_data->cell_start != NULL)
+                    grid_search_circle (private_data, x, y, radius, NULL, hits);
+                  else
+                    exhaustive_search_circle (private_data, npoints, x, y, radius, NULL, hits);
+                }
+              npasses++;
+              elapsed = g_timer_elapsed (timer, NULL);
+            }
+          while (elapsed < CALIBRATION_MIN_SECONDS);
+          time_per_search = (path == 0) ? private_data->calibration_rtree_time
+            : private_data->calibration_wide_time;
+          time_per_search[i] = elapsed / (npasses * CALIBRATION_NQUERIES);
+        }
+    }
+  g_timer_destroy (timer);
+  g_array_free (hits, TRUE);
+  g_free (center);
+
+  /* Find the smallest radius from which the wide-area path wins at every
+   * radius tried. */
+  for (i = NCALIBRATION_RADII; i > 0; i--)
+    if (private_data->calibration_rtree_time[i - 1] <= private_data->calibration_wide_time[i - 1])
+      break;
+  /* Now i is the number of radii at which the R-tree is used.  Recall that
+   * rtree_threshold is compared against the search diameter. */
+  if (i == 0)
+    private_data->rtree_threshold = 0;
+  else if (i == NCALIBRATION_RADII)
+    private_data->rtree_threshold = 2 * private_data->calibration_radius[i - 1];
+  else
+    private_data->rtree_threshold =
+      private_data->calibration_radius[i - 1] + private_data->calibration_radius[i];
+  private_data->calibrated = TRUE;
+
+end:
+#if DEBUG
+  g_debug ("----- EXIT calibrate");
+#endif
+  return;
+}
+
+
+
+/**
+ * Returns the largest search radius for which the R-tree is used.  Wider
+ * searches use the grid, or check every point if there is no grid.  Only
+ * meaningful after spatial_search_prepare() has been called.
+ *
+ * @param searcher the spatial search object.
+ * @return the cutover radius.
+ */
+double
+spatial_search_cutover_radius (spatial_search_t *searcher)
+{
+  private_data_t *private_data;
+
+  private_data = (private_data_t *)(searcher->private_data);
+  if (private_data->backend == SPATIAL_SEARCH_GRID)
+    return 0;
+  else
+    return private_data->rtree_threshold / 2;
+}
+
+
+
+/**
+ * Returns a text description of how the R-tree cutover was chosen: the
+ * cutover radius and, if it was measured, the timings at each radius tried.
+ *
+ * @param searcher the spatial search object.
+ * @return a string.
+ */
+char *
+spatial_search_calibration_to_string (spatial_search_t *searcher)
+{
+  private_data_t *private_data;
+  GString *s;
+  char *chararray;
+  unsigned int i;
+
+  private_data = (private_data_t *)(searcher->private_data);
+  s = g_string_new (NULL);
+  if (private_data->backend == SPATIAL_SEARCH_GRID)
+    g_string_printf (s, "<spatial search: grid for all radii>");
+  else if (!private_data->calibrated)
+    g_string_printf (s, "<spatial search: R-tree for radii up to %g km (not calibrated)>",
+                     private_data->rtree_threshold / 2);
+  else
+    {
+      g_string_printf (s, "<spatial search: R-tree for radii up to %g km",
+                       private_data->rtree_threshold / 2);
+      g_string_append_printf (s, "\n  radius (km)  R-tree (us/search)  %s (us/search)",
+                              private_data->cell_start != NULL ? "grid" : "exhaustive");
+      for (i = 0; i < NCALIBRATION_RADII; i++)
+        g_string_append_printf (s, "\n  %g  %.2f  %.2f",
+                                private_data->calibration_radius[i],
+                                1e6 * private_data->calibration_rtree_time[i],
+                                1e6 * private_data->calibration_wide_time[i]);
+      g_string_append_c (s, '>');
+    }
+
+  /* don't return the wrapper object */
+  chararray = s->str;
+  g_string_free (s, FALSE);
+  return chararray;
+}
+
+
+
 /**
  * Deletes a spatial search object from memory.
  *
@@ -690,8 +2115,24 @@ free_spatial_search (spatial_search_t *searcher)
   if (searcher != NULL)
   {
     private_data = (private_data_t *)(searcher->private_data);  
-    RTreeDeleteIndex (private_data->rtree);
-    g_array_free (private_data->xy, TRUE);
+    /* A compacted grid belongs to this object alone. */
+    if (private_data->cell_id != private_data->full_cell_id)
+      {
+        g_free (private_data->cell_start);
+        g_free (private_data->cell_id);
+        g_free (private_data->cell_xy);
+      }
+    g_free (private_data->removed);
+    /* A view shares everything else with the object it views. */
+    if (private_data->view_of == NULL)
+      {
+        RTreeDeleteIndex (private_data->rtree);
+        g_array_free (private_data->xy, TRUE);
+        g_array_free (private_data->query_radii, TRUE);
+        g_free (private_data->full_cell_start);
+        g_free (private_data->full_cell_id);
+        g_free (private_data->full_cell_xy);
+      }
     g_free (private_data);
     g_free (searcher);
   }
@@ -20,6 +20,24 @@
 
 
 
+/**
+ * The data structures a spatial search object can use.  Whichever is chosen,
+ * searches wider than the R-tree handles well visit points in order of id, so
+ * the choice does not change which random numbers the callers draw for which
+ * points.
+ */
+typedef enum
+{
+  SPATIAL_SEARCH_AUTO, /**< an R-tree for narrow searches and a uniform grid
+    for wide ones */
+  SPATIAL_SEARCH_RTREE, /**< an R-tree for narrow searches and an exhaustive
+    scan for wide ones */
+  SPATIAL_SEARCH_GRID /**< a uniform grid for all searches */
+}
+spatial_search_backend_t;
+
+
+
 /** A spatial search object. */
 typedef struct
 {
@@ -38,19 +56,61 @@ typedef void (*spatial_search_hit_callback)(int id, gpointer user_data);
 
 
 
+/**
+ * A list of search results, for callers that would rather loop over the
+ * points found than be called back once for each.  One list can be re-used
+ * for any number of searches, which saves allocating memory each time.
+ */
+typedef struct
+{
+  GArray *id; /**< The id's of the points found, as ints. */
+  GArray *distance_sq; /**< The squared distance from the center of the
+    search to each point in id, as doubles.  NULL if the list was created
+    without distances. */
+  GArray *start; /**< Where the points found around each center begin in id,
+    as unsigned ints.  There is one extra entry at the end, so the points
+    found around center k are at positions start[k] to start[k+1]-1. */
+  unsigned int ncenters; /**< The number of centers searched around. */
+}
+spatial_search_hits_t;
+
+
+
 /* Prototypes. */
 spatial_search_t *new_spatial_search (void);
 void spatial_search_add_point (spatial_search_t *, double x, double y);
-void spatial_search_prepare (spatial_search_t *);
+void spatial_search_add_query_radius (spatial_search_t *, double radius);
+void spatial_search_prepare (spatial_search_t *, spatial_search_backend_t);
+spatial_search_t *spatial_search_new_view (spatial_search_t *);
+void spatial_search_remove_point (spatial_search_t *, int id);
+void spatial_search_restore_points (spatial_search_t *);
 void spatial_search_circle_by_xy (spatial_search_t *,
                                   double x, double y, double radius,
                                   spatial_search_hit_callback, gpointer user_data);
 void spatial_search_circle_by_id (spatial_search_t *,
                                   int id, double radius,
                                   spatial_search_hit_callback, gpointer user_data);
+spatial_search_hits_t *spatial_search_new_hits (gboolean with_distances);
+unsigned int spatial_search_circle_by_xy_to_array (spatial_search_t *,
+                                                   double x, double y, double radius,
+                                                   spatial_search_hits_t *);
+unsigned int spatial_search_circle_by_id_to_array (spatial_search_t *,
+                                                   int id, double radius,
+                                                   spatial_search_hits_t *);
+unsigned int spatial_search_sector_by_xy_to_array (spatial_search_t *,
+                                                   double x, double y, double radius,
+                                                   double start_heading, double end_heading,
+                                                   spatial_search_hits_t *);
+unsigned int spatial_search_circles_by_id (spatial_search_t *,
+                                           unsigned int ncenters, const int *center_id,
+                                           const double *radius,
+                                           spatial_search_hits_t *);
+void spatial_search_free_hits (spatial_search_hits_t *);
 void spatial_search_rectangle (spatial_search_t *,
                                double x1, double y1, double x2, double y2,
                                spatial_search_hit_callback, gpointer user_data);
+double spatial_search_cutover_radius (spatial_search_t *);
+char *spatial_search_calibration_to_string (spatial_search_t *);
 void free_spatial_search (spatial_search_t *);
 
 #endif /* !SPATIAL_SEARCH_H */
@@ -18,6 +18,10 @@
 #  include <config.h>
 #endif
 
+#if STDC_HEADERS
+#  include <string.h>
+#endif
+
 #if HAVE_MPI && !CANCEL_MPI
 #  include "mpix.h"
 #endif
@@ -39,6 +43,12 @@ main (int argc, char *argv[])
   const char *output_file = NULL;
   double fixed_rng_value = -1;
   int seed = -1;
+  int nthreads = 1;
+  const char *checkpoint_file = NULL;
+  const char *unit_order = NULL;
+  int neighbour_memory = -1;
+  gboolean sparse_airborne = FALSE;
+  int contact_threads = 1;
   GError *option_error = NULL;
   GOptionContext *context;
   GOptionEntry options[] = {
@@ -47,6 +57,12 @@ main (int argc, char *argv[])
     { "output-file", 'o', 0, G_OPTION_ARG_FILENAME, &output_file, "Output file", NULL },
     { "fixed-random-value", 'r', 0, G_OPTION_ARG_DOUBLE, &fixed_rng_value, "Fixed number to use instead of random numbers", NULL },
     { "rng-seed", 's', 0, G_OPTION_ARG_INT, &seed, "Seed used to initialize the random number generator", NULL },
+    { "threads", 't', 0, G_OPTION_ARG_INT, &nthreads, "Number of iterations to run in parallel (default 1)", "N" },
+    { "checkpoint", 'c', 0, G_OPTION_ARG_FILENAME, &checkpoint_file, "Save progress after each iteration to this file, resume from it if it exists, and delete it when the run finishes", "FILE" },
+    { "unit-order", 'u', 0, G_OPTION_ARG_STRING, &unit_order, "Order in which to store units in memory: file (default), morton or hilbert", "ORDER" },
+    { "neighbour-memory", 'n', 0, G_OPTION_ARG_INT, &neighbour_memory, "Memory in MB the spread models may use in all to remember the units near each source (default 256)", "MB" },
+    { "sparse-airborne", 'a', 0, G_OPTION_ARG_NONE, &sparse_airborne, "Record only adequate airborne exposures, if no exposure outputs are requested (faster, but gives different results for a given seed)", NULL },
+    { "contact-threads", 'C', 0, G_OPTION_ARG_INT, &contact_threads, "Number of threads each iteration may use to work out contact spread (default 1)", "N" },
 #ifdef USE_SC_GUILIB
     { "production-types", 'p', 0, G_OPTION_ARG_FILENAME, &production_type_file, "File containing production types used in this scenario", NULL },
 #endif
@@ -93,6 +109,22 @@ main (int argc, char *argv[])
     }
   g_option_context_free (context);
 
+  naadsm_set_nthreads (nthreads);
+  if (checkpoint_file != NULL)
+    naadsm_set_checkpoint_file (checkpoint_file);
+  if (unit_order == NULL || strcmp (unit_order, "file") == 0)
+    naadsm_set_unit_order (0);
+  else if (strcmp (unit_order, "morton") == 0)
+    naadsm_set_unit_order (1);
+  else if (strcmp (unit_order, "hilbert") == 0)
+    naadsm_set_unit_order (2);
+  else
+    g_error ("unknown unit order \"%s\" (use file, morton or hilbert)", unit_order);
+  if (neighbour_memory >= 0)
+    naadsm_set_neighbour_list_memory (neighbour_memory);
+  naadsm_set_sparse_airborne_exposures (sparse_airborne);
+  naadsm_set_contact_spread_threads (contact_threads);
+
 #ifdef USE_SC_GUILIB
   run_sim_main (herd_file,
                 parameter_file,
@@ -27,18 +27,42 @@
 
 
 /**
- * Creates a list mapping event types to the sub-models that listen for them.
+ * Reports whether a sub-model takes a given event type in batches.
  *
- * @param list an (uninitialized) array of lists of sub-models.
- * @param nmodels the number of sub-models.
- * @param models an array of sub-models.
+ * @param model a sub-model.
+ * @param event_type an event type.
+ * @return TRUE if the sub-model takes events of the given type in batches.
+ */
+static gboolean
+is_batching (naadsm_model_t * model, EVT_event_type_t event_type)
+{
+  unsigned int i;
+
+  for (i = 0; i < model->nevents_batched; i++)
+    if (model->events_batched[i] == event_type)
+      return TRUE;
+  return FALSE;
+}
+
+
+
+/**
+ * Builds the table mapping event types to the sub-models that listen for them.
+ * The listeners for each event type are stored contiguously, in the order the
+ * sub-models appear in the manager's model list, so that dispatching an event
+ * is a walk over a short array.  Sub-models that take an event type in batches
+ * go in a second array for that type.
+ *
+ * @param manager an event manager whose models and nmodels fields have been
+ *   set.
  */
 void
-build_listener_list (GSList ** list, naadsm_model_t ** models, int nmodels)
+build_listener_list (naadsm_event_manager_t * manager)
 {
-  GSList *model_list;
   naadsm_model_t *model;
+  naadsm_listener_t *listener;
   EVT_event_type_t event_type;
+  unsigned int ntotal;
   int i;                        /* loop counter */
 #if DEBUG
   GString *s;
@@ -48,50 +72,77 @@ build_listener_list (GSList ** list, naadsm_model_t ** models, int nmodels)
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- ENTER build_listener_list");
 #endif
 
+  /* Count the listeners first, so that they can all go in one block. */
+  ntotal = 0;
+  for (event_type = 0; event_type < EVT_NEVENT_TYPES; event_type++)
+    {
+      manager->nlisteners[event_type] = 0;
+      manager->nbatch_listeners[event_type] = 0;
+      for (i = 0; i < manager->nmodels; i++)
+        {
+          model = manager->models[i];
+          if (!model->is_listening_for (model, event_type))
+            continue;
+          if (is_batching (model, event_type))
+            manager->nbatch_listeners[event_type]++;
+          else
+            manager->nlisteners[event_type]++;
+        }
+      ntotal += manager->nlisteners[event_type] + manager->nbatch_listeners[event_type];
+    }
+  manager->listener_table = g_new (naadsm_listener_t, MAX (ntotal, 1));
+
+  listener = manager->listener_table;
   for (event_type = 0; event_type < EVT_NEVENT_TYPES; event_type++)
     {
 #if DEBUG
       s = g_string_new (NULL);
-      g_string_sprintf (s, "building list for %s events...", EVT_event_type_name[event_type]);
+      g_string_sprintf (s, "%s models listening:", EVT_event_type_name[event_type]);
 #endif
-
-      model_list = NULL;
-      for (i = 0; i < nmodels; i++)
+      manager->listeners[event_type] = listener;
+      for (i = 0; i < manager->nmodels; i++)
         {
-          model = models[i];
-          if (model->is_listening_for (model, event_type))
+          model = manager->models[i];
+          if (model->is_listening_for (model, event_type)
+              && !is_batching (model, event_type))
             {
-              model_list = g_slist_append (model_list, model);
+              listener->model = model;
+              listener->run = model->run;
+              listener->run_batch = NULL;
+              listener++;
 #if DEBUG
               g_string_sprintfa (s, " %s", model->name);
 #endif
             }
         }
-      list[event_type] = model_list;
+      manager->batch_listeners[event_type] = listener;
+      for (i = 0; i < manager->nmodels; i++)
+        {
+          model = manager->models[i];
+          if (model->is_listening_for (model, event_type)
+              && is_batching (model, event_type))
+            {
+              g_assert (model->run_batch != NULL);
+              listener->model = model;
+              listener->run = model->run;
+              listener->run_batch = model->run_batch;
+              listener++;
 #if DEBUG
-      g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "%s", s->str);
-      g_string_free (s, TRUE);
+              g_string_sprintfa (s, " %s (batched)", model->name);
 #endif
-    }
-
+            }
+        }
+      if (manager->nbatch_listeners[event_type] > 0)
+        manager->batch[event_type] = g_ptr_array_new ();
+      else
+        manager->batch[event_type] = NULL;
 #if DEBUG
-  for (event_type = 0; event_type < EVT_NEVENT_TYPES; event_type++)
-    {
-      s = g_string_new (NULL);
-      g_string_sprintf (s, "%s models listening:", EVT_event_type_name[event_type]);
-      model_list = list[event_type];
-      if (model_list == NULL)
+      if (manager->nlisteners[event_type] + manager->nbatch_listeners[event_type] == 0)
         g_string_sprintfa (s, " none");
-      else
-        for (; model_list != NULL; model_list = g_slist_next (model_list))
-          {
-            model = (naadsm_model_t *) (model_list->data);
-            g_string_sprintfa (s, " %s", model->name);
-          }
       g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "%s", s->str);
       g_string_free (s, TRUE);
-    }
 #endif
+    }
 
 #if DEBUG
   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "----- EXIT build_listener_list");
@@ -100,6 +151,23 @@ build_listener_list (GSList ** list, naadsm_model_t ** models, int nmodels)
 
 
 
+/**
+ * Frees the events held in a batch and empties it.
+ *
+ * @param batch a batch of events.
+ */
+static void
+clear_batch (GPtrArray * batch)
+{
+  unsigned int i;
+
+  for (i = 0; i < batch->len; i++)
+    EVT_free_event ((EVT_event_t *) g_ptr_array_index (batch, i));
+  g_ptr_array_set_size (batch, 0);
+}
+
+
+
 /**
  * Creates a new event manager.
  *
@@ -111,6 +179,7 @@ naadsm_event_manager_t *
 naadsm_new_event_manager (naadsm_model_t ** models, int nmodels)
 {
   naadsm_event_manager_t *manager;
+  EVT_event_type_t event_type;
 
 #if DEBUG
   g_debug ("----- ENTER naadsm_new_event_manager");
@@ -120,8 +189,13 @@ naadsm_new_event_manager (naadsm_model_t ** models, int nmodels)
   manager->nmodels = nmodels;
   manager->models = models;
   manager->queue = EVT_new_event_queue ();
+  manager->event_pool = EVT_new_event_pool ();
+  manager->change_request_pool = HRD_new_change_request_pool ();
 
-  build_listener_list (manager->listeners, models, nmodels);
+  build_listener_list (manager);
+  for (event_type = 0; event_type < EVT_NEVENT_TYPES; event_type++)
+    manager->ndispatched[event_type] = 0;
+  manager->nevents_dispatched = 0;
 
 #if DEBUG
   g_debug ("----- EXIT naadsm_new_event_manager");
@@ -139,6 +213,9 @@ void
 naadsm_free_event_manager (naadsm_event_manager_t * manager)
 {
   EVT_event_type_t event_type;
+#if DEBUG
+  char *s;
+#endif
 
 #if DEBUG
   g_debug ("----- ENTER naadsm_free_event_manager");
@@ -147,9 +224,34 @@ naadsm_free_event_manager (naadsm_event_manager_t * manager)
   if (manager == NULL)
     return;
 
+#if DEBUG
+  s = naadsm_event_manager_counts_to_string (manager);
+  g_debug ("%s", s);
+  g_free (s);
+#endif
+
   EVT_free_event_queue (manager->queue);
   for (event_type = 0; event_type < EVT_NEVENT_TYPES; event_type++)
-    g_slist_free (manager->listeners[event_type]);
+    if (manager->batch[event_type] != NULL)
+      {
+        clear_batch (manager->batch[event_type]);
+        g_ptr_array_free (manager->batch[event_type], TRUE);
+      }
+  g_free (manager->listener_table);
+
+#if DEBUG
+  /* The high-water marks say how many events and change requests were alive
+   * at once, which is what the pools cost in memory. */
+  s = EVT_event_pool_to_string (manager->event_pool);
+  g_debug ("%s", s);
+  g_free (s);
+  s = HRD_change_request_pool_to_string (manager->change_request_pool);
+  g_debug ("%s", s);
+  g_free (s);
+#endif
+  EVT_free_event_pool (manager->event_pool);
+  HRD_free_change_request_pool (manager->change_request_pool);
+
   g_free (manager);
 
 #if DEBUG
@@ -159,6 +261,106 @@ naadsm_free_event_manager (naadsm_event_manager_t * manager)
 
 
 
+/**
+ * Returns a text representation of how many events of each type an event
+ * manager has handled, and how many sub-models each type was sent to.
+ *
+ * @param manager an event manager.
+ * @return a string.
+ */
+char *
+naadsm_event_manager_counts_to_string (naadsm_event_manager_t * manager)
+{
+  GString *s;
+  char *chararray;
+  EVT_event_type_t event_type;
+
+  s = g_string_new ("<Event counts");
+  for (event_type = 0; event_type < EVT_NEVENT_TYPES; event_type++)
+    if (manager->ndispatched[event_type] > 0)
+      g_string_sprintfa (s, "\n  %s=%lu (to %u models)",
+                         EVT_event_type_name[event_type],
+                         manager->ndispatched[event_type],
+                         manager->nlisteners[event_type]);
+  g_string_append_c (s, '>');
+  /* don't return the wrapper object */
+  chararray = s->str;
+  g_string_free (s, FALSE);
+  return chararray;
+}
+
+
+
+/**
+ * Makes the calling thread take new events and change requests from an event
+ * manager's pools, and return deleted ones to them.  A thread must install a
+ * worker's pools before running an iteration with that worker, and uninstall
+ * them afterwards so that no other worker's events end up in them.
+ *
+ * @param manager an event manager.  Pass NULL to uninstall the pools.
+ */
+void
+naadsm_install_pools (naadsm_event_manager_t * manager)
+{
+  if (manager == NULL)
+    {
+      EVT_set_event_pool (NULL);
+      HRD_set_change_request_pool (NULL);
+    }
+  else
+    {
+      EVT_set_event_pool (manager->event_pool);
+      HRD_set_change_request_pool (manager->change_request_pool);
+    }
+}
+
+
+
+/**
+ * Delivers the batches gathered during a wave to the sub-models that take
+ * them, one event type at a time, then frees the events.
+ *
+ * @param manager an event manager.
+ * @param herds a list of herds.
+ * @param zones a list of zones.
+ * @param rng a random number generator.
+ * @param deliver if FALSE, the events are freed without being delivered.  Used
+ *   when the user has asked to stop the simulation.
+ */
+static void
+flush_batches (naadsm_event_manager_t * manager, HRD_herd_list_t * herds,
+               ZON_zone_list_t * zones, RAN_gen_t * rng, gboolean deliver)
+{
+  EVT_event_type_t event_type;
+  GPtrArray *batch;
+  naadsm_listener_t *listener, *end;
+
+  for (event_type = 0; event_type < EVT_NEVENT_TYPES; event_type++)
+    {
+      batch = manager->batch[event_type];
+      if (batch == NULL || batch->len == 0)
+        continue;
+      if (deliver)
+        {
+          listener = manager->batch_listeners[event_type];
+          end = listener + manager->nbatch_listeners[event_type];
+          for (; listener < end; listener++)
+            {
+#if DEBUG
+              g_debug ("running %s on %u %s events", listener->model->name,
+                       batch->len, EVT_event_type_name[event_type]);
+#endif
+              listener->run_batch (listener->model, herds, zones,
+                                   (EVT_event_t **) batch->pdata, batch->len,
+                                   rng, manager->queue);
+            }
+        }
+      clear_batch (batch);
+    }
+}
+
+
+
 /**
  * Carries out the consequences of a new event.
  *
@@ -180,8 +382,10 @@ naadsm_create_event (naadsm_event_manager_t * manager, EVT_event_t * new_event,
                      HRD_herd_list_t * herds, ZON_zone_list_t * zones, RAN_gen_t * rng)
 {
   EVT_event_t *event;
-  GSList *iter;
-  naadsm_model_t *model;
+  naadsm_listener_t *listener, *end;
+  gboolean stop_requested;
+  gboolean have_batches;
+  unsigned int nsince_check;
 #if DEBUG
   char *s;
 #endif
@@ -200,8 +404,25 @@ naadsm_create_event (naadsm_event_manager_t * manager, EVT_event_t * new_event,
 #endif
 #endif
 
+  /* Asking the GUI whether the user wants to stop can be expensive, so it is
+   * done at the start of every wave and every NAADSM_STOP_CHECK_INTERVAL events
+   * rather than before every listener.  Once a stop has been requested, the
+   * remaining events are discarded without being handled.  If necessary,
+   * another check in the caller will break the day and iteration loops. */
+  stop_requested = FALSE;
+  have_batches = FALSE;
+  nsince_check = NAADSM_STOP_CHECK_INTERVAL;
   while (!EVT_event_queue_is_empty (manager->queue))
-    { 
+    {
+      if (!stop_requested && NULL != naadsm_simulation_stop
+          && (manager->queue->current_wave->len == 0
+              || nsince_check >= NAADSM_STOP_CHECK_INTERVAL))
+        {
+          stop_requested = (0 != naadsm_simulation_stop ());
+          nsince_check = 0;
+        }
+      nsince_check++;
+
       event = EVT_event_dequeue (manager->queue, rng);
 
 #if DEBUG
@@ -211,22 +432,19 @@ naadsm_create_event (naadsm_event_manager_t * manager, EVT_event_t * new_event,
       g_free (s);
 #endif
 
-      for (iter = manager->listeners[event->type]; iter != NULL; iter = g_slist_next (iter))
+      if (!stop_requested)
         {
-          /* Does the GUI user want to stop a simulation in progress? */
-          if (NULL != naadsm_simulation_stop)
+          manager->ndispatched[event->type]++;
+          manager->nevents_dispatched++;
+          listener = manager->listeners[event->type];
+          end = listener + manager->nlisteners[event->type];
+          for (; listener < end; listener++)
             {
-              /* This check may break the day loop.
-               * If necessary, another check (see above) will break the iteration loop.*/
-              if (0 != naadsm_simulation_stop ())
-                break;
-            }
-
-          model = (naadsm_model_t *) (iter->data);
 #if DEBUG
-          g_debug ("running %s", model->name);
-#endif 
-          model->run (model, herds, zones, event, rng, manager->queue);         
+              g_debug ("running %s", listener->model->name);
+#endif
+              listener->run (listener->model, herds, zones, event, rng, manager->queue);
+            }
         }
 
 #ifdef FIX_ME
@@ -237,7 +455,21 @@ naadsm_create_event (naadsm_event_manager_t * manager, EVT_event_t * new_event,
       g_free (s);
 #endif
 #endif
-      EVT_free_event (event);
+      /* Events that some model takes in batches are kept until the end of the
+       * wave. */
+      if (manager->batch[event->type] != NULL)
+        {
+          g_ptr_array_add (manager->batch[event->type], event);
+          have_batches = TRUE;
+        }
+      else
+        EVT_free_event (event);
+
+      if (have_batches && manager->queue->current_wave->len == 0)
+        {
+          flush_batches (manager, herds, zones, rng, !stop_requested);
+          have_batches = FALSE;
+        }
     }
 #if DEBUG
   g_debug ("----- EXIT naadsm_create_event");
@@ -27,6 +27,26 @@
 
 
 
+/**
+ * How many events the event manager hands out between checks of whether the
+ * user has asked to stop the simulation.  The check is also made at the start
+ * of every wave of events.
+ */
+#define NAADSM_STOP_CHECK_INTERVAL 256
+
+
+
+/** One entry in the event manager's dispatch table. */
+typedef struct
+{
+  naadsm_model_t *model;
+  naadsm_model_run_t run;
+  naadsm_model_run_batch_t run_batch;
+}
+naadsm_listener_t;
+
+
+
 /**
  * An object that manages communication among sub-models.  It queries
  * sub-models as to what events they listen for and runs them when those events
@@ -39,7 +59,24 @@ typedef struct
   int nmodels;
   naadsm_model_t **models;
   EVT_event_queue_t *queue;
-  GSList *listeners[EVT_NEVENT_TYPES]; /** which models are listening for which events */
+  naadsm_listener_t *listener_table; /**< storage for all the listener arrays */
+  naadsm_listener_t *listeners[EVT_NEVENT_TYPES]; /**< which models take
+    which events one at a time, in the order the models were loaded */
+  unsigned int nlisteners[EVT_NEVENT_TYPES]; /**< length of each listener array */
+  naadsm_listener_t *batch_listeners[EVT_NEVENT_TYPES]; /**< which models take
+    which events in batches, in the order the models were loaded */
+  unsigned int nbatch_listeners[EVT_NEVENT_TYPES]; /**< length of each batch
+    listener array */
+  GPtrArray *batch[EVT_NEVENT_TYPES]; /**< events of the current wave waiting
+    to be delivered to the batch listeners.  NULL for event types that no model
+    takes in batches. */
+  unsigned long ndispatched[EVT_NEVENT_TYPES]; /**< how many events of each
+    type have been handled, over all iterations */
+  unsigned long nevents_dispatched; /**< the sum of ndispatched, kept so that
+    the caller can tell cheaply whether anything happened between two points */
+  EVT_event_pool_t *event_pool; /**< recycled storage for events */
+  HRD_change_request_pool_t *change_request_pool; /**< recycled storage for
+    herd change requests */
 }
 naadsm_event_manager_t;
 
@@ -48,6 +85,8 @@ naadsm_event_manager_t;
 /* Prototypes. */
 naadsm_event_manager_t *naadsm_new_event_manager (naadsm_model_t **, int);
 void naadsm_free_event_manager (naadsm_event_manager_t *);
+void naadsm_install_pools (naadsm_event_manager_t *);
+char *naadsm_event_manager_counts_to_string (naadsm_event_manager_t *);
 void naadsm_create_event (naadsm_event_manager_t *, EVT_event_t *,
                           HRD_herd_list_t *, ZON_zone_list_t *, RAN_gen_t *);
                           
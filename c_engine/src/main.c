@@ -208,6 +208,14 @@
  * na&iuml;ve search through all units when a search over a large area is
  * needed.
  *
+ * Where exactly the cutover falls depends on how the units are clustered:
+ * figure 4 was measured on units spread evenly over the study area, and dense
+ * clusters of units (as in many poultry populations) shift it considerably.
+ * So rather than use a fixed ratio, the spatial search object times a short
+ * series of searches at several radii through both paths when it is prepared,
+ * and uses the R-tree up to the radius where it stops being faster.  The
+ * timings are written to the log at verbosity 1 or higher.
+ *
  * The uncontrolled fast spread scenarios mentioned earlier experience a
  * considerable speedup with this approach: 4&times; faster with 5000 units,
  * 7&times; with 10000 units, and 22&times; with 50000 units.
@@ -680,8 +688,10 @@ node 0 run 0
 #include <unistd.h>
 #include <stdio.h>
 #include <time.h>
+#include <glib/gstdio.h>
 #include "herd.h"
 #include "model_loader.h"
+#include "model_util.h"
 #include "event_manager.h"
 #include "reporting.h"
 #include "rng.h"
@@ -971,20 +981,165 @@ build_report (gpointer data, gpointer user_data)
 }
 
 
-#ifdef USE_SC_GUILIB
+
+
+/**
+ * The number of threads to use for running iterations.  Set with
+ * naadsm_set_nthreads().
+ */
+int naadsm_nthreads = 1;
+
+
+
+/**
+ * Sets the number of threads to use for running iterations.  Values less than
+ * 1 are treated as 1.  Parallel threads are only used in the command-line
+ * version of the simulator, when it has been built with GThread support.
+ *
+ * @param nthreads the number of threads.
+ */
 DLL_API void
-run_sim_main (const char *herd_file,
-              const char *parameter_file,
-              const char *output_file, double fixed_rng_value, int verbosity, int seed, char *production_type_file)
-#else
+naadsm_set_nthreads (int nthreads)
+{
+  naadsm_nthreads = (nthreads > 1) ? nthreads : 1;
+}
+
+
+
+/**
+ * The file in which to save progress after each iteration.  Set with
+ * naadsm_set_checkpoint_file().
+ */
+char *naadsm_checkpoint_file = NULL;
+
+
+
+/**
+ * Sets a file in which to save progress after each iteration.  If the file
+ * already exists when the simulation starts, the iterations it records as
+ * finished are not run again, and the output file (if any) is cut back to the
+ * end of the last finished iteration and appended to.  The file is deleted
+ * once every iteration has finished.  Pass NULL to turn checkpoints off.
+ *
+ * @param filename the checkpoint file name.
+ */
 DLL_API void
-run_sim_main (const char *herd_file,
-              const char *parameter_file,
-              const char *output_file, double fixed_rng_value, int verbosity, int seed)
-#endif
+naadsm_set_checkpoint_file (const char *filename)
+{
+  g_free (naadsm_checkpoint_file);
+  naadsm_checkpoint_file = g_strdup (filename);
+}
+
+
+
+/**
+ * The order in which to store the herds.  Set with naadsm_set_unit_order().
+ */
+HRD_herd_order_t naadsm_unit_order = HRD_FileOrder;
+
+
+
+/**
+ * Sets the order in which the herds are stored in memory.  Storing them along
+ * a space-filling curve makes spatial searches faster on large populations.
+ * Outputs always identify units by their position in the herd file, whatever
+ * the storage order, but the storage order does decide which random numbers
+ * go to which unit, so results for a given seed differ between orders.
+ *
+ * @param order 0 for the order of the herd file (the default), 1 for a Morton
+ *   (Z-order) curve, 2 for a Hilbert curve.
+ */
+DLL_API void
+naadsm_set_unit_order (int order)
+{
+  switch (order)
+    {
+    case 1:
+      naadsm_unit_order = HRD_MortonOrder;
+      break;
+    case 2:
+      naadsm_unit_order = HRD_HilbertOrder;
+      break;
+    default:
+      naadsm_unit_order = HRD_FileOrder;
+    }
+}
+
+
+
+/**
+ * Sets the most memory that the spread models may use, between them, to
+ * remember which units are near each source, with the distance and heading to
+ * each (airborne spread), and the units sorted by distance from each source
+ * (contact spread).  The limit covers every model and every thread together;
+ * lists are kept in the order they are first needed until it is reached.
+ * Sources whose lists do not fit are handled with a fresh search or sort every
+ * day, so this setting affects speed but not results.
+ *
+ * @param megabytes the memory limit, in MB.  0 turns the lists off.
+ */
+DLL_API void
+naadsm_set_neighbour_list_memory (int megabytes)
+{
+  naadsm_neighbour_list_limit = (gsize) MAX (megabytes, 0) * 1024 * 1024;
+}
+
+
+
+/**
+ * Has the airborne spread models record only the exposures that are adequate.
+ * They can then choose the units to expose by skipping ahead a random number
+ * of units at a time, instead of drawing a random number for every unit near
+ * every source.  The chance of each unit being infected is the same, but the
+ * random numbers are used differently, so results for a given seed differ
+ * from the normal mode.  The mode is turned back off if any output would count
+ * the exposures that are left out (see airborne_exposures_reported()).
+ *
+ * @param sparse non-zero to record only adequate airborne exposures.
+ */
+DLL_API void
+naadsm_set_sparse_airborne_exposures (int sparse)
+{
+  naadsm_sparse_airborne_exposures = (sparse != 0);
+}
+
+
+
+/**
+ * Sets the number of threads the contact spread model may use to work out
+ * the contacts from the day's sources.  Every source draws from its own random
+ * number stream and the results are combined in a fixed order, so the number
+ * of threads affects speed but not results.  This is on top of any threads
+ * running iterations in parallel (see naadsm_set_nthreads()).  Values less
+ * than 1 are treated as 1, and builds without GThread support always use 1.
+ *
+ * @param nthreads the number of threads.
+ */
+DLL_API void
+naadsm_set_contact_spread_threads (int nthreads)
+{
+  naadsm_contact_spread_nthreads = (nthreads > 1) ? nthreads : 1;
+}
+
+
+
+/**
+ * Everything that changes during a Monte Carlo iteration.  When iterations are
+ * run in parallel threads, each thread gets its own worker.  The herd
+ * locations, the spatial index and the projection are shared by all workers,
+ * and the parameter file is parsed only once.  Each worker has its own copy of
+ * the herd states, its own zones, its own instances of the sub-models and its
+ * own output variables.  The sub-models keep their parameters in the same
+ * local_data as their state, so each worker also has its own copy of the
+ * parameter blocks and charts.
+ */
+typedef struct
 {
-  unsigned int ndays, nruns, day, run;
-  double prevalence_num, prevalence_denom;
+  HRD_herd_list_t *herds;
+  ZON_zone_list_t *zones;
+  int nmodels;
+  naadsm_model_t **models;
+  naadsm_event_manager_t *manager;
   RPT_reporting_t *show_unit_states;
   RPT_reporting_t *num_units_in_state;
   RPT_reporting_t *num_units_in_state_by_prodtype;
@@ -996,524 +1151,635 @@ run_sim_main (const char *herd_file,
   RPT_reporting_t *clock_time;
   RPT_reporting_t *version;
   GPtrArray *reporting_vars;
-  int nmodels = 0;
-  naadsm_model_t **models = NULL;
-  naadsm_event_manager_t *manager;
-  unsigned int nherds;
-  HRD_herd_list_t *herds;
-  HRD_herd_t *herd;
-  RAN_gen_t *rng;
-  unsigned int nzones;
-  ZON_zone_list_t *zones;
-  ZON_zone_t *zone;
-  int i, j;                     /* loop counters */
-  const char *drill_down_list[3] = { NULL, NULL, NULL };
-  gboolean active_infections_yesterday, active_infections_today,
-    pending_actions, pending_infections, disease_end_recorded,
-    stop_on_disease_end, early_exit;
-  time_t start_time, finish_time;
-  build_report_args_t build_report_args;
-  char *summary;
-  GString *s;
-  char *prev_summary;
-  guint exit_conditions = 0;
-  double m_total_time, total_processor_time;
-  unsigned long total_runs;
-  m_total_time = total_processor_time = 0.0;
+  GString *s; /**< Holds the output for one day. */
+  GString *output; /**< If not NULL, the daily output is collected here
+    instead of being printed, so that the output of iterations running in
+    parallel does not get interleaved. */
+  double m_total_time; /**< MPI timer seconds spent in this worker's
+    iterations. */
+}
+naadsm_worker_t;
 
-#ifdef USE_SC_GUILIB
-  GPtrArray *production_types;
 
-  production_types = NULL;
-  /* _scenario.version defined as 50 chars wide in general.h */
-  g_snprintf( _scenario.version, 50, "Version: %s, Spec: %s", current_version(), specification_version() );
-#endif
 
-  /* Open a file for output, if specified; if not, use stdout. */
-  if (output_file)
-    {
-      output_file = make_expanded_filename (output_file);
-      output_stream = fopen (output_file, "w");
-      if (output_stream == NULL)
-        {
-          /* FIXME: use errno to provide a more helpful message. */
-          g_error ("Could not open file \"%s\" for writing.", output_file);
-        }
-      g_set_print_handler (file_gprint);
-    }
+/**
+ * The contents of a checkpoint file.  Every iteration starts from a clean
+ * state (the herds, zones and sub-models are reset) and draws from its own
+ * random number stream, named by the seed and the iteration number.  So
+ * between iterations, the whole state of a run is described by how many
+ * iterations have been finished.  The other fields identify the run, so that
+ * a checkpoint is never applied to a different scenario or to edited files.
+ */
+typedef struct
+{
+  gint32 seed;
+  guint32 first_run;
+  guint32 nruns;
+  guint32 ndays;
+  guint32 nherds;
+  guint64 parameter_hash; /**< Hash of the parameter file's contents. */
+  guint64 herd_hash; /**< Hash of the herd file's contents. */
+  guint32 nruns_done; /**< Iterations finished and printed. */
+  gint64 output_length; /**< Length of the output file after the last
+    finished iteration, or -1 if output goes to the console. */
+}
+naadsm_checkpoint_t;
 
-  /* This line prints a Byte Order Mark (BOM) that indicates that the output is
-   * in UTF-8.  Not currently used. */
-  /*
-  if (NULL == naadsm_printf)
-    g_print ("%s", "\xEF\xBB\xBF");
-  */
+/** Identifies a checkpoint file and its layout. */
+#define NAADSM_CHECKPOINT_MAGIC "NAADSMCK"
+#define NAADSM_CHECKPOINT_VERSION 2
 
-  /* Set the verbosity level. */
-  if (verbosity < 1)
-    {
-      g_log_set_handler (NULL, G_LOG_LEVEL_DEBUG, silent_log_handler, NULL);
-      g_log_set_handler ("herd", G_LOG_LEVEL_DEBUG, silent_log_handler, NULL);
-      g_log_set_handler ("prob_dist", G_LOG_LEVEL_DEBUG, silent_log_handler, NULL);
-      g_log_set_handler ("rel_chart", G_LOG_LEVEL_DEBUG, silent_log_handler, NULL);
-      g_log_set_handler ("reporting", G_LOG_LEVEL_DEBUG, silent_log_handler, NULL);
-      g_log_set_handler ("zone", G_LOG_LEVEL_DEBUG, silent_log_handler, NULL);
-      g_log_set_handler ("gis", G_LOG_LEVEL_DEBUG, silent_log_handler, NULL);
-    }
-  #ifdef WIN_DLL
-    #if DEBUG
-      /* #define G_LOG_DOMAIN "debug_off" to disable logging for selected units,
-       * or #define G_LOG_DOMAIN "debug_on" to enable logging only for selected units. */
-        
-      g_log_set_handler (NULL, G_LOG_ALL_LEVELS, silent_log_handler, NULL);
-      g_log_set_handler ("herd", G_LOG_ALL_LEVELS, silent_log_handler, NULL);
-      g_log_set_handler ("prob_dist", G_LOG_ALL_LEVELS, silent_log_handler, NULL);
-      g_log_set_handler ("rel_chart", G_LOG_ALL_LEVELS, silent_log_handler, NULL);
-      g_log_set_handler ("reporting", G_LOG_ALL_LEVELS, silent_log_handler, NULL);
-      g_log_set_handler ("zone", G_LOG_ALL_LEVELS, silent_log_handler, NULL);
-      g_log_set_handler ("gis", G_LOG_ALL_LEVELS, silent_log_handler, NULL);
-      g_log_set_handler ("debug_off", G_LOG_ALL_LEVELS, silent_log_handler, NULL);
-      g_log_set_handler ("debug_on", G_LOG_ALL_LEVELS, naadsm_log_handler, NULL);
-      
-      g_debug ("This will be the first debugging message reported to the GUI."); 
-    #else
-      g_log_set_handler (NULL, G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL);
-      g_log_set_handler ("herd", G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL);
-      g_log_set_handler ("prob_dist", G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL);
-      g_log_set_handler ("rel_chart", G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL);
-      g_log_set_handler ("reporting", G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL);
-      g_log_set_handler ("zone", G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL);
-      g_log_set_handler ("gis", G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL);
-      g_log_set_handler ("debug_off", G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL);
-      g_log_set_handler ("debug_on", G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL); 
-    #endif    
-  #endif
-  
-#if DEBUG
-  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "verbosity = %i", verbosity);
-#endif
 
+
+/**
+ * Settings that are the same for every iteration.
+ */
+typedef struct
+{
+  unsigned int ndays;
+  unsigned int nruns;
+  guint exit_conditions;
+  gboolean stop_on_disease_end;
+  RAN_gen_t *rng; /**< The generator from which each iteration's own random
+    number stream is derived. */
+  unsigned int first_run; /**< The overall iteration number of this node's
+    first iteration.  Non-zero only when the iterations are divided among MPI
+    nodes. */
+  char *checkpoint_file; /**< Where to save progress, or NULL. */
+  naadsm_checkpoint_t checkpoint; /**< Progress so far. */
 #ifdef USE_SC_GUILIB
-  if ( NULL != production_type_file )
-  {
-    production_types = PRT_load_production_type_list ( production_type_file );
-  };
-#endif
-  /* Get the list of herds. */
-  if (herd_file)
-    {
-#ifdef USE_SC_GUILIB
-      herds = HRD_load_herd_list ( herd_file, production_types );
-#else
-      herds = HRD_load_herd_list ( herd_file );
+  GPtrArray *production_types;
 #endif
-      nherds = HRD_herd_list_length (herds);
-    }
-  else
-    {
-      herds = NULL;
-      nherds = 0;
-    }
+}
+naadsm_run_settings_t;
 
-#if DEBUG
-  g_debug ("%i units read", nherds);
-#endif
-  if (nherds == 0)
-    {
-      g_error ("no units in file %s", herd_file);
-    }
 
-#ifdef FIX_ME                   /* FIXME: this block causes a crash on Windows */
+
+/**
+ * Creates a new worker: its output variables, its zone list, and its own
+ * instances of the sub-models.  The sub-models are instantiated from
+ * parameters that have already been read, so that the parameter file is read
+ * only once however many workers there are.
+ *
+ * @param herds the herd list the worker will use.
+ * @param parameters the simulation parameters, from naadsm_read_parameters().
+ * @return a newly-allocated worker.
+ */
+naadsm_worker_t *
+new_worker (HRD_herd_list_t * herds, scew_parser * parameters)
+{
+  naadsm_worker_t *w;
+  ZON_zone_t *zone;
+  const char *drill_down_list[3] = { NULL, NULL, NULL };
+  int i, j;                     /* loop counters */
+
 #if DEBUG
-  summary = HRD_herd_list_to_string (herds);
-  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "\n%s", summary);
-  free (summary);
-#endif
+  g_debug ("----- ENTER new_worker");
 #endif
 
-  /* Project the herd locations onto a flat map, if they aren't already. */
-  if (herds->projection == NULL)
-    {
-      herds->projection = default_projection (herds);
-      HRD_herd_list_project (herds, herds->projection);
-    }
-  /* Build a spatial index around the herd locations. */
-  herds->spatial_index = new_spatial_search ();
-  for (i = 0; i < nherds; i++)
-    {
-      herd = HRD_herd_list_get (herds, i);
-      spatial_search_add_point (herds->spatial_index, herd->x, herd->y);
-    }
-  spatial_search_prepare (herds->spatial_index);
-
-  s = g_string_new (NULL);
+  w = g_new (naadsm_worker_t, 1);
+  w->herds = herds;
+  w->s = g_string_new (NULL);
+  w->output = NULL;
+  w->m_total_time = 0.0;
 
   /* Initialize the reporting variables, and bundle them together so they can
    * easily be sent to a function for initialization. */
-  show_unit_states = RPT_new_reporting ("all-units-states", RPT_integer, RPT_never);
-  num_units_in_state = RPT_new_reporting ("tsdU", RPT_group, RPT_never);
-  num_units_in_state_by_prodtype =
+  w->show_unit_states = RPT_new_reporting ("all-units-states", RPT_integer, RPT_never);
+  w->num_units_in_state = RPT_new_reporting ("tsdU", RPT_group, RPT_never);
+  w->num_units_in_state_by_prodtype =
     RPT_new_reporting ("num-units-in-each-state-by-production-type", RPT_group, RPT_never);
-  num_animals_in_state = RPT_new_reporting ("tsdA", RPT_group, RPT_never);
-  num_animals_in_state_by_prodtype =
+  w->num_animals_in_state = RPT_new_reporting ("tsdA", RPT_group, RPT_never);
+  w->num_animals_in_state_by_prodtype =
     RPT_new_reporting ("num-animals-in-each-state-by-production-type", RPT_group, RPT_never);
   for (i = 0; i < HRD_NSTATES; i++)
     {
-      RPT_reporting_set_integer1 (num_units_in_state, 0, HRD_status_name[i]);
-      RPT_reporting_set_integer1 (num_animals_in_state, 0, HRD_status_name[i]);
+      RPT_reporting_set_integer1 (w->num_units_in_state, 0, HRD_status_name[i]);
+      RPT_reporting_set_integer1 (w->num_animals_in_state, 0, HRD_status_name[i]);
       drill_down_list[1] = HRD_status_name[i];
       for (j = 0; j < herds->production_type_names->len; j++)
         {
           drill_down_list[0] = (char *) g_ptr_array_index (herds->production_type_names, j);
-          RPT_reporting_set_integer (num_units_in_state_by_prodtype, 0, drill_down_list);
-          RPT_reporting_set_integer (num_animals_in_state_by_prodtype, 0, drill_down_list);
+          RPT_reporting_set_integer (w->num_units_in_state_by_prodtype, 0, drill_down_list);
+          RPT_reporting_set_integer (w->num_animals_in_state_by_prodtype, 0, drill_down_list);
         }
     }
-  avg_prevalence = RPT_new_reporting ("average-prevalence", RPT_real, RPT_never);
-  last_day_of_disease =
+  w->avg_prevalence = RPT_new_reporting ("average-prevalence", RPT_real, RPT_never);
+  w->last_day_of_disease =
     RPT_new_reporting ("diseaseDuration", RPT_integer, RPT_never);
-  last_day_of_outbreak =
+  w->last_day_of_outbreak =
     RPT_new_reporting ("outbreakDuration", RPT_integer, RPT_never);
-  clock_time = RPT_new_reporting ("clock-time", RPT_real, RPT_never);
-  version = RPT_new_reporting ("version", RPT_text, RPT_never);
-  RPT_reporting_set_text (version, PACKAGE_VERSION, NULL);
-  reporting_vars = g_ptr_array_new ();
-  g_ptr_array_add (reporting_vars, show_unit_states);
-  g_ptr_array_add (reporting_vars, num_units_in_state);
-  g_ptr_array_add (reporting_vars, num_units_in_state_by_prodtype);
-  g_ptr_array_add (reporting_vars, num_animals_in_state);
-  g_ptr_array_add (reporting_vars, num_animals_in_state_by_prodtype);
-  g_ptr_array_add (reporting_vars, avg_prevalence);
-  g_ptr_array_add (reporting_vars, last_day_of_disease);
-  g_ptr_array_add (reporting_vars, last_day_of_outbreak);
-  g_ptr_array_add (reporting_vars, clock_time);
-  g_ptr_array_add (reporting_vars, version);
+  w->clock_time = RPT_new_reporting ("clock-time", RPT_real, RPT_never);
+  w->version = RPT_new_reporting ("version", RPT_text, RPT_never);
+  RPT_reporting_set_text (w->version, PACKAGE_VERSION, NULL);
+  w->reporting_vars = g_ptr_array_new ();
+  g_ptr_array_add (w->reporting_vars, w->show_unit_states);
+  g_ptr_array_add (w->reporting_vars, w->num_units_in_state);
+  g_ptr_array_add (w->reporting_vars, w->num_units_in_state_by_prodtype);
+  g_ptr_array_add (w->reporting_vars, w->num_animals_in_state);
+  g_ptr_array_add (w->reporting_vars, w->num_animals_in_state_by_prodtype);
+  g_ptr_array_add (w->reporting_vars, w->avg_prevalence);
+  g_ptr_array_add (w->reporting_vars, w->last_day_of_disease);
+  g_ptr_array_add (w->reporting_vars, w->last_day_of_outbreak);
+  g_ptr_array_add (w->reporting_vars, w->clock_time);
+  g_ptr_array_add (w->reporting_vars, w->version);
 
   /* Pre-create a "background" zone. */
-  zones = ZON_new_zone_list (nherds);
+  w->zones = ZON_new_zone_list (HRD_herd_list_length (herds));
   zone = ZON_new_zone ("", -1, 0.0);
 #ifdef USE_SC_GUILIB
   zone->_herdDays = NULL;
   zone->_animalDays = NULL;
 #endif
-  ZON_zone_list_append (zones, zone);
+  ZON_zone_list_append (w->zones, zone);
 
-  /* Get the simulation parameters and sub-models. */
-  nmodels =
-    naadsm_load_models (parameter_file, herds, herds->projection, zones,
-                        &ndays, &nruns, &models, reporting_vars, &exit_conditions );
-  nzones = ZON_zone_list_length (zones);
+  /* Get the sub-models. */
+  w->nmodels =
+    naadsm_load_models (parameters, herds, herds->projection, w->zones,
+                        &(w->models), w->reporting_vars);
 
   /* The clock time reporting variable is special -- it can only be reported
    * once (at the end of each simulation) or never. */
-  if (clock_time->frequency != RPT_never && clock_time->frequency != RPT_once)
+  if (w->clock_time->frequency != RPT_never && w->clock_time->frequency != RPT_once)
     {
       g_warning ("clock-time cannot be reported %s; it will reported at the end of each simulation",
-                 RPT_frequency_name[clock_time->frequency]);
-      RPT_reporting_set_frequency (clock_time, RPT_once);
+                 RPT_frequency_name[w->clock_time->frequency]);
+      RPT_reporting_set_frequency (w->clock_time, RPT_once);
     }
 
   /* Now that the reporting frequency of show_unit_states has been set from the
    * simulation parameters, remove that variable from the list of reporting
    * variables, because it is treated specially. */
-  g_ptr_array_remove (reporting_vars, show_unit_states);
+  g_ptr_array_remove (w->reporting_vars, w->show_unit_states);
 
-#if HAVE_MPI && !CANCEL_MPI
-  /* Increase the number of runs to divide evenly by the number of processors,
-   * if necessary. */
-  if (nruns % me.np != 0)
-    nruns += (me.np - nruns % me.np);
-  nruns /= me.np;               /* because it's parallel, wheee! */
-  _scenario.nruns = nruns;
-#endif
+  w->manager = naadsm_new_event_manager (w->models, w->nmodels);
 
 #if DEBUG
-  g_debug ("simulation %u days x %u runs", ndays, nruns);
+  g_debug ("----- EXIT new_worker");
 #endif
 
+  return w;
+}
 
-  /* Initialize the pseudo-random number generator. */
-#ifdef USE_SC_GUILIB
-  if ( _scenario.random_seed == 0 )
-     rng = RAN_new_generator ( -1 );
-  else
-    rng = RAN_new_generator( _scenario.random_seed );
-#else
-  rng = RAN_new_generator (seed);
-#endif
-  if (fixed_rng_value >= 0 && fixed_rng_value < 1)
-    {
-      RAN_fix (rng, fixed_rng_value);
-    }
 
-  manager = naadsm_new_event_manager (models, nmodels);
 
-  build_report_args.string = s;
+/**
+ * Deletes a worker from memory.  The worker's herd list is not freed.
+ *
+ * @param w a worker.
+ */
+void
+free_worker (naadsm_worker_t * w)
+{
+  if (w == NULL)
+    return;
+
+  RPT_free_reporting (w->show_unit_states);
+  RPT_free_reporting (w->num_units_in_state);
+  RPT_free_reporting (w->num_units_in_state_by_prodtype);
+  RPT_free_reporting (w->num_animals_in_state);
+  RPT_free_reporting (w->num_animals_in_state_by_prodtype);
+  RPT_free_reporting (w->avg_prevalence);
+  RPT_free_reporting (w->last_day_of_disease);
+  RPT_free_reporting (w->last_day_of_outbreak);
+  RPT_free_reporting (w->clock_time);
+  RPT_free_reporting (w->version);
+  g_ptr_array_free (w->reporting_vars, TRUE);
+  g_string_free (w->s, TRUE);
+  if (w->output != NULL)
+    g_string_free (w->output, TRUE);
+  naadsm_free_event_manager (w->manager);
+  naadsm_unload_models (w->nmodels, w->models);
+  ZON_free_zone_list (w->zones);
+  g_free (w);
+}
 
-  /* Determine whether each iteration should end when the active disease phase ends. */
-  stop_on_disease_end = (0 != get_stop_on_disease_end( exit_conditions ) );
 
-  m_total_time = total_processor_time = 0.0;
-  total_runs = 0;
 
+/**
+ * Checks whether anything would see the airborne exposures that are not
+ * adequate: the exposure counts and lists written by exposure-monitor, or an
+ * exposure callback from the user interface.
+ *
+ * @param w a worker whose sub-models have been loaded.
+ * @return TRUE if any such exposures would be reported.
+ */
+static gboolean
+airborne_exposures_reported (naadsm_worker_t * w)
+{
 #ifdef USE_SC_GUILIB
-  sc_sim_start( herds, production_types, zones );
+  /* The SC version records every exposure for its iteration summaries. */
+  return TRUE;
 #else
-  if (NULL != naadsm_sim_start)
-    naadsm_sim_start ();
+  RPT_reporting_t *output;
+  unsigned int i;
+
+  if (naadsm_expose_herd != NULL)
+    return TRUE;
+  for (i = 0; i < w->reporting_vars->len; i++)
+    {
+      output = (RPT_reporting_t *) g_ptr_array_index (w->reporting_vars, i);
+      if (output->frequency != RPT_never
+          && (strcmp (output->name, "exposures") == 0
+              || strncmp (output->name, "expn", 4) == 0
+              || strncmp (output->name, "expc", 4) == 0))
+        return TRUE;
+    }
+  return FALSE;
 #endif
+}
 
 
-/*
-#ifdef USE_SC_GUILIB
-  write_scenario_SQL();
-  write_job_SQL();
-  write_production_types_SQL( production_types );
-  write_zones_SQL( zones );
-  fflush(NULL);
-#endif
-*/
 
+/**
+ * Copies the herd module's running counts of herds and animals in each state
+ * into the output variables that report them, but only for the variables that
+ * are going to be written out today.
+ *
+ * The by-production-type variables have always been running sums of the daily
+ * counts rather than daily counts, so today's counts are added to them every
+ * day unless they are never written out.
+ *
+ * @param w a worker.
+ * @param args the day and flags used to build today's report.
+ */
+void
+report_state_counts (naadsm_worker_t * w, build_report_args_t * args)
+{
+  HRD_herd_list_t *herds;
+  HRD_tally_t *tally;
+  const char *drill_down_list[3] = { NULL, NULL, NULL };
+  unsigned int nprodtypes, i, j, k;
+  gboolean units_by_prodtype, animals_by_prodtype;
 
-  /* Begin the loop over the specified number of iterations. */
-  naadsm_create_event (manager, EVT_new_before_any_simulations_event(), herds, zones, rng);
-  for (run = 0; run < nruns; run++)
+#define REPORTED_TODAY(R) (RPT_reporting_due (R, args->day) \
+  || (args->include_all_values && (R)->frequency != RPT_never))
+
+  herds = w->herds;
+  tally = herds->tally;
+  nprodtypes = MIN (tally->nprodtypes, herds->production_type_names->len);
+
+  if (REPORTED_TODAY (w->num_units_in_state))
+    for (i = 0; i < HRD_NSTATES; i++)
+      RPT_reporting_set_integer1 (w->num_units_in_state, tally->nunits[i], HRD_status_name[i]);
+
+  if (REPORTED_TODAY (w->num_animals_in_state))
+    for (i = 0; i < HRD_NSTATES; i++)
+      RPT_reporting_set_integer1 (w->num_animals_in_state, tally->nanimals[i], HRD_status_name[i]);
+
+  units_by_prodtype = (w->num_units_in_state_by_prodtype->frequency != RPT_never);
+  animals_by_prodtype = (w->num_animals_in_state_by_prodtype->frequency != RPT_never);
+  if (units_by_prodtype || animals_by_prodtype)
+    for (j = 0; j < nprodtypes; j++)
+      {
+        drill_down_list[0] = (char *) g_ptr_array_index (herds->production_type_names, j);
+        for (i = 0; i < HRD_NSTATES; i++)
+          {
+            drill_down_list[1] = HRD_status_name[i];
+            k = j * HRD_NSTATES + i;
+            if (units_by_prodtype)
+              RPT_reporting_add_integer (w->num_units_in_state_by_prodtype,
+                                         tally->nunits_by_prodtype[k], drill_down_list);
+            if (animals_by_prodtype)
+              RPT_reporting_add_integer (w->num_animals_in_state_by_prodtype,
+                                         tally->nanimals_by_prodtype[k], drill_down_list);
+          }
+      }
+
+  if (REPORTED_TODAY (w->avg_prevalence))
+    RPT_reporting_set_real (w->avg_prevalence, (tally->prevalence_denom > 0) ?
+                            tally->prevalence_num / tally->prevalence_denom : 0, NULL);
+
+#undef REPORTED_TODAY
+}
+
+
+
+/**
+ * Finds the next day that has to be run in full, after a day on which nothing
+ * happened.  Only the sub-models that listen for Midnight, NewDay or EndOfDay
+ * events can have work of their own to do on a quiet day; each of those is
+ * asked for the earliest day it needs waking, and a model that cannot say is
+ * assumed to need every day.  The last day is always run in full.
+ *
+ * @param w the worker running the iteration.
+ * @param day the current simulation day.
+ * @param ndays the number of days in the iteration.
+ * @return the next day to run, between day + 1 and ndays.
+ */
+static unsigned int
+next_day_to_run (naadsm_worker_t * w, unsigned int day, unsigned int ndays)
+{
+  naadsm_model_t *model;
+  unsigned int wake;
+  int model_wake;
+  int i;
+
+  wake = ndays;
+  for (i = 0; i < w->nmodels && wake > day + 1; i++)
     {
+      model = w->models[i];
+      if (!model->is_listening_for (model, EVT_Midnight)
+          && !model->is_listening_for (model, EVT_NewDay)
+          && !model->is_listening_for (model, EVT_EndOfDay))
+        continue;
+      if (model->next_wake_day == NULL)
+        return day + 1;
+      model_wake = model->next_wake_day (model, w->herds, w->zones, (int) day);
+      if (model_wake <= (int) day + 1)
+        return day + 1;
+#if DEBUG
+      g_debug ("%s can sleep until day %i", model->name, model_wake);
+#endif
+      if ((unsigned int) model_wake < wake)
+        wake = (unsigned int) model_wake;
+    }
+
+  return MAX (wake, day + 1);
+}
+
+
+
+/**
+ * Runs one Monte Carlo iteration.
+ *
+ * @param w the worker that will run the iteration.
+ * @param settings settings common to all iterations.
+ * @param run the iteration number, counting from 0.
+ */
+void
+run_iteration (naadsm_worker_t * w, naadsm_run_settings_t * settings, unsigned int run)
+{
+  unsigned int ndays, day, wake_day, ndays_skipped;
+  unsigned long nevents_before;
+  HRD_herd_list_t *herds;
+  HRD_tally_t *tally;
+  ZON_zone_list_t *zones;
+  naadsm_event_manager_t *manager;
+  EVT_event_t *new_day_event;
+  RAN_gen_t *rng;
+  int i;                        /* loop counter */
+  gboolean active_infections_yesterday, active_infections_today,
+    pending_actions, pending_infections, disease_end_recorded,
+    early_exit, skip_today, can_exit_tomorrow;
+  time_t start_time, finish_time;
+  build_report_args_t build_report_args;
+  char *summary;
+  char *prev_summary;
+#ifdef USE_SC_GUILIB
+  GPtrArray *production_types;
+#endif
 
 #if defined( USE_MPI ) && !CANCEL_MPI
-      double m_start_time, m_end_time;
-      m_start_time = m_end_time = 0.0;
-      m_start_time = MPI_Wtime();
+  double m_start_time, m_end_time;
+  m_start_time = m_end_time = 0.0;
+  m_start_time = MPI_Wtime();
 #endif
 
-    _iteration.zoneFociCreated = FALSE;
-    _iteration.diseaseEndDay = -1;
-    _iteration.outbreakEndDay = -1;
-    _iteration.first_detection = FALSE;
+  herds = w->herds;
+  zones = w->zones;
+  manager = w->manager;
+  naadsm_install_pools (manager);
+  /* Each iteration draws from its own random number stream, so the results
+   * of iteration k do not depend on which thread or MPI node runs it. */
+  rng = RAN_new_substream (settings->rng, settings->first_run + run, RAN_IterationStream);
+  ndays = settings->ndays;
+#ifdef USE_SC_GUILIB
+  production_types = settings->production_types;
+#endif
+  build_report_args.string = w->s;
 
-      /* Does the GUI user want to stop a simulation in progress? */
-      if (NULL != naadsm_simulation_stop)
-        {
-          if (0 != naadsm_simulation_stop ())
-            break;
-        }
+  _iteration.zoneFociCreated = FALSE;
+  _iteration.diseaseEndDay = -1;
+  _iteration.outbreakEndDay = -1;
+  _iteration.first_detection = FALSE;
 
 #if DEBUG
-      g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "resetting everything before start of simulation");
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "resetting everything before start of simulation");
 #endif
 
 /*
 #error TODO:  After removing the infectious_herd updates from the sc_naadsm functions make sure to call them from near here if the optimizations have been defined
 */
 #ifdef USE_SC_GUILIB
-      sc_iteration_start ( production_types, herds,  run);
+  sc_iteration_start ( production_types, herds,  run);
 #else
-      if (NULL != naadsm_iteration_start)
-        naadsm_iteration_start (run);
+  if (NULL != naadsm_iteration_start)
+    naadsm_iteration_start (run);
 #endif
 
-      if ( _iteration.infectious_herds != NULL )
-      {
-        g_hash_table_destroy( _iteration.infectious_herds );
-        _iteration.infectious_herds = NULL;
-      };
-      _iteration.infectious_herds = g_hash_table_new( g_direct_hash, g_direct_equal );
+  if ( _iteration.infectious_herds != NULL )
+  {
+    HRD_free_herd_set( _iteration.infectious_herds );
+    _iteration.infectious_herds = NULL;
+  };
+  _iteration.infectious_herds = HRD_new_herd_set( HRD_herd_list_length( herds ) );
 
-      /* Reset reporting variables. */
-      RPT_reporting_set_null (last_day_of_disease, NULL);
-      RPT_reporting_set_null (last_day_of_outbreak, NULL);
+  /* Reset reporting variables. */
+  RPT_reporting_set_null (w->last_day_of_disease, NULL);
+  RPT_reporting_set_null (w->last_day_of_outbreak, NULL);
 
-      /* Reset all models. */
-      for (i = 0; i < nmodels; i++)
-        models[i]->reset (models[i]);
+  /* Reset all models. */
+  for (i = 0; i < w->nmodels; i++)
+    w->models[i]->reset (w->models[i]);
 
-      /* Reset all zones. */
-      ZON_zone_list_reset (zones);
+  /* Reset all zones. */
+  ZON_zone_list_reset (zones);
 
 #ifdef TORRINGTON
-      /* Randomize initial states for all herds, if desired.
-         Note that this function selects the indicated number
-         of initially infected units from each production type separately.*/
-      randomize_initial_states( herds, rng );
+  /* Randomize initial states for all herds, if desired.
+     Note that this function selects the indicated number
+     of initially infected units from each production type separately.*/
+  randomize_initial_states( herds, rng );
 #endif 
 
 #ifdef WHEATLAND
-      /* Randomize initial states for all herds, if desired.
-         Note that this function selects the indicated number of
-         initially infected units randomly from the entire population. */
-      randomize_initial_states( herds, rng );
+  /* Randomize initial states for all herds, if desired.
+     Note that this function selects the indicated number of
+     initially infected units randomly from the entire population. */
+  randomize_initial_states( herds, rng );
 #endif
 
-      active_infections_yesterday = TRUE;
-      pending_actions = TRUE;
-      pending_infections = TRUE;
-      disease_end_recorded = FALSE;
-      early_exit = FALSE;
+  active_infections_yesterday = TRUE;
+  pending_actions = TRUE;
+  pending_infections = TRUE;
+  disease_end_recorded = FALSE;
+  early_exit = FALSE;
+  wake_day = 1;
+  ndays_skipped = 0;
+  nevents_before = 0;
 
-      naadsm_create_event (manager, EVT_new_before_each_simulation_event(), herds, zones, rng);
+  naadsm_create_event (manager, EVT_new_before_each_simulation_event(), herds, zones, rng);
 
-      /* Run the iteration. */
-      start_time = time (NULL);
+  /* Run the iteration. */
+  start_time = time (NULL);
 
-      /* Begin the loop over the days in an iteration. */
-      for (day = 1; (day <= ndays) && (!early_exit); day++)
-        {
+  /* Begin the loop over the days in an iteration. */
+  for (day = 1; (day <= ndays) && (!early_exit); day++)
+    {
 #if defined( USE_MPI ) && !CANCEL_MPI
-          double m_day_start_time = MPI_Wtime();
-          double m_day_end_time = m_day_start_time;
+      double m_day_start_time = MPI_Wtime();
+      double m_day_end_time = m_day_start_time;
 #endif
-          /* Does the GUI user want to stop a simulation in progress? */
-          if (NULL != naadsm_simulation_stop)
-            {
-              /* This check may break the day loop.
-               * If necessary, Another check (see above) will break the iteration loop.*/
-              if (0 != naadsm_simulation_stop ())
-                break;
-            }
-
-          /* Should the iteration end due to first detection? */
-      if ( _iteration.first_detection && (0 != get_stop_on_first_detection( exit_conditions )) )
-      break;
+      /* Does the GUI user want to stop a simulation in progress? */
+      if (NULL != naadsm_simulation_stop)
+        {
+          /* This check may break the day loop.
+           * If necessary, Another check (see above) will break the iteration loop.*/
+          if (0 != naadsm_simulation_stop ())
+            break;
+        }
 
+      /* Should the iteration end due to first detection? */
+      if ( _iteration.first_detection && (0 != get_stop_on_first_detection( settings->exit_conditions )) )
+        break;
 
       _iteration.current_day = day;
 #ifdef USE_SC_GUILIB
-          sc_day_start( production_types );
+      sc_day_start( production_types );
 #else
-          if (NULL != naadsm_day_start)
-            naadsm_day_start (day);
+      if (NULL != naadsm_day_start)
+        naadsm_day_start (day);
 #endif
 
 #if DEBUG && defined( USE_MPI )
-          double m_start_day_time = MPI_Wtime();
+      double m_start_day_time = MPI_Wtime();
 #endif
+      /* After a day on which nothing happened, the days until some sub-model
+       * next has work of its own to do are not run.  They would only have
+       * passed the Midnight, NewDay and EndOfDay events around.  Each of those
+       * events takes one random number as it comes off the queue, so the same
+       * numbers are drawn here; that keeps the results identical to running
+       * every day. */
+      skip_today = (day < wake_day && day < ndays);
+      if (skip_today)
+        {
+          RAN_num (rng);
+          RAN_num (rng);
+          RAN_num (rng);
+          ndays_skipped++;
+        }
+      else
+        {
+          nevents_before = manager->nevents_dispatched;
           /* Process changes made to the herds and zones on the previous day. */
           naadsm_create_event (manager, EVT_new_midnight_event (day), herds, zones, rng);
+        }
 
-          /* Count the number of herds and animals infected, vaccinated, and
-           * destroyed, and the number of herds and animals in each state. */
-          RPT_reporting_zero (num_units_in_state);
-          RPT_reporting_zero (num_animals_in_state);
-          prevalence_num = prevalence_denom = 0;
+      /* The number of herds and animals in each state is kept up to date by
+       * the herd module as herds change state.  It is copied into the output
+       * variables only on days when they are reported. */
+      tally = herds->tally;
+#if DEBUG
+      g_assert (HRD_herd_list_tally_ok (herds));
+#endif
+      active_infections_today = (tally->nunits[Latent] > 0
+                                 || tally->nunits[InfectiousSubclinical] > 0
+                                 || tally->nunits[InfectiousClinical] > 0);
 
-          for (i = 0; i < nherds; i++)
-            {
-              herd = HRD_herd_list_get (herds, i);
-
-              RPT_reporting_add_integer1 (num_units_in_state, 1, HRD_status_name[herd->status]);
-              RPT_reporting_add_integer1 (num_animals_in_state, herd->size,
-                                          HRD_status_name[herd->status]);
-              drill_down_list[0] = herd->production_type_name;
-              drill_down_list[1] = HRD_status_name[herd->status];
-              RPT_reporting_add_integer (num_units_in_state_by_prodtype, 1, drill_down_list);
-              RPT_reporting_add_integer (num_animals_in_state_by_prodtype, herd->size,
-                                         drill_down_list);
-
-              if (herd->status >= Latent && herd->status <= InfectiousClinical)
-                {
-                  prevalence_num += herd->size * herd->prevalence;
-                  prevalence_denom += herd->size;
-                }
-              RPT_reporting_set_real (avg_prevalence, (prevalence_denom > 0) ?
-                                      prevalence_num / prevalence_denom : 0, NULL);
-            }                   /* end loop over herds */
-          active_infections_today = (
-            RPT_reporting_get_integer1 (num_units_in_state, HRD_status_name[Latent]) > 0
-            || RPT_reporting_get_integer1 (num_units_in_state, HRD_status_name[InfectiousSubclinical]) > 0
-            || RPT_reporting_get_integer1 (num_units_in_state, HRD_status_name[InfectiousClinical]) > 0
-          );
-
-          /* Run the models to get today's changes. */
-          naadsm_create_event (manager, EVT_new_new_day_event (day), herds, zones, rng);
-
-          /* Check if the outbreak is over, and if so, whether we can exit this
-           * Monte Carlo trial early. */
-
-          /* Check first for active infections... */
-          if (active_infections_yesterday)
+      /* Run the models to get today's changes.  The NewDay event tells models
+       * that keep day-indexed arrays how many days went by unseen. */
+      if (!skip_today)
+        {
+          new_day_event = EVT_new_new_day_event (day);
+          new_day_event->u.new_day.ndays_skipped = ndays_skipped;
+          ndays_skipped = 0;
+          naadsm_create_event (manager, new_day_event, herds, zones, rng);
+        }
+
+      /* Check if the outbreak is over, and if so, whether we can exit this
+       * Monte Carlo trial early. */
+
+      /* Check first for active infections... */
+      if (active_infections_yesterday)
+        {
+          if (!active_infections_today)
             {
-              if (!active_infections_today)
-                {
-                  ;
+              ;
 #if DEBUG
-                  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "no more active infections");
+              g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "no more active infections");
 #endif
-                }
             }
-          else /* there were no active infections yesterday */
+        }
+      else /* there were no active infections yesterday */
+        {
+          if (active_infections_today)
             {
-              if (active_infections_today)
-                {
-                  ;
+              ;
 #if DEBUG
-                  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "active infections again");
+              g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "active infections again");
 #endif
-                }
             }
+        }
 
-          /* Should the end of the disease phase be recorded? */
-          if (!disease_end_recorded && !active_infections_today && !pending_infections)
-            {
+      /* Should the end of the disease phase be recorded? */
+      if (!disease_end_recorded && !active_infections_today && !pending_infections)
+        {
 
 #ifdef USE_SC_GUILIB
-              sc_disease_end( day );
+          sc_disease_end( day );
 #else
-              if (NULL != naadsm_disease_end)
-                naadsm_disease_end (day);
+          if (NULL != naadsm_disease_end)
+            naadsm_disease_end (day);
 #endif
-              RPT_reporting_set_integer (last_day_of_disease, day - 1, NULL);
-              disease_end_recorded = TRUE;
-            }
+          RPT_reporting_set_integer (w->last_day_of_disease, day - 1, NULL);
+          disease_end_recorded = TRUE;
+        }
 
 
-          /* Check the early exit conditions.  If the user wants to exit when
-           * the active disease phase ends, then active_infections and pending_infections
-           * must both be false to exit early.
-           *
-           * Otherwise, active_infections and pending_actions must both be false
-           * to exit early.
-           */
-          if (stop_on_disease_end)
+      /* Check the early exit conditions.  If the user wants to exit when
+       * the active disease phase ends, then active_infections and pending_infections
+       * must both be false to exit early.
+       *
+       * Otherwise, active_infections and pending_actions must both be false
+       * to exit early.
+       */
+      if (settings->stop_on_disease_end)
+        {
+          if (!active_infections_today && !pending_infections)
             {
-              if (!active_infections_today && !pending_infections)
-                {
 #if DEBUG
-                  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "can exit early on end of disease phase");
+              g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "can exit early on end of disease phase");
 #endif
-                  early_exit = TRUE;
-                }
+              early_exit = TRUE;
             }
-          else
+        }
+      else
+        {
+          if (!active_infections_today && !pending_actions)
             {
-              if (!active_infections_today && !pending_actions)
-                {
 #if DEBUG
-                  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "can exit early on end of outbreak");
+              g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "can exit early on end of outbreak");
 #endif
 #ifdef USE_SC_GUILIB
-          sc_outbreak_end( day );
+      sc_outbreak_end( day );
 #else
-                  if (NULL != naadsm_outbreak_end)
-                    naadsm_outbreak_end (day);
+              if (NULL != naadsm_outbreak_end)
+                naadsm_outbreak_end (day);
 #endif
-                  RPT_reporting_set_integer (last_day_of_outbreak, day - 1, NULL);
-                  early_exit = TRUE;
-                }
+              RPT_reporting_set_integer (w->last_day_of_outbreak, day - 1, NULL);
+              early_exit = TRUE;
             }
-          active_infections_yesterday = active_infections_today;
+        }
+      active_infections_yesterday = active_infections_today;
+#if DEBUG
+      g_assert (!(skip_today && early_exit));
+#endif
 
+      if (!skip_today)
+        {
           naadsm_create_event (manager, EVT_new_end_of_day_event (day, early_exit), herds, zones, rng);
 
           /* Next, check for pending actions... */
           pending_actions = FALSE;
-          for (i = 0; i < nmodels; i++)
+          for (i = 0; i < w->nmodels; i++)
             {
-              if (models[i]->has_pending_actions (models[i]))
+              if (w->models[i]->has_pending_actions (w->models[i]))
                 {
 
 #if DEBUG
                   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "%s has pending actions",
-                         models[i]->name);
+                         w->models[i]->name);
 #endif
 
                   pending_actions = TRUE;
@@ -1524,106 +1790,795 @@ run_sim_main (const char *herd_file,
 
           /* And finally, check for pending infections. */
           pending_infections = FALSE;
-          for (i = 0; i < nmodels; i++)
+          for (i = 0; i < w->nmodels; i++)
             {
-              if (models[i]->has_pending_infections (models[i]))
+              if (w->models[i]->has_pending_infections (w->models[i]))
                 {
 
 #if DEBUG
                   g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "%s has pending infections",
-                         models[i]->name);
+                         w->models[i]->name);
 #endif
                   pending_infections = TRUE;
                   break;
                 }
             }
 
+          /* A day is quiet if only the three day events were handled.  Nothing
+           * changes on a skipped day, so if the iteration could stop early
+           * tomorrow it would stop on a skipped day, without its EndOfDay event
+           * saying so.  Days are therefore skipped only while it cannot. */
+          can_exit_tomorrow = (tally->nunits[Latent] == 0
+                               && tally->nunits[InfectiousSubclinical] == 0
+                               && tally->nunits[InfectiousClinical] == 0);
+          if (settings->stop_on_disease_end)
+            can_exit_tomorrow = can_exit_tomorrow && !pending_infections;
+          else
+            can_exit_tomorrow = can_exit_tomorrow && !pending_actions;
+          if (!early_exit && !can_exit_tomorrow && day < ndays
+              && manager->nevents_dispatched - nevents_before == 3)
+            wake_day = next_day_to_run (w, day, ndays);
+        }
+
 
-          /* Build the daily output string.  Start with the special case
-           * variable that tells whether to output the state of every unit. */
+      /* Build the daily output string.  Start with the special case
+       * variable that tells whether to output the state of every unit. */
 #ifndef SILENT_MODE
 #ifndef WIN_DLL
-          if (RPT_reporting_due (show_unit_states, day - 1)
-              || (early_exit && show_unit_states->frequency != RPT_never))
-            {
-              summary = HRD_herd_list_summary_to_string (herds);
-              g_string_printf (s, "%s", summary);
-              g_free (summary);
-            }
-          else
+      if (RPT_reporting_due (w->show_unit_states, day - 1)
+          || (early_exit && w->show_unit_states->frequency != RPT_never))
+        {
+          summary = HRD_herd_list_summary_to_string (herds);
+          g_string_printf (w->s, "%s", summary);
+          g_free (summary);
+        }
+      else
 #endif
 #endif
-            g_string_truncate (s, 0);
-
-          /* For the other output variables, append text in the format
-           * variable-name=value to the output string. */
-          build_report_args.day = day - 1;
-          build_report_args.include_all_values = (early_exit || day == ndays);
-          build_report_args.include_all_names = (day == 1);
-          if (build_report_args.include_all_values)
-            {
-              finish_time = time (NULL);
-              RPT_reporting_set_real (clock_time, (double) (finish_time - start_time), NULL);
-              naadsm_create_event (manager, EVT_new_last_day_event (day), herds, zones, rng);
-            }
-          g_ptr_array_foreach (reporting_vars, build_report, &build_report_args);
+        g_string_truncate (w->s, 0);
+
+      /* For the other output variables, append text in the format
+       * variable-name=value to the output string. */
+      build_report_args.day = day - 1;
+      build_report_args.include_all_values = (early_exit || day == ndays);
+      build_report_args.include_all_names = (day == 1);
+      report_state_counts (w, &build_report_args);
+      if (build_report_args.include_all_values)
+        {
+          finish_time = time (NULL);
+          RPT_reporting_set_real (w->clock_time, (double) (finish_time - start_time), NULL);
+          naadsm_create_event (manager, EVT_new_last_day_event (day), herds, zones, rng);
+        }
+      g_ptr_array_foreach (w->reporting_vars, build_report, &build_report_args);
 
 /* The DLL shouldn't output anything directly to the console.  Strange things happen... */
 #ifndef SILENT_MODE
 #ifndef WIN_DLL
 #if HAVE_MPI && !CANCEL_MPI
-          g_print ("node %i run %u\n%s\n", me.rank, run, s->str);
+      if (w->output != NULL)
+        g_string_append_printf (w->output, "node %i run %u\n%s\n", me.rank, run, w->s->str);
+      else
+        g_print ("node %i run %u\n%s\n", me.rank, run, w->s->str);
 #else
-          g_print ("node 0 run %u\n%s\n", run, s->str);
+      if (w->output != NULL)
+        g_string_append_printf (w->output, "node 0 run %u\n%s\n", run, w->s->str);
+      else
+        g_print ("node 0 run %u\n%s\n", run, w->s->str);
 #endif
 #endif
 #endif
 
-          if (NULL != naadsm_show_all_prevalences)
-            {
-              prev_summary = HRD_herd_list_prevalence_to_string (herds, day);
-              naadsm_show_all_prevalences (prev_summary);
-              free (prev_summary);
-            }
+      if (NULL != naadsm_show_all_prevalences)
+        {
+          prev_summary = HRD_herd_list_prevalence_to_string (herds, day);
+          naadsm_show_all_prevalences (prev_summary);
+          free (prev_summary);
+        }
 
-          if (NULL != naadsm_show_all_states)
-            {
-              summary = HRD_herd_list_summary_to_string (herds);
-              naadsm_show_all_states (summary);
-              free (summary);
-            }
+      if (NULL != naadsm_show_all_states)
+        {
+          summary = HRD_herd_list_summary_to_string (herds);
+          naadsm_show_all_states (summary);
+          free (summary);
+        }
 
-          if (NULL != naadsm_set_zone_perimeters)
-            naadsm_set_zone_perimeters (zones);
+      if (NULL != naadsm_set_zone_perimeters)
+        naadsm_set_zone_perimeters (zones);
 
 #ifdef USE_SC_GUILIB
-          sc_day_complete( day, run, production_types, zones );
+      sc_day_complete( day, run, production_types, zones );
 #else
-          if (NULL != naadsm_day_complete)
-            naadsm_day_complete (day);
+      if (NULL != naadsm_day_complete)
+        naadsm_day_complete (day);
 #endif
 
 #if defined( USE_MPI ) && !CANCEL_MPI
-  m_day_end_time = MPI_Wtime();
-  g_debug( "%i: Iteration: %i, Day: %i, Day_Time: %g\n", me.rank, run, day, (double)(m_day_end_time - m_day_start_time ) );
+      m_day_end_time = MPI_Wtime();
+      g_debug( "%i: Iteration: %i, Day: %i, Day_Time: %g\n", me.rank, run, day, (double)(m_day_end_time - m_day_start_time ) );
 #endif
-        } /* end loop over days of one Monte Carlo trial */
+    } /* end loop over days of one Monte Carlo trial */
 
 #ifdef USE_SC_GUILIB
-      sc_iteration_complete( zones, herds, production_types, run );
+  sc_iteration_complete( zones, herds, production_types, run );
 #else
-      if (NULL != naadsm_iteration_complete)
-        naadsm_iteration_complete (run);
+  if (NULL != naadsm_iteration_complete)
+    naadsm_iteration_complete (run);
 #endif
 
 #if defined( USE_MPI ) && !CANCEL_MPI
   m_end_time = MPI_Wtime();
-  m_total_time = (double)((((double)m_end_time - (double)m_start_time)) + (double)m_total_time);
-  #ifdef DEBUG
-      g_debug("%i - Run: %d timing: startCount %g, endCount %g, totalCount %g MPI Timer Seconds\n", me.rank, me.rank * _scenario.nruns + run + 1, m_start_time, m_end_time, (double)((double)m_end_time - (double)m_start_time));
+  w->m_total_time = (double)((((double)m_end_time - (double)m_start_time)) + (double)w->m_total_time);
+#ifdef DEBUG
+  g_debug("%i - Run: %d timing: startCount %g, endCount %g, totalCount %g MPI Timer Seconds\n", me.rank, me.rank * _scenario.nruns + run + 1, m_start_time, m_end_time, (double)((double)m_end_time - (double)m_start_time));
+#endif
+#endif
+
+  RAN_free_generator (rng);
+  naadsm_install_pools (NULL);
+  return;
+}
+
+
+
+/**
+ * Computes a hash (64-bit FNV-1a) of a file's contents, so that a checkpoint
+ * is not applied after the scenario's files have been edited.
+ *
+ * @param filename the file name.  May be NULL.
+ * @return the hash, or 0 if filename is NULL.
+ */
+static guint64
+hash_file (const char *filename)
+{
+  FILE *fp;
+  guchar buf[8192];
+  size_t n, i;
+  guint64 hash;
+
+  if (filename == NULL)
+    return 0;
+
+  fp = g_fopen (filename, "rb");
+  if (fp == NULL)
+    g_error ("could not open \"%s\" to compare it with the checkpoint", filename);
+
+  hash = G_GINT64_CONSTANT (0xcbf29ce484222325);
+  while ((n = fread (buf, 1, sizeof (buf), fp)) > 0)
+    for (i = 0; i < n; i++)
+      {
+        hash ^= buf[i];
+        hash *= G_GINT64_CONSTANT (0x100000001b3);
+      }
+  fclose (fp);
+
+  return hash;
+}
+
+
+
+/**
+ * Reads a checkpoint file.  The file is binary and is only meant to be read
+ * back on the kind of machine that wrote it.
+ *
+ * @param filename the checkpoint file name.
+ * @param checkpoint a location in which to store the contents of the file.
+ * @return TRUE if the file was read, FALSE if it does not exist.  A file that
+ *   exists but cannot be read is a fatal error, since silently starting over
+ *   would throw away the work it records.
+ */
+static gboolean
+read_checkpoint (const char *filename, naadsm_checkpoint_t * checkpoint)
+{
+  FILE *fp;
+  char magic[sizeof (NAADSM_CHECKPOINT_MAGIC) - 1];
+  guint32 version;
+  gboolean ok;
+
+  fp = g_fopen (filename, "rb");
+  if (fp == NULL)
+    return FALSE;
+
+  ok = (fread (magic, sizeof (magic), 1, fp) == 1
+        && memcmp (magic, NAADSM_CHECKPOINT_MAGIC, sizeof (magic)) == 0
+        && fread (&version, sizeof (version), 1, fp) == 1
+        && version == NAADSM_CHECKPOINT_VERSION
+        && fread (&checkpoint->seed, sizeof (checkpoint->seed), 1, fp) == 1
+        && fread (&checkpoint->first_run, sizeof (checkpoint->first_run), 1, fp) == 1
+        && fread (&checkpoint->nruns, sizeof (checkpoint->nruns), 1, fp) == 1
+        && fread (&checkpoint->ndays, sizeof (checkpoint->ndays), 1, fp) == 1
+        && fread (&checkpoint->nherds, sizeof (checkpoint->nherds), 1, fp) == 1
+        && fread (&checkpoint->parameter_hash, sizeof (checkpoint->parameter_hash), 1, fp) == 1
+        && fread (&checkpoint->herd_hash, sizeof (checkpoint->herd_hash), 1, fp) == 1
+        && fread (&checkpoint->nruns_done, sizeof (checkpoint->nruns_done), 1, fp) == 1
+        && fread (&checkpoint->output_length, sizeof (checkpoint->output_length), 1, fp) == 1);
+  fclose (fp);
+  if (!ok)
+    g_error ("\"%s\" is not a checkpoint file from this version", filename);
+
+  return TRUE;
+}
+
+
+
+/**
+ * Writes a checkpoint file.  The new contents go to a temporary file first,
+ * which then replaces the old one, so that a run killed part-way through
+ * writing still leaves the previous checkpoint intact.
+ *
+ * @param filename the checkpoint file name.
+ * @param checkpoint the progress to save.
+ */
+static void
+write_checkpoint (const char *filename, naadsm_checkpoint_t * checkpoint)
+{
+  FILE *fp;
+  char *tmp_filename;
+  guint32 version;
+  gboolean ok;
+
+  tmp_filename = g_strdup_printf ("%s.tmp", filename);
+  fp = g_fopen (tmp_filename, "wb");
+  if (fp == NULL)
+    g_error ("could not open \"%s\" for writing", tmp_filename);
+
+  version = NAADSM_CHECKPOINT_VERSION;
+  ok = (fwrite (NAADSM_CHECKPOINT_MAGIC, sizeof (NAADSM_CHECKPOINT_MAGIC) - 1, 1, fp) == 1
+        && fwrite (&version, sizeof (version), 1, fp) == 1
+        && fwrite (&checkpoint->seed, sizeof (checkpoint->seed), 1, fp) == 1
+        && fwrite (&checkpoint->first_run, sizeof (checkpoint->first_run), 1, fp) == 1
+        && fwrite (&checkpoint->nruns, sizeof (checkpoint->nruns), 1, fp) == 1
+        && fwrite (&checkpoint->ndays, sizeof (checkpoint->ndays), 1, fp) == 1
+        && fwrite (&checkpoint->nherds, sizeof (checkpoint->nherds), 1, fp) == 1
+        && fwrite (&checkpoint->parameter_hash, sizeof (checkpoint->parameter_hash), 1, fp) == 1
+        && fwrite (&checkpoint->herd_hash, sizeof (checkpoint->herd_hash), 1, fp) == 1
+        && fwrite (&checkpoint->nruns_done, sizeof (checkpoint->nruns_done), 1, fp) == 1
+        && fwrite (&checkpoint->output_length, sizeof (checkpoint->output_length), 1, fp) == 1);
+  ok = (fclose (fp) == 0) && ok;
+  if (!ok)
+    g_error ("could not write checkpoint file \"%s\"", tmp_filename);
+
+#ifdef G_OS_WIN32
+  /* rename() will not replace an existing file on Windows. */
+  g_remove (filename);
+#endif
+  if (g_rename (tmp_filename, filename) != 0)
+    g_error ("could not replace checkpoint file \"%s\"", filename);
+  g_free (tmp_filename);
+}
+
+
+
+/**
+ * Records that an iteration has been finished and its output printed.  The
+ * iterations are recorded in order, so everything before the recorded one is
+ * done.
+ *
+ * @param settings settings common to all iterations, including the
+ *   checkpoint.
+ * @param run the iteration number, counting from 0.
+ */
+static void
+iteration_done (naadsm_run_settings_t * settings, unsigned int run)
+{
+  if (settings->checkpoint_file == NULL)
+    return;
+
+  /* An iteration that was cut short by the user is not finished. */
+  if (NULL != naadsm_simulation_stop && 0 != naadsm_simulation_stop ())
+    return;
+
+  settings->checkpoint.nruns_done = run + 1;
+  if (output_stream != NULL)
+    {
+      fflush (output_stream);
+#if HAVE_FSEEKO
+      settings->checkpoint.output_length = (gint64) ftello (output_stream);
+#else
+      settings->checkpoint.output_length = (gint64) ftell (output_stream);
+#endif
+    }
+  write_checkpoint (settings->checkpoint_file, &(settings->checkpoint));
+}
+
+
+
+#if HAVE_GTHREAD
+/**
+ * Shared data for the threads that run iterations in parallel.
+ */
+typedef struct
+{
+  naadsm_run_settings_t *settings;
+  GAsyncQueue *idle_workers; /**< Workers not currently running an
+    iteration. */
+  GString **finished_output; /**< The buffered output of iterations that have
+    finished but have not yet been printed, indexed by iteration number. */
+  unsigned int next_run_to_print;
+}
+naadsm_thread_pool_args_t;
+
+G_LOCK_DEFINE_STATIC (finished_output);
+
+
+
+/**
+ * Runs one iteration on whichever worker is free.  This function is typed as
+ * a GFunc so that it can be used with a GLib thread pool.  The output of each
+ * iteration is printed as a block, in iteration order, so the output does not
+ * depend on which thread finishes first.
+ *
+ * @param data the iteration number plus 1, cast to a gpointer.  (A thread pool
+ *   cannot be given a NULL task.)
+ * @param user_data a pointer to a naadsm_thread_pool_args_t structure, cast to
+ *   a gpointer.
+ */
+void
+run_iteration_in_thread (gpointer data, gpointer user_data)
+{
+  naadsm_thread_pool_args_t *args;
+  unsigned int run;
+  naadsm_worker_t *w;
+  GString *output;
+
+  args = (naadsm_thread_pool_args_t *) user_data;
+  run = GPOINTER_TO_UINT (data) - 1;
+  w = (naadsm_worker_t *) g_async_queue_pop (args->idle_workers);
+
+  w->output = g_string_new (NULL);
+  run_iteration (w, args->settings, run);
+
+  G_LOCK (finished_output);
+  args->finished_output[run] = w->output;
+  while (args->next_run_to_print < args->settings->nruns
+         && args->finished_output[args->next_run_to_print] != NULL)
+    {
+      output = args->finished_output[args->next_run_to_print];
+      g_print ("%s", output->str);
+      g_string_free (output, TRUE);
+      args->finished_output[args->next_run_to_print] = NULL;
+      iteration_done (args->settings, args->next_run_to_print);
+      args->next_run_to_print++;
+    }
+  G_UNLOCK (finished_output);
+  w->output = NULL;
+
+  g_async_queue_push (args->idle_workers, w);
+}
+#endif
+
+
+
+/**
+ * Checks whether the loaded sub-models can be run in more than one thread at
+ * a time.  The table writers write straight to their own files, so every
+ * worker would open and write the same file.
+ *
+ * @param w a worker.
+ * @return TRUE if the worker's sub-models are safe to copy into parallel
+ *   workers.
+ */
+gboolean
+worker_can_be_cloned (naadsm_worker_t * w)
+{
+  int i;
+
+  for (i = 0; i < w->nmodels; i++)
+    {
+      if (strcmp (w->models[i]->name, "full-table-writer") == 0
+          || strcmp (w->models[i]->name, "apparent-events-table-writer") == 0)
+        return FALSE;
+    }
+  return TRUE;
+}
+
+
+
+#ifdef USE_SC_GUILIB
+DLL_API void
+run_sim_main (const char *herd_file,
+              const char *parameter_file,
+              const char *output_file, double fixed_rng_value, int verbosity, int seed, char *production_type_file)
+#else
+DLL_API void
+run_sim_main (const char *herd_file,
+              const char *parameter_file,
+              const char *output_file, double fixed_rng_value, int verbosity, int seed)
+#endif
+{
+  unsigned int ndays, nruns, run;
+  naadsm_run_settings_t settings;
+  naadsm_worker_t **workers;
+  int nworkers;
+  unsigned int nherds;
+  HRD_herd_list_t *herds;
+  HRD_herd_t *herd;
+  RAN_gen_t *rng;
+  int i;                        /* loop counter */
+  guint exit_conditions = 0;
+  double m_total_time, total_processor_time;
+  unsigned long total_runs;
+  naadsm_checkpoint_t saved;
+  gboolean resume;
+  scew_parser *parameters;
+#if HAVE_GTHREAD
+  naadsm_thread_pool_args_t pool_args;
+  GThreadPool *pool;
+  GError *error = NULL;
+#endif
+  m_total_time = total_processor_time = 0.0;
+
+#ifdef USE_SC_GUILIB
+  GPtrArray *production_types;
+
+  production_types = NULL;
+  /* _scenario.version defined as 50 chars wide in general.h */
+  g_snprintf( _scenario.version, 50, "Version: %s, Spec: %s", current_version(), specification_version() );
+#endif
+
+  /* If a checkpoint was left by an earlier run that did not finish, pick up
+   * where it left off. */
+  resume = FALSE;
+  settings.checkpoint_file = NULL;
+  if (naadsm_checkpoint_file != NULL)
+    {
+      settings.checkpoint_file = make_expanded_filename (naadsm_checkpoint_file);
+      resume = read_checkpoint (settings.checkpoint_file, &saved);
+#if DEBUG
+      if (resume)
+        g_debug ("resuming after %u finished iterations", saved.nruns_done);
+#endif
+    }
+
+  /* Open a file for output, if specified; if not, use stdout. */
+  if (output_file)
+    {
+      output_file = make_expanded_filename (output_file);
+      if (resume && saved.output_length >= 0)
+        {
+          /* Cut off whatever the interrupted iteration wrote, and carry on
+           * from the end of the last finished one. */
+          if (truncate (output_file, (off_t) saved.output_length) != 0)
+            g_error ("Could not truncate file \"%s\" to resume from the checkpoint.", output_file);
+          output_stream = fopen (output_file, "a");
+        }
+      else
+        output_stream = fopen (output_file, "w");
+      if (output_stream == NULL)
+        {
+          /* FIXME: use errno to provide a more helpful message. */
+          g_error ("Could not open file \"%s\" for writing.", output_file);
+        }
+      g_set_print_handler (file_gprint);
+    }
+
+  /* This line prints a Byte Order Mark (BOM) that indicates that the output is
+   * in UTF-8.  Not currently used. */
+  /*
+  if (NULL == naadsm_printf)
+    g_print ("%s", "\xEF\xBB\xBF");
+  */
+
+  /* Set the verbosity level. */
+  if (verbosity < 1)
+    {
+      g_log_set_handler (NULL, G_LOG_LEVEL_DEBUG, silent_log_handler, NULL);
+      g_log_set_handler ("herd", G_LOG_LEVEL_DEBUG, silent_log_handler, NULL);
+      g_log_set_handler ("prob_dist", G_LOG_LEVEL_DEBUG, silent_log_handler, NULL);
+      g_log_set_handler ("rel_chart", G_LOG_LEVEL_DEBUG, silent_log_handler, NULL);
+      g_log_set_handler ("reporting", G_LOG_LEVEL_DEBUG, silent_log_handler, NULL);
+      g_log_set_handler ("zone", G_LOG_LEVEL_DEBUG, silent_log_handler, NULL);
+      g_log_set_handler ("gis", G_LOG_LEVEL_DEBUG, silent_log_handler, NULL);
+    }
+  #ifdef WIN_DLL
+#if DEBUG
+      /* #define G_LOG_DOMAIN "debug_off" to disable logging for selected units,
+       * or #define G_LOG_DOMAIN "debug_on" to enable logging only for selected units. */
+        
+      g_log_set_handler (NULL, G_LOG_ALL_LEVELS, silent_log_handler, NULL);
+      g_log_set_handler ("herd", G_LOG_ALL_LEVELS, silent_log_handler, NULL);
+      g_log_set_handler ("prob_dist", G_LOG_ALL_LEVELS, silent_log_handler, NULL);
+      g_log_set_handler ("rel_chart", G_LOG_ALL_LEVELS, silent_log_handler, NULL);
+      g_log_set_handler ("reporting", G_LOG_ALL_LEVELS, silent_log_handler, NULL);
+      g_log_set_handler ("zone", G_LOG_ALL_LEVELS, silent_log_handler, NULL);
+      g_log_set_handler ("gis", G_LOG_ALL_LEVELS, silent_log_handler, NULL);
+      g_log_set_handler ("debug_off", G_LOG_ALL_LEVELS, silent_log_handler, NULL);
+      g_log_set_handler ("debug_on", G_LOG_ALL_LEVELS, naadsm_log_handler, NULL);
+      
+      g_debug ("This will be the first debugging message reported to the GUI."); 
+    #else
+      g_log_set_handler (NULL, G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL);
+      g_log_set_handler ("herd", G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL);
+      g_log_set_handler ("prob_dist", G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL);
+      g_log_set_handler ("rel_chart", G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL);
+      g_log_set_handler ("reporting", G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL);
+      g_log_set_handler ("zone", G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL);
+      g_log_set_handler ("gis", G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL);
+      g_log_set_handler ("debug_off", G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL);
+      g_log_set_handler ("debug_on", G_LOG_ALERT_LEVELS, naadsm_log_handler, NULL); 
+    #endif    
   #endif
+  
+#if DEBUG
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "verbosity = %i", verbosity);
+#endif
+
+#ifdef USE_SC_GUILIB
+  if ( NULL != production_type_file )
+  {
+    production_types = PRT_load_production_type_list ( production_type_file );
+  };
+#endif
+  /* Get the list of herds. */
+  if (herd_file)
+    {
+#ifdef USE_SC_GUILIB
+      herds = HRD_load_herd_list ( herd_file, production_types );
+#else
+      herds = HRD_load_herd_list ( herd_file );
+#endif
+      nherds = HRD_herd_list_length (herds);
+    }
+  else
+    {
+      herds = NULL;
+      nherds = 0;
+    }
+
+#if DEBUG
+  g_debug ("%i units read", nherds);
+#endif
+  if (nherds == 0)
+    {
+      g_error ("no units in file %s", herd_file);
+    }
+
+#ifdef FIX_ME                   /* FIXME: this block causes a crash on Windows */
+#if DEBUG
+  summary = HRD_herd_list_to_string (herds);
+  g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "\n%s", summary);
+  free (summary);
+#endif
+#endif
+
+  /* Project the herd locations onto a flat map, if they aren't already. */
+  if (herds->projection == NULL)
+    {
+      herds->projection = default_projection (herds);
+      HRD_herd_list_project (herds, herds->projection);
+    }
+  /* Store the herds in a cache-friendly order, if requested.  This must come
+   * before anything records herd indices. */
+  HRD_herd_list_reorder (herds, naadsm_unit_order);
+
+  /* Build a spatial index around the herd locations. */
+  herds->spatial_index = new_spatial_search ();
+  for (i = 0; i < nherds; i++)
+    {
+      herd = HRD_herd_list_get (herds, i);
+      spatial_search_add_point (herds->spatial_index, herd->x, herd->y);
+    }
+
+  /* Read the simulation parameters.  Every worker's sub-models are
+   * instantiated from this one parsed copy. */
+  parameters = naadsm_read_parameters (parameter_file, &ndays, &nruns, &exit_conditions);
+
+  /* Create the first worker.  It uses the herd list that was just loaded. */
+  workers = g_new (naadsm_worker_t *, 1);
+  workers[0] = new_worker (herds, parameters);
+  nworkers = 1;
+
+  /* Airborne exposures that are not adequate can only be left out if nothing
+   * reports them. */
+  if (naadsm_sparse_airborne_exposures && airborne_exposures_reported (workers[0]))
+    {
+      g_warning ("exposures are reported, so all airborne exposures will be recorded");
+      naadsm_sparse_airborne_exposures = FALSE;
+    }
+
+  /* The spatial index is finished after the sub-models are loaded, because
+   * they tell it the search radii they will use. */
+  spatial_search_prepare (herds->spatial_index, SPATIAL_SEARCH_AUTO);
+  {
+    char *summary;
+
+    summary = spatial_search_calibration_to_string (herds->spatial_index);
+    g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "%s", summary);
+    g_free (summary);
+  }
+  naadsm_new_live_indexes (herds);
+
+#if HAVE_MPI && !CANCEL_MPI
+  /* Increase the number of runs to divide evenly by the number of processors,
+   * if necessary. */
+  if (nruns % me.np != 0)
+    nruns += (me.np - nruns % me.np);
+  nruns /= me.np;               /* because it's parallel, wheee! */
+  _scenario.nruns = nruns;
+#endif
+
+#if DEBUG
+  g_debug ("simulation %u days x %u runs", ndays, nruns);
+#endif
+
+
+  /* Initialize the pseudo-random number generator. */
+#ifdef USE_SC_GUILIB
+  if ( _scenario.random_seed == 0 )
+     rng = RAN_new_generator ( -1 );
+  else
+    rng = RAN_new_generator( _scenario.random_seed );
+#else
+  /* A resumed run must use the seed of the run it continues. */
+  if (resume && seed == -1)
+    seed = saved.seed;
+  rng = RAN_new_generator (seed);
+#endif
+  if (resume && rng->seed != saved.seed)
+    g_error ("the checkpoint was made with random number seed %i", saved.seed);
+  if (fixed_rng_value >= 0 && fixed_rng_value < 1)
+    {
+      RAN_fix (rng, fixed_rng_value);
+    }
+
+  settings.ndays = ndays;
+  settings.nruns = nruns;
+  settings.exit_conditions = exit_conditions;
+  settings.rng = rng;
+#if HAVE_MPI && !CANCEL_MPI
+  settings.first_run = me.rank * nruns;
+#else
+  settings.first_run = 0;
+#endif
+#ifdef USE_SC_GUILIB
+  settings.production_types = production_types;
 #endif
-    }                           /* loop over all Monte Carlo trials */
+
+  /* Determine whether each iteration should end when the active disease phase ends. */
+  settings.stop_on_disease_end = (0 != get_stop_on_disease_end( exit_conditions ) );
+
+  settings.checkpoint.seed = rng->seed;
+  settings.checkpoint.first_run = settings.first_run;
+  settings.checkpoint.nruns = nruns;
+  settings.checkpoint.ndays = ndays;
+  settings.checkpoint.nherds = nherds;
+  settings.checkpoint.parameter_hash = 0;
+  settings.checkpoint.herd_hash = 0;
+  if (settings.checkpoint_file != NULL)
+    {
+      settings.checkpoint.parameter_hash = hash_file (parameter_file);
+      settings.checkpoint.herd_hash = hash_file (herd_file);
+    }
+  settings.checkpoint.nruns_done = 0;
+  settings.checkpoint.output_length = -1;
+  if (resume)
+    {
+      if (saved.first_run != settings.checkpoint.first_run
+          || saved.nruns != settings.checkpoint.nruns
+          || saved.ndays != settings.checkpoint.ndays
+          || saved.nherds != settings.checkpoint.nherds)
+        g_error ("the checkpoint \"%s\" is from a different scenario", settings.checkpoint_file);
+      if (saved.parameter_hash != settings.checkpoint.parameter_hash
+          || saved.herd_hash != settings.checkpoint.herd_hash)
+        g_error ("the parameter or herd file has changed since the checkpoint \"%s\" was made",
+                 settings.checkpoint_file);
+      settings.checkpoint.nruns_done = saved.nruns_done;
+      settings.checkpoint.output_length = saved.output_length;
+    }
+
+  m_total_time = total_processor_time = 0.0;
+  total_runs = 0;
+
+  /* Decide how many threads to run iterations in.  The GUI callbacks and the
+   * SQL output are not safe to call from several threads at once. */
+  if (naadsm_nthreads > 1)
+    {
+#if !HAVE_GTHREAD || defined( USE_SC_GUILIB ) || defined( WIN_DLL )
+      g_warning ("this version cannot run iterations in parallel threads; using 1 thread");
+      naadsm_nthreads = 1;
+#else
+      if (!worker_can_be_cloned (workers[0]))
+        {
+          g_warning ("the table writers cannot be used with more than 1 thread; using 1 thread");
+          naadsm_nthreads = 1;
+        }
+      else if ((unsigned int) naadsm_nthreads > nruns)
+        naadsm_nthreads = MAX ((int) nruns, 1);
+#endif
+    }
+
+  /* Create the remaining workers.  Each gets its own copy of the herd states,
+   * but shares the herd locations, spatial index and projection. */
+  if (naadsm_nthreads > 1)
+    {
+      workers = g_renew (naadsm_worker_t *, workers, naadsm_nthreads);
+      for (nworkers = 1; nworkers < naadsm_nthreads; nworkers++)
+        {
+          HRD_herd_list_t *clone;
+
+          clone = HRD_clone_herd_list (herds);
+          naadsm_new_live_indexes (clone);
+          workers[nworkers] = new_worker (clone, parameters);
+        }
+    }
+  scew_parser_free (parameters);
+#if DEBUG
+  g_debug ("running iterations in %i thread(s)", nworkers);
+#endif
+
+#ifdef USE_SC_GUILIB
+  sc_sim_start( herds, production_types, workers[0]->zones );
+#else
+  if (NULL != naadsm_sim_start)
+    naadsm_sim_start ();
+#endif
+
+
+/*
+#ifdef USE_SC_GUILIB
+  write_scenario_SQL();
+  write_job_SQL();
+  write_production_types_SQL( production_types );
+  write_zones_SQL( zones );
+  fflush(NULL);
+#endif
+*/
+
+
+  /* Begin the loop over the specified number of iterations. */
+  for (i = 0; i < nworkers; i++)
+    naadsm_create_event (workers[i]->manager, EVT_new_before_any_simulations_event(),
+                         workers[i]->herds, workers[i]->zones, rng);
+  if (nworkers == 1)
+    {
+      for (run = settings.checkpoint.nruns_done; run < settings.nruns; run++)
+        {
+          /* Does the GUI user want to stop a simulation in progress? */
+          if (NULL != naadsm_simulation_stop)
+            {
+              if (0 != naadsm_simulation_stop ())
+                break;
+            }
+
+          run_iteration (workers[0], &settings, run);
+          iteration_done (&settings, run);
+        }                       /* loop over all Monte Carlo trials */
+    }
+#if HAVE_GTHREAD
+  else
+    {
+#if !GLIB_CHECK_VERSION(2,32,0)
+      if (!g_thread_supported ())
+        g_thread_init (NULL);
+#endif
+      pool_args.settings = &settings;
+      pool_args.idle_workers = g_async_queue_new ();
+      for (i = 0; i < nworkers; i++)
+        g_async_queue_push (pool_args.idle_workers, workers[i]);
+      pool_args.finished_output = g_new0 (GString *, settings.nruns);
+      pool_args.next_run_to_print = settings.checkpoint.nruns_done;
+
+      pool = g_thread_pool_new (run_iteration_in_thread, &pool_args, nworkers,
+                                TRUE, &error);
+      if (pool == NULL)
+        g_error ("could not create threads: %s", error->message);
+      for (run = settings.checkpoint.nruns_done; run < settings.nruns; run++)
+        g_thread_pool_push (pool, GUINT_TO_POINTER (run + 1), NULL);
+      /* Wait for all iterations to finish. */
+      g_thread_pool_free (pool, FALSE, TRUE);
+
+      g_free (pool_args.finished_output);
+      g_async_queue_unref (pool_args.idle_workers);
+    }
+#endif
+
+  /* A run that finished every iteration leaves no checkpoint behind, so that
+   * running the same command again starts over instead of finding nothing
+   * left to do. */
+  if (settings.checkpoint_file != NULL
+      && settings.checkpoint.nruns_done == settings.nruns)
+    g_remove (settings.checkpoint_file);
+  for (i = 0; i < nworkers; i++)
+    m_total_time += workers[i]->m_total_time;
 
 #ifdef USE_SC_GUILIB
 
@@ -1645,7 +2600,7 @@ run_sim_main (const char *herd_file,
     {
       _scenario.total_processor_time = total_processor_time;
       _scenario.iterations_completed = total_runs;
-      sc_sim_complete( -1, herds, production_types, zones );
+      sc_sim_complete( -1, herds, production_types, workers[0]->zones );
     };
 #else
   /* Inform the GUI that the simulation has ended */
@@ -1664,24 +2619,22 @@ run_sim_main (const char *herd_file,
     }
 #endif
 
-  /* Clean up. */
-  RPT_free_reporting (show_unit_states);
-  RPT_free_reporting (num_units_in_state);
-  RPT_free_reporting (num_units_in_state_by_prodtype);
-  RPT_free_reporting (num_animals_in_state);
-  RPT_free_reporting (num_animals_in_state_by_prodtype);
-  RPT_free_reporting (avg_prevalence);
-  RPT_free_reporting (last_day_of_disease);
-  RPT_free_reporting (last_day_of_outbreak);
-  RPT_free_reporting (clock_time);
-  RPT_free_reporting (version);
-  g_ptr_array_free (reporting_vars, TRUE);
-  g_string_free (s, TRUE);
-  naadsm_free_event_manager (manager);
-  naadsm_unload_models (nmodels, models);
+  /* Clean up.  The copies of the herd list must be freed before the
+   * original, because they share parts of it. */
+  for (i = nworkers - 1; i >= 0; i--)
+    {
+      if (workers[i]->herds != herds)
+        {
+          naadsm_free_spatial_indexes (workers[i]->herds);
+          HRD_free_herd_list (workers[i]->herds);
+        }
+      free_worker (workers[i]);
+    }
+  g_free (workers);
   RAN_free_generator (rng);
-  ZON_free_zone_list (zones);
+  naadsm_free_spatial_indexes (herds);
   HRD_free_herd_list (herds);
+  g_free (settings.checkpoint_file);
   if (output_stream != NULL)
     fclose (output_stream);
 
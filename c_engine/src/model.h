@@ -138,6 +138,19 @@ typedef void (*naadsm_model_run_t) (struct naadsm_model_t_ *,
 
 
 
+/**
+ * Type of a function that runs a model on a batch of events: all of the events
+ * of one type from one wave, in the same random order in which they were taken
+ * from the queue.  The events belong to the event manager and are freed after
+ * the call.
+ */
+typedef void (*naadsm_model_run_batch_t) (struct naadsm_model_t_ *,
+                                          HRD_herd_list_t *, ZON_zone_list_t *,
+                                          EVT_event_t **, unsigned int,
+                                          RAN_gen_t *, EVT_event_queue_t *);
+
+
+
 /** Type of a function that resets a model after one simulation run. */
 typedef void (*naadsm_model_reset_t) (struct naadsm_model_t_ *);
 
@@ -167,6 +180,21 @@ typedef gboolean (*naadsm_model_has_pending_infections_t) (struct naadsm_model_t
 
 
 
+/**
+ * Type of a function that reports the earliest day on which a model has work
+ * of its own to do.  It is called at the end of a quiet day, one on which no
+ * events other than Midnight, NewDay and EndOfDay were created.  It returns
+ * the first later day on which the model, if sent only those three events,
+ * would do anything more than repeat what it did today: create an event, draw
+ * a random number, change a unit or zone, or change an output variable.
+ * G_MAXINT means nothing is scheduled.
+ */
+typedef int (*naadsm_model_next_wake_day_t) (struct naadsm_model_t_ *,
+                                             HRD_herd_list_t *, ZON_zone_list_t *,
+                                             int day);
+
+
+
 /** Type of a function that returns a string representation of a model. */
 typedef char *(*naadsm_model_to_string_t) (struct naadsm_model_t_ *);
 
@@ -193,11 +221,27 @@ typedef struct naadsm_model_t_
   naadsm_model_set_params_t set_params; /**< A function that sets parameters
     for the model. */
   naadsm_model_run_t run; /**< A function that runs the model. */
+  EVT_event_type_t *events_batched; /**< Event types, from among those the
+    model listens for, that the model takes in batches through run_batch
+    instead of one at a time through run.  A batch is delivered after every
+    event in the wave has been handed to the models that take events one at a
+    time, so a model should only batch events whose handling neither depends on
+    nor affects what other models do with the same wave. */
+  unsigned int nevents_batched; /**< Length of events_batched. */
+  naadsm_model_run_batch_t run_batch; /**< A function that runs the model on a
+    batch of events.  NULL if nevents_batched is 0.  Model constructors
+    allocate the model with g_new0, so a model that takes every event through
+    run leaves events_batched, nevents_batched and run_batch at their zero
+    defaults. */
   naadsm_model_reset_t reset; /**< A function that resets the model after one simulation run. */
   naadsm_model_is_listening_for_t is_listening_for; /**< A function that reports whether the model is listening for a given event type.*/
   naadsm_model_has_pending_actions_t has_pending_actions; /**< A function that reports whether the model has any pending actions to carry out.*/
   naadsm_model_has_pending_infections_t has_pending_infections; /**< A function
     that reports whether the model has any pending infections to cause. */
+  naadsm_model_next_wake_day_t next_wake_day; /**< A function that reports
+    the earliest day on which the model has work of its own to do.  NULL if the
+    model may have work every day; models that do not listen for Midnight,
+    NewDay or EndOfDay events need not provide one. */
   naadsm_model_to_string_t to_string; /**< A function that returns a string representation of the model. */
   naadsm_model_printf_t printf; /**< A function that prints the model. */
   naadsm_model_fprintf_t fprintf; /**< A function that prints the model to a stream. */
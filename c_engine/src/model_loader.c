@@ -220,67 +220,39 @@ get_num_runs (scew_element * e)
 
 
 /**
- * Instantiates a set of models based on information in a parameter file.
+ * Reads and parses a parameter file.  The parsed parameters can then be used
+ * to instantiate any number of sets of models with naadsm_load_models(), so
+ * that the file is read only once however many sets are needed.
  *
  * @param parameter_file name of the parameter file.
- * @param herds a list of herds.
- * @param projection the map projection used to convert the herds from latitude
- *   and longitude and x and y.
- * @param zones a list of zones.  This can be empty at first, as it may be
- *   populated while reading the parameters.
  * @param ndays a location in which to store the number of days the simulation
  *   lasts.
  * @param nruns a location in which to store the number of Monte Carlo runs of
  *   the simulation.
- * @param models a location in which to store the address of the array of
- *   pointers to models.
- * @param outputs a list of output variables to report.  Their names should
- *   correspond to output elements in the parameter file.
  * @param _exit_conditions a location in which to store a set of flags
  *   (combined with bitwise-or) specifying when the simulation should end
  *   (e.g., at the first detection, or when all disease is gone).
- * @return the number of models loaded.
+ * @return the parsed parameters.  Free them with scew_parser_free() once no
+ *   more models are to be instantiated.
  */
-int
-naadsm_load_models (const char *parameter_file, HRD_herd_list_t * herds,
-                    projPJ projection, ZON_zone_list_t * zones,
-                    unsigned int *ndays, unsigned int *nruns,
-                    naadsm_model_t *** models, GPtrArray * outputs, guint *_exit_conditions )
+scew_parser *
+naadsm_read_parameters (const char *parameter_file,
+                        unsigned int *ndays, unsigned int *nruns, guint *_exit_conditions)
 {
   scew_parser *parser;          /* to read the parameter file */
   scew_error err;               /* parser error code */
   scew_element *params;         /* root of the parameter tree */
-  scew_element *e;              /* a subtree of the parameter tree */
-  scew_element **ee;            /* a list of subtrees */
-  scew_element *model_spec;     /* a subtree for a model */
-  const char *model_name;       /* name of a model */
-  struct model_load_info_t *model_load_info;
-  naadsm_model_is_singleton_t model_is_singleton_fn;
-  gboolean singleton;
-  GHashTable *singletons;       /* stores the "singleton" modules (for which
-                                   there can be only one instance).  Keys are
-                                   model names (char *) and data are pointers
-                                   to models. */
-  naadsm_model_new_t model_instantiation_fn;
-  naadsm_model_t *model;
-  int nmodels;
-  int nloaded = 0;
-  int i, j;                     /* loop counters */
-  unsigned int noutputs = 0;
-  RPT_reporting_t *output;
-  const XML_Char *variable_name;
-  unsigned int nzones;
 #if DEBUG
-  char *s;
+  int i;                        /* loop counter */
 #endif
 
 #if DEBUG
-  g_debug ("----- ENTER naadsm_load_models");
+  g_debug ("----- ENTER naadsm_read_parameters");
 #endif
 
   parser = scew_parser_create ();
   if (parser == NULL)
-    return 0;
+    g_error ("could not create a parser for the parameter file");
 
   /* This test isn't foolproof because the file could be deleted in the split-
    * second before scew_parser_load_file tries to open it. */
@@ -321,6 +293,68 @@ naadsm_load_models (const char *parameter_file, HRD_herd_list_t * herds,
       will return "0" for "no premature exit" */
   *_exit_conditions = get_exit_condition( scew_element_by_name ( params, "exit-condition" ) );
 
+#if DEBUG
+  g_debug ("----- EXIT naadsm_read_parameters");
+#endif
+
+  return parser;
+}
+
+
+
+/**
+ * Instantiates a set of models based on parameters read with
+ * naadsm_read_parameters().  The parameters are not changed, so several sets
+ * of models can be instantiated from them.
+ *
+ * @param parameters the parsed parameters.
+ * @param herds a list of herds.
+ * @param projection the map projection used to convert the herds from latitude
+ *   and longitude and x and y.
+ * @param zones a list of zones.  This can be empty at first, as it may be
+ *   populated while reading the parameters.
+ * @param models a location in which to store the address of the array of
+ *   pointers to models.
+ * @param outputs a list of output variables to report.  Their names should
+ *   correspond to output elements in the parameter file.
+ * @return the number of models loaded.
+ */
+int
+naadsm_load_models (scew_parser * parameters, HRD_herd_list_t * herds,
+                    projPJ projection, ZON_zone_list_t * zones,
+                    naadsm_model_t *** models, GPtrArray * outputs)
+{
+  scew_element *params;         /* root of the parameter tree */
+  scew_element *e;              /* a subtree of the parameter tree */
+  scew_element **ee;            /* a list of subtrees */
+  scew_element *model_spec;     /* a subtree for a model */
+  const char *model_name;       /* name of a model */
+  struct model_load_info_t *model_load_info;
+  naadsm_model_is_singleton_t model_is_singleton_fn;
+  gboolean singleton;
+  GHashTable *singletons;       /* stores the "singleton" modules (for which
+                                   there can be only one instance).  Keys are
+                                   model names (char *) and data are pointers
+                                   to models. */
+  naadsm_model_new_t model_instantiation_fn;
+  naadsm_model_t *model;
+  int nmodels;
+  int nloaded = 0;
+  int i, j;                     /* loop counters */
+  unsigned int noutputs = 0;
+  RPT_reporting_t *output;
+  const XML_Char *variable_name;
+  unsigned int nzones;
+#if DEBUG
+  char *s;
+#endif
+
+#if DEBUG
+  g_debug ("----- ENTER naadsm_load_models");
+#endif
+
+  params = scew_tree_root (scew_parser_tree (parameters));
+
   /* Get the number of sub-models that will run in the simulation. */
   e = scew_element_by_name (params, "models");
   nmodels = (int) scew_element_count (e);
@@ -472,9 +506,6 @@ naadsm_load_models (const char *parameter_file, HRD_herd_list_t * herds,
          zones->use_rtree_index ? "will" : "will not");
 #endif
 
-  /* Clean up. */
-  scew_parser_free (parser);
-
 #if DEBUG
   g_debug ("----- EXIT naadsm_load_models");
 #endif
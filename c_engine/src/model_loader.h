@@ -25,10 +25,12 @@
 
 
 /* Prototypes. */
-int naadsm_load_models (const char *parameter_file,
+scew_parser *naadsm_read_parameters (const char *parameter_file,
+                                     unsigned int *ndays, unsigned int *nruns,
+                                     guint *_exit_conditions);
+int naadsm_load_models (scew_parser * parameters,
                         HRD_herd_list_t *, projPJ, ZON_zone_list_t *,
-                        unsigned int *ndays, unsigned int *nruns,
-                        naadsm_model_t *** models, GPtrArray * outputs, guint *_exit_conditions);
+                        naadsm_model_t *** models, GPtrArray * outputs);
 void naadsm_unload_models (int nmodels, naadsm_model_t ** models);
 
 #endif /* !MODEL_LOADER_H */
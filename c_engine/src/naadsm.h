@@ -245,6 +245,24 @@ run_sim_main (const char *herd_file,
               double fixed_rng_value, int verbosity, int seed);
 #endif
 
+/* Function to set the number of threads used to run iterations */
+DLL_API void naadsm_set_nthreads (int nthreads);
+
+/* Function to set a file in which to save progress after each iteration */
+DLL_API void naadsm_set_checkpoint_file (const char *filename);
+
+/* Function to set the order in which units are stored in memory */
+DLL_API void naadsm_set_unit_order (int order);
+
+/* Function to set the memory the spread models may use for neighbour lists */
+DLL_API void naadsm_set_neighbour_list_memory (int megabytes);
+
+/* Function to have the airborne spread models record only adequate exposures */
+DLL_API void naadsm_set_sparse_airborne_exposures (int sparse);
+
+/* Function to set the number of threads the contact spread model may use */
+DLL_API void naadsm_set_contact_spread_threads (int nthreads);
+
 
 /* Functions for version tracking */
 /* ------------------------------ */
@@ -165,7 +165,7 @@ herd:
        * initialize the herd structure. */
       $$ = HRD_new_herd (NULL, $1, $3, $5, $7);
       assert ($$ != NULL);
-      $$->status = $9;
+      $$->state->status = $9;
 
       /* Copy the values from the variable-length part of the line into the
        * herd structure. */